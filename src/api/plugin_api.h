@@ -7,7 +7,7 @@
 #define CHUNKWM_EXTERN extern "C"
 
 // NOTE(koekeishiya): Increment upon ABI breaking changes!
-#define CHUNKWM_PLUGIN_API_VERSION 8
+#define CHUNKWM_PLUGIN_API_VERSION 12
 
 // NOTE(koekeishiya): Forward-declare struct
 struct plugin;
@@ -23,6 +23,14 @@ typedef PLUGIN_VOID_FUNC(plugin_void_func);
               void *Data)
 typedef PLUGIN_MAIN_FUNC(plugin_main_func);
 
+#define PLUGIN_EVENT_FUNC(name) void name(void *Data)
+typedef PLUGIN_EVENT_FUNC(plugin_event_func);
+
+/*
+ * NOTE(koekeishiya): Events that have an entry in 'Handlers' are passed directly to that
+ * function, indexed by their chunkwm_plugin_export id. Events without a handler, daemon
+ * commands and broadcasts from other plugins are still passed by name through 'Run'.
+ */
 struct plugin
 {
     plugin_bool_func *Init;
@@ -31,6 +39,14 @@ struct plugin
 
     chunkwm_plugin_export *Subscriptions;
     unsigned SubscriptionCount;
+
+    plugin_event_func *Handlers[chunkwm_export_count];
+};
+
+struct chunkwm_plugin_handler
+{
+    chunkwm_plugin_export Export;
+    plugin_event_func *Handler;
 };
 
 CHUNKWM_EXTERN typedef plugin *(*plugin_func)();
@@ -59,6 +75,19 @@ struct plugin_details
         Plugin->Subscriptions = Sub;                             \
     }
 
+// NOTE(koekeishiya): Subscribe to every export in the table and register its handler.
+#define CHUNKWM_PLUGIN_SUBSCRIBE_HANDLERS(Table)                                \
+    void InitPluginSubscriptions(plugin *Plugin)                                \
+    {                                                                           \
+        static chunkwm_plugin_export Exports[sizeof(Table) / sizeof(*Table)];   \
+        Plugin->SubscriptionCount = sizeof(Table) / sizeof(*Table);             \
+        for (unsigned Index = 0; Index < Plugin->SubscriptionCount; ++Index) {  \
+            Exports[Index] = Table[Index].Export;                               \
+            Plugin->Handlers[Table[Index].Export] = Table[Index].Handler;       \
+        }                                                                       \
+        Plugin->Subscriptions = Exports;                                        \
+    }
+
 #define CHUNKWM_PLUGIN(PluginName, PluginVersion)                \
       CHUNKWM_EXTERN                                             \
       {                                                          \
@@ -2,13 +2,58 @@
 #define CHUNKWM_PLUGIN_CVAR_H
 
 #include <stddef.h>
+#include <stdint.h>
 
+/*
+ * NOTE(koekeishiya): Typed view of a cvar that the core keeps in sync with its string value.
+ * Every field can be read with a single atomic load. 'Version' is odd while an update is in
+ * progress, and changes on every update. A handle is valid for as long as chunkwm is running.
+ * 'String' may be freed by the next update and must not be dereferenced by a plugin; read the
+ * string through CopyCVarHandle instead.
+ */
+struct cvar_handle
+{
+    uint32_t volatile Version;
+    int volatile Integer;
+    unsigned volatile Unsigned;
+    float volatile FloatingPoint;
+    char *volatile String;
+};
+
+// NOTE(koekeishiya): 'Acquired' is set once AcquireCVar has returned a value of the cvar.
 struct cvar
 {
     const char *Name;
-    char *Value;
+    char *volatile Value;
+    cvar_handle Handle;
+    bool volatile Acquired;
+};
+
+/*
+ * NOTE(koekeishiya): A change of a watched cvar. 'OldValue' is NULL if the cvar was created.
+ * The strings are owned by chunkwm and are only valid for the duration of the callback.
+ */
+struct cvar_change
+{
+    const char *Name;
+    const char *OldValue;
+    const char *NewValue;
+};
+
+/*
+ * NOTE(koekeishiya): A watcher is called once per change, on the thread that updated the cvar.
+ * A batched watcher is instead called once with every change made while a plugin handled an
+ * event or command (or while the core handled a command). A cvar that changed more than once in
+ * the same batch is reported once, with its first old and last new value.
+ */
+enum cvar_watch_flags
+{
+    CVar_Watch_Batched = (1 << 0),
 };
 
+#define CVAR_WATCH_FUNC(name) void name(cvar_change *Changes, unsigned Count, void *Context)
+typedef CVAR_WATCH_FUNC(cvar_watch_func);
+
 #define CHUNKWM_API_BROADCAST_FUNC(name) void name(const char *Plugin, const char *Event, void *Data, size_t Size)
 typedef CHUNKWM_API_BROADCAST_FUNC(plugin_broadcast_func);
 
@@ -18,9 +63,31 @@ typedef CHUNKWM_API_UPDATE_CVAR_FUNC(chunkwm_update_cvar_func);
 #define CHUNKWM_API_ACQUIRE_CVAR_FUNC(name) char *name(const char *Name)
 typedef CHUNKWM_API_ACQUIRE_CVAR_FUNC(chunkwm_acquire_cvar_func);
 
+/*
+ * NOTE(koekeishiya): The string returned by AcquireCVar stays valid for the lifetime of chunkwm,
+ * but is not updated when the cvar changes; every value that it has returned is kept around
+ * instead of being freed. CopyCVar copies the value into a caller-provided buffer without
+ * taking a lock, and returns the length of the value, or -1 if the cvar does not exist.
+ */
+#define CHUNKWM_API_COPY_CVAR_FUNC(name) int name(const char *Name, char *Buffer, size_t Size)
+typedef CHUNKWM_API_COPY_CVAR_FUNC(chunkwm_copy_cvar_func);
+
+// NOTE(koekeishiya): Same as CopyCVar, for a handle; returns -1 if 'Handle' is NULL.
+#define CHUNKWM_API_COPY_CVAR_HANDLE_FUNC(name) int name(cvar_handle *Handle, char *Buffer, size_t Size)
+typedef CHUNKWM_API_COPY_CVAR_HANDLE_FUNC(chunkwm_copy_cvar_handle_func);
+
 #define CHUNKWM_API_FIND_CVAR_FUNC(name) bool name(const char *Name)
 typedef CHUNKWM_API_FIND_CVAR_FUNC(chunkwm_find_cvar_func);
 
+#define CHUNKWM_API_ACQUIRE_CVAR_HANDLE_FUNC(name) cvar_handle *name(const char *Name)
+typedef CHUNKWM_API_ACQUIRE_CVAR_HANDLE_FUNC(chunkwm_acquire_cvar_handle_func);
+
+#define CHUNKWM_API_WATCH_CVAR_FUNC(name) bool name(const char *Name, cvar_watch_func *Callback, void *Context, uint32_t Flags)
+typedef CHUNKWM_API_WATCH_CVAR_FUNC(chunkwm_watch_cvar_func);
+
+#define CHUNKWM_API_UNWATCH_CVAR_FUNC(name) void name(const char *Name, cvar_watch_func *Callback, void *Context)
+typedef CHUNKWM_API_UNWATCH_CVAR_FUNC(chunkwm_unwatch_cvar_func);
+
 #ifdef CHUNKWM_CORE
 #define CHUNKWM_API_LOG_FUNC(name) void name(unsigned Level, const char *Format, ...)
 #else
@@ -35,6 +102,11 @@ struct chunkwm_api
     chunkwm_find_cvar_func *FindCVar;
     plugin_broadcast_func *Broadcast;
     chunkwm_log *Log;
+    chunkwm_acquire_cvar_handle_func *AcquireCVarHandle;
+    chunkwm_watch_cvar_func *WatchCVar;
+    chunkwm_unwatch_cvar_func *UnwatchCVar;
+    chunkwm_copy_cvar_func *CopyCVar;
+    chunkwm_copy_cvar_handle_func *CopyCVarHandle;
 };
 
 #endif
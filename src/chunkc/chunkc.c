@@ -1,5 +1,7 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
 #include <string.h>
 
 #include <libproc.h>
@@ -13,81 +15,324 @@
 
 #define SOCKET_PATH_FMT "/tmp/chunkwm_%s-socket"
 
-int main(int argc, char **argv)
+/*
+ * NOTE(koekeishiya): must match the framed protocol in src/common/ipc/daemon.h
+ * every frame starts with: magic (1 byte) | flags (1 byte) | reserved (2 bytes) | length (4 bytes, network order)
+ */
+#define DAEMON_FRAME_MAGIC       0xc7
+#define DAEMON_FRAME_END         (1 << 0)
+#define DAEMON_FRAME_ERROR       (1 << 1)
+#define DAEMON_FRAME_HEADER_SIZE 8
+#define DAEMON_MAX_MESSAGE_SIZE  (1 << 20)
+
+static bool send_all(int sock_fd, const char *data, size_t length)
 {
-    if (argc < 2) {
-        fprintf(stderr, "chunkc: no arguments found!\n");
-        exit(1);
+    while (length) {
+        ssize_t count = send(sock_fd, data, length, 0);
+        if (count <= 0) {
+            return false;
+        }
+        data += count;
+        length -= count;
+    }
+
+    return true;
+}
+
+static bool send_request(int sock_fd, const char *message, size_t length)
+{
+    uint32_t network_length = htonl((uint32_t) length);
+    char header[DAEMON_FRAME_HEADER_SIZE] = { (char) DAEMON_FRAME_MAGIC, 0, 0, 0 };
+    memcpy(header + 4, &network_length, sizeof(uint32_t));
+
+    return send_all(sock_fd, header, sizeof(header)) &&
+           send_all(sock_fd, message, length);
+}
+
+/*
+ * NOTE(koekeishiya): number of commands that batch mode sends ahead of the responses it has read.
+ * it must stay below the number of requests the daemon queues per connection, so that the daemon
+ * never stops reading from us while we are blocked sending.
+ */
+#define BATCH_WINDOW 32
+
+enum response_status
+{
+    RESPONSE_OK,
+    RESPONSE_FAILED,
+    RESPONSE_ERROR,
+};
+
+struct batch_command
+{
+    size_t line;
+    char *text;
+};
+
+/*
+ * NOTE(koekeishiya): the response is streamed to stdout frame by frame as it arrives,
+ * and is complete once we have read the frame that has the end flag set.
+ */
+static enum response_status read_response(int sock_fd)
+{
+    char header[DAEMON_FRAME_HEADER_SIZE];
+    size_t header_length = 0;
+    size_t remaining = 0;
+    bool in_payload = false;
+    bool last_frame = false;
+    bool failed = false;
+
+    char response[BUFSIZ];
+    struct pollfd fds[] = {
+        { sock_fd, POLLIN, 0 },
+        { STDOUT_FILENO, POLLHUP, 0 },
+    };
+
+    while (poll(fds, 2, -1) > 0) {
+        if (fds[1].revents & (POLLERR | POLLHUP)) {
+            return RESPONSE_ERROR;
+        }
+
+        if (!(fds[0].revents & (POLLIN | POLLHUP | POLLERR))) {
+            continue;
+        }
+
+        if (!in_payload) {
+            ssize_t num_bytes = recv(sock_fd, header + header_length, sizeof(header) - header_length, 0);
+            if (num_bytes <= 0) {
+                return RESPONSE_ERROR;
+            }
+
+            header_length += num_bytes;
+            if (header_length < sizeof(header)) {
+                continue;
+            }
+
+            if ((unsigned char) header[0] != DAEMON_FRAME_MAGIC) {
+                fprintf(stderr, "chunkc: invalid response from chunkwm!\n");
+                return RESPONSE_ERROR;
+            }
+
+            uint32_t network_length;
+            memcpy(&network_length, header + 4, sizeof(uint32_t));
+            remaining = ntohl(network_length);
+            last_frame = header[1] & DAEMON_FRAME_END;
+            failed = header[1] & DAEMON_FRAME_ERROR;
+            header_length = 0;
+            in_payload = true;
+        } else {
+            size_t wanted = remaining < sizeof(response) ? remaining : sizeof(response);
+            ssize_t num_bytes = recv(sock_fd, response, wanted, 0);
+            if (num_bytes <= 0) {
+                return RESPONSE_ERROR;
+            }
+
+            fwrite(response, 1, num_bytes, stdout);
+            fflush(stdout);
+            remaining -= num_bytes;
+        }
+
+        if (in_payload && remaining == 0) {
+            if (last_frame) {
+                return failed ? RESPONSE_FAILED : RESPONSE_OK;
+            }
+            in_payload = false;
+        }
     }
 
+    return RESPONSE_ERROR;
+}
+
+/*
+ * NOTE(koekeishiya): every line is sent as is, the same way chunkc would join its arguments;
+ * empty lines and lines starting with '#' are skipped. returns the number of commands that failed.
+ */
+static size_t run_batch(int sock_fd, FILE *input)
+{
+    struct batch_command window[BATCH_WINDOW];
+    size_t head = 0;
+    size_t count = 0;
+    size_t line_number = 0;
+    size_t failed = 0;
+    bool eof = false;
+
+    char *line = NULL;
+    size_t capacity = 0;
+
+    for (;;) {
+        while (!eof && count < BATCH_WINDOW) {
+            ssize_t length = getline(&line, &capacity, input);
+            if (length == -1) {
+                eof = true;
+                break;
+            }
+
+            ++line_number;
+
+            char *command = line;
+            while (*command == ' ' || *command == '\t') {
+                ++command;
+                --length;
+            }
+            while (length > 0 && (command[length - 1] == '\n' || command[length - 1] == '\r' ||
+                                  command[length - 1] == ' ' || command[length - 1] == '\t')) {
+                command[--length] = '\0';
+            }
+
+            if (length == 0 || *command == '#') {
+                continue;
+            }
+
+            if (length > DAEMON_MAX_MESSAGE_SIZE) {
+                fprintf(stderr, "chunkc: line %zu: message exceeds %d bytes!\n", line_number, DAEMON_MAX_MESSAGE_SIZE);
+                ++failed;
+                continue;
+            }
+
+            if (!send_request(sock_fd, command, length)) {
+                fprintf(stderr, "chunkc: line %zu: failed to send data!\n", line_number);
+                ++failed;
+                eof = true;
+                break;
+            }
+
+            struct batch_command *entry = window + ((head + count) % BATCH_WINDOW);
+            entry->line = line_number;
+            entry->text = strdup(command);
+            ++count;
+        }
+
+        if (count == 0) {
+            break;
+        }
+
+        struct batch_command *entry = window + head;
+        enum response_status status = read_response(sock_fd);
+
+        if (status == RESPONSE_ERROR) {
+            fprintf(stderr, "chunkc: line %zu: connection lost!\n", entry->line);
+            failed += count;
+            break;
+        } else if (status == RESPONSE_FAILED) {
+            fprintf(stderr, "chunkc: line %zu: '%s' failed\n", entry->line, entry->text);
+            ++failed;
+        }
+
+        free(entry->text);
+        head = (head + 1) % BATCH_WINDOW;
+        --count;
+    }
+
+    while (count > 0) {
+        free(window[head].text);
+        head = (head + 1) % BATCH_WINDOW;
+        --count;
+    }
+
+    free(line);
+    return failed;
+}
+
+static int connect_to_chunkwm(void)
+{
     char *user = getenv("USER");
     if (!user) {
         fprintf(stderr, "chunkc: could not read env USER.\n");
-        exit(1);
+        return -1;
     }
 
     int sock_fd;
-	struct sockaddr_un sock_address;
-	sock_address.sun_family = AF_UNIX;
+    struct sockaddr_un sock_address;
+    sock_address.sun_family = AF_UNIX;
 
-	if ((sock_fd = socket(AF_UNIX, SOCK_STREAM, 0)) == -1) {
+    if ((sock_fd = socket(AF_UNIX, SOCK_STREAM, 0)) == -1) {
         fprintf(stderr, "chunkc: could not create socket!\n");
-        exit(1);
-	}
+        return -1;
+    }
 
     snprintf(sock_address.sun_path, sizeof(sock_address.sun_path), SOCKET_PATH_FMT, user);
 
-	if (connect(sock_fd, (struct sockaddr *) &sock_address, sizeof(sock_address)) == -1) {
+    if (connect(sock_fd, (struct sockaddr *) &sock_address, sizeof(sock_address)) == -1) {
         fprintf(stderr, "chunkc: connection failed!\n");
-        exit(1);
-	}
+        close(sock_fd);
+        return -1;
+    }
 
-    size_t message_length = argc - 1;
-    size_t argl[argc];
+    return sock_fd;
+}
 
-    for (size_t i = 1; i < argc; ++i) {
-        argl[i] = strlen(argv[i]);
-        message_length += argl[i];
+int main(int argc, char **argv)
+{
+    if (argc < 2) {
+        fprintf(stderr, "chunkc: no arguments found!\n");
+        exit(1);
     }
 
-    char message[message_length];
-    char *temp = message;
+    bool batch = strcmp(argv[1], "--batch") == 0;
+    FILE *input = stdin;
 
-    for (size_t i = 1; i < argc; ++i) {
-        memcpy(temp, argv[i], argl[i]);
-        temp += argl[i];
-        *temp++ = ' ';
+    if (batch) {
+        if (argc > 3) {
+            fprintf(stderr, "usage: chunkc --batch [file]\n");
+            exit(1);
+        }
+
+        if (argc == 3 && strcmp(argv[2], "-") != 0) {
+            if (!(input = fopen(argv[2], "r"))) {
+                fprintf(stderr, "chunkc: could not open '%s'!\n", argv[2]);
+                exit(1);
+            }
+        }
+    }
+
+    int sock_fd = connect_to_chunkwm();
+    if (sock_fd == -1) {
+        exit(1);
     }
-    *(temp - 1) = '\0';
 
-    if (send(sock_fd, message, message_length, 0) == -1) {
-        fprintf(stderr, "chunkc: failed to send data!\n");
+    int result = 0;
+
+    if (batch) {
+        result = run_batch(sock_fd, input) ? 1 : 0;
+        if (input != stdin) {
+            fclose(input);
+        }
     } else {
-        int num_bytes;
-        char response[BUFSIZ];
-        struct pollfd fds[] = {
-            { sock_fd, POLLIN, 0 },
-            { STDOUT_FILENO, POLLHUP, 0 },
-        };
-
-        while (poll(fds, 2, -1) > 0) {
-            if (fds[1].revents & (POLLERR | POLLHUP)) {
-                break;
-            }
-            if (fds[0].revents & POLLIN) {
-                if ((num_bytes = recv(sock_fd, response, sizeof(response) - 1, 0)) > 0) {
-                    response[num_bytes] = '\0';
-                    printf("%s", response);
-                    fflush(stdout);
-                } else {
-                    break;
-                }
-            }
+        size_t message_length = 0;
+        size_t argl[argc];
+
+        for (size_t i = 1; i < argc; ++i) {
+            argl[i] = strlen(argv[i]);
+            message_length += argl[i] + 1;
+        }
+
+        if (message_length - 1 > DAEMON_MAX_MESSAGE_SIZE) {
+            fprintf(stderr, "chunkc: message exceeds %d bytes!\n", DAEMON_MAX_MESSAGE_SIZE);
+            exit(1);
         }
+
+        char *message = malloc(message_length);
+        char *temp = message;
+
+        for (size_t i = 1; i < argc; ++i) {
+            memcpy(temp, argv[i], argl[i]);
+            temp += argl[i];
+            *temp++ = ' ';
+        }
+        *(temp - 1) = '\0';
+
+        if (!send_request(sock_fd, message, message_length - 1)) {
+            fprintf(stderr, "chunkc: failed to send data!\n");
+            result = 1;
+        } else if (read_response(sock_fd) == RESPONSE_FAILED) {
+            result = 1;
+        }
+
+        free(message);
     }
 
     shutdown(sock_fd, SHUT_RDWR);
     close(sock_fd);
 
-    return 0;
+    return result;
 }
@@ -71,7 +71,7 @@ macos_window *AXLibCopyWindow(macos_window *Window)
 
     Result->Owner = Window->Owner;
     Result->Id = Window->Id;
-    Result->Name = strdup(Window->Name);
+    Result->Name = Window->Name ? strdup(Window->Name) : NULL;
     Result->Level = Window->Level;
     Result->Position = Window->Position;
     Result->Size = Window->Size;
@@ -75,37 +75,105 @@ void CreateCVar(const char *Name, char *Value)
     UpdateCVar(Name, Value);
 }
 
+// NOTE(koekeishiya): The core parses the value on update, so lookups by name only cost the map lookup.
 int CVarIntegerValue(const char *Name)
 {
-    int Result = 0;
-    char *String = ChunkwmAPI->AcquireCVar(Name);
-    if (String) {
-        sscanf(String, "%d", &Result);
+    return CVarIntegerValue(CVarHandle(Name));
+}
+
+int CVarUnsignedValue(const char *Name)
+{
+    return CVarUnsignedValue(CVarHandle(Name));
+}
+
+float CVarFloatingPointValue(const char *Name)
+{
+    return CVarFloatingPointValue(CVarHandle(Name));
+}
+
+int CVarStringCopy(const char *Name, char *Buffer, size_t Size)
+{
+    return ChunkwmAPI->CopyCVar(Name, Buffer, Size);
+}
+
+char *CVarStringDuplicate(const char *Name)
+{
+    size_t Size = 64;
+    char *Result = (char *) malloc(Size);
+
+    int Length;
+    while ((Length = CVarStringCopy(Name, Result, Size)) >= (int) Size) {
+        Size = Length + 1;
+        Result = (char *) realloc(Result, Size);
+    }
+
+    if (Length < 0) {
+        free(Result);
+        Result = NULL;
     }
+
     return Result;
 }
 
-int CVarUnsignedValue(const char *Name)
+bool CVarStringEquals(const char *Name, const char *Value)
 {
-    unsigned Result = 0;
-    char *String = ChunkwmAPI->AcquireCVar(Name);
-    if (String) {
-        sscanf(String, "%x", &Result);
+    char Buffer[256];
+    int Length = CVarStringCopy(Name, Buffer, sizeof(Buffer));
+    return ((Length >= 0) &&
+            (Length < (int) sizeof(Buffer)) &&
+            (strcmp(Buffer, Value) == 0));
+}
+
+cvar_handle *CVarHandle(const char *Name)
+{
+    return ChunkwmAPI->AcquireCVarHandle(Name);
+}
+
+cvar_handle *CVarHandle(cvar_handle **Cached, const char *Name)
+{
+    cvar_handle *Result = __atomic_load_n(Cached, __ATOMIC_ACQUIRE);
+    if (!Result) {
+        Result = CVarHandle(Name);
+        if (Result) __atomic_store_n(Cached, Result, __ATOMIC_RELEASE);
     }
     return Result;
 }
 
-float CVarFloatingPointValue(const char *Name)
+uint32_t CVarVersion(cvar_handle *Handle)
+{
+    return Handle ? __atomic_load_n(&Handle->Version, __ATOMIC_ACQUIRE) : 0;
+}
+
+int CVarIntegerValue(cvar_handle *Handle)
+{
+    return Handle ? __atomic_load_n(&Handle->Integer, __ATOMIC_RELAXED) : 0;
+}
+
+int CVarUnsignedValue(cvar_handle *Handle)
+{
+    return Handle ? __atomic_load_n(&Handle->Unsigned, __ATOMIC_RELAXED) : 0;
+}
+
+float CVarFloatingPointValue(cvar_handle *Handle)
 {
     float Result = 0.0f;
-    char *String = ChunkwmAPI->AcquireCVar(Name);
-    if (String) {
-        sscanf(String, "%f", &Result);
+    if (Handle) {
+        __atomic_load(&Handle->FloatingPoint, &Result, __ATOMIC_RELAXED);
     }
     return Result;
 }
 
-char *CVarStringValue(const char *Name)
+int CVarStringCopy(cvar_handle *Handle, char *Buffer, size_t Size)
+{
+    return ChunkwmAPI->CopyCVarHandle(Handle, Buffer, Size);
+}
+
+bool WatchCVar(const char *Name, cvar_watch_func *Callback, void *Context, bool Batched)
+{
+    return ChunkwmAPI->WatchCVar(Name, Callback, Context, Batched ? CVar_Watch_Batched : 0);
+}
+
+void UnwatchCVar(const char *Name, cvar_watch_func *Callback, void *Context)
 {
-    return ChunkwmAPI->AcquireCVar(Name);
+    ChunkwmAPI->UnwatchCVar(Name, Callback, Context);
 }
@@ -1,7 +1,14 @@
 #ifndef CHUNKWM_COMMON_CVAR_H
 #define CHUNKWM_COMMON_CVAR_H
 
+#include <stddef.h>
+#include <stdint.h>
+
 struct chunkwm_api;
+struct cvar_handle;
+struct cvar_change;
+typedef void cvar_watch_func(cvar_change *Changes, unsigned Count, void *Context);
+
 void BeginCVars(chunkwm_api *Api);
 
 bool CVarExists(const char *Name);
@@ -19,6 +26,36 @@ void CreateCVar(const char *Name, char *Value);
 int CVarIntegerValue(const char *Name);
 int CVarUnsignedValue(const char *Name);
 float CVarFloatingPointValue(const char *Name);
-char *CVarStringValue(const char *Name);
+
+/*
+ * NOTE(koekeishiya): A string value may be freed as soon as the cvar is updated, so it is only
+ * ever read as a copy. CVarStringCopy returns the length of the value, or -1 if the cvar does
+ * not exist, and CVarStringDuplicate returns a copy that the caller must free (or NULL).
+ */
+int CVarStringCopy(const char *Name, char *Buffer, size_t Size);
+char *CVarStringDuplicate(const char *Name);
+bool CVarStringEquals(const char *Name, const char *Value);
+
+/*
+ * NOTE(koekeishiya): A handle is resolved once and can then be read without locking or parsing.
+ * Returns NULL if the cvar does not exist (yet); reading a NULL handle yields 0.
+ * CVarHandle(&Cached, Name) resolves into 'Cached' on first use, and keeps retrying while the
+ * cvar does not exist, so that it can be kept in a local_persist before the cvar is created.
+ */
+cvar_handle *CVarHandle(const char *Name);
+cvar_handle *CVarHandle(cvar_handle **Cached, const char *Name);
+uint32_t CVarVersion(cvar_handle *Handle);
+
+int CVarIntegerValue(cvar_handle *Handle);
+int CVarUnsignedValue(cvar_handle *Handle);
+float CVarFloatingPointValue(cvar_handle *Handle);
+int CVarStringCopy(cvar_handle *Handle, char *Buffer, size_t Size);
+
+/*
+ * NOTE(koekeishiya): Watch a single cvar, or every cvar if 'Name' is NULL. A plugin must remove
+ * its watchers before it is unloaded.
+ */
+bool WatchCVar(const char *Name, cvar_watch_func *Callback, void *Context = NULL, bool Batched = false);
+void UnwatchCVar(const char *Name, cvar_watch_func *Callback, void *Context = NULL);
 
 #endif
@@ -13,35 +13,206 @@
 #include <netinet/in.h>
 #include <netdb.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+
+#ifdef __APPLE__
+#include <sys/event.h>
+#else
+#include <sys/epoll.h>
+#endif
+
+#include <queue>
+#include <map>
+#include <set>
+#include <vector>
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
 
 #define internal static
 #define local_persist static
 
-internal int DaemonSockFD;
-internal bool IsRunning;
+// NOTE(koekeishiya): How long a write to a non-blocking response socket waits for room, in milliseconds.
+#define DAEMON_SEND_TIMEOUT 1000
+
+internal int DaemonSockFD = -1;
+internal bool volatile IsRunning;
 internal pthread_t Thread;
 internal daemon_callback *ConnectionCallback;
 
-// NOTE(koekeishiya): Caller frees memory.
+internal inline void
+WriteFrameHeader(char *Header, uint8_t Flags, uint32_t Length)
+{
+    uint32_t NetworkLength = htonl(Length);
+    Header[0] = (char) DAEMON_FRAME_MAGIC;
+    Header[1] = (char) Flags;
+    Header[2] = 0;
+    Header[3] = 0;
+    memcpy(Header + 4, &NetworkLength, sizeof(uint32_t));
+}
+
+internal inline uint32_t
+ReadFrameLength(const char *Header)
+{
+    uint32_t NetworkLength;
+    memcpy(&NetworkLength, Header + 4, sizeof(uint32_t));
+    return ntohl(NetworkLength);
+}
+
+/*
+ * NOTE(koekeishiya): Response sockets are non-blocking. When one is full we wait for room, but
+ * give up after DAEMON_SEND_TIMEOUT, so that a handler is never blocked for long by the daemon.
+ */
+internal bool
+SendAll(int SockFD, const char *Data, size_t Length)
+{
+    while (Length) {
+        ssize_t Count = send(SockFD, Data, Length, MSG_NOSIGNAL);
+        if (Count > 0) {
+            Data += Count;
+            Length -= Count;
+        } else if ((Count == -1) && (errno == EINTR)) {
+            continue;
+        } else if ((Count == -1) && ((errno == EAGAIN) || (errno == EWOULDBLOCK))) {
+            struct pollfd Descriptor = { SockFD, POLLOUT, 0 };
+            int Ready = poll(&Descriptor, 1, DAEMON_SEND_TIMEOUT);
+            if ((Ready == 0) || ((Ready == -1) && (errno != EINTR))) {
+                return false;
+            }
+        } else {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+internal bool
+ReceiveAll(int SockFD, char *Data, size_t Length)
+{
+    while (Length) {
+        ssize_t Count = recv(SockFD, Data, Length, 0);
+        if (Count > 0) {
+            Data += Count;
+            Length -= Count;
+        } else if ((Count == -1) && (errno == EINTR)) {
+            continue;
+        } else {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/*
+ * NOTE(koekeishiya): Reads an unframed message until the peer sends a null-byte or closes the
+ * connection, and gives up on messages larger than DAEMON_MAX_MESSAGE_SIZE. Caller frees memory.
+ */
 char *ReadFromSocket(int SockFD)
 {
-    int Length = 256;
-    char *Result = (char *) malloc(Length);
+    size_t Length = 0;
+    size_t Capacity = 256;
+    char *Result = (char *) malloc(Capacity);
+
+    for (;;) {
+        if (Length + 1 == Capacity) {
+            if (Capacity > DAEMON_MAX_MESSAGE_SIZE) goto err;
+            Capacity *= 2;
+            Result = (char *) realloc(Result, Capacity);
+        }
 
-    Length = recv(SockFD, Result, Length, 0);
-    if (Length > 0) {
-        Result[Length] = '\0';
-    } else {
-        free(Result);
-        Result = NULL;
+        ssize_t Count = recv(SockFD, Result + Length, Capacity - Length - 1, 0);
+        if (Count > 0) {
+            bool Terminated = memchr(Result + Length, '\0', Count) != NULL;
+            Length += Count;
+            if (Terminated) break;
+        } else if (Count == 0) {
+            break;
+        } else if (errno != EINTR) {
+            goto err;
+        }
     }
 
+    if (Length == 0) goto err;
+
+    Result[Length] = '\0';
     return Result;
+
+err:
+    free(Result);
+    return NULL;
 }
 
 void WriteToSocket(const char *Message, int SockFD)
 {
-    send(SockFD, Message, strlen(Message), 0);
+    SendAll(SockFD, Message, strlen(Message));
+}
+
+bool SendDaemonRequest(const char *Message, int SockFD)
+{
+    size_t Length = strlen(Message);
+    if (Length > DAEMON_MAX_MESSAGE_SIZE) return false;
+
+    char Buffer[DAEMON_FRAME_HEADER_SIZE + 1024];
+    WriteFrameHeader(Buffer, 0, Length);
+
+    if (Length <= sizeof(Buffer) - DAEMON_FRAME_HEADER_SIZE) {
+        memcpy(Buffer + DAEMON_FRAME_HEADER_SIZE, Message, Length);
+        return SendAll(SockFD, Buffer, DAEMON_FRAME_HEADER_SIZE + Length);
+    }
+
+    return SendAll(SockFD, Buffer, DAEMON_FRAME_HEADER_SIZE) &&
+           SendAll(SockFD, Message, Length);
+}
+
+char *ReadDaemonResponse(daemon_reader *Reader, int SockFD)
+{
+    Reader->Length = 0;
+    Reader->Failed = false;
+
+    for (;;) {
+        char Header[DAEMON_FRAME_HEADER_SIZE];
+        if (!ReceiveAll(SockFD, Header, sizeof(Header))) return NULL;
+
+        uint32_t Length = ReadFrameLength(Header);
+        if ((uint8_t) Header[0] != DAEMON_FRAME_MAGIC) return NULL;
+        if (Reader->Length + Length > DAEMON_MAX_RESPONSE_SIZE) return NULL;
+
+        if (Reader->Length + Length + 1 > Reader->Capacity) {
+            size_t Capacity = Reader->Capacity ? Reader->Capacity : 256;
+            while (Capacity < Reader->Length + Length + 1) Capacity *= 2;
+            Reader->Buffer = (char *) realloc(Reader->Buffer, Capacity);
+            Reader->Capacity = Capacity;
+        }
+
+        if (!ReceiveAll(SockFD, Reader->Buffer + Reader->Length, Length)) return NULL;
+        Reader->Length += Length;
+
+        if (Header[1] & DAEMON_FRAME_END) {
+            Reader->Failed = Header[1] & DAEMON_FRAME_ERROR;
+            break;
+        }
+    }
+
+    if (!Reader->Buffer) {
+        Reader->Capacity = 256;
+        Reader->Buffer = (char *) malloc(Reader->Capacity);
+    }
+
+    Reader->Buffer[Reader->Length] = '\0';
+    return Reader->Buffer;
+}
+
+void FreeDaemonReader(daemon_reader *Reader)
+{
+    free(Reader->Buffer);
+    Reader->Buffer = NULL;
+    Reader->Length = 0;
+    Reader->Capacity = 0;
 }
 
 void CloseSocket(int SockFD)
@@ -51,25 +222,654 @@ void CloseSocket(int SockFD)
 }
 
 /*
- * NOTE(koekeishiya): The connection must be closed manually by the implementor of the connection callback !!!
+ * NOTE(koekeishiya): Every file descriptor that the daemon thread waits on is described by
+ * a daemon_source. 'Read' and 'Write' reflect the interest that is currently registered,
+ * and a source without any interest is not registered at all.
+ */
+enum daemon_source_kind
+{
+    Daemon_Source_Listener,
+    Daemon_Source_Wakeup,
+    Daemon_Source_Client,
+    Daemon_Source_Response,
+};
+
+struct daemon_connection;
+struct daemon_source
+{
+    daemon_source_kind Kind;
+    int FD;
+    bool Read;
+    bool Write;
+    daemon_connection *Connection;
+};
+
+struct daemon_buffer
+{
+    char *Data;
+    size_t Offset;
+    size_t Length;
+    size_t Capacity;
+};
+
+/*
+ * NOTE(koekeishiya): 'Response' is the daemon side of the socket that was given to the callback
+ * for the request that is currently in flight, and its FD is -1 while the connection is idle.
+ * 'RequestFD' is the side that was given to the callback, and 'RequestFailed' is set through
+ * 'FailDaemonRequest' before the callback closes it.
+ * 'InputClosed' is set once no more requests will be read from the client, and 'HungUp' is set
+ * once nothing can be written to it either; the connection is destroyed when it has no request
+ * in flight and nothing left to do.
+ */
+struct daemon_connection
+{
+    daemon_source Client;
+    daemon_source Response;
+
+    bool Detected;
+    bool Framed;
+    bool InputClosed;
+    bool HungUp;
+    bool Dead;
+
+    int RequestFD;
+    bool volatile RequestFailed;
+
+    daemon_buffer Input;
+    daemon_buffer Output;
+    std::queue<char *> Pending;
+};
+
+struct daemon_poll_event
+{
+    daemon_source *Source;
+    bool Readable;
+    bool Writable;
+    bool HangUp;
+};
+
+#define DAEMON_READ_SIZE          4096
+#define DAEMON_READ_BATCH_SIZE    (64 * 1024)
+#define DAEMON_BUFFER_RETAIN_SIZE (64 * 1024)
+#define DAEMON_OUTPUT_LIMIT       (DAEMON_MAX_RESPONSE_SIZE + (1 << 20))
+#define DAEMON_MAX_PENDING        64
+#define DAEMON_POLL_EVENT_COUNT   64
+
+internal int PollFD = -1;
+internal int WakeupFD[2] = { -1, -1 };
+internal daemon_source ListenerSource;
+internal daemon_source WakeupSource;
+internal std::set<daemon_connection *> Connections;
+internal std::vector<daemon_connection *> DeadConnections;
+
+/*
+ * NOTE(koekeishiya): Maps the socket given to a callback to its connection. A callback must not
+ * use its socket after closing it, so when a new request is given a socket with the same number,
+ * the previous entry is stale and can simply be replaced.
+ */
+internal std::map<int, daemon_connection *> RequestConnections;
+internal pthread_mutex_t RequestConnectionsLock = PTHREAD_MUTEX_INITIALIZER;
+
+#ifdef __APPLE__
+internal bool
+PollCreate()
+{
+    PollFD = kqueue();
+    return PollFD != -1;
+}
+
+internal void
+PollUpdate(daemon_source *Source, bool Read, bool Write)
+{
+    if ((Source->Read == Read) && (Source->Write == Write)) return;
+
+    struct kevent Changes[2];
+    EV_SET(&Changes[0], Source->FD, EVFILT_READ, EV_ADD | (Read ? EV_ENABLE : EV_DISABLE), 0, 0, Source);
+    EV_SET(&Changes[1], Source->FD, EVFILT_WRITE, EV_ADD | (Write ? EV_ENABLE : EV_DISABLE), 0, 0, Source);
+    kevent(PollFD, Changes, 2, NULL, 0, NULL);
+
+    Source->Read = Read;
+    Source->Write = Write;
+}
+
+internal int
+PollWait(daemon_poll_event *Events, int MaxCount)
+{
+    struct kevent Results[DAEMON_POLL_EVENT_COUNT];
+    int Count = kevent(PollFD, NULL, 0, Results, MaxCount, NULL);
+
+    for (int Index = 0; Index < Count; ++Index) {
+        Events[Index].Source = (daemon_source *) Results[Index].udata;
+        Events[Index].Readable = Results[Index].filter == EVFILT_READ;
+        Events[Index].Writable = Results[Index].filter == EVFILT_WRITE;
+        Events[Index].HangUp = false;
+    }
+
+    return Count;
+}
+#else
+internal bool
+PollCreate()
+{
+    PollFD = epoll_create1(EPOLL_CLOEXEC);
+    return PollFD != -1;
+}
+
+internal void
+PollUpdate(daemon_source *Source, bool Read, bool Write)
+{
+    if ((Source->Read == Read) && (Source->Write == Write)) return;
+
+    struct epoll_event Event = {};
+    Event.events = (Read ? (uint32_t) EPOLLIN : 0) | (Write ? (uint32_t) EPOLLOUT : 0);
+    Event.data.ptr = Source;
+
+    int Operation;
+    if (!Source->Read && !Source->Write) {
+        Operation = EPOLL_CTL_ADD;
+    } else if (!Read && !Write) {
+        Operation = EPOLL_CTL_DEL;
+    } else {
+        Operation = EPOLL_CTL_MOD;
+    }
+    epoll_ctl(PollFD, Operation, Source->FD, &Event);
+
+    Source->Read = Read;
+    Source->Write = Write;
+}
+
+internal int
+PollWait(daemon_poll_event *Events, int MaxCount)
+{
+    struct epoll_event Results[DAEMON_POLL_EVENT_COUNT];
+    int Count = epoll_wait(PollFD, Results, MaxCount, -1);
+
+    for (int Index = 0; Index < Count; ++Index) {
+        Events[Index].Source = (daemon_source *) Results[Index].data.ptr;
+        Events[Index].Readable = Results[Index].events & (EPOLLIN | EPOLLHUP | EPOLLERR);
+        Events[Index].Writable = Results[Index].events & (EPOLLOUT | EPOLLERR);
+        Events[Index].HangUp = Results[Index].events & (EPOLLHUP | EPOLLERR);
+    }
+
+    return Count;
+}
+#endif
+
+internal inline void
+SetNonBlocking(int SockFD)
+{
+    fcntl(SockFD, F_SETFL, fcntl(SockFD, F_GETFL, 0) | O_NONBLOCK);
+}
+
+internal inline void
+SetNoSigPipe(int SockFD)
+{
+#ifdef SO_NOSIGPIPE
+    int _True = 1;
+    setsockopt(SockFD, SOL_SOCKET, SO_NOSIGPIPE, &_True, sizeof(int));
+#endif
+}
+
+internal inline size_t
+BufferPending(daemon_buffer *Buffer)
+{
+    return Buffer->Length - Buffer->Offset;
+}
+
+internal void
+BufferReserve(daemon_buffer *Buffer, size_t Size)
+{
+    if (Buffer->Offset) {
+        memmove(Buffer->Data, Buffer->Data + Buffer->Offset, BufferPending(Buffer));
+        Buffer->Length -= Buffer->Offset;
+        Buffer->Offset = 0;
+    }
+
+    if (Buffer->Length + Size > Buffer->Capacity) {
+        size_t Capacity = Buffer->Capacity ? Buffer->Capacity : DAEMON_READ_SIZE;
+        while (Capacity < Buffer->Length + Size) Capacity *= 2;
+        Buffer->Data = (char *) realloc(Buffer->Data, Capacity);
+        Buffer->Capacity = Capacity;
+    }
+}
+
+// NOTE(koekeishiya): Connections are long-lived, so we do not hold on to a large buffer once it has been drained.
+internal void
+BufferReset(daemon_buffer *Buffer)
+{
+    Buffer->Offset = 0;
+    Buffer->Length = 0;
+
+    if (Buffer->Capacity > DAEMON_BUFFER_RETAIN_SIZE) {
+        free(Buffer->Data);
+        Buffer->Data = NULL;
+        Buffer->Capacity = 0;
+    }
+}
+
+internal void
+CreateConnection(int SockFD)
+{
+    daemon_connection *Connection = new daemon_connection();
+    Connection->Client = { Daemon_Source_Client, SockFD, false, false, Connection };
+    Connection->Response = { Daemon_Source_Response, -1, false, false, Connection };
+    Connections.insert(Connection);
+    PollUpdate(&Connection->Client, true, false);
+}
+
+internal void
+EndRequest(daemon_connection *Connection, bool Failed)
+{
+    if (Connection->Response.FD != -1) {
+        PollUpdate(&Connection->Response, false, false);
+        close(Connection->Response.FD);
+        Connection->Response.FD = -1;
+
+        pthread_mutex_lock(&RequestConnectionsLock);
+        std::map<int, daemon_connection *>::iterator It = RequestConnections.find(Connection->RequestFD);
+        if ((It != RequestConnections.end()) && (It->second == Connection)) {
+            RequestConnections.erase(It);
+        }
+        pthread_mutex_unlock(&RequestConnectionsLock);
+
+        Failed |= __atomic_load_n(&Connection->RequestFailed, __ATOMIC_ACQUIRE);
+    }
+
+    if (Connection->Framed && !Connection->HungUp) {
+        uint8_t Flags = DAEMON_FRAME_END | (Failed ? DAEMON_FRAME_ERROR : 0);
+        BufferReserve(&Connection->Output, DAEMON_FRAME_HEADER_SIZE);
+        WriteFrameHeader(Connection->Output.Data + Connection->Output.Length, Flags, 0);
+        Connection->Output.Length += DAEMON_FRAME_HEADER_SIZE;
+    }
+}
+
+// NOTE(koekeishiya): The connection is freed after the current batch of poll events has been handled.
+internal void
+DestroyConnection(daemon_connection *Connection)
+{
+    Connection->HungUp = true;
+    EndRequest(Connection, false);
+
+    PollUpdate(&Connection->Client, false, false);
+    CloseSocket(Connection->Client.FD);
+
+    while (!Connection->Pending.empty()) {
+        free(Connection->Pending.front());
+        Connection->Pending.pop();
+    }
+
+    Connection->Dead = true;
+    Connections.erase(Connection);
+    DeadConnections.push_back(Connection);
+}
+
+internal void
+FreeDeadConnections()
+{
+    for (size_t Index = 0; Index < DeadConnections.size(); ++Index) {
+        daemon_connection *Connection = DeadConnections[Index];
+        free(Connection->Input.Data);
+        free(Connection->Output.Data);
+        delete Connection;
+    }
+    DeadConnections.clear();
+}
+
+/*
+ * NOTE(koekeishiya): The client is gone; a request that is in flight still runs to completion, but its response is discarded.
+ * Our end of the response socket is closed right away, so that a handler which keeps its socket open
+ * (an event subscription) sees its writes fail, instead of writing to a client that no longer exists.
+ */
+internal void
+HangUpConnection(daemon_connection *Connection)
+{
+    Connection->InputClosed = true;
+    Connection->HungUp = true;
+    EndRequest(Connection, false);
+    BufferReset(&Connection->Input);
+    BufferReset(&Connection->Output);
+
+    while (!Connection->Pending.empty()) {
+        free(Connection->Pending.front());
+        Connection->Pending.pop();
+    }
+}
+
+internal void
+ParseRequests(daemon_connection *Connection, bool Drained)
+{
+    daemon_buffer *Input = &Connection->Input;
+
+    if (!Connection->Detected) {
+        if (BufferPending(Input) == 0) return;
+        Connection->Framed = (uint8_t) Input->Data[Input->Offset] == DAEMON_FRAME_MAGIC;
+        Connection->Detected = true;
+    }
+
+    if (Connection->Framed) {
+        while (BufferPending(Input) >= DAEMON_FRAME_HEADER_SIZE) {
+            char *Header = Input->Data + Input->Offset;
+            uint32_t Length = ReadFrameLength(Header);
+
+            if (((uint8_t) Header[0] != DAEMON_FRAME_MAGIC) || (Length > DAEMON_MAX_MESSAGE_SIZE)) {
+                HangUpConnection(Connection);
+                return;
+            }
+
+            if (BufferPending(Input) < DAEMON_FRAME_HEADER_SIZE + Length) break;
+
+            char *Message = (char *) malloc(Length + 1);
+            memcpy(Message, Header + DAEMON_FRAME_HEADER_SIZE, Length);
+            Message[Length] = '\0';
+            Connection->Pending.push(Message);
+            Input->Offset += DAEMON_FRAME_HEADER_SIZE + Length;
+        }
+
+        if (BufferPending(Input) == 0) {
+            BufferReset(Input);
+        }
+    } else {
+        /*
+         * NOTE(koekeishiya): An unframed request ends at the first null-byte. Clients that do not
+         * terminate their message are served with whatever they had sent when the socket ran dry,
+         * which is how the old server, that only did a single read, behaved as well.
+         */
+        char *Message = Input->Data + Input->Offset;
+        size_t Length = BufferPending(Input);
+        char *End = (char *) memchr(Message, '\0', Length);
+
+        if (End || (Length && (Drained || Connection->InputClosed))) {
+            Connection->Pending.push(strndup(Message, End ? End - Message : Length));
+            Connection->InputClosed = true;
+            BufferReset(Input);
+        } else if (Length > DAEMON_MAX_MESSAGE_SIZE) {
+            HangUpConnection(Connection);
+        }
+    }
+}
+
+internal void
+ReadRequests(daemon_connection *Connection)
+{
+    daemon_buffer *Input = &Connection->Input;
+    bool Drained = false;
+
+    while (BufferPending(Input) < DAEMON_READ_BATCH_SIZE) {
+        BufferReserve(Input, DAEMON_READ_SIZE);
+        ssize_t Length = read(Connection->Client.FD, Input->Data + Input->Length, DAEMON_READ_SIZE);
+        if (Length > 0) {
+            Input->Length += Length;
+        } else if (Length == 0) {
+            Connection->InputClosed = true;
+            break;
+        } else if (errno == EINTR) {
+            continue;
+        } else if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
+            Drained = true;
+            break;
+        } else {
+            HangUpConnection(Connection);
+            return;
+        }
+    }
+
+    ParseRequests(Connection, Drained);
+}
+
+internal void
+FlushResponses(daemon_connection *Connection)
+{
+    daemon_buffer *Output = &Connection->Output;
+
+    while (BufferPending(Output)) {
+        ssize_t Length = send(Connection->Client.FD, Output->Data + Output->Offset, BufferPending(Output), MSG_NOSIGNAL);
+        if (Length > 0) {
+            Output->Offset += Length;
+        } else if ((Length == -1) && (errno == EINTR)) {
+            continue;
+        } else if ((Length == -1) && ((errno == EAGAIN) || (errno == EWOULDBLOCK))) {
+            return;
+        } else {
+            HangUpConnection(Connection);
+            return;
+        }
+    }
+
+    BufferReset(Output);
+}
+
+/*
+ * NOTE(koekeishiya): Framed responses are read straight into the output buffer, leaving room
+ * for the frame header in front of the data. The request is complete once the callback has
+ * closed its end of the response socket.
+ *
+ * The response socket is always drained, also while the client is not reading, so that the
+ * handler writing the response is never held up by a stalled client. The output is bounded by
+ * DAEMON_OUTPUT_LIMIT, which is more than a client accepts for one response; a client that
+ * falls that far behind is hung up on, and the handler sees its writes fail.
+ */
+internal void
+ReadResponse(daemon_connection *Connection)
+{
+    daemon_buffer *Output = &Connection->Output;
+    size_t HeaderSize = Connection->Framed ? DAEMON_FRAME_HEADER_SIZE : 0;
+
+    for (size_t Total = 0; Total < DAEMON_READ_BATCH_SIZE;) {
+        if (BufferPending(Output) >= DAEMON_OUTPUT_LIMIT) {
+            HangUpConnection(Connection);
+            return;
+        }
+
+        BufferReserve(Output, HeaderSize + DAEMON_READ_SIZE);
+        ssize_t Length = read(Connection->Response.FD, Output->Data + Output->Length + HeaderSize, DAEMON_READ_SIZE);
+        if (Length > 0) {
+            Total += Length;
+            if (Connection->HungUp) continue;
+            if (HeaderSize) WriteFrameHeader(Output->Data + Output->Length, 0, Length);
+            Output->Length += HeaderSize + Length;
+        } else if ((Length == -1) && (errno == EINTR)) {
+            continue;
+        } else if ((Length == -1) && ((errno == EAGAIN) || (errno == EWOULDBLOCK))) {
+            return;
+        } else {
+            EndRequest(Connection, false);
+            return;
+        }
+    }
+}
+
+internal void
+DispatchRequest(daemon_connection *Connection)
+{
+    char *Message = Connection->Pending.front();
+    Connection->Pending.pop();
+
+    int Sockets[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, Sockets) == -1) {
+        EndRequest(Connection, true);
+        free(Message);
+        return;
+    }
+
+    SetNonBlocking(Sockets[0]);
+    SetNonBlocking(Sockets[1]);
+    SetNoSigPipe(Sockets[1]);
+
+    Connection->Response.FD = Sockets[0];
+    Connection->RequestFD = Sockets[1];
+    Connection->RequestFailed = false;
+    PollUpdate(&Connection->Response, true, false);
+
+    pthread_mutex_lock(&RequestConnectionsLock);
+    RequestConnections[Sockets[1]] = Connection;
+    pthread_mutex_unlock(&RequestConnectionsLock);
+
+    (*ConnectionCallback)(Message, Sockets[1]);
+    free(Message);
+}
+
+internal void
+UpdateConnection(daemon_connection *Connection)
+{
+    if (Connection->Dead) return;
+
+    if ((Connection->Response.FD == -1) && !Connection->Pending.empty()) {
+        DispatchRequest(Connection);
+    }
+
+    if (BufferPending(&Connection->Output)) {
+        FlushResponses(Connection);
+    }
+
+    bool HasOutput = BufferPending(&Connection->Output) != 0;
+    if ((Connection->Response.FD == -1) && Connection->Pending.empty()) {
+        if (Connection->HungUp || (Connection->InputClosed && !HasOutput)) {
+            DestroyConnection(Connection);
+            return;
+        }
+    }
+
+    bool Read = !Connection->InputClosed && (Connection->Pending.size() < DAEMON_MAX_PENDING);
+    PollUpdate(&Connection->Client, Read, HasOutput);
+
+    if (Connection->Response.FD != -1) {
+        PollUpdate(&Connection->Response, true, false);
+    }
+}
+
+internal void
+AcceptConnections()
+{
+    for (;;) {
+        int SockFD = accept(DaemonSockFD, NULL, 0);
+        if (SockFD == -1) {
+            if (errno == EINTR) continue;
+            break;
+        }
+
+        SetNonBlocking(SockFD);
+        SetNoSigPipe(SockFD);
+        CreateConnection(SockFD);
+    }
+}
+
+internal void
+HandleEvent(daemon_poll_event *Event)
+{
+    daemon_source *Source = Event->Source;
+
+    switch (Source->Kind) {
+    case Daemon_Source_Listener: {
+        AcceptConnections();
+    } break;
+    case Daemon_Source_Wakeup: {
+        char Buffer[64];
+        while (read(WakeupFD[0], Buffer, sizeof(Buffer)) > 0);
+    } break;
+    case Daemon_Source_Client: {
+        daemon_connection *Connection = Source->Connection;
+        if (Connection->Dead) break;
+
+        if (Event->Readable && Source->Read) {
+            ReadRequests(Connection);
+        } else if (Event->HangUp) {
+            HangUpConnection(Connection);
+        }
+
+        if (Event->Writable && Source->Write && !Connection->HungUp) {
+            FlushResponses(Connection);
+        }
+
+        UpdateConnection(Connection);
+    } break;
+    case Daemon_Source_Response: {
+        daemon_connection *Connection = Source->Connection;
+        if (Connection->Dead) break;
+
+        if (Event->Readable && Source->Read) {
+            ReadResponse(Connection);
+        }
+
+        UpdateConnection(Connection);
+    } break;
+    }
+}
+
+/*
+ * NOTE(koekeishiya): The daemon thread owns every connection; the callbacks only ever see the
+ * response socket of their own request, so they may complete it from any thread, and plugins
+ * can keep writing to it through their own copy of this file.
  */
 internal void *
-HandleConnection(void *)
+HandleConnections(void *)
 {
+    daemon_poll_event Events[DAEMON_POLL_EVENT_COUNT];
+
     while (IsRunning) {
-        int SockFD = accept(DaemonSockFD, NULL, 0);
-        if (SockFD != -1) {
-            char *Message = ReadFromSocket(SockFD);
-            if (Message) {
-                (*ConnectionCallback)(Message, SockFD);
-                free(Message);
-            }
+        int Count = PollWait(Events, DAEMON_POLL_EVENT_COUNT);
+        for (int Index = 0; Index < Count; ++Index) {
+            HandleEvent(Events + Index);
         }
+        FreeDeadConnections();
     }
 
+    while (!Connections.empty()) {
+        DestroyConnection(*Connections.begin());
+    }
+    FreeDeadConnections();
+
     return NULL;
 }
 
+void FailDaemonRequest(int SockFD)
+{
+    pthread_mutex_lock(&RequestConnectionsLock);
+    std::map<int, daemon_connection *>::iterator It = RequestConnections.find(SockFD);
+    if (It != RequestConnections.end()) {
+        __atomic_store_n(&It->second->RequestFailed, true, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&RequestConnectionsLock);
+}
+
+internal bool
+StartDaemonThread()
+{
+    SetNonBlocking(DaemonSockFD);
+
+    if (!PollCreate()) {
+        goto poll_err;
+    }
+
+    if (pipe(WakeupFD) == -1) {
+        goto pipe_err;
+    }
+
+    SetNonBlocking(WakeupFD[0]);
+    ListenerSource = { Daemon_Source_Listener, DaemonSockFD, false, false, NULL };
+    WakeupSource = { Daemon_Source_Wakeup, WakeupFD[0], false, false, NULL };
+    PollUpdate(&ListenerSource, true, false);
+    PollUpdate(&WakeupSource, true, false);
+
+    IsRunning = true;
+    if (pthread_create(&Thread, NULL, &HandleConnections, NULL) != 0) {
+        goto thread_err;
+    }
+
+    return true;
+
+thread_err:
+    IsRunning = false;
+    close(WakeupFD[0]);
+    close(WakeupFD[1]);
+
+pipe_err:
+    close(PollFD);
+    PollFD = -1;
+
+poll_err:
+    return false;
+}
+
 bool ConnectToDaemon(int *SockFD, char *SocketPath)
 {
     struct sockaddr_un SockAddress;
@@ -127,9 +927,7 @@ bool StartDaemon(char *SocketPath, daemon_callback *Callback)
         return false;
     }
 
-    IsRunning = true;
-    pthread_create(&Thread, NULL, &HandleConnection, NULL);
-    return true;
+    return StartDaemonThread();
 }
 
 bool StartDaemon(int Port, daemon_callback *Callback)
@@ -160,16 +958,22 @@ bool StartDaemon(int Port, daemon_callback *Callback)
         return false;
     }
 
-    IsRunning = true;
-    pthread_create(&Thread, NULL, &HandleConnection, NULL);
-    return true;
+    return StartDaemonThread();
 }
 
 void StopDaemon()
 {
     if (IsRunning) {
         IsRunning = false;
+        write(WakeupFD[1], "", 1);
+        pthread_join(Thread, NULL);
+
+        close(WakeupFD[0]);
+        close(WakeupFD[1]);
+        close(PollFD);
+        PollFD = -1;
+
         CloseSocket(DaemonSockFD);
-        DaemonSockFD = 0;
+        DaemonSockFD = -1;
     }
 }
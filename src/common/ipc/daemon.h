@@ -1,9 +1,49 @@
 #ifndef CHUNKWM_COMMON_DAEMON_H
 #define CHUNKWM_COMMON_DAEMON_H
 
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * NOTE(koekeishiya): The callback is invoked on the daemon thread once a complete request has
+ * been received, and should hand the request off instead of processing it inline.
+ * 'SockFD' is a response socket that belongs to this request only. Everything written to it
+ * is forwarded to the client, and the request is complete once it is passed to 'CloseSocket'.
+ * Requests from the same connection are dispatched one at a time, in the order they were sent.
+ */
 #define DAEMON_CALLBACK(name) void name(const char *Message, int SockFD)
 typedef DAEMON_CALLBACK(daemon_callback);
 
+/*
+ * NOTE(koekeishiya): A connection that starts with DAEMON_FRAME_MAGIC is kept alive and may send
+ * any number of framed requests. Every frame starts with an 8 byte header:
+ *
+ *     magic (1 byte) | flags (1 byte) | reserved (2 bytes) | length (4 bytes, network order)
+ *
+ * A response is sent as zero or more frames, and the last frame of a response has the
+ * DAEMON_FRAME_END flag set, along with DAEMON_FRAME_ERROR if the request failed. Any other connection is treated as an unframed (legacy) client:
+ * a single request terminated by a null-byte, and the connection is closed after the response.
+ */
+#define DAEMON_FRAME_MAGIC       0xc7
+#define DAEMON_FRAME_END         (1 << 0)
+#define DAEMON_FRAME_ERROR       (1 << 1)
+#define DAEMON_FRAME_HEADER_SIZE 8
+#define DAEMON_MAX_MESSAGE_SIZE  (1 << 20)
+#define DAEMON_MAX_RESPONSE_SIZE (16 << 20)
+
+/*
+ * NOTE(koekeishiya): Holds the buffer that responses are read into, so that it can be reused
+ * for every response read from the same connection. 'Failed' is set if the daemon reported
+ * that the last response read belongs to a request that failed.
+ */
+struct daemon_reader
+{
+    char *Buffer;
+    size_t Length;
+    size_t Capacity;
+    bool Failed;
+};
+
 bool StartDaemon(int Port, daemon_callback Callback);
 bool StartDaemon(char *SocketPath, daemon_callback *Callback);
 
@@ -16,4 +56,21 @@ void WriteToSocket(const char *Message, int SockFD);
 char *ReadFromSocket(int SockFD);
 void CloseSocket(int SockFD);
 
+/*
+ * NOTE(koekeishiya): Marks the request that 'SockFD' was given for as failed, and must be called
+ * before the socket is closed. Only has an effect in the process that runs the daemon, and is
+ * not visible to unframed clients.
+ */
+void FailDaemonRequest(int SockFD);
+
+/*
+ * NOTE(koekeishiya): Client side of the framed protocol. 'ReadDaemonResponse' returns the complete,
+ * null-terminated response, which is valid until the next read through the same reader. It returns
+ * NULL if the connection was closed or the response exceeds DAEMON_MAX_RESPONSE_SIZE, after which
+ * the connection can not be used anymore.
+ */
+bool SendDaemonRequest(const char *Message, int SockFD);
+char *ReadDaemonResponse(daemon_reader *Reader, int SockFD);
+void FreeDaemonReader(daemon_reader *Reader);
+
 #endif
@@ -0,0 +1,357 @@
+#include "dock.h"
+#include "daemon.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <map>
+
+#define internal static
+
+#define DOCK_RETRY_LIMIT     8
+#define DOCK_RETRY_DELAY_US  1000
+
+// NOTE(koekeishiya): A message with a 'Count' of zero carries preformatted text, anything else is a batch.
+struct dock_message
+{
+    dock_message *Next;
+    char Text[DOCK_MAX_MESSAGE_SIZE];
+
+    dock_window_op Op;
+    float Duration;
+    int Count;
+    dock_window_value *Values;
+};
+
+internal int DockPort = DOCK_PORT;
+internal bool volatile DockUnreachable;
+
+internal dock_message *volatile DockQueue;
+internal pthread_mutex_t DockLock = PTHREAD_MUTEX_INITIALIZER;
+internal pthread_cond_t DockReady = PTHREAD_COND_INITIALIZER;
+internal pthread_cond_t DockDrained = PTHREAD_COND_INITIALIZER;
+internal uint32_t volatile DockPending;
+internal pthread_t DockThread;
+internal bool volatile DockClientRunning;
+internal bool DockClientStopping;
+
+internal dock_client_stats DockStats;
+
+/*
+ * NOTE(koekeishiya): The payload only listens on the loopback interface, so there is no reason
+ * to resolve 'localhost' for every message.
+ */
+bool ConnectToDock(int *SockFD)
+{
+    if ((*SockFD = socket(PF_INET, SOCK_STREAM, 0)) == -1) {
+        return false;
+    }
+
+#ifdef SO_NOSIGPIPE
+    int Set = 1;
+    setsockopt(*SockFD, SOL_SOCKET, SO_NOSIGPIPE, &Set, sizeof(Set));
+#endif
+
+    struct sockaddr_in Address;
+    memset(&Address, 0, sizeof(Address));
+    Address.sin_family = AF_INET;
+    Address.sin_port = htons(DockPort);
+    Address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    if (connect(*SockFD, (struct sockaddr *) &Address, sizeof(Address)) == -1) {
+        int Error = errno;
+        close(*SockFD);
+        *SockFD = -1;
+        errno = Error;
+        return false;
+    }
+
+    return true;
+}
+
+/*
+ * NOTE(koekeishiya): The payload has a listen backlog of 10, and a connection is refused once the
+ * backlog is full, which happens when many messages are sent in a burst (fading every window).
+ * A refused connection is retried with an increasing delay, but once a message has been dropped
+ * we assume that the payload has not been loaded, and stop retrying until a message gets through.
+ */
+internal bool
+DeliverDockMessage(const char *Message)
+{
+    int RetryLimit = __atomic_load_n(&DockUnreachable, __ATOMIC_RELAXED) ? 0 : DOCK_RETRY_LIMIT;
+    useconds_t Delay = DOCK_RETRY_DELAY_US;
+
+    for (int Attempt = 0;; ++Attempt) {
+        int SockFD;
+        if (ConnectToDock(&SockFD)) {
+            WriteToSocket(Message, SockFD);
+            CloseSocket(SockFD);
+            __atomic_store_n(&DockUnreachable, false, __ATOMIC_RELAXED);
+            __atomic_add_fetch(&DockStats.Sent, 1, __ATOMIC_RELAXED);
+            return true;
+        }
+
+        if ((Attempt == RetryLimit) || ((errno != ECONNREFUSED) && (errno != EAGAIN) && (errno != EINTR))) {
+            break;
+        }
+
+        __atomic_add_fetch(&DockStats.Retried, 1, __ATOMIC_RELAXED);
+        usleep(Delay);
+        Delay *= 2;
+    }
+
+    __atomic_store_n(&DockUnreachable, true, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&DockStats.Dropped, 1, __ATOMIC_RELAXED);
+    return false;
+}
+
+// NOTE(koekeishiya): Messages are pushed onto a lock-free stack, and reversed by the sending thread.
+internal dock_message *
+TakeDockMessages()
+{
+    dock_message *Stack = __atomic_exchange_n(&DockQueue, NULL, __ATOMIC_ACQUIRE);
+    dock_message *List = NULL;
+
+    while (Stack) {
+        dock_message *Next = Stack->Next;
+        Stack->Next = List;
+        List = Stack;
+        Stack = Next;
+    }
+
+    return List;
+}
+
+internal void
+FormatDockWindowMessage(char *Buffer, size_t Size, dock_message *Message, dock_window_value *Value)
+{
+    switch (Message->Op) {
+    case DockWindow_Alpha: {
+        snprintf(Buffer, Size, "window_alpha %d %f", Value->WindowId, Value->Value);
+    } break;
+    case DockWindow_AlphaFade: {
+        snprintf(Buffer, Size, "window_alpha_fade %d %f %f", Value->WindowId, Value->Value, Message->Duration);
+    } break;
+    case DockWindow_Level: {
+        snprintf(Buffer, Size, "window_level %d %d", Value->WindowId, (int) Value->Value);
+    } break;
+    case DockWindow_Sticky: {
+        snprintf(Buffer, Size, "window_sticky %d %d", Value->WindowId, (int) Value->Value);
+    } break;
+    case DockWindow_Move: {
+        snprintf(Buffer, Size, "window_move %d %d %d", Value->WindowId, Value->X, Value->Y);
+    } break;
+    }
+}
+
+// NOTE(koekeishiya): A fade and a plain alpha change replace each other.
+internal inline uint64_t
+DockWindowKey(dock_window_op Op, uint32_t WindowId)
+{
+    uint64_t Kind = Op == DockWindow_AlphaFade ? DockWindow_Alpha : Op;
+    return (Kind << 32) | WindowId;
+}
+
+/*
+ * NOTE(koekeishiya): 'Latest' maps every window operation to the last batch that contains it.
+ * Values are skipped if a later batch that was taken at the same time replaces them.
+ */
+internal void
+DeliverDockBatch(dock_message *Message, std::map<uint64_t, dock_message *> *Latest)
+{
+    char Buffer[DOCK_MAX_MESSAGE_SIZE];
+
+    for (int Index = 0; Index < Message->Count; ++Index) {
+        dock_window_value *Value = Message->Values + Index;
+
+        if (Latest && ((*Latest)[DockWindowKey(Message->Op, Value->WindowId)] != Message)) {
+            __atomic_add_fetch(&DockStats.Coalesced, 1, __ATOMIC_RELAXED);
+            continue;
+        }
+
+        FormatDockWindowMessage(Buffer, sizeof(Buffer), Message, Value);
+        DeliverDockMessage(Buffer);
+    }
+}
+
+// NOTE(koekeishiya): Wakes 'FlushDockClient' once every message that was queued has been sent.
+internal void
+FinishDockMessage()
+{
+    if (__atomic_sub_fetch(&DockPending, 1, __ATOMIC_ACQ_REL) == 0) {
+        pthread_mutex_lock(&DockLock);
+        pthread_cond_broadcast(&DockDrained);
+        pthread_mutex_unlock(&DockLock);
+    }
+}
+
+internal void
+DeliverDockMessages(dock_message *List)
+{
+    std::map<uint64_t, dock_message *> Latest;
+    bool HasBatch = false;
+
+    for (dock_message *Message = List; Message; Message = Message->Next) {
+        for (int Index = 0; Index < Message->Count; ++Index) {
+            Latest[DockWindowKey(Message->Op, Message->Values[Index].WindowId)] = Message;
+            HasBatch = true;
+        }
+    }
+
+    while (List) {
+        dock_message *Next = List->Next;
+        if (List->Count) {
+            DeliverDockBatch(List, HasBatch ? &Latest : NULL);
+        } else {
+            DeliverDockMessage(List->Text);
+        }
+        free(List);
+        FinishDockMessage();
+        List = Next;
+    }
+}
+
+internal void *
+DockThreadProc(void *)
+{
+    for (;;) {
+        dock_message *List = TakeDockMessages();
+        if (!List) {
+            pthread_mutex_lock(&DockLock);
+            while (!__atomic_load_n(&DockQueue, __ATOMIC_ACQUIRE) && !DockClientStopping) {
+                pthread_cond_wait(&DockReady, &DockLock);
+            }
+            bool Stop = !__atomic_load_n(&DockQueue, __ATOMIC_ACQUIRE) && DockClientStopping;
+            pthread_mutex_unlock(&DockLock);
+
+            if (Stop) break;
+            continue;
+        }
+
+        DeliverDockMessages(List);
+    }
+
+    return NULL;
+}
+
+internal void
+QueueDockMessage(dock_message *Message)
+{
+    __atomic_add_fetch(&DockStats.Queued, Message->Count ? Message->Count : 1, __ATOMIC_RELAXED);
+
+    if (!__atomic_load_n(&DockClientRunning, __ATOMIC_ACQUIRE)) {
+        if (Message->Count) {
+            DeliverDockBatch(Message, NULL);
+        } else {
+            DeliverDockMessage(Message->Text);
+        }
+        free(Message);
+        return;
+    }
+
+    __atomic_add_fetch(&DockPending, 1, __ATOMIC_ACQ_REL);
+
+    dock_message *Head = __atomic_load_n(&DockQueue, __ATOMIC_RELAXED);
+    do {
+        Message->Next = Head;
+    } while (!__atomic_compare_exchange_n(&DockQueue, &Head, Message, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+
+    // NOTE(koekeishiya): Only the message that makes the queue non-empty has to wake the sending thread.
+    if (!Head) {
+        pthread_mutex_lock(&DockLock);
+        pthread_cond_signal(&DockReady);
+        pthread_mutex_unlock(&DockLock);
+    }
+}
+
+void SendDockMessage(const char *Format, ...)
+{
+    dock_message *Message = (dock_message *) malloc(sizeof(dock_message));
+    Message->Count = 0;
+
+    va_list Args;
+    va_start(Args, Format);
+    vsnprintf(Message->Text, sizeof(Message->Text), Format, Args);
+    va_end(Args);
+
+    QueueDockMessage(Message);
+}
+
+void SendDockWindowBatch(dock_window_op Op, dock_window_value *Values, int Count, float Duration)
+{
+    if (Count <= 0) {
+        return;
+    }
+
+    dock_message *Message = (dock_message *) malloc(sizeof(dock_message) + Count * sizeof(dock_window_value));
+    Message->Op = Op;
+    Message->Duration = Duration;
+    Message->Count = Count;
+    Message->Values = (dock_window_value *) (Message + 1);
+    memcpy(Message->Values, Values, Count * sizeof(dock_window_value));
+
+    QueueDockMessage(Message);
+}
+
+bool BeginDockClient(int Port)
+{
+    if (__atomic_load_n(&DockClientRunning, __ATOMIC_ACQUIRE)) {
+        return true;
+    }
+
+    DockPort = Port;
+    DockClientStopping = false;
+
+    if (pthread_create(&DockThread, NULL, &DockThreadProc, NULL) != 0) {
+        return false;
+    }
+
+    __atomic_store_n(&DockClientRunning, true, __ATOMIC_RELEASE);
+    return true;
+}
+
+// NOTE(koekeishiya): Messages that are already queued are sent before this returns.
+void EndDockClient()
+{
+    if (!__atomic_load_n(&DockClientRunning, __ATOMIC_ACQUIRE)) {
+        return;
+    }
+
+    __atomic_store_n(&DockClientRunning, false, __ATOMIC_RELEASE);
+
+    pthread_mutex_lock(&DockLock);
+    DockClientStopping = true;
+    pthread_cond_signal(&DockReady);
+    pthread_mutex_unlock(&DockLock);
+
+    pthread_join(DockThread, NULL);
+}
+
+void FlushDockClient()
+{
+    if (!__atomic_load_n(&DockClientRunning, __ATOMIC_ACQUIRE)) {
+        return;
+    }
+
+    pthread_mutex_lock(&DockLock);
+    while (__atomic_load_n(&DockPending, __ATOMIC_ACQUIRE) != 0) {
+        pthread_cond_wait(&DockDrained, &DockLock);
+    }
+    pthread_mutex_unlock(&DockLock);
+}
+
+void DockClientStats(dock_client_stats *Stats)
+{
+    Stats->Queued = __atomic_load_n(&DockStats.Queued, __ATOMIC_RELAXED);
+    Stats->Sent = __atomic_load_n(&DockStats.Sent, __ATOMIC_RELAXED);
+    Stats->Retried = __atomic_load_n(&DockStats.Retried, __ATOMIC_RELAXED);
+    Stats->Dropped = __atomic_load_n(&DockStats.Dropped, __ATOMIC_RELAXED);
+    Stats->Coalesced = __atomic_load_n(&DockStats.Coalesced, __ATOMIC_RELAXED);
+}
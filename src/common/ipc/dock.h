@@ -0,0 +1,78 @@
+#ifndef CHUNKWM_COMMON_DOCK_H
+#define CHUNKWM_COMMON_DOCK_H
+
+#include <stdint.h>
+
+#define DOCK_PORT             5050
+#define DOCK_MAX_MESSAGE_SIZE 64
+
+/*
+ * NOTE(koekeishiya): Client for the extended dock functionality that chwm-sa injects into the Dock.
+ * The payload accepts one connection at a time and reads a single message from it, before it
+ * closes the connection. It does not reply, but the connection is only closed after the
+ * message has been processed.
+ *
+ * 'SendDockMessage' does not block; messages are queued and sent from a separate thread, in the
+ * order they were queued. A message is retried when the connection is refused because the
+ * payload is busy, and is dropped if the payload has not been loaded.
+ * If the client has not been started, the message is sent by the calling thread instead.
+ */
+struct dock_client_stats
+{
+    uint64_t Queued;
+    uint64_t Sent;
+    uint64_t Retried;
+    uint64_t Dropped;
+    uint64_t Coalesced;
+};
+
+enum dock_window_op
+{
+    DockWindow_Alpha,
+    DockWindow_AlphaFade,
+    DockWindow_Level,
+    DockWindow_Sticky,
+    DockWindow_Move,
+};
+
+/*
+ * NOTE(koekeishiya): 'Value' is the alpha, level key or sticky flag, and 'X' and 'Y' are only used
+ * to move a window.
+ */
+struct dock_window_value
+{
+    uint32_t WindowId;
+    float Value;
+    int X, Y;
+};
+
+bool BeginDockClient(int Port);
+void EndDockClient();
+
+void SendDockMessage(const char *Format, ...);
+
+/*
+ * NOTE(koekeishiya): Queues an operation for a list of windows as a single entry. The payload only
+ * understands one window per message, so the sending thread still writes one message per window,
+ * but skips values that have been replaced by a later batch for the same window before they were
+ * sent; fading all windows on every focus change only sends the most recent alpha of each window.
+ * 'Duration' is only used by DockWindow_AlphaFade.
+ */
+void SendDockWindowBatch(dock_window_op Op, dock_window_value *Values, int Count, float Duration);
+
+/*
+ * NOTE(koekeishiya): Waits until every message that was queued before the call has been sent.
+ * Must not be called from the thread that sends the queued messages.
+ */
+void FlushDockClient();
+
+/*
+ * NOTE(koekeishiya): Connects to the payload from the calling thread, for messages that have to
+ * wait until the Dock has processed them, and can not be queued. Call 'FlushDockClient' first,
+ * so that the message does not overtake messages that are still queued.
+ */
+bool ConnectToDock(int *SockFD);
+
+void DockClientStats(dock_client_stats *Stats);
+
+#endif
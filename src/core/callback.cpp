@@ -1,14 +1,19 @@
 #include "config.h"
 #include "plugin.h"
-#include "wqueue.h"
+#include "tpool.h"
+#include "delivery.h"
+#include "subscription.h"
 #include "state.h"
+#include "cvar.h"
 #include "clog.h"
 
 #include "dispatch/carbon.h"
 #include "dispatch/workspace.h"
 #include "dispatch/event.h"
+#include "dispatch/journal.h"
 
 #include "../common/accessibility/window.h"
+#include "../common/accessibility/display.h"
 #include "../common/misc/assert.h"
 
 #include <stdio.h>
@@ -18,48 +23,183 @@
 
 #define ProcessPluginList(plugin_export, Context)          \
     plugin_list *List = BeginPluginList(plugin_export);    \
-    for (plugin_list_iter It = List->begin();              \
-         It != List->end();                                \
-         ++It) {                                           \
-        plugin *Plugin = It->first;                        \
-        Plugin->Run(#plugin_export,                        \
-                    (void *) Context);                     \
+    for (unsigned Index = 0;                               \
+         Index < List->Count;                              \
+         ++Index) {                                        \
+        plugin_subscriber *Subscriber =                    \
+            List->Subscribers + Index;                     \
+        if (Subscriber->Handler) {                         \
+            Subscriber->Handler((void *) Context);         \
+        } else {                                           \
+            Subscriber->Plugin->Run(#plugin_export,        \
+                                    (void *) Context);     \
+        }                                                  \
     }                                                      \
-    EndPluginList(plugin_export)
+    EndPluginList()
 
 #define ProcessPluginListThreaded(plugin_export, Context)  \
-    plugin_list *List = BeginPluginList(plugin_export);    \
-    plugin_work WorkArray[List->size()];                   \
-    int WorkCount = 0;                                     \
-    for (plugin_list_iter It = List->begin();              \
-         It != List->end();                                \
-         ++It) {                                           \
-        plugin_work *Work = WorkArray + WorkCount++;       \
-        Work->Plugin = It->first;                          \
-        Work->Export = (char *) #plugin_export;            \
-        Work->Data = (void *) Context;                     \
-        AddWorkQueueEntry(&Queue,                          \
-                          &PluginWorkCallback,             \
-                          Work);                           \
-    }                                                      \
-    EndPluginList(plugin_export);                          \
-    CompleteWorkQueue(&Queue)                              \
+    DispatchPluginList(plugin_export, (void *) Context, NULL)
+
+/*
+ * NOTE(koekeishiya): Used for events whose context is destroyed once the plugins have
+ * processed it. With asynchronous delivery 'Release' runs when the last queue is done.
+ */
+#define ProcessPluginListDeferred(plugin_export, Context, Release) \
+    DispatchPluginList(plugin_export, (void *) Context, Release)
 
 struct plugin_work
 {
     plugin *Plugin;
+    plugin_event_func *Handler;
     char *Export;
     void *Data;
 };
 
-internal work_queue Queue;
+internal thread_pool Pool;
 
 internal
 WORK_QUEUE_CALLBACK(PluginWorkCallback)
 {
     plugin_work *Work = (plugin_work *) Data;
-    Work->Plugin->Run(Work->Export,
-                      Work->Data);
+    BeginCVarBatch();
+    if (Work->Handler) {
+        Work->Handler(Work->Data);
+    } else {
+        Work->Plugin->Run(Work->Export,
+                          Work->Data);
+    }
+    EndCVarBatch();
+}
+
+internal
+PLUGIN_PAYLOAD_RELEASE(ReleaseWindowSnapshot)
+{
+    AXLibDestroyWindow((macos_window *) Context);
+}
+
+internal inline bool
+IsWindowExport(chunkwm_plugin_export Export)
+{
+    return ((Export >= chunkwm_export_window_created) &&
+            (Export <= chunkwm_export_window_title_changed));
+}
+
+/*
+ * NOTE(koekeishiya): The event-loop keeps updating the windows it tracks (title, position, size)
+ * while an asynchronous plugin may still be processing an older event, so such plugins receive
+ * a copy of the window that is owned by the payload. Applications are passed as they are; their
+ * fields are not changed after construction, plugins compare them by address, and a terminated
+ * application is only destroyed after every queue has passed the barrier for it.
+ */
+internal plugin_payload *
+BeginPluginSnapshot(chunkwm_plugin_export Export, void *Context)
+{
+    if (Context && IsWindowExport(Export)) {
+        macos_window *Copy = AXLibCopyWindow((macos_window *) Context);
+        return BeginPluginPayload(Copy, Copy, &ReleaseWindowSnapshot);
+    }
+
+    return BeginPluginPayload(Context, Context, NULL);
+}
+
+/*
+ * NOTE(koekeishiya): Plugins that use synchronous delivery are run on the thread pool and
+ * joined before we return. Plugins that opted in to asynchronous delivery get the event
+ * appended to their own serial queue instead, and the event-loop moves on immediately.
+ */
+internal void
+DispatchPluginList(chunkwm_plugin_export Export, void *Context, plugin_payload_release *Release)
+{
+    plugin_payload *Payload = NULL;
+
+    plugin_list *List = BeginPluginList(Export);
+    plugin_work WorkArray[List->Count];
+    int WorkCount = 0;
+    task_group Group = {};
+
+    for (unsigned Index = 0; Index < List->Count; ++Index) {
+        plugin_subscriber *Subscriber = List->Subscribers + Index;
+        plugin_queue *Queue = GetPluginQueue(Subscriber->Plugin);
+        if (Queue) {
+            if (!Payload) Payload = BeginPluginSnapshot(Export, Context);
+            EnqueuePluginDelivery(Queue, chunkwm_plugin_export_str[Export], Subscriber->Handler, Payload);
+        } else {
+            plugin_work *Work = WorkArray + WorkCount++;
+            Work->Plugin = Subscriber->Plugin;
+            Work->Handler = Subscriber->Handler;
+            Work->Export = (char *) chunkwm_plugin_export_str[Export];
+            Work->Data = Context;
+            ThreadPoolSubmit(&Pool, &Group, &PluginWorkCallback, Work);
+        }
+    }
+
+    EndPluginList();
+    ThreadPoolJoin(&Pool, &Group);
+
+    if (Payload) {
+        EndPluginPayload(Payload);
+    }
+
+    if (Release) {
+        if (HasPluginQueues()) {
+            plugin_payload *Barrier = BeginPluginPayload(Context, Context, Release);
+            EnqueuePluginBarrier(Barrier);
+            EndPluginPayload(Barrier);
+        } else {
+            Release(Context);
+        }
+    }
+}
+
+internal
+PLUGIN_PAYLOAD_RELEASE(ReleaseDisplayId)
+{
+    free(Context);
+}
+
+internal
+PLUGIN_PAYLOAD_RELEASE(ReleaseWindow)
+{
+    AXLibDestroyWindow((macos_window *) Context);
+}
+
+internal
+PLUGIN_PAYLOAD_RELEASE(ReleaseApplication)
+{
+    AXLibDestroyApplication((macos_application *) Context);
+}
+
+internal
+PLUGIN_PAYLOAD_RELEASE(ReleasePluginBroadcast)
+{
+    void **Broadcast = (void **) Context;
+
+    if (Broadcast[1]) {
+        free(Broadcast[1]);
+    }
+
+    free(Broadcast[0]);
+    free(Broadcast);
+}
+
+struct plugin_command
+{
+    chunkwm_payload Payload;
+    chunkwm_delegate *Delegate;
+};
+
+internal
+PLUGIN_PAYLOAD_RELEASE(ReleasePluginCommand)
+{
+    plugin_command *Command = (plugin_command *) Context;
+    chunkwm_delegate *Delegate = Command->Delegate;
+
+    CloseSocket(Delegate->SockFD);
+    free(Delegate->Target);
+    free(Delegate->Command);
+    free((char *)(Delegate->Message));
+    free(Delegate);
+    free(Command);
 }
 
 // NOTE(koekeishiya): We pass a pointer to this function to every plugin as they are loaded.
@@ -70,7 +210,7 @@ void ChunkwmBroadcast(const char *PluginName, const char *EventName,
         return;
     }
 
-    void **Context = (void **) malloc(2 * sizeof(void *));
+    void **Context = (void **) malloc(3 * sizeof(void *));
 
     size_t TotalLength = strlen(PluginName) + strlen(EventName) + 2;
     char *Event = (char *) malloc(TotalLength);
@@ -84,6 +224,7 @@ void ChunkwmBroadcast(const char *PluginName, const char *EventName,
     } else {
         Context[1] = NULL;
     }
+    Context[2] = (void *) Size;
 
     c_log(C_LOG_LEVEL_DEBUG, "chunkwm:%s:%s\n", PluginName, EventName);
     ConstructEvent(ChunkWM_PluginBroadcast, Context);
@@ -95,11 +236,16 @@ CHUNKWM_CALLBACK(Callback_ChunkWM_PluginBroadcast)
 
     char *PluginEvent = (char *) Context[0];
     void *EventData = (void *) Context[1];
+    size_t EventSize = (size_t) Context[2];
+
+    PublishBroadcastRecord(PluginEvent, EventData, EventSize);
 
     loaded_plugin_list *List = BeginLoadedPluginList();
 
     plugin_work WorkArray[List->size()];
     int WorkCount = 0;
+    task_group Group = {};
+    plugin_payload *Payload = NULL;
 
     for (loaded_plugin_list_iter It = List->begin();
          It != List->end();
@@ -108,53 +254,138 @@ CHUNKWM_CALLBACK(Callback_ChunkWM_PluginBroadcast)
         if (strncmp(LoadedPlugin->Info->PluginName,
                     PluginEvent,
                     strlen(LoadedPlugin->Info->PluginName)) != 0) {
-            plugin_work *Work = WorkArray + WorkCount++;
-            Work->Plugin = LoadedPlugin->Plugin;
-            Work->Export = PluginEvent;
-            Work->Data = EventData;
-            AddWorkQueueEntry(&Queue, &PluginWorkCallback, Work);
+            plugin_queue *Queue = GetPluginQueue(LoadedPlugin->Plugin);
+            if (Queue) {
+                if (!Payload) Payload = BeginPluginPayload(EventData, Context, &ReleasePluginBroadcast);
+                EnqueuePluginDelivery(Queue, PluginEvent, NULL, Payload);
+            } else {
+                plugin_work *Work = WorkArray + WorkCount++;
+                Work->Plugin = LoadedPlugin->Plugin;
+                Work->Handler = NULL;
+                Work->Export = PluginEvent;
+                Work->Data = EventData;
+                ThreadPoolSubmit(&Pool, &Group, &PluginWorkCallback, Work);
+            }
         }
     }
 
     EndLoadedPluginList();
-    CompleteWorkQueue(&Queue);
+    ThreadPoolJoin(&Pool, &Group);
 
-    if (EventData) {
-        free(EventData);
+    if (Payload) {
+        EndPluginPayload(Payload);
+    } else {
+        ReleasePluginBroadcast(Context);
     }
+}
 
-    free(PluginEvent);
-    free(Context);
+/*
+ * NOTE(koekeishiya): Extract the payload that is required to reconstruct an event from
+ * its context. Called by AddEvent on the thread that queues the event, before the event-loop
+ * can see it, so the context is still valid. It must not make calls to an application.
+ */
+CHUNKWM_CALLBACK(JournalChunkEvent)
+{
+    event_journal_record Record = {};
+    Record.Timestamp = Event->Timestamp;
+    Record.Type = Event->Type;
+
+    switch (Event->Type) {
+    case ChunkWM_ApplicationLaunched:
+    case ChunkWM_ApplicationTerminated: {
+        carbon_application_details *Info = (carbon_application_details *) Event->Context;
+        Record.PID = Info->PID;
+    } break;
+    case ChunkWM_ApplicationActivated:
+    case ChunkWM_ApplicationDeactivated:
+    case ChunkWM_ApplicationVisible:
+    case ChunkWM_ApplicationHidden: {
+        workspace_application_details *Info = (workspace_application_details *) Event->Context;
+        Record.PID = Info->PID;
+    } break;
+    case ChunkWM_DisplayAdded:
+    case ChunkWM_DisplayRemoved:
+    case ChunkWM_DisplayMoved:
+    case ChunkWM_DisplayResized: {
+        CGDirectDisplayID *DisplayId = (CGDirectDisplayID *) Event->Context;
+        Record.DisplayId = *DisplayId;
+    } break;
+    case ChunkWM_DisplayChanged:
+    case ChunkWM_SpaceChanged: {
+        macos_space *Space;
+        if (AXLibActiveSpace(&Space)) {
+            Record.SpaceId = Space->Id;
+            AXLibDestroySpace(Space);
+        }
+    } break;
+    case ChunkWM_WindowCreated:
+    case ChunkWM_WindowDestroyed:
+    case ChunkWM_WindowFocused:
+    case ChunkWM_WindowMoved:
+    case ChunkWM_WindowResized:
+    case ChunkWM_WindowMinimized:
+    case ChunkWM_WindowDeminimized:
+    case ChunkWM_WindowSheetCreated:
+    case ChunkWM_WindowTitleChanged: {
+        macos_window *Window = (macos_window *) Event->Context;
+
+        /*
+         * NOTE(koekeishiya): This is the cached geometry. For moved and resized events it is
+         * the frame from before the event, because the handler that reads the new frame has
+         * not run yet; reading it here would be a synchronous call to the application.
+         */
+        CGPoint Position = Window->Position;
+        CGSize Size = Window->Size;
+
+        Record.WindowId = Window->Id;
+        Record.PID = Window->Owner->PID;
+        Record.X = Position.x;
+        Record.Y = Position.y;
+        Record.Width = Size.width;
+        Record.Height = Size.height;
+    } break;
+    default: {
+        // NOTE(koekeishiya): Plugin events are journaled by type only.
+    } break;
+    }
+
+    WriteEventJournal(&Record);
 }
 
 bool BeginCallbackThreads(int Count)
 {
-    if ((Queue.Semaphore = sem_open("work_queue_semaphore", O_CREAT, 0644, 0)) == SEM_FAILED) {
-        return false;
-    }
+    return BeginThreadPool(&Pool, Count);
+}
+
+void CallbackThreadPoolStats(thread_pool_stats *Stats)
+{
+    ThreadPoolStats(&Pool, Stats);
+}
 
-    pthread_t Thread[Count];
-    for (int Index = 0; Index < Count; ++Index) {
-        pthread_create(&Thread[Index], NULL, &WorkQueueThreadProc, &Queue);
+internal void
+CompletePluginRequest(plugin_fs *PluginFS, bool Success)
+{
+    if (PluginFS->SockFD != -1) {
+        if (!Success) FailDaemonRequest(PluginFS->SockFD);
+        CloseSocket(PluginFS->SockFD);
     }
 
-    return true;
+    DestroyPluginFS(PluginFS);
+    free(PluginFS);
 }
 
 CHUNKWM_CALLBACK(Callback_ChunkWM_PluginLoad)
 {
     plugin_fs *PluginFS = (plugin_fs *) Event->Context;
-    LoadPlugin(PluginFS->Absolutepath, PluginFS->Filename);
-    DestroyPluginFS(PluginFS);
-    free(PluginFS);
+    bool Success = LoadPlugin(PluginFS->Absolutepath, PluginFS->Filename);
+    CompletePluginRequest(PluginFS, Success);
 }
 
 CHUNKWM_CALLBACK(Callback_ChunkWM_PluginUnload)
 {
     plugin_fs *PluginFS = (plugin_fs *) Event->Context;
-    UnloadPlugin(PluginFS->Absolutepath, PluginFS->Filename);
-    DestroyPluginFS(PluginFS);
-    free(PluginFS);
+    bool Success = UnloadPlugin(PluginFS->Absolutepath, PluginFS->Filename);
+    CompletePluginRequest(PluginFS, Success);
 }
 
 CHUNKWM_CALLBACK(Callback_ChunkWM_PluginCommand)
@@ -162,19 +393,34 @@ CHUNKWM_CALLBACK(Callback_ChunkWM_PluginCommand)
     chunkwm_delegate *Delegate = (chunkwm_delegate *) Event->Context;
     ASSERT(Delegate);
 
+    plugin_command *Command = (plugin_command *) malloc(sizeof(plugin_command));
+    Command->Payload.SockFD = Delegate->SockFD;
+    Command->Payload.Command = Delegate->Command;
+    Command->Payload.Message = Delegate->Message;
+    Command->Delegate = Delegate;
+
+    /*
+     * NOTE(koekeishiya): Commands are serialized with the events of a plugin that uses
+     * asynchronous delivery; the socket is closed once the plugin has written its response.
+     */
     plugin *Plugin = GetPluginFromFilename(Delegate->Target);
-    if (Plugin) {
-        chunkwm_payload Payload = { Delegate->SockFD, Delegate->Command, Delegate->Message };
-        Plugin->Run("chunkwm_daemon_command", (void *) &Payload);
+    plugin_queue *Queue = Plugin ? GetPluginQueue(Plugin) : NULL;
+    if (Queue) {
+        plugin_payload *Payload = BeginPluginPayload(&Command->Payload, Command, &ReleasePluginCommand);
+        EnqueuePluginDelivery(Queue, "chunkwm_daemon_command", NULL, Payload);
+        EndPluginPayload(Payload);
     } else {
-        c_log(C_LOG_LEVEL_WARN, "chunkwm: plugin '%s' is not loaded.\n", Delegate->Target);
-    }
+        if (Plugin) {
+            BeginCVarBatch();
+            Plugin->Run("chunkwm_daemon_command", (void *) &Command->Payload);
+            EndCVarBatch();
+        } else {
+            c_log(C_LOG_LEVEL_WARN, "chunkwm: plugin '%s' is not loaded.\n", Delegate->Target);
+            FailDaemonRequest(Delegate->SockFD);
+        }
 
-    CloseSocket(Delegate->SockFD);
-    free(Delegate->Target);
-    free(Delegate->Command);
-    free((char *)(Delegate->Message));
-    free(Delegate);
+        ReleasePluginCommand(Command);
+    }
 }
 
 // NOTE(koekeishiya): Application-related callbacks.
@@ -211,10 +457,11 @@ CHUNKWM_CALLBACK(Callback_ChunkWM_ApplicationTerminated)
         c_log(C_LOG_LEVEL_DEBUG, "%d:%s terminated\n", Info->PID, Info->ProcessName);
 #if 0
         ProcessPluginList(chunkwm_export_application_terminated, Application);
+        RemoveAndDestroyApplication(Application);
 #else
-        ProcessPluginListThreaded(chunkwm_export_application_terminated, Application);
+        RemoveApplication(Application);
+        ProcessPluginListDeferred(chunkwm_export_application_terminated, Application, ReleaseApplication);
 #endif
-        RemoveAndDestroyApplication(Application);
     }
 
     EndCarbonApplicationDetails(Info);
@@ -228,6 +475,7 @@ CHUNKWM_CALLBACK(Callback_ChunkWM_ApplicationActivated)
     macos_application *Application = GetApplicationFromPID(Info->PID);
     if (Application) {
         c_log(C_LOG_LEVEL_DEBUG, "%d:%s activated\n", Info->PID, Info->ProcessName);
+        PublishEventRecord(EventTopic_Focus, "application_activated %d", Info->PID);
 #if 0
         ProcessPluginList(chunkwm_export_application_activated, Application);
 #else
@@ -303,6 +551,7 @@ CHUNKWM_CALLBACK(Callback_ChunkWM_SpaceChanged)
      * every space change. Windows that are already tracked is NOT added multiple times.
      */
     UpdateWindowCollection();
+    PublishEventRecord(EventTopic_Space, "space_changed");
 
 #if 0
     ProcessPluginList(chunkwm_export_space_changed, NULL);
@@ -320,11 +569,10 @@ CHUNKWM_CALLBACK(Callback_ChunkWM_DisplayAdded)
     c_log(C_LOG_LEVEL_DEBUG, "%d: display added\n", *DisplayId);
 #if 0
     ProcessPluginList(chunkwm_export_display_added, DisplayId);
+    free(DisplayId);
 #else
-    ProcessPluginListThreaded(chunkwm_export_display_added, DisplayId);
+    ProcessPluginListDeferred(chunkwm_export_display_added, DisplayId, ReleaseDisplayId);
 #endif
-
-    free(DisplayId);
 }
 
 CHUNKWM_CALLBACK(Callback_ChunkWM_DisplayRemoved)
@@ -335,11 +583,10 @@ CHUNKWM_CALLBACK(Callback_ChunkWM_DisplayRemoved)
     c_log(C_LOG_LEVEL_DEBUG, "%d: display removed\n", *DisplayId);
 #if 0
     ProcessPluginList(chunkwm_export_display_removed, DisplayId);
+    free(DisplayId);
 #else
-    ProcessPluginListThreaded(chunkwm_export_display_removed, DisplayId);
+    ProcessPluginListDeferred(chunkwm_export_display_removed, DisplayId, ReleaseDisplayId);
 #endif
-
-    free(DisplayId);
 }
 
 CHUNKWM_CALLBACK(Callback_ChunkWM_DisplayMoved)
@@ -350,11 +597,10 @@ CHUNKWM_CALLBACK(Callback_ChunkWM_DisplayMoved)
     c_log(C_LOG_LEVEL_DEBUG, "%d: display moved\n", *DisplayId);
 #if 0
     ProcessPluginList(chunkwm_export_display_moved, DisplayId);
+    free(DisplayId);
 #else
-    ProcessPluginListThreaded(chunkwm_export_display_moved, DisplayId);
+    ProcessPluginListDeferred(chunkwm_export_display_moved, DisplayId, ReleaseDisplayId);
 #endif
-
-    free(DisplayId);
 }
 
 CHUNKWM_CALLBACK(Callback_ChunkWM_DisplayResized)
@@ -365,11 +611,10 @@ CHUNKWM_CALLBACK(Callback_ChunkWM_DisplayResized)
     c_log(C_LOG_LEVEL_DEBUG, "%d: display resolution changed\n", *DisplayId);
 #if 0
     ProcessPluginList(chunkwm_export_display_resized, DisplayId);
+    free(DisplayId);
 #else
-    ProcessPluginListThreaded(chunkwm_export_display_resized, DisplayId);
+    ProcessPluginListDeferred(chunkwm_export_display_resized, DisplayId, ReleaseDisplayId);
 #endif
-
-    free(DisplayId);
 }
 
 CHUNKWM_CALLBACK(Callback_ChunkWM_DisplayChanged)
@@ -383,6 +628,7 @@ CHUNKWM_CALLBACK(Callback_ChunkWM_DisplayChanged)
      * every space change. Windows that are already tracked is NOT added multiple times.
      */
     UpdateWindowCollection();
+    PublishEventRecord(EventTopic_Space, "display_changed");
 
 #if 0
     ProcessPluginList(chunkwm_export_space_changed, NULL);
@@ -399,6 +645,7 @@ CHUNKWM_CALLBACK(Callback_ChunkWM_WindowCreated)
 
     if (AddWindowToCollection(Window)) {
         c_log(C_LOG_LEVEL_DEBUG, "%s:%s%d window created\n", Window->Owner->Name, Window->Name, Window->Id);
+        PublishEventRecord(EventTopic_Window, "window_created %u %d", Window->Id, Window->Owner->PID);
 #if 0
         ProcessPluginList(chunkwm_export_window_created, Window);
 #else
@@ -423,12 +670,13 @@ CHUNKWM_CALLBACK(Callback_ChunkWM_WindowDestroyed)
     ASSERT(Window);
 
     c_log(C_LOG_LEVEL_DEBUG, "%s:%s:%d window destroyed\n", Window->Owner->Name, Window->Name, Window->Id);
+    PublishEventRecord(EventTopic_Window, "window_destroyed %u %d", Window->Id, Window->Owner->PID);
 #if 0
     ProcessPluginList(chunkwm_export_window_destroyed, Window);
+    AXLibDestroyWindow(Window);
 #else
-    ProcessPluginListThreaded(chunkwm_export_window_destroyed, Window);
+    ProcessPluginListDeferred(chunkwm_export_window_destroyed, Window, ReleaseWindow);
 #endif
-    AXLibDestroyWindow(Window);
 }
 
 CHUNKWM_CALLBACK(Callback_ChunkWM_WindowFocused)
@@ -446,6 +694,7 @@ CHUNKWM_CALLBACK(Callback_ChunkWM_WindowFocused)
          */
         if (!AXLibHasFlags(Window, Window_Minimized)) {
             c_log(C_LOG_LEVEL_DEBUG, "%s:%s:%d window focused\n", Window->Owner->Name, Window->Name, Window->Id);
+            PublishEventRecord(EventTopic_Focus, "window_focused %u %d", Window->Id, Window->Owner->PID);
 #if 0
             ProcessPluginList(chunkwm_export_window_focused, Window);
 #else
@@ -15,12 +15,17 @@
 #include "dispatch/workspace.h"
 #include "dispatch/display.h"
 #include "dispatch/event.h"
+#include "dispatch/journal.h"
 
 #include "hotload.h"
 #include "hotloader.h"
 #include "state.h"
 #include "plugin.h"
 #include "wqueue.h"
+#include "tpool.h"
+#include "delivery.h"
+#include "subscription.h"
+#include "histogram.h"
 #include "cvar.h"
 #include "constants.h"
 
@@ -48,6 +53,7 @@
 #include "dispatch/carbon.cpp"
 #include "dispatch/workspace.mm"
 #include "dispatch/event.cpp"
+#include "dispatch/journal.cpp"
 #include "dispatch/display.cpp"
 
 #include "hotload.c"
@@ -55,14 +61,16 @@
 #include "state.cpp"
 #include "callback.cpp"
 #include "plugin.cpp"
-#include "wqueue.cpp"
+#include "tpool.cpp"
+#include "delivery.cpp"
+#include "subscription.cpp"
+#include "histogram.cpp"
 #include "config.cpp"
 #include "cvar.cpp"
 
 #define internal static
 #define local_persist static
 
-#define SOCKET_PATH_FMT  "/tmp/chunkwm_%s-socket"
 #define PIDFILE_PATH_FMT "/tmp/chunkwm_%s-pid"
 
 internal carbon_event_handler Carbon;
@@ -295,7 +303,7 @@ int main(int Count, char **Args)
     }
 
     if (!BeginCallbackThreads(CHUNKWM_THREAD_COUNT)) {
-        c_log(C_LOG_LEVEL_WARN, "chunkwm: could not get semaphore, callback multi-threading disabled..\n");
+        c_log(C_LOG_LEVEL_WARN, "chunkwm: could not start callback thread pool, callback multi-threading disabled..\n");
     }
 
     if (!InitState()) {
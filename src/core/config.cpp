@@ -7,9 +7,13 @@
 #include "../common/ipc/daemon.h"
 
 #include "dispatch/event.h"
+#include "dispatch/journal.h"
 
 #include "constants.h"
 #include "cvar.h"
+#include "tpool.h"
+#include "delivery.h"
+#include "subscription.h"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -68,11 +72,12 @@ PopulatePluginPath(const char **Message, plugin_fs *PluginFs)
 {
     char *Absolutepath, *Filename;
     token Token = GetToken(Message);
-    char *Directory = CVarStringValue(CVAR_PLUGIN_DIR);
+    char *Directory = CVarStringDuplicate(CVAR_PLUGIN_DIR);
 
     if (Directory) {
         Filename = TokenToString(Token);
         Absolutepath = PluginAbsolutepathFromDirectory(Filename, Directory);
+        free(Directory);
         if (!Absolutepath) {
             free(Filename);
             return false;
@@ -88,6 +93,7 @@ PopulatePluginPath(const char **Message, plugin_fs *PluginFs)
 
     PluginFs->Absolutepath = Absolutepath;
     PluginFs->Filename = Filename;
+    PluginFs->SockFD = -1;
     return true;
 }
 
@@ -115,9 +121,237 @@ ChunkwmDaemonDelegate(const char *Message, chunkwm_delegate *Delegate)
     return Success;
 }
 
+internal bool
+SetEventLaneFromMessage(const char **Message)
+{
+    bool Result = false;
+    token EventToken = GetToken(Message);
+    token LaneToken = GetToken(Message);
+    char *EventName = TokenToString(EventToken);
+    char *LaneName = TokenToString(LaneToken);
+
+    event_type Type;
+    event_lane_type Lane;
+    if (!EventTypeFromString(EventName, &Type)) {
+        c_log(C_LOG_LEVEL_WARN, "chunkwm: invalid event type '%s'\n", EventName);
+    } else if (!EventLaneTypeFromString(LaneName, &Lane)) {
+        c_log(C_LOG_LEVEL_WARN, "chunkwm: invalid event lane '%s'\n", LaneName);
+    } else {
+        SetEventLane(Type, Lane);
+        Result = true;
+    }
+
+    free(LaneName);
+    free(EventName);
+    return Result;
+}
+
+internal inline double
+NanosecondsToMilliseconds(uint64_t Value)
+{
+    return Value / 1000000.0;
+}
+
+internal void
+WriteEventLaneStats(int SockFD)
+{
+    char Buffer[MAX_LEN];
+    for (int Index = 0; Index < Event_Lane_Count; ++Index) {
+        event_lane_stats Stats;
+        EventLaneStats((event_lane_type) Index, &Stats);
+
+        double WaitAverage = Stats.Dispatched ? NanosecondsToMilliseconds(Stats.WaitTotal) / Stats.Dispatched : 0.0;
+        double WaitMax = NanosecondsToMilliseconds(Stats.WaitMax);
+
+        snprintf(Buffer, sizeof(Buffer), "%s depth:%u dispatched:%llu wait_avg:%.3fms wait_max:%.3fms\n",
+                 event_lane_type_str[Index], Stats.Depth, Stats.Dispatched, WaitAverage, WaitMax);
+        WriteToSocket(Buffer, SockFD);
+    }
+}
+
+internal void
+WriteEventTypeStats(int SockFD)
+{
+    char Buffer[MAX_LEN];
+    for (int Index = 0; Index < ChunkWM_EventTypeCount; ++Index) {
+        event_type_stats Stats;
+        EventTypeStats((event_type) Index, &Stats);
+
+        histogram *Queue = Stats.QueueWait;
+        histogram *Handler = Stats.Handler;
+        if ((Handler->Count == 0) && (Stats.Coalesced == 0)) continue;
+
+        snprintf(Buffer, sizeof(Buffer),
+                 "%s count:%llu coalesced:%llu "
+                 "queue[p50:%.3f p90:%.3f p99:%.3f max:%.3f] "
+                 "handler[p50:%.3f p90:%.3f p99:%.3f max:%.3f]\n",
+                 event_type_str[Index], Handler->Count, Stats.Coalesced,
+                 NanosecondsToMilliseconds(HistogramPercentile(Queue, 50.0)),
+                 NanosecondsToMilliseconds(HistogramPercentile(Queue, 90.0)),
+                 NanosecondsToMilliseconds(HistogramPercentile(Queue, 99.0)),
+                 NanosecondsToMilliseconds(Queue->Max),
+                 NanosecondsToMilliseconds(HistogramPercentile(Handler, 50.0)),
+                 NanosecondsToMilliseconds(HistogramPercentile(Handler, 90.0)),
+                 NanosecondsToMilliseconds(HistogramPercentile(Handler, 99.0)),
+                 NanosecondsToMilliseconds(Handler->Max));
+        WriteToSocket(Buffer, SockFD);
+    }
+}
+
+internal bool
+SetPluginDeliveryFromMessage(const char **Message)
+{
+    token FilenameToken = GetToken(Message);
+    token ModeToken = GetToken(Message);
+
+    if (FilenameToken.Length == 0) {
+        c_log(C_LOG_LEVEL_WARN, "chunkwm: missing plugin for delivery mode\n");
+        return false;
+    } else if (TokenEquals(ModeToken, "async")) {
+        char *Filename = TokenToString(FilenameToken);
+        SetPluginDeliveryMode(Filename, true);
+        free(Filename);
+    } else if (TokenEquals(ModeToken, "sync")) {
+        char *Filename = TokenToString(FilenameToken);
+        SetPluginDeliveryMode(Filename, false);
+        free(Filename);
+    } else {
+        c_log(C_LOG_LEVEL_WARN, "chunkwm: invalid delivery mode '%.*s'\n", ModeToken.Length, ModeToken.Text);
+        return false;
+    }
+
+    return true;
+}
+
+void CallbackThreadPoolStats(thread_pool_stats *Stats);
+
+internal void
+WriteThreadPoolStats(int SockFD)
+{
+    char Buffer[MAX_LEN];
+    thread_pool_stats Stats;
+    CallbackThreadPoolStats(&Stats);
+
+    snprintf(Buffer, sizeof(Buffer),
+             "pool workers:%u submitted:%llu executed:%llu stolen:%llu inline:%llu "
+             "helped:%llu joins:%llu join_parks:%llu worker_parks:%llu\n",
+             Stats.WorkerCount, Stats.Submitted, Stats.Executed, Stats.Stolen, Stats.Inline,
+             Stats.Helped, Stats.Joins, Stats.JoinParks, Stats.WorkerParks);
+    WriteToSocket(Buffer, SockFD);
+}
+
+internal void
+WritePluginQueueStats(int SockFD)
+{
+    char Buffer[MAX_LEN];
+    plugin_queue_stats Stats[64];
+    int Count = PluginQueueStats(Stats, 64);
+
+    for (int Index = 0; Index < Count; ++Index) {
+        plugin_queue_stats *Entry = Stats + Index;
+        snprintf(Buffer, sizeof(Buffer),
+                 "%s depth:%u delivered:%llu lag[avg:%.3f p99:%.3f max:%.3f]\n",
+                 Entry->Filename, Entry->Depth, Entry->Delivered,
+                 NanosecondsToMilliseconds(Entry->LagAverage),
+                 NanosecondsToMilliseconds(Entry->LagP99),
+                 NanosecondsToMilliseconds(Entry->LagMax));
+        WriteToSocket(Buffer, SockFD);
+    }
+}
+
+internal void
+WriteEventSubscriptionStats(int SockFD)
+{
+    char Buffer[MAX_LEN];
+    char Topics[64];
+    event_subscription_stats Stats[64];
+    int Count = EventSubscriptionStats(Stats, 64);
+
+    for (int Index = 0; Index < Count; ++Index) {
+        event_subscription_stats *Entry = Stats + Index;
+        EventTopicsToString(Entry->Topics, Topics, sizeof(Topics));
+        snprintf(Buffer, sizeof(Buffer),
+                 "subscription topics:%s published:%llu dropped:%llu\n",
+                 Topics, Entry->Published, Entry->Dropped);
+        WriteToSocket(Buffer, SockFD);
+    }
+}
+
+internal bool
+HandleStats(chunkwm_delegate *Delegate)
+{
+    token Token = GetToken(&Delegate->Message);
+    if (TokenEquals(Token, "lanes")) {
+        WriteEventLaneStats(Delegate->SockFD);
+    } else if (TokenEquals(Token, "events")) {
+        WriteEventTypeStats(Delegate->SockFD);
+    } else if (TokenEquals(Token, "pool")) {
+        WriteThreadPoolStats(Delegate->SockFD);
+    } else if (TokenEquals(Token, "plugins")) {
+        WritePluginQueueStats(Delegate->SockFD);
+    } else if (TokenEquals(Token, "subscriptions")) {
+        WriteEventSubscriptionStats(Delegate->SockFD);
+    } else if (TokenEquals(Token, "reset")) {
+        ResetEventStats();
+    } else {
+        c_log(C_LOG_LEVEL_WARN, "chunkwm: invalid stats category '%.*s'\n", Token.Length, Token.Text);
+        return false;
+    }
+
+    return true;
+}
+
+extern CHUNKWM_CALLBACK(JournalChunkEvent);
+
+internal bool
+HandleJournal(chunkwm_delegate *Delegate)
+{
+    bool Result = false;
+    token Token = GetToken(&Delegate->Message);
+    if (TokenEquals(Token, "off")) {
+        SetEventJournalCallback(NULL);
+        EndEventJournal();
+        Result = true;
+    } else if (Token.Length > 0) {
+        char *Path = TokenToString(Token);
+        if (BeginEventJournal(Path)) {
+            SetEventJournalCallback(&JournalChunkEvent);
+            Result = true;
+        }
+        free(Path);
+    } else {
+        c_log(C_LOG_LEVEL_WARN, "chunkwm: missing path for event journal\n");
+    }
+    return Result;
+}
+
+/*
+ * NOTE(koekeishiya): Subscribes to the given topics, or all of them if none are given.
+ * The response socket is owned by the subscription if this succeeds.
+ */
+internal bool
+HandleSubscribe(chunkwm_delegate *Delegate)
+{
+    uint32_t Topics = 0;
+    for (token Token = GetToken(&Delegate->Message);
+         Token.Length > 0;
+         Token = GetToken(&Delegate->Message)) {
+        uint32_t Topic;
+        if (!ParseEventTopic(Token.Text, Token.Length, &Topic)) {
+            c_log(C_LOG_LEVEL_WARN, "chunkwm: invalid event topic '%.*s'\n", Token.Length, Token.Text);
+            return false;
+        }
+        Topics |= Topic;
+    }
+
+    return BeginEventSubscription(Delegate->SockFD, Topics ? Topics : EventTopic_All);
+}
+
 internal void
 HandleCore(chunkwm_delegate *Delegate)
 {
+    bool Success = true;
+    bool Deferred = false;
     if (StringEquals(Delegate->Command, CVAR_PLUGIN_DIR)) {
         token Token = GetToken(&Delegate->Message);
         char *Directory = TokenToString(Token);
@@ -156,6 +390,16 @@ HandleCore(chunkwm_delegate *Delegate)
         } else if (TokenEquals(Token, "profile")) {
             c_log_active_level = C_LOG_LEVEL_PROFILE;
         }
+    } else if (StringEquals(Delegate->Command, "event_lane")) {
+        Success = SetEventLaneFromMessage(&Delegate->Message);
+    } else if (StringEquals(Delegate->Command, "plugin_delivery")) {
+        Success = SetPluginDeliveryFromMessage(&Delegate->Message);
+    } else if (StringEquals(Delegate->Command, "stats")) {
+        Success = HandleStats(Delegate);
+    } else if (StringEquals(Delegate->Command, "journal")) {
+        Success = HandleJournal(Delegate);
+    } else if (StringEquals(Delegate->Command, "subscribe")) {
+        Success = Deferred = HandleSubscribe(Delegate);
     } else if (StringEquals(Delegate->Command, "load")) {
         plugin_fs *PluginFS = (plugin_fs *) malloc(sizeof(plugin_fs));
         if (PopulatePluginPath(&Delegate->Message, PluginFS)) {
@@ -167,27 +411,47 @@ HandleCore(chunkwm_delegate *Delegate)
                     free(PluginFS->Absolutepath);
                     PluginFS->Absolutepath = ResolvedPath;
                 }
+                PluginFS->SockFD = Delegate->SockFD;
                 ConstructEvent(ChunkWM_PluginLoad, PluginFS);
+                Deferred = true;
             } else {
                 c_log(C_LOG_LEVEL_WARN, "chunkwm: plugin '%s' not found..\n", PluginFS->Absolutepath);
                 DestroyPluginFS(PluginFS);
                 free(PluginFS);
+                Success = false;
             }
         } else {
             free(PluginFS);
+            Success = false;
         }
     } else if (StringEquals(Delegate->Command, "unload")) {
         plugin_fs *PluginFS = (plugin_fs *) malloc(sizeof(plugin_fs));
         if (PopulatePluginPath(&Delegate->Message, PluginFS)) {
+            PluginFS->SockFD = Delegate->SockFD;
             ConstructEvent(ChunkWM_PluginUnload, PluginFS);
+            Deferred = true;
         } else {
             free(PluginFS);
+            Success = false;
         }
     } else {
         c_log(C_LOG_LEVEL_WARN, "chunkwm: invalid command '%s::%s'\n", Delegate->Target, Delegate->Command);
+        Success = false;
+    }
+
+    if (!Success) {
+        FailDaemonRequest(Delegate->SockFD);
+    }
+
+    /*
+     * NOTE(koekeishiya): A subscription keeps its socket open, and a plugin load or unload
+     * completes the request once it has run, so that a pipelined client (chunkc --batch)
+     * does not send commands to a plugin that is not loaded yet.
+     */
+    if (!Deferred) {
+        CloseSocket(Delegate->SockFD);
     }
 
-    CloseSocket(Delegate->SockFD);
     free(Delegate->Target);
     free(Delegate->Command);
     free(Delegate);
@@ -200,7 +464,7 @@ ValidToken(token *Token)
     return Result;
 }
 
-internal void
+internal bool
 SetCVar(const char **Message)
 {
     token NameToken = GetToken(Message);
@@ -212,45 +476,61 @@ SetCVar(const char **Message)
             UpdateCVar(Name, Value);
             free(Name);
             free(Value);
+            return true;
         } else {
             c_log(C_LOG_LEVEL_WARN, "chunkwm: missing value for cvar '%.*s'.\n", NameToken.Length, NameToken.Length);
         }
     } else {
         c_log(C_LOG_LEVEL_WARN, "chunkwm: missing cvar name.\n");
     }
+    return false;
 }
 
-internal void
+internal bool
 GetCVar(const char **Message, int SockFD)
 {
+    bool Result = false;
     token NameToken = GetToken(Message);
     if (ValidToken(&NameToken)) {
         char *Name = TokenToString(NameToken);
-        char *Value = CVarStringValue(Name);
+        char *Value = CVarStringDuplicate(Name);
         if (Value) {
             WriteToSocket(Value, SockFD);
+            free(Value);
+            Result = true;
         }
         free(Name);
     } else {
         c_log(C_LOG_LEVEL_WARN, "chunkwm: missing cvar name.\n");
     }
+    return Result;
 }
 
 internal void
 HandleCVar(chunkwm_delegate *Delegate, const char **Message)
 {
+    bool Success = false;
     token Type = GetToken(Message);
     if (TokenEquals(Type, "set")) {
-        SetCVar(Message);
+        Success = SetCVar(Message);
     } else if (TokenEquals(Type, "get")) {
-        GetCVar(Message, Delegate->SockFD);
+        Success = GetCVar(Message, Delegate->SockFD);
     } else {
         c_log(C_LOG_LEVEL_WARN, "chunkwm: invalid command '%.*s %s'\n", Type.Length, Type.Text, *Message);
     }
+
+    if (!Success) {
+        FailDaemonRequest(Delegate->SockFD);
+    }
+
     CloseSocket(Delegate->SockFD);
     free(Delegate);
 }
 
+/*
+ * NOTE(koekeishiya): Runs on the daemon thread, which only parses the request and hands it off
+ * to the event-loop, so that a slow command can not stall other clients.
+ */
 DAEMON_CALLBACK(DaemonCallback)
 {
     chunkwm_delegate *Delegate = (chunkwm_delegate *) malloc(sizeof(chunkwm_delegate));
@@ -259,11 +539,29 @@ DAEMON_CALLBACK(DaemonCallback)
 
     if (ChunkwmDaemonDelegate(Message, Delegate)) {
         if (StringEquals(Delegate->Target, "core")) {
-            HandleCore(Delegate);
+            ConstructEvent(ChunkWM_DaemonCommand, Delegate);
         } else {
             ConstructEvent(ChunkWM_PluginCommand, Delegate);
         }
     } else {
-        HandleCVar(Delegate, &Message);
+        Delegate->Message = strdup(Message);
+        ConstructEvent(ChunkWM_DaemonCommand, Delegate);
+    }
+}
+
+CHUNKWM_CALLBACK(Callback_ChunkWM_DaemonCommand)
+{
+    chunkwm_delegate *Delegate = (chunkwm_delegate *) Event->Context;
+    char *Message = (char *) Delegate->Message;
+
+    BeginCVarBatch();
+    if (Delegate->Target) {
+        HandleCore(Delegate);
+    } else {
+        const char *Cursor = Message;
+        HandleCVar(Delegate, &Cursor);
     }
+    EndCVarBatch();
+
+    free(Message);
 }
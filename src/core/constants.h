@@ -10,7 +10,7 @@
 #define CHUNKWM_THREAD_COUNT    4
 
 #define CHUNKWM_CONFIG          ".chunkwmrc"
-#define CHUNKWM_PORT            3920
+#define SOCKET_PATH_FMT         "/tmp/chunkwm_%s-socket"
 
 #define CVAR_PLUGIN_DIR         "plugin_dir"
 #define CVAR_PLUGIN_HOTLOAD     "hotload"
@@ -1,7 +1,10 @@
 #include "cvar.h"
 
 #include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
 #include <pthread.h>
+#include <sched.h>
 
 #include "../common/misc/assert.h"
 
@@ -9,36 +12,325 @@
 
 extern chunkwm_api API;
 
-internal cvar_map CVars;
+/*
+ * NOTE(koekeishiya): Readers never lock. The map of cvars is immutable and replaced as a whole
+ * when a cvar is created, and the value of a cvar is replaced by swapping its pointer; writers
+ * are serialized by CVarsLock. A reader counts itself in the reader slot of the current epoch
+ * while it dereferences the map or a value. Replaced maps and values are retired, and freed
+ * once both reader slots have drained after the epoch has been advanced past them.
+ */
+#define CVAR_RECLAIM_THRESHOLD 64
+
+internal cvar_map *volatile CVars;
 internal pthread_mutex_t CVarsLock;
 
+internal uint32_t volatile CVarEpoch;
+internal uint32_t volatile CVarReaders[2];
+internal std::vector<char *> RetiredCVarValues;
+internal std::vector<cvar_map *> RetiredCVarMaps;
+
+/*
+ * NOTE(koekeishiya): 'Pending' counts the notifications that are about to call, or are calling,
+ * the watcher. A watcher that is removed while notifications are pending is freed by the thread
+ * that removed it once they have finished, or by the last of them if nobody waits for it.
+ */
+struct cvar_watcher
+{
+    char *Name;
+    cvar_watch_func *Callback;
+    void *Context;
+    uint32_t Flags;
+    unsigned Pending;
+    unsigned Waiters;
+    bool Removed;
+};
+
+struct cvar_notification
+{
+    cvar_watcher *Watcher;
+    size_t First;
+    unsigned Count;
+};
+
+internal std::vector<cvar_watcher *> CVarWatchers;
+internal pthread_mutex_t CVarWatchLock = PTHREAD_MUTEX_INITIALIZER;
+internal pthread_cond_t CVarNotifyDone = PTHREAD_COND_INITIALIZER;
+internal uint32_t volatile CVarWatcherCount;
+
+internal __thread unsigned CVarNotifyDepth;
+internal __thread unsigned CVarBatchDepth;
+internal __thread std::vector<cvar_change> *CVarBatchChanges;
+
+internal inline unsigned
+BeginCVarRead()
+{
+    unsigned Slot = __atomic_load_n(&CVarEpoch, __ATOMIC_ACQUIRE) & 1;
+    __atomic_add_fetch(&CVarReaders[Slot], 1, __ATOMIC_SEQ_CST);
+    return Slot;
+}
+
+internal inline void
+EndCVarRead(unsigned Slot)
+{
+    __atomic_sub_fetch(&CVarReaders[Slot], 1, __ATOMIC_RELEASE);
+}
+
+// NOTE(koekeishiya): Caller must either hold CVarsLock or be inside a read.
 internal cvar *
 _FindCVar(const char *Name)
 {
-    cvar_map_it It = CVars.find(Name);
-    return It != CVars.end() ? It->second : NULL;
+    cvar_map *Map = __atomic_load_n(&CVars, __ATOMIC_SEQ_CST);
+    cvar_map_it It = Map->find(Name);
+    return It != Map->end() ? It->second : NULL;
+}
+
+internal inline char *
+_CVarValue(cvar *Var)
+{
+    return __atomic_load_n(&Var->Value, __ATOMIC_SEQ_CST);
+}
+
+/*
+ * NOTE(koekeishiya): A reader that entered before something was retired is counted in one of
+ * the two slots. Advancing the epoch makes new readers use the other slot, so each slot drains
+ * in turn, even if readers keep arriving.
+ */
+internal void
+WaitForCVarReaders()
+{
+    for (int Pass = 0; Pass < 2; ++Pass) {
+        uint32_t Epoch = __atomic_fetch_add(&CVarEpoch, 1, __ATOMIC_SEQ_CST);
+        while (__atomic_load_n(&CVarReaders[Epoch & 1], __ATOMIC_SEQ_CST) != 0) {
+            sched_yield();
+        }
+    }
+}
+
+// NOTE(koekeishiya): Caller must hold CVarsLock.
+internal void
+ReclaimCVarsLocked(bool Force)
+{
+    size_t Count = RetiredCVarValues.size() + RetiredCVarMaps.size();
+    if ((Count == 0) || (!Force && (Count < CVAR_RECLAIM_THRESHOLD))) return;
+
+    WaitForCVarReaders();
+
+    for (size_t Index = 0; Index < RetiredCVarValues.size(); ++Index) {
+        free(RetiredCVarValues[Index]);
+    }
+
+    for (size_t Index = 0; Index < RetiredCVarMaps.size(); ++Index) {
+        delete RetiredCVarMaps[Index];
+    }
+
+    RetiredCVarValues.clear();
+    RetiredCVarMaps.clear();
+}
+
+/*
+ * NOTE(koekeishiya): Parses the string value of a cvar into its typed handle, using the same
+ * formats as the string readers in 'common/config/cvar.cpp'. Caller must hold CVarsLock.
+ */
+internal void
+_UpdateCVarHandle(cvar *Var)
+{
+    cvar_handle *Handle = &Var->Handle;
+
+    int Integer = 0;
+    unsigned Unsigned = 0;
+    float FloatingPoint = 0.0f;
+
+    sscanf(Var->Value, "%d", &Integer);
+    sscanf(Var->Value, "%x", &Unsigned);
+    sscanf(Var->Value, "%f", &FloatingPoint);
+
+    uint32_t Version = __atomic_load_n(&Handle->Version, __ATOMIC_RELAXED);
+    __atomic_store_n(&Handle->Version, Version + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    __atomic_store_n(&Handle->Integer, Integer, __ATOMIC_RELAXED);
+    __atomic_store_n(&Handle->Unsigned, Unsigned, __ATOMIC_RELAXED);
+    __atomic_store(&Handle->FloatingPoint, &FloatingPoint, __ATOMIC_RELAXED);
+    __atomic_store_n(&Handle->String, Var->Value, __ATOMIC_RELAXED);
+
+    __atomic_store_n(&Handle->Version, Version + 2, __ATOMIC_RELEASE);
 }
 
 internal cvar *
 _CreateCVar(const char *Name, char *Value)
 {
     cvar *Var = (cvar *) malloc(sizeof(cvar));
+    memset(Var, 0, sizeof(cvar));
 
     Var->Name = strdup(Name);
     Var->Value = strdup(Value);
+    _UpdateCVarHandle(Var);
 
     return Var;
 }
 
+internal inline bool
+CVarsAreWatched()
+{
+    return __atomic_load_n(&CVarWatcherCount, __ATOMIC_ACQUIRE) != 0;
+}
+
+internal inline bool
+CVarWatcherMatches(cvar_watcher *Watcher, const char *Name)
+{
+    return !Watcher->Name || (strcmp(Watcher->Name, Name) == 0);
+}
+
+internal inline bool
+CVarWatcherEquals(cvar_watcher *Watcher, const char *Name, cvar_watch_func *Callback, void *Context)
+{
+    if ((Watcher->Callback != Callback) || (Watcher->Context != Context)) return false;
+    if (!Name || !Watcher->Name) return Name == Watcher->Name;
+    return strcmp(Watcher->Name, Name) == 0;
+}
+
+internal void
+FreeCVarWatcher(cvar_watcher *Watcher)
+{
+    free(Watcher->Name);
+    free(Watcher);
+}
+
+internal void
+FreeCVarChange(cvar_change *Change)
+{
+    free((char *) Change->Name);
+    free((char *) Change->OldValue);
+    free((char *) Change->NewValue);
+}
+
+/*
+ * NOTE(koekeishiya): The changes that a watcher should see are collected while holding
+ * CVarWatchLock, and the watchers are called after it is released, so that a watcher is free
+ * to read or update cvars. A watcher that updates cvars will be notified recursively.
+ */
+internal void
+NotifyCVarWatchers(cvar_change *Changes, unsigned Count, bool Batched)
+{
+    std::vector<cvar_notification> Notifications;
+    std::vector<cvar_change> Matches;
+
+    pthread_mutex_lock(&CVarWatchLock);
+    for (size_t WatcherIndex = 0; WatcherIndex < CVarWatchers.size(); ++WatcherIndex) {
+        cvar_watcher *Watcher = CVarWatchers[WatcherIndex];
+        if (((Watcher->Flags & CVar_Watch_Batched) != 0) != Batched) continue;
+
+        cvar_notification Notification = { Watcher, Matches.size(), 0 };
+        for (unsigned Index = 0; Index < Count; ++Index) {
+            if (CVarWatcherMatches(Watcher, Changes[Index].Name)) {
+                Matches.push_back(Changes[Index]);
+                ++Notification.Count;
+            }
+        }
+
+        if (Notification.Count) {
+            ++Watcher->Pending;
+            Notifications.push_back(Notification);
+        }
+    }
+    pthread_mutex_unlock(&CVarWatchLock);
+
+    if (Notifications.empty()) return;
+
+    ++CVarNotifyDepth;
+    for (size_t Index = 0; Index < Notifications.size(); ++Index) {
+        cvar_notification *Notification = &Notifications[Index];
+        cvar_watcher *Watcher = Notification->Watcher;
+        Watcher->Callback(&Matches[Notification->First], Notification->Count, Watcher->Context);
+    }
+    --CVarNotifyDepth;
+
+    bool Wake = false;
+    pthread_mutex_lock(&CVarWatchLock);
+    for (size_t Index = 0; Index < Notifications.size(); ++Index) {
+        cvar_watcher *Watcher = Notifications[Index].Watcher;
+        if ((--Watcher->Pending == 0) && (Watcher->Removed)) {
+            if (Watcher->Waiters) {
+                Wake = true;
+            } else {
+                FreeCVarWatcher(Watcher);
+            }
+        }
+    }
+    if (Wake) {
+        pthread_cond_broadcast(&CVarNotifyDone);
+    }
+    pthread_mutex_unlock(&CVarWatchLock);
+}
+
+/*
+ * NOTE(koekeishiya): Takes ownership of the strings in 'Change'. Inside a batch, repeated
+ * changes of the same cvar are merged, keeping the first old value and the last new value.
+ */
+internal void
+PublishCVarChange(cvar_change *Change)
+{
+    NotifyCVarWatchers(Change, 1, false);
+
+    if (CVarBatchDepth == 0) {
+        NotifyCVarWatchers(Change, 1, true);
+        FreeCVarChange(Change);
+        return;
+    }
+
+    if (!CVarBatchChanges) {
+        CVarBatchChanges = new std::vector<cvar_change>;
+    }
+
+    for (size_t Index = 0; Index < CVarBatchChanges->size(); ++Index) {
+        cvar_change *Pending = &(*CVarBatchChanges)[Index];
+        if (strcmp(Pending->Name, Change->Name) == 0) {
+            free((char *) Pending->NewValue);
+            Pending->NewValue = Change->NewValue;
+            free((char *) Change->Name);
+            free((char *) Change->OldValue);
+            return;
+        }
+    }
+
+    CVarBatchChanges->push_back(*Change);
+}
+
+void BeginCVarBatch()
+{
+    ++CVarBatchDepth;
+}
+
+void EndCVarBatch()
+{
+    ASSERT(CVarBatchDepth > 0);
+    if (--CVarBatchDepth > 0) return;
+
+    std::vector<cvar_change> *Changes = CVarBatchChanges;
+    if (!Changes) return;
+
+    CVarBatchChanges = NULL;
+    NotifyCVarWatchers(&(*Changes)[0], Changes->size(), true);
+
+    for (size_t Index = 0; Index < Changes->size(); ++Index) {
+        FreeCVarChange(&(*Changes)[Index]);
+    }
+    delete Changes;
+}
+
 bool BeginCVars()
 {
     BeginCVars(&API);
+    CVars = new cvar_map;
     return pthread_mutex_init(&CVarsLock, NULL) == 0;
 }
 
 void EndCVars()
 {
-    for (cvar_map_it It = CVars.begin(); It != CVars.end(); ++It) {
+    pthread_mutex_lock(&CVarsLock);
+    ReclaimCVarsLocked(true);
+
+    for (cvar_map_it It = CVars->begin(); It != CVars->end(); ++It) {
         cvar *Var = It->second;
 
         free((char *) Var->Name);
@@ -46,41 +338,217 @@ void EndCVars()
         free(Var);
     }
 
-    CVars.clear();
+    delete CVars;
+    CVars = NULL;
+    pthread_mutex_unlock(&CVarsLock);
     pthread_mutex_destroy(&CVarsLock);
+
+    pthread_mutex_lock(&CVarWatchLock);
+    for (size_t Index = 0; Index < CVarWatchers.size(); ++Index) {
+        FreeCVarWatcher(CVarWatchers[Index]);
+    }
+    CVarWatchers.clear();
+    __atomic_store_n(&CVarWatcherCount, 0, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&CVarWatchLock);
 }
 
 // NOTE(koekeishiya): API - Exposed to plugins through pointer
 void UpdateCVarAPI(const char *Name, char *Value)
 {
+    cvar_change Change = {};
+    bool Watched = CVarsAreWatched();
+
     pthread_mutex_lock(&CVarsLock);
     cvar *Var = _FindCVar(Name);
     if (Var) {
-        ASSERT(Var->Value);
-        free(Var->Value);
-        Var->Value = strdup(Value);
+        char *OldValue = Var->Value;
+        ASSERT(OldValue);
+        if (Watched && (strcmp(OldValue, Value) != 0)) {
+            Change.Name = strdup(Name);
+            Change.OldValue = strdup(OldValue);
+            Change.NewValue = strdup(Value);
+        }
+        __atomic_store_n(&Var->Value, strdup(Value), __ATOMIC_SEQ_CST);
+        _UpdateCVarHandle(Var);
+
+        // NOTE(koekeishiya): AcquireCVarAPI may have returned the old value, see below.
+        if (!__atomic_load_n(&Var->Acquired, __ATOMIC_SEQ_CST)) {
+            RetiredCVarValues.push_back(OldValue);
+        }
     } else {
         cvar *Var = _CreateCVar(Name, Value);
-        CVars[Var->Name] = Var;
+        cvar_map *OldMap = CVars;
+        cvar_map *NewMap = new cvar_map(*OldMap);
+        (*NewMap)[Var->Name] = Var;
+        __atomic_store_n(&CVars, NewMap, __ATOMIC_SEQ_CST);
+        RetiredCVarMaps.push_back(OldMap);
+        if (Watched) {
+            Change.Name = strdup(Name);
+            Change.NewValue = strdup(Value);
+        }
     }
+    ReclaimCVarsLocked(false);
     pthread_mutex_unlock(&CVarsLock);
+
+    if (Change.Name) {
+        PublishCVarChange(&Change);
+    }
 }
 
-// NOTE(koekeishiya): API - Exposed to plugins through pointer
+/*
+ * NOTE(koekeishiya): API - Exposed to plugins through pointer
+ * Plugins keep the returned string without telling us when they are done with it, so a value
+ * that may have been returned is never freed. The cvar is flagged before its value is loaded,
+ * and UpdateCVarAPI checks the flag after it has replaced the value; either the update sees
+ * the flag and keeps the old value, or we load the new value. Only the values of cvars that
+ * have been read through AcquireCVar are kept; use CopyCVarAPI to avoid that.
+ */
 char *AcquireCVarAPI(const char *Name)
 {
-    pthread_mutex_lock(&CVarsLock);
+    unsigned Slot = BeginCVarRead();
     cvar *CVar = _FindCVar(Name);
-    char *Result = CVar ? CVar->Value : NULL;
-    pthread_mutex_unlock(&CVarsLock);
+    char *Result = NULL;
+    if (CVar) {
+        __atomic_store_n(&CVar->Acquired, true, __ATOMIC_SEQ_CST);
+        Result = _CVarValue(CVar);
+    }
+    EndCVarRead(Slot);
+    return Result;
+}
+
+// NOTE(koekeishiya): Caller must be inside a read, so that 'Value' is not reclaimed while we copy it.
+internal int
+_CopyCVarValue(char *Value, char *Buffer, size_t Size)
+{
+    size_t Length = strlen(Value);
+    if (Size) {
+        size_t Count = Length < Size - 1 ? Length : Size - 1;
+        memcpy(Buffer, Value, Count);
+        Buffer[Count] = '\0';
+    }
+    return (int) Length;
+}
+
+/*
+ * NOTE(koekeishiya): API - Exposed to plugins through pointer
+ * Copies at most Size - 1 characters of the value into Buffer and always terminates it.
+ * Returns the full length of the value, or -1 if the cvar does not exist.
+ */
+int CopyCVarAPI(const char *Name, char *Buffer, size_t Size)
+{
+    int Result = -1;
+    if (Size) Buffer[0] = '\0';
+
+    unsigned Slot = BeginCVarRead();
+    cvar *CVar = _FindCVar(Name);
+    if (CVar) {
+        Result = _CopyCVarValue(_CVarValue(CVar), Buffer, Size);
+    }
+    EndCVarRead(Slot);
+
+    return Result;
+}
+
+/*
+ * NOTE(koekeishiya): API - Exposed to plugins through pointer
+ * The string of a handle is loaded and copied inside a read, like the value in CopyCVarAPI.
+ */
+int CopyCVarHandleAPI(cvar_handle *Handle, char *Buffer, size_t Size)
+{
+    if (Size) Buffer[0] = '\0';
+    if (!Handle) return -1;
+
+    unsigned Slot = BeginCVarRead();
+    int Result = _CopyCVarValue(__atomic_load_n(&Handle->String, __ATOMIC_ACQUIRE), Buffer, Size);
+    EndCVarRead(Slot);
+
     return Result;
 }
 
 // NOTE(koekeishiya): API - Exposed to plugins through pointer
 bool FindCVarAPI(const char *Name)
 {
-    pthread_mutex_lock(&CVarsLock);
+    unsigned Slot = BeginCVarRead();
     cvar *CVar = _FindCVar(Name);
-    pthread_mutex_unlock(&CVarsLock);
+    EndCVarRead(Slot);
     return CVar != NULL;
 }
+
+// NOTE(koekeishiya): API - Exposed to plugins through pointer
+cvar_handle *AcquireCVarHandleAPI(const char *Name)
+{
+    unsigned Slot = BeginCVarRead();
+    cvar *CVar = _FindCVar(Name);
+    cvar_handle *Result = CVar ? &CVar->Handle : NULL;
+    EndCVarRead(Slot);
+    return Result;
+}
+
+// NOTE(koekeishiya): API - Exposed to plugins through pointer
+bool WatchCVarAPI(const char *Name, cvar_watch_func *Callback, void *Context, uint32_t Flags)
+{
+    if (!Callback) return false;
+
+    bool Result = true;
+    pthread_mutex_lock(&CVarWatchLock);
+    for (size_t Index = 0; Index < CVarWatchers.size(); ++Index) {
+        cvar_watcher *Watcher = CVarWatchers[Index];
+        if (CVarWatcherEquals(Watcher, Name, Callback, Context)) {
+            Result = false;
+            goto out;
+        }
+    }
+
+    {
+        cvar_watcher *Watcher = (cvar_watcher *) calloc(1, sizeof(cvar_watcher));
+        Watcher->Name = Name ? strdup(Name) : NULL;
+        Watcher->Callback = Callback;
+        Watcher->Context = Context;
+        Watcher->Flags = Flags;
+        CVarWatchers.push_back(Watcher);
+        __atomic_add_fetch(&CVarWatcherCount, 1, __ATOMIC_RELEASE);
+    }
+
+out:
+    pthread_mutex_unlock(&CVarWatchLock);
+    return Result;
+}
+
+/*
+ * NOTE(koekeishiya): Waits for notifications of this watcher that are in flight on other threads,
+ * so that a plugin may be unloaded as soon as it has removed its watchers; notifications of other
+ * watchers are not waited for. When called from inside a watcher we cannot wait, because the
+ * notification that we are part of may be calling this watcher, and would never finish.
+ */
+void UnwatchCVarAPI(const char *Name, cvar_watch_func *Callback, void *Context)
+{
+    cvar_watcher *Watcher = NULL;
+
+    pthread_mutex_lock(&CVarWatchLock);
+    for (size_t Index = 0; Index < CVarWatchers.size(); ++Index) {
+        if (CVarWatcherEquals(CVarWatchers[Index], Name, Callback, Context)) {
+            Watcher = CVarWatchers[Index];
+            CVarWatchers.erase(CVarWatchers.begin() + Index);
+            __atomic_sub_fetch(&CVarWatcherCount, 1, __ATOMIC_RELEASE);
+            break;
+        }
+    }
+
+    if (!Watcher) goto out;
+
+    Watcher->Removed = true;
+    if ((Watcher->Pending != 0) && (CVarNotifyDepth == 0)) {
+        ++Watcher->Waiters;
+        while (Watcher->Pending != 0) {
+            pthread_cond_wait(&CVarNotifyDone, &CVarWatchLock);
+        }
+        --Watcher->Waiters;
+    }
+
+    if (Watcher->Pending == 0) {
+        FreeCVarWatcher(Watcher);
+    }
+
+out:
+    pthread_mutex_unlock(&CVarWatchLock);
+}
@@ -2,6 +2,7 @@
 #define CHUNKWM_CORE_CVAR_H
 
 #include <map>
+#include <vector>
 
 #include "../common/config/cvar.h"
 #include "../common/misc/string.h"
@@ -18,7 +19,29 @@ void UpdateCVarAPI(const char *Name, char *Value);
 // NOTE(koekeishiya): API - Exposed to plugins through pointer
 char *AcquireCVarAPI(const char *Name);
 
+// NOTE(koekeishiya): API - Exposed to plugins through pointer
+int CopyCVarAPI(const char *Name, char *Buffer, size_t Size);
+
+// NOTE(koekeishiya): API - Exposed to plugins through pointer
+int CopyCVarHandleAPI(cvar_handle *Handle, char *Buffer, size_t Size);
+
 // NOTE(koekeishiya): API - Exposed to plugins through pointer
 bool FindCVarAPI(const char *Name);
 
+// NOTE(koekeishiya): API - Exposed to plugins through pointer
+cvar_handle *AcquireCVarHandleAPI(const char *Name);
+
+// NOTE(koekeishiya): API - Exposed to plugins through pointer
+bool WatchCVarAPI(const char *Name, cvar_watch_func *Callback, void *Context, uint32_t Flags);
+
+// NOTE(koekeishiya): API - Exposed to plugins through pointer
+void UnwatchCVarAPI(const char *Name, cvar_watch_func *Callback, void *Context);
+
+/*
+ * NOTE(koekeishiya): Changes made by the calling thread between these calls are delivered
+ * to batched watchers once, when the outermost batch ends. Batches nest.
+ */
+void BeginCVarBatch();
+void EndCVarBatch();
+
 #endif
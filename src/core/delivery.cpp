@@ -0,0 +1,259 @@
+#include "delivery.h"
+#include "cvar.h"
+#include "clog.h"
+
+#include "../common/misc/string.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <map>
+
+#define internal static
+
+internal std::map<const char *, bool, string_comparator> DeliveryModes;
+internal pthread_mutex_t DeliveryModeLock = PTHREAD_MUTEX_INITIALIZER;
+
+internal std::map<plugin *, plugin_queue *> PluginQueues;
+internal pthread_mutex_t PluginQueueLock = PTHREAD_MUTEX_INITIALIZER;
+internal uint32_t volatile PluginQueueCount;
+
+internal inline uint64_t
+GetDeliveryTime()
+{
+    struct timespec Time;
+    clock_gettime(CLOCK_MONOTONIC, &Time);
+    return (uint64_t) Time.tv_sec * 1000000000ULL + Time.tv_nsec;
+}
+
+/*
+ * NOTE(koekeishiya): The delivery mode is looked up when a plugin is loaded,
+ * so changing it only affects plugins that are loaded afterwards.
+ */
+void SetPluginDeliveryMode(const char *Filename, bool Async)
+{
+    pthread_mutex_lock(&DeliveryModeLock);
+    std::map<const char *, bool, string_comparator>::iterator It = DeliveryModes.find(Filename);
+    if (It != DeliveryModes.end()) {
+        It->second = Async;
+    } else {
+        DeliveryModes[strdup(Filename)] = Async;
+    }
+    pthread_mutex_unlock(&DeliveryModeLock);
+}
+
+bool PluginDeliveryIsAsync(const char *Filename)
+{
+    pthread_mutex_lock(&DeliveryModeLock);
+    std::map<const char *, bool, string_comparator>::iterator It = DeliveryModes.find(Filename);
+    bool Result = (It != DeliveryModes.end()) && It->second;
+    pthread_mutex_unlock(&DeliveryModeLock);
+    return Result;
+}
+
+plugin_payload *BeginPluginPayload(void *Data, void *Context, plugin_payload_release *Release)
+{
+    plugin_payload *Payload = (plugin_payload *) malloc(sizeof(plugin_payload));
+    Payload->RefCount = 1;
+    Payload->Data = Data;
+    Payload->Context = Context;
+    Payload->Release = Release;
+    return Payload;
+}
+
+void EndPluginPayload(plugin_payload *Payload)
+{
+    if (__atomic_sub_fetch(&Payload->RefCount, 1, __ATOMIC_ACQ_REL) == 0) {
+        if (Payload->Release) {
+            Payload->Release(Payload->Context);
+        }
+        free(Payload);
+    }
+}
+
+internal void *
+PluginQueueThreadProc(void *Data)
+{
+    plugin_queue *Queue = (plugin_queue *) Data;
+
+    for (;;) {
+        pthread_mutex_lock(&Queue->Lock);
+        while (Queue->Running && Queue->Deliveries.empty()) {
+            pthread_cond_wait(&Queue->Ready, &Queue->Lock);
+        }
+
+        // NOTE(koekeishiya): Deliveries that were queued before the queue was stopped are still processed.
+        if (Queue->Deliveries.empty()) {
+            pthread_mutex_unlock(&Queue->Lock);
+            break;
+        }
+
+        plugin_delivery Delivery = Queue->Deliveries.front();
+        bool IsBarrier = !Delivery.Handler && !Delivery.Export;
+        Queue->Deliveries.pop();
+        if (!IsBarrier) {
+            HistogramRecord(&Queue->Lag, GetDeliveryTime() - Delivery.Timestamp);
+        }
+        pthread_mutex_unlock(&Queue->Lock);
+
+        BeginCVarBatch();
+        if (Delivery.Handler) {
+            Delivery.Handler(Delivery.Payload->Data);
+        } else if (Delivery.Export) {
+            Queue->Plugin->Run(Delivery.Export, Delivery.Payload->Data);
+        }
+        EndCVarBatch();
+
+        if (!IsBarrier) {
+            __atomic_add_fetch(&Queue->Delivered, 1, __ATOMIC_RELAXED);
+        }
+
+        EndPluginPayload(Delivery.Payload);
+        __atomic_sub_fetch(&Queue->Depth, 1, __ATOMIC_RELAXED);
+    }
+
+    return NULL;
+}
+
+void EnqueuePluginDelivery(plugin_queue *Queue, const char *Export, plugin_event_func *Handler, plugin_payload *Payload)
+{
+    __atomic_add_fetch(&Payload->RefCount, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&Queue->Depth, 1, __ATOMIC_RELAXED);
+
+    plugin_delivery Delivery = { Export, Handler, Payload, GetDeliveryTime() };
+    pthread_mutex_lock(&Queue->Lock);
+    Queue->Deliveries.push(Delivery);
+    pthread_cond_signal(&Queue->Ready);
+    pthread_mutex_unlock(&Queue->Lock);
+}
+
+/*
+ * NOTE(koekeishiya): A queue may still hold deliveries that reference a window or application
+ * that is about to be destroyed, even if the plugin did not subscribe to the destroying event.
+ * Every queue receives a barrier, so that the payload is released after all of them have caught up.
+ */
+void EnqueuePluginBarrier(plugin_payload *Payload)
+{
+    pthread_mutex_lock(&PluginQueueLock);
+    for (std::map<plugin *, plugin_queue *>::iterator It = PluginQueues.begin();
+         It != PluginQueues.end();
+         ++It) {
+        EnqueuePluginDelivery(It->second, NULL, NULL, Payload);
+    }
+    pthread_mutex_unlock(&PluginQueueLock);
+}
+
+bool BeginPluginQueue(plugin *Plugin, const char *Filename)
+{
+    plugin_queue *Queue = new plugin_queue;
+    Queue->Plugin = Plugin;
+    Queue->Filename = strdup(Filename);
+    Queue->Running = true;
+    Queue->Depth = 0;
+    Queue->Delivered = 0;
+    HistogramReset(&Queue->Lag);
+
+    if (pthread_mutex_init(&Queue->Lock, NULL) != 0) {
+        goto lock_err;
+    }
+
+    if (pthread_cond_init(&Queue->Ready, NULL) != 0) {
+        goto cond_err;
+    }
+
+    if (pthread_create(&Queue->Thread, NULL, &PluginQueueThreadProc, Queue) != 0) {
+        goto thread_err;
+    }
+
+    pthread_mutex_lock(&PluginQueueLock);
+    PluginQueues[Plugin] = Queue;
+    __atomic_add_fetch(&PluginQueueCount, 1, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&PluginQueueLock);
+
+    c_log(C_LOG_LEVEL_DEBUG, "chunkwm: plugin '%s' uses asynchronous delivery\n", Filename);
+    return true;
+
+thread_err:
+    pthread_cond_destroy(&Queue->Ready);
+
+cond_err:
+    pthread_mutex_destroy(&Queue->Lock);
+
+lock_err:
+    c_log(C_LOG_LEVEL_WARN, "chunkwm: could not create delivery queue for plugin '%s'\n", Filename);
+    free(Queue->Filename);
+    delete Queue;
+    return false;
+}
+
+// NOTE(koekeishiya): Blocks until the plugin has processed every delivery that is already queued.
+void EndPluginQueue(plugin *Plugin)
+{
+    pthread_mutex_lock(&PluginQueueLock);
+    std::map<plugin *, plugin_queue *>::iterator It = PluginQueues.find(Plugin);
+    if (It == PluginQueues.end()) {
+        pthread_mutex_unlock(&PluginQueueLock);
+        return;
+    }
+
+    plugin_queue *Queue = It->second;
+    PluginQueues.erase(It);
+    __atomic_sub_fetch(&PluginQueueCount, 1, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&PluginQueueLock);
+
+    pthread_mutex_lock(&Queue->Lock);
+    Queue->Running = false;
+    pthread_cond_signal(&Queue->Ready);
+    pthread_mutex_unlock(&Queue->Lock);
+
+    pthread_join(Queue->Thread, NULL);
+    pthread_cond_destroy(&Queue->Ready);
+    pthread_mutex_destroy(&Queue->Lock);
+    free(Queue->Filename);
+    delete Queue;
+}
+
+plugin_queue *GetPluginQueue(plugin *Plugin)
+{
+    if (!HasPluginQueues()) {
+        return NULL;
+    }
+
+    pthread_mutex_lock(&PluginQueueLock);
+    std::map<plugin *, plugin_queue *>::iterator It = PluginQueues.find(Plugin);
+    plugin_queue *Result = It != PluginQueues.end() ? It->second : NULL;
+    pthread_mutex_unlock(&PluginQueueLock);
+    return Result;
+}
+
+bool HasPluginQueues()
+{
+    return __atomic_load_n(&PluginQueueCount, __ATOMIC_ACQUIRE) != 0;
+}
+
+int PluginQueueStats(plugin_queue_stats *Stats, int MaxCount)
+{
+    int Count = 0;
+
+    pthread_mutex_lock(&PluginQueueLock);
+    for (std::map<plugin *, plugin_queue *>::iterator It = PluginQueues.begin();
+         It != PluginQueues.end() && Count < MaxCount;
+         ++It) {
+        plugin_queue *Queue = It->second;
+        plugin_queue_stats *Entry = Stats + Count++;
+
+        snprintf(Entry->Filename, sizeof(Entry->Filename), "%s", Queue->Filename);
+        Entry->Depth = __atomic_load_n(&Queue->Depth, __ATOMIC_RELAXED);
+        Entry->Delivered = __atomic_load_n(&Queue->Delivered, __ATOMIC_RELAXED);
+
+        pthread_mutex_lock(&Queue->Lock);
+        Entry->LagAverage = Queue->Lag.Count ? Queue->Lag.Total / Queue->Lag.Count : 0;
+        Entry->LagP99 = HistogramPercentile(&Queue->Lag, 99.0);
+        Entry->LagMax = Queue->Lag.Max;
+        pthread_mutex_unlock(&Queue->Lock);
+    }
+    pthread_mutex_unlock(&PluginQueueLock);
+
+    return Count;
+}
@@ -0,0 +1,86 @@
+#ifndef CHUNKWM_CORE_DELIVERY_H
+#define CHUNKWM_CORE_DELIVERY_H
+
+#include "../api/plugin_api.h"
+#include "histogram.h"
+
+#include <stdint.h>
+#include <pthread.h>
+#include <queue>
+
+#define PLUGIN_PAYLOAD_RELEASE(name) void name(void *Context)
+typedef PLUGIN_PAYLOAD_RELEASE(plugin_payload_release);
+
+/*
+ * NOTE(koekeishiya): The context of an event that is delivered to one or more plugin queues.
+ * 'Data' is passed to the plugin and 'Context' is passed to 'Release'; they only differ when
+ * the data is owned by a larger structure. The event-loop holds one reference while
+ * dispatching and every queued delivery holds one.
+ * 'Release' runs on whichever thread drops the last reference, and is where resources that
+ * would otherwise be freed right after dispatch (destroyed windows, terminated applications,
+ * display ids, broadcast buffers) are destroyed. Window events are delivered as a copy of the
+ * window that the payload owns, so the event-loop can keep updating the window it tracks.
+ */
+struct plugin_payload
+{
+    uint32_t volatile RefCount;
+    void *Data;
+    void *Context;
+    plugin_payload_release *Release;
+};
+
+/*
+ * NOTE(koekeishiya): A delivery without an export name or handler is a barrier; it is not passed to the
+ * plugin, but keeps its payload alive until the plugin has processed everything queued before it.
+ */
+struct plugin_delivery
+{
+    const char *Export;
+    plugin_event_func *Handler;
+    plugin_payload *Payload;
+    uint64_t Timestamp;
+};
+
+struct plugin_queue
+{
+    plugin *Plugin;
+    char *Filename;
+
+    bool volatile Running;
+    pthread_t Thread;
+    pthread_mutex_t Lock;
+    pthread_cond_t Ready;
+    std::queue<plugin_delivery> Deliveries;
+
+    uint32_t volatile Depth;
+    uint64_t volatile Delivered;
+    histogram Lag;
+};
+
+struct plugin_queue_stats
+{
+    char Filename[64];
+    uint32_t Depth;
+    uint64_t Delivered;
+    uint64_t LagAverage;
+    uint64_t LagP99;
+    uint64_t LagMax;
+};
+
+void SetPluginDeliveryMode(const char *Filename, bool Async);
+bool PluginDeliveryIsAsync(const char *Filename);
+
+bool BeginPluginQueue(plugin *Plugin, const char *Filename);
+void EndPluginQueue(plugin *Plugin);
+plugin_queue *GetPluginQueue(plugin *Plugin);
+bool HasPluginQueues();
+
+plugin_payload *BeginPluginPayload(void *Data, void *Context, plugin_payload_release *Release);
+void EndPluginPayload(plugin_payload *Payload);
+
+void EnqueuePluginDelivery(plugin_queue *Queue, const char *Export, plugin_event_func *Handler, plugin_payload *Payload);
+void EnqueuePluginBarrier(plugin_payload *Payload);
+
+int PluginQueueStats(plugin_queue_stats *Stats, int MaxCount);
+
+#endif
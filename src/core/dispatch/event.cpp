@@ -1,42 +1,354 @@
 #include "event.h"
 #include "../clog.h"
 
+#include <string.h>
+#include <time.h>
+
 #define internal static
 
 internal event_loop EventLoop = {};
+internal event_coalesce_policy EventCoalescePolicy[ChunkWM_EventTypeCount];
+internal event_lane_type volatile EventLaneMap[ChunkWM_EventTypeCount];
+
+internal inline uint64_t
+GetMonotonicTime()
+{
+    struct timespec Time;
+    clock_gettime(CLOCK_MONOTONIC, &Time);
+    return (uint64_t) Time.tv_sec * 1000000000ULL + Time.tv_nsec;
+}
+
+internal void
+BeginEventRing(event_ring *Ring)
+{
+    for (uint32_t Index = 0; Index < EVENT_RING_SIZE; ++Index) {
+        Ring->Cells[Index].Sequence = Index;
+    }
+
+    Ring->EntryToWrite = 0;
+    Ring->EntryToRead = 0;
+    Ring->OverflowCount = 0;
+    Ring->OverflowTotal = 0;
+}
+
+/* NOTE(koekeishiya): Returns false if the ring is full. */
+internal bool
+PushEventRing(event_ring *Ring, chunk_event *Event)
+{
+    event_ring_cell *Cell;
+    uint32_t Position = __atomic_load_n(&Ring->EntryToWrite, __ATOMIC_RELAXED);
+
+    for (;;) {
+        Cell = Ring->Cells + (Position & EVENT_RING_MASK);
+        uint32_t Sequence = __atomic_load_n(&Cell->Sequence, __ATOMIC_ACQUIRE);
+        int32_t Difference = (int32_t) Sequence - (int32_t) Position;
+
+        if (Difference == 0) {
+            if (__atomic_compare_exchange_n(&Ring->EntryToWrite, &Position, Position + 1,
+                                            true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                break;
+            }
+        } else if (Difference < 0) {
+            return false;
+        } else {
+            Position = __atomic_load_n(&Ring->EntryToWrite, __ATOMIC_RELAXED);
+        }
+    }
+
+    Cell->Event = *Event;
+    __atomic_store_n(&Cell->Sequence, Position + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+/* NOTE(koekeishiya): Must only be called from the event-loop thread. */
+internal bool
+PopEventRing(event_ring *Ring, chunk_event *Event)
+{
+    uint32_t Position = Ring->EntryToRead;
+    event_ring_cell *Cell = Ring->Cells + (Position & EVENT_RING_MASK);
+    uint32_t Sequence = __atomic_load_n(&Cell->Sequence, __ATOMIC_ACQUIRE);
+
+    if (Sequence != Position + 1) {
+        return false;
+    }
+
+    *Event = Cell->Event;
+    __atomic_store_n(&Cell->Sequence, Position + EVENT_RING_SIZE, __ATOMIC_RELEASE);
+    Ring->EntryToRead = Position + 1;
+    return true;
+}
+
+internal void
+SpillEventRing(event_ring *Ring, chunk_event *Event)
+{
+    pthread_mutex_lock(&Ring->OverflowLock);
+    Ring->Overflow.push(*Event);
+    __atomic_add_fetch(&Ring->OverflowCount, 1, __ATOMIC_SEQ_CST);
+    pthread_mutex_unlock(&Ring->OverflowLock);
+
+    uint32_t Total = __atomic_add_fetch(&Ring->OverflowTotal, 1, __ATOMIC_RELAXED);
+    if ((Total & (Total - 1)) == 0) {
+        c_log(C_LOG_LEVEL_WARN, "chunkwm: event ring is full, %d events spilled to overflow queue\n", Total);
+    }
+}
 
 /* NOTE(koekeishiya): Must be thread-safe! Called through ConstructEvent macro */
 void AddEvent(chunk_event Event)
 {
     if (Event.Handle) {
-        pthread_mutex_lock(&EventLoop.Lock);
-        EventLoop.Queue.push(Event);
-        pthread_mutex_unlock(&EventLoop.Lock);
+        Event.Timestamp = GetMonotonicTime();
+        event_ring *Ring = &EventLoop.Lanes[EventLaneMap[Event.Type]].Ring;
+
+        /*
+         * NOTE(koekeishiya): Journal the event before it is queued; once it is in the ring the
+         * event-loop may coalesce it, or run its handler and free its context.
+         */
+        chunkwm_callback *Journal = EventLoop.Journal;
+        if (Journal) {
+            (*Journal)(&Event);
+        }
+
+        if ((__atomic_load_n(&Ring->OverflowCount, __ATOMIC_SEQ_CST) != 0) ||
+            (!PushEventRing(Ring, &Event))) {
+            SpillEventRing(Ring, &Event);
+        }
 
-        if (EventLoop.Running) {
+        /*
+         * NOTE(koekeishiya): The event-loop only sleeps after it has flagged that it is
+         * waiting and seen an empty ring, so we only need to post when that flag is set.
+         */
+        if ((EventLoop.Running) &&
+            (__atomic_exchange_n(&EventLoop.Waiting, 0, __ATOMIC_SEQ_CST))) {
             sem_post(EventLoop.Semaphore);
         }
     }
 }
 
+internal inline void
+ProcessEvent(chunk_event *Event)
+{
+    c_log(C_LOG_LEVEL_DEBUG, "chunkwm: processing event of type '%s'\n", Event->Name);
+    (*Event->Handle)(Event);
+}
+
+internal inline void
+InitEventCoalescePolicy()
+{
+    for (int Index = 0; Index < ChunkWM_EventTypeCount; ++Index) {
+        EventCoalescePolicy[Index] = Coalesce_None;
+    }
+
+    EventCoalescePolicy[ChunkWM_WindowMoved] = Coalesce_Latest;
+    EventCoalescePolicy[ChunkWM_WindowResized] = Coalesce_Latest;
+    EventCoalescePolicy[ChunkWM_WindowTitleChanged] = Coalesce_Latest;
+}
+
+/*
+ * NOTE(koekeishiya): Events are only ordered within a lane, so event types whose handlers
+ * depend on the order they were queued in must share a lane. A command may refer to a plugin
+ * that is loaded or unloaded by a command queued before it ('core::load' followed by a
+ * 'tiling::rule' in chunkwmrc). An application that has just launched is often activated
+ * right away, and the activation is dropped if the launch has not yet added the application;
+ * likewise a display has to be added before a display change can refer to it.
+ * SetEventLane moves every type of a group together.
+ */
+#define EVENT_LANE_GROUP_SIZE 5
+internal const event_type EventLaneGroups[][EVENT_LANE_GROUP_SIZE] =
+{
+    { ChunkWM_PluginCommand, ChunkWM_DaemonCommand, ChunkWM_PluginLoad, ChunkWM_PluginUnload, ChunkWM_EventTypeCount },
+    { ChunkWM_ApplicationLaunched, ChunkWM_ApplicationTerminated,
+      ChunkWM_ApplicationActivated, ChunkWM_ApplicationDeactivated, ChunkWM_EventTypeCount },
+    { ChunkWM_DisplayAdded, ChunkWM_DisplayRemoved, ChunkWM_DisplayMoved, ChunkWM_DisplayResized, ChunkWM_DisplayChanged },
+};
+
+internal inline void
+SetEventLaneGroup(event_type Type, event_lane_type Lane)
+{
+    EventLaneMap[Type] = Lane;
+
+    for (size_t Group = 0; Group < sizeof(EventLaneGroups) / sizeof(EventLaneGroups[0]); ++Group) {
+        bool Member = false;
+        for (int Index = 0; Index < EVENT_LANE_GROUP_SIZE; ++Index) {
+            if (EventLaneGroups[Group][Index] == Type) Member = true;
+        }
+
+        if (!Member) continue;
+
+        for (int Index = 0; Index < EVENT_LANE_GROUP_SIZE; ++Index) {
+            event_type GroupType = EventLaneGroups[Group][Index];
+            if (GroupType != ChunkWM_EventTypeCount) EventLaneMap[GroupType] = Lane;
+        }
+    }
+}
+
+internal inline void
+InitEventLaneMap()
+{
+    for (int Index = 0; Index < ChunkWM_EventTypeCount; ++Index) {
+        EventLaneMap[Index] = Event_Lane_Bulk;
+    }
+
+    SetEventLaneGroup(ChunkWM_ApplicationActivated, Event_Lane_Critical);
+    SetEventLaneGroup(ChunkWM_DisplayChanged, Event_Lane_Critical);
+    SetEventLaneGroup(ChunkWM_SpaceChanged, Event_Lane_Critical);
+    SetEventLaneGroup(ChunkWM_WindowFocused, Event_Lane_Critical);
+    SetEventLaneGroup(ChunkWM_PluginCommand, Event_Lane_Critical);
+}
+
+/*
+ * NOTE(koekeishiya): Walk the batch backwards so that the first occurrence we see of a
+ * (type, context) pair is the most recent one; every older occurrence is discarded.
+ */
+internal void
+CoalesceEventBatch(event_batch *Batch)
+{
+    if (Batch->Count < 2) return;
+
+    if (++Batch->Generation == 0) {
+        memset(Batch->Slots, 0, sizeof(Batch->Slots));
+        Batch->Generation = 1;
+    }
+
+    uint32_t Generation = Batch->Generation;
+    for (int Index = Batch->Count - 1; Index >= 0; --Index) {
+        chunk_event *Event = Batch->Events + Index;
+        if (EventCoalescePolicy[Event->Type] != Coalesce_Latest) continue;
+
+        uint32_t Hash = (uint32_t)(((uintptr_t) Event->Context >> 4) * 2654435761u) ^ Event->Type;
+        for (;;) {
+            event_coalesce_slot *Slot = Batch->Slots + (Hash & EVENT_COALESCE_MASK);
+            if (Slot->Generation != Generation) {
+                Slot->Generation = Generation;
+                Slot->Type = Event->Type;
+                Slot->Context = Event->Context;
+                break;
+            }
+
+            if ((Slot->Type == Event->Type) && (Slot->Context == Event->Context)) {
+                c_log(C_LOG_LEVEL_DEBUG, "chunkwm: coalesced event of type '%s'\n", Event->Name);
+                Event->Handle = NULL;
+                ++EventLoop.Coalesced[Event->Type];
+                break;
+            }
+
+            ++Hash;
+        }
+    }
+}
+
+/*
+ * NOTE(koekeishiya): Refill the batch of a lane with everything that is currently pending.
+ * Events previously taken from the overflow queue are older than anything in the ring,
+ * and anything left in the ring is older than what is currently in the overflow queue.
+ */
+internal void
+FillEventBatch(event_lane *Lane)
+{
+    event_ring *Ring = &Lane->Ring;
+    event_batch *Batch = &Lane->Batch;
+
+    Batch->Count = 0;
+    Batch->Cursor = 0;
+
+    while (Batch->Count < EVENT_RING_SIZE) {
+        if (!Lane->Pending.empty()) {
+            Batch->Events[Batch->Count++] = Lane->Pending.front();
+            Lane->Pending.pop();
+            --Lane->PendingCount;
+        } else if (PopEventRing(Ring, Batch->Events + Batch->Count)) {
+            ++Batch->Count;
+        } else if (__atomic_load_n(&Ring->OverflowCount, __ATOMIC_SEQ_CST) != 0) {
+            pthread_mutex_lock(&Ring->OverflowLock);
+            Lane->Pending.swap(Ring->Overflow);
+            Lane->PendingCount = Lane->Pending.size();
+            __atomic_store_n(&Ring->OverflowCount, 0, __ATOMIC_SEQ_CST);
+            pthread_mutex_unlock(&Ring->OverflowLock);
+        } else {
+            break;
+        }
+    }
+
+    CoalesceEventBatch(Batch);
+}
+
+/*
+ * NOTE(koekeishiya): Dispatch at most Limit events from the batch of a lane, refilling it
+ * first if it has been exhausted. Returns the number of events consumed from the batch,
+ * including events that were discarded by coalescing.
+ */
+internal unsigned
+ServeEventLane(event_lane *Lane, unsigned Limit)
+{
+    event_batch *Batch = &Lane->Batch;
+    if (Batch->Cursor == Batch->Count) {
+        FillEventBatch(Lane);
+    }
+
+    unsigned Count = 0;
+    while ((Batch->Cursor < Batch->Count) && (Count < Limit)) {
+        chunk_event *Event = Batch->Events + Batch->Cursor++;
+        ++Count;
+
+        if (!Event->Handle) continue;
+
+        uint64_t Dispatch = GetMonotonicTime();
+        uint64_t Wait = Dispatch - Event->Timestamp;
+        Lane->WaitTotal += Wait;
+        if (Wait > Lane->WaitMax) Lane->WaitMax = Wait;
+        ++Lane->Dispatched;
+
+        event_type Type = Event->Type;
+        ProcessEvent(Event);
+
+        HistogramRecord(&EventLoop.QueueWait[Type], Wait);
+        HistogramRecord(&EventLoop.Handler[Type], GetMonotonicTime() - Dispatch);
+    }
+
+    return Count;
+}
+
+internal unsigned
+DrainEventLanes()
+{
+    unsigned Count = ServeEventLane(&EventLoop.Lanes[Event_Lane_Critical], EVENT_RING_SIZE);
+    Count += ServeEventLane(&EventLoop.Lanes[Event_Lane_Bulk], EVENT_BULK_SLICE);
+    return Count;
+}
+
+internal inline bool
+HasPendingEvents(event_lane *Lane)
+{
+    event_ring *Ring = &Lane->Ring;
+    event_ring_cell *Cell = Ring->Cells + (Ring->EntryToRead & EVENT_RING_MASK);
+    bool Result = ((Lane->Batch.Cursor != Lane->Batch.Count) ||
+                   (!Lane->Pending.empty()) ||
+                   (__atomic_load_n(&Cell->Sequence, __ATOMIC_ACQUIRE) == Ring->EntryToRead + 1) ||
+                   (__atomic_load_n(&Ring->OverflowCount, __ATOMIC_SEQ_CST) != 0));
+    return Result;
+}
+
+internal inline bool
+HasPendingEvents()
+{
+    for (int Index = 0; Index < Event_Lane_Count; ++Index) {
+        if (HasPendingEvents(&EventLoop.Lanes[Index])) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
 internal void *
 ProcessEventQueue(void *)
 {
     while (EventLoop.Running) {
-        pthread_mutex_lock(&EventLoop.Lock);
-        bool HasWork = !EventLoop.Queue.empty();
-        pthread_mutex_unlock(&EventLoop.Lock);
-
-        while (HasWork) {
-            pthread_mutex_lock(&EventLoop.Lock);
-            chunk_event Event = EventLoop.Queue.front();
-            EventLoop.Queue.pop();
-
-            HasWork = !EventLoop.Queue.empty();
-            pthread_mutex_unlock(&EventLoop.Lock);
+        while (DrainEventLanes());
 
-            c_log(C_LOG_LEVEL_DEBUG, "chunkwm: processing event of type '%s'\n", Event.Name);
-            (*Event.Handle)(&Event);
+        __atomic_store_n(&EventLoop.Waiting, 1, __ATOMIC_SEQ_CST);
+        if (HasPendingEvents()) {
+            __atomic_store_n(&EventLoop.Waiting, 0, __ATOMIC_SEQ_CST);
+            continue;
         }
 
         int Result = sem_wait(EventLoop.Semaphore);
@@ -50,24 +362,121 @@ ProcessEventQueue(void *)
     return NULL;
 }
 
-/* NOTE(koekeishiya): Initialize required mutexes and semaphore for the eventloop */
+uint64_t EventCoalescedCount(event_type Type)
+{
+    return EventLoop.Coalesced[Type];
+}
+
+bool EventTypeFromString(const char *Name, event_type *Type)
+{
+    for (int Index = 0; Index < ChunkWM_EventTypeCount; ++Index) {
+        if (strcmp(Name, event_type_str[Index]) == 0) {
+            *Type = (event_type) Index;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool EventLaneTypeFromString(const char *Name, event_lane_type *Lane)
+{
+    for (int Index = 0; Index < Event_Lane_Count; ++Index) {
+        if (strcmp(Name, event_lane_type_str[Index]) == 0) {
+            *Lane = (event_lane_type) Index;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/*
+ * NOTE(koekeishiya): Events that are already queued remain in their current lane;
+ * only events constructed after this call are affected. Event types that must stay
+ * ordered with respect to each other are moved together, see EventLaneGroups.
+ */
+void SetEventLane(event_type Type, event_lane_type Lane)
+{
+    SetEventLaneGroup(Type, Lane);
+}
+
+/* NOTE(koekeishiya): Values are read without synchronization and are approximate. */
+void EventLaneStats(event_lane_type Type, event_lane_stats *Stats)
+{
+    event_lane *Lane = &EventLoop.Lanes[Type];
+    event_ring *Ring = &Lane->Ring;
+    event_batch *Batch = &Lane->Batch;
+
+    Stats->Depth = (Ring->EntryToWrite - Ring->EntryToRead) +
+                   Ring->OverflowCount +
+                   Lane->PendingCount +
+                   (Batch->Count - Batch->Cursor);
+    Stats->Dispatched = Lane->Dispatched;
+    Stats->WaitTotal = Lane->WaitTotal;
+    Stats->WaitMax = Lane->WaitMax;
+}
+
+void EventTypeStats(event_type Type, event_type_stats *Stats)
+{
+    Stats->Coalesced = EventLoop.Coalesced[Type];
+    Stats->QueueWait = &EventLoop.QueueWait[Type];
+    Stats->Handler = &EventLoop.Handler[Type];
+}
+
+void SetEventJournalCallback(chunkwm_callback *Callback)
+{
+    EventLoop.Journal = Callback;
+}
+
+/*
+ * NOTE(koekeishiya): Called from the daemon thread while the event-loop may be recording;
+ * an event that completes concurrently with the reset may be partially accounted for.
+ */
+void ResetEventStats()
+{
+    for (int Index = 0; Index < Event_Lane_Count; ++Index) {
+        event_lane *Lane = &EventLoop.Lanes[Index];
+        Lane->Dispatched = 0;
+        Lane->WaitTotal = 0;
+        Lane->WaitMax = 0;
+    }
+
+    for (int Index = 0; Index < ChunkWM_EventTypeCount; ++Index) {
+        EventLoop.Coalesced[Index] = 0;
+        HistogramReset(&EventLoop.QueueWait[Index]);
+        HistogramReset(&EventLoop.Handler[Index]);
+    }
+}
+
+/* NOTE(koekeishiya): Initialize the event lanes, overflow mutexes and semaphore for the eventloop */
 bool BeginEventLoop()
 {
     bool Result = true;
+    int Index;
 
     if ((EventLoop.Semaphore = sem_open("eventloop_semaphore", O_CREAT, 0644, 0)) == SEM_FAILED) {
         c_log(C_LOG_LEVEL_ERROR, "chunkwm: could not initialize semaphore!");
         goto sem_err;
     }
 
-    if (pthread_mutex_init(&EventLoop.Lock, NULL) != 0) {
-        c_log(C_LOG_LEVEL_ERROR, "chunkwm: could not initialize work mutex!");
-        goto work_err;
+    for (Index = 0; Index < Event_Lane_Count; ++Index) {
+        if (pthread_mutex_init(&EventLoop.Lanes[Index].Ring.OverflowLock, NULL) != 0) {
+            c_log(C_LOG_LEVEL_ERROR, "chunkwm: could not initialize overflow mutex!");
+            goto work_err;
+        }
+
+        BeginEventRing(&EventLoop.Lanes[Index].Ring);
     }
 
+    InitEventCoalescePolicy();
+    InitEventLaneMap();
     goto out;
 
 work_err:
+    while (--Index >= 0) {
+        pthread_mutex_destroy(&EventLoop.Lanes[Index].Ring.OverflowLock);
+    }
     sem_destroy(EventLoop.Semaphore);
 
 sem_err:
@@ -77,10 +486,12 @@ out:
     return Result;
 }
 
-/* NOTE(koekeishiya): Destroy mutexes and condition used by the event-loop */
+/* NOTE(koekeishiya): Destroy mutexes and semaphore used by the event-loop */
 void EndEventLoop()
 {
-    pthread_mutex_destroy(&EventLoop.Lock);
+    for (int Index = 0; Index < Event_Lane_Count; ++Index) {
+        pthread_mutex_destroy(&EventLoop.Lanes[Index].Ring.OverflowLock);
+    }
     sem_destroy(EventLoop.Semaphore);
 }
 
@@ -96,6 +507,7 @@ void StopEventLoop()
 {
     if (EventLoop.Running) {
         EventLoop.Running = false;
+        sem_post(EventLoop.Semaphore);
         pthread_join(EventLoop.Thread, NULL);
     }
 }
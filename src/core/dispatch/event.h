@@ -3,8 +3,11 @@
 
 #include <pthread.h>
 #include <semaphore.h>
+#include <stdint.h>
 #include <queue>
 
+#include "../histogram.h"
+
 struct chunk_event;
 #define CHUNKWM_CALLBACK(name) void name(chunk_event *Event)
 typedef CHUNKWM_CALLBACK(chunkwm_callback);
@@ -40,7 +43,42 @@ extern CHUNKWM_CALLBACK(Callback_ChunkWM_PluginCommand);
 extern CHUNKWM_CALLBACK(Callback_ChunkWM_PluginBroadcast);
 extern CHUNKWM_CALLBACK(Callback_ChunkWM_PluginLoad);
 extern CHUNKWM_CALLBACK(Callback_ChunkWM_PluginUnload);
+extern CHUNKWM_CALLBACK(Callback_ChunkWM_DaemonCommand);
+
+static const char *event_type_str[] =
+{
+    "ChunkWM_ApplicationLaunched",
+    "ChunkWM_ApplicationTerminated",
+    "ChunkWM_ApplicationActivated",
+    "ChunkWM_ApplicationDeactivated",
+    "ChunkWM_ApplicationVisible",
+    "ChunkWM_ApplicationHidden",
+
+    "ChunkWM_DisplayAdded",
+    "ChunkWM_DisplayRemoved",
+    "ChunkWM_DisplayMoved",
+    "ChunkWM_DisplayResized",
+    "ChunkWM_DisplayChanged",
+    "ChunkWM_SpaceChanged",
 
+    "ChunkWM_WindowCreated",
+    "ChunkWM_WindowDestroyed",
+    "ChunkWM_WindowFocused",
+    "ChunkWM_WindowMoved",
+    "ChunkWM_WindowResized",
+    "ChunkWM_WindowMinimized",
+    "ChunkWM_WindowDeminimized",
+    "ChunkWM_WindowSheetCreated",
+    "ChunkWM_WindowTitleChanged",
+
+    "ChunkWM_PluginCommand",
+    "ChunkWM_PluginBroadcast",
+    "ChunkWM_PluginLoad",
+    "ChunkWM_PluginUnload",
+    "ChunkWM_DaemonCommand",
+
+    "ChunkWM_EventTypeCount"
+};
 enum event_type
 {
     ChunkWM_ApplicationLaunched,
@@ -70,6 +108,45 @@ enum event_type
     // NOTE(koekeishiya): This property is not exposed to plugins
     ChunkWM_PluginCommand,
     ChunkWM_PluginBroadcast,
+    ChunkWM_PluginLoad,
+    ChunkWM_PluginUnload,
+    ChunkWM_DaemonCommand,
+
+    ChunkWM_EventTypeCount
+};
+
+/*
+ * NOTE(koekeishiya): Events with the Coalesce_Latest policy that are pending at the same
+ * time for the same context (window) are collapsed into the most recent one before dispatch.
+ * Only events whose context is not owned by the event may be coalesced.
+ */
+enum event_coalesce_policy
+{
+    Coalesce_None,
+    Coalesce_Latest,
+};
+
+/*
+ * NOTE(koekeishiya): Every event type is mapped to a lane. The event-loop serves a
+ * full batch of the critical lane before each slice of at most EVENT_BULK_SLICE bulk
+ * events, so that focus and space changes never queue behind a burst of bulk events,
+ * while the bulk lane is still guaranteed to make progress.
+ */
+#define EVENT_BULK_SLICE 16
+
+static const char *event_lane_type_str[] =
+{
+    "critical",
+    "bulk",
+
+    "count"
+};
+enum event_lane_type
+{
+    Event_Lane_Critical,
+    Event_Lane_Bulk,
+
+    Event_Lane_Count
 };
 
 struct chunk_event
@@ -77,15 +154,108 @@ struct chunk_event
     chunkwm_callback *Handle;
     void *Context;
     const char *Name;
+    event_type Type;
+    uint64_t Timestamp;
+};
+
+/*
+ * NOTE(koekeishiya): Bounded multi-producer / single-consumer ring of chunk_events.
+ * Every cell carries a sequence number; a producer claims a slot by advancing EntryToWrite
+ * and publishes the event by storing Sequence = Position + 1. The event-loop thread is the
+ * only consumer and releases a slot by storing Sequence = Position + EVENT_RING_SIZE.
+ *
+ * Overflow policy: when the ring is full the event is spilled to a mutex-guarded overflow
+ * queue instead of being dropped, as most events own heap-allocated context. While the
+ * overflow queue is non-empty, producers keep spilling so that per-thread ordering holds.
+ */
+#define EVENT_RING_SIZE 1024
+#define EVENT_RING_MASK (EVENT_RING_SIZE - 1)
+
+struct event_ring_cell
+{
+    uint32_t volatile Sequence;
+    chunk_event Event;
+};
+
+struct event_ring
+{
+    event_ring_cell Cells[EVENT_RING_SIZE];
+
+    uint32_t volatile EntryToWrite __attribute__((aligned(64)));
+    uint32_t EntryToRead __attribute__((aligned(64)));
+
+    uint32_t volatile OverflowCount;
+    uint32_t volatile OverflowTotal;
+    pthread_mutex_t OverflowLock;
+    std::queue<chunk_event> Overflow;
+};
+
+#define EVENT_COALESCE_SIZE (2 * EVENT_RING_SIZE)
+#define EVENT_COALESCE_MASK (EVENT_COALESCE_SIZE - 1)
+
+struct event_coalesce_slot
+{
+    uint32_t Generation;
+    event_type Type;
+    void *Context;
+};
+
+/*
+ * NOTE(koekeishiya): Owned by the event-loop thread. Pending events are drained
+ * into Batch, coalesced, and then dispatched in order.
+ */
+struct event_batch
+{
+    chunk_event Events[EVENT_RING_SIZE];
+    unsigned Count;
+    unsigned Cursor;
+
+    uint32_t Generation;
+    event_coalesce_slot Slots[EVENT_COALESCE_SIZE];
+};
+
+struct event_lane_stats
+{
+    uint32_t Depth;
+    uint64_t Dispatched;
+    uint64_t WaitTotal;
+    uint64_t WaitMax;
+};
+
+struct event_type_stats
+{
+    uint64_t Coalesced;
+    histogram *QueueWait;
+    histogram *Handler;
+};
+
+struct event_lane
+{
+    event_ring Ring;
+    event_batch Batch;
+
+    /* NOTE(koekeishiya): Events taken from the overflow queue; owned by the event-loop thread. */
+    std::queue<chunk_event> Pending;
+    uint32_t volatile PendingCount;
+
+    uint64_t volatile Dispatched;
+    uint64_t volatile WaitTotal;
+    uint64_t volatile WaitMax;
 };
 
 struct event_loop
 {
     bool Running;
+    uint32_t volatile Waiting;
     pthread_t Thread;
     sem_t *Semaphore;
-    pthread_mutex_t Lock;
-    std::queue<chunk_event> Queue;
+    event_lane Lanes[Event_Lane_Count];
+
+    chunkwm_callback *volatile Journal;
+
+    uint64_t volatile Coalesced[ChunkWM_EventTypeCount];
+    histogram QueueWait[ChunkWM_EventTypeCount];
+    histogram Handler[ChunkWM_EventTypeCount];
 };
 
 bool BeginEventLoop();
@@ -98,6 +268,20 @@ void PauseEventLoop();
 void ResumeEventLoop();
 
 void AddEvent(chunk_event Event);
+uint64_t EventCoalescedCount(event_type Type);
+
+bool EventTypeFromString(const char *Name, event_type *Type);
+bool EventLaneTypeFromString(const char *Name, event_lane_type *Lane);
+void SetEventLane(event_type Type, event_lane_type Lane);
+void EventLaneStats(event_lane_type Lane, event_lane_stats *Stats);
+void EventTypeStats(event_type Type, event_type_stats *Stats);
+void ResetEventStats();
+
+/*
+ * NOTE(koekeishiya): The journal callback is invoked by AddEvent on the thread that
+ * queues the event, for every event, before it can be coalesced. It must be thread-safe.
+ */
+void SetEventJournalCallback(chunkwm_callback *Callback);
 
 /* NOTE(koekeishiya): Construct a chunk_event with the appropriate callback through macro expansion. */
 #define ConstructEvent(EventType, EventContext) \
@@ -105,6 +289,7 @@ void AddEvent(chunk_event Event);
          Event.Context = EventContext; \
          Event.Handle = &Callback_##EventType; \
          Event.Name = #EventType; \
+         Event.Type = EventType; \
          AddEvent(Event); \
        } while(0)
 
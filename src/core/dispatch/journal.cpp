@@ -0,0 +1,100 @@
+#include "journal.h"
+#include "../clog.h"
+
+#include <pthread.h>
+#include <string.h>
+
+#define internal static
+
+internal FILE *JournalHandle;
+internal pthread_mutex_t JournalLock = PTHREAD_MUTEX_INITIALIZER;
+
+internal inline void
+InitEventJournalHeader(event_journal_header *Header)
+{
+    memset(Header, 0, sizeof(event_journal_header));
+    memcpy(Header->Magic, "cwej", 4);
+    Header->Version = EVENT_JOURNAL_VERSION;
+    Header->RecordSize = sizeof(event_journal_record);
+}
+
+bool BeginEventJournal(const char *Path)
+{
+    bool Result = false;
+    pthread_mutex_lock(&JournalLock);
+
+    if (JournalHandle) {
+        fclose(JournalHandle);
+        JournalHandle = NULL;
+    }
+
+    FILE *Handle = fopen(Path, "wb");
+    if (Handle) {
+        event_journal_header Header;
+        InitEventJournalHeader(&Header);
+
+        if (fwrite(&Header, sizeof(event_journal_header), 1, Handle) == 1) {
+            JournalHandle = Handle;
+            Result = true;
+        } else {
+            fclose(Handle);
+        }
+    }
+
+    pthread_mutex_unlock(&JournalLock);
+
+    if (!Result) {
+        c_log(C_LOG_LEVEL_WARN, "chunkwm: could not open event journal '%s'\n", Path);
+    }
+
+    return Result;
+}
+
+void EndEventJournal()
+{
+    pthread_mutex_lock(&JournalLock);
+    if (JournalHandle) {
+        fclose(JournalHandle);
+        JournalHandle = NULL;
+    }
+    pthread_mutex_unlock(&JournalLock);
+}
+
+bool EventJournalIsActive()
+{
+    return JournalHandle != NULL;
+}
+
+void WriteEventJournal(event_journal_record *Record)
+{
+    pthread_mutex_lock(&JournalLock);
+    if (JournalHandle) {
+        fwrite(Record, sizeof(event_journal_record), 1, JournalHandle);
+    }
+    pthread_mutex_unlock(&JournalLock);
+}
+
+// NOTE(koekeishiya): Caller is responsible for closing the returned handle.
+FILE *OpenEventJournal(const char *Path)
+{
+    FILE *Handle = fopen(Path, "rb");
+    if (!Handle) {
+        return NULL;
+    }
+
+    event_journal_header Expected, Header;
+    InitEventJournalHeader(&Expected);
+
+    if ((fread(&Header, sizeof(event_journal_header), 1, Handle) != 1) ||
+        (memcmp(&Header, &Expected, sizeof(event_journal_header)) != 0)) {
+        fclose(Handle);
+        return NULL;
+    }
+
+    return Handle;
+}
+
+bool ReadEventJournal(FILE *Handle, event_journal_record *Record)
+{
+    return fread(Record, sizeof(event_journal_record), 1, Handle) == 1;
+}
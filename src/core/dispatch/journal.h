@@ -0,0 +1,43 @@
+#ifndef CHUNKWM_CORE_JOURNAL_H
+#define CHUNKWM_CORE_JOURNAL_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ * NOTE(koekeishiya): The event journal is a header followed by fixed-size records,
+ * one per queued chunk_event, in the order they were queued and before coalescing.
+ * Events queued by different threads may be written slightly out of timestamp order.
+ * Fields that do not apply to an event type are zero. Records are written in host byte-order.
+ */
+#define EVENT_JOURNAL_VERSION 1
+
+struct event_journal_header
+{
+    char Magic[4];
+    uint32_t Version;
+    uint32_t RecordSize;
+    uint32_t Reserved;
+};
+
+struct event_journal_record
+{
+    uint64_t Timestamp;
+    uint32_t Type;
+    uint32_t WindowId;
+    int32_t PID;
+    uint32_t DisplayId;
+    int64_t SpaceId;
+    float X, Y;
+    float Width, Height;
+};
+
+bool BeginEventJournal(const char *Path);
+void EndEventJournal();
+bool EventJournalIsActive();
+void WriteEventJournal(event_journal_record *Record);
+
+FILE *OpenEventJournal(const char *Path);
+bool ReadEventJournal(FILE *Handle, event_journal_record *Record);
+
+#endif
@@ -0,0 +1,71 @@
+#include "histogram.h"
+
+#include <string.h>
+
+#define internal static
+
+internal inline int
+HistogramBucketIndex(uint64_t Value)
+{
+    if (Value < HISTOGRAM_SUB_BUCKET_COUNT) {
+        return (int) Value;
+    }
+
+    int MostSignificantBit = 63 - __builtin_clzll(Value);
+    if (MostSignificantBit >= HISTOGRAM_MAX_BITS) {
+        return HISTOGRAM_BUCKET_COUNT - 1;
+    }
+
+    int Shift = MostSignificantBit - HISTOGRAM_SUB_BUCKET_BITS;
+    int SubBucket = (int)((Value >> Shift) & (HISTOGRAM_SUB_BUCKET_COUNT - 1));
+    return ((Shift + 1) * HISTOGRAM_SUB_BUCKET_COUNT) + SubBucket;
+}
+
+// NOTE(koekeishiya): Returns the highest value that maps to the given bucket.
+internal inline uint64_t
+HistogramBucketValue(int Index)
+{
+    if (Index < HISTOGRAM_SUB_BUCKET_COUNT) {
+        return (uint64_t) Index;
+    }
+
+    int Shift = (Index / HISTOGRAM_SUB_BUCKET_COUNT) - 1;
+    uint64_t SubBucket = (uint64_t)(Index % HISTOGRAM_SUB_BUCKET_COUNT) | HISTOGRAM_SUB_BUCKET_COUNT;
+    return ((SubBucket + 1) << Shift) - 1;
+}
+
+void HistogramRecord(histogram *Histogram, uint64_t Value)
+{
+    if ((Histogram->Count == 0) || (Value < Histogram->Min)) Histogram->Min = Value;
+    if (Value > Histogram->Max) Histogram->Max = Value;
+
+    ++Histogram->Buckets[HistogramBucketIndex(Value)];
+    Histogram->Total += Value;
+    ++Histogram->Count;
+}
+
+uint64_t HistogramPercentile(histogram *Histogram, double Percentile)
+{
+    if (Histogram->Count == 0) {
+        return 0;
+    }
+
+    uint64_t Target = (uint64_t)((Percentile / 100.0) * Histogram->Count + 0.5);
+    if (Target < 1) Target = 1;
+
+    uint64_t Seen = 0;
+    for (int Index = 0; Index < HISTOGRAM_BUCKET_COUNT; ++Index) {
+        Seen += Histogram->Buckets[Index];
+        if (Seen >= Target) {
+            uint64_t Result = HistogramBucketValue(Index);
+            return Result < Histogram->Max ? Result : Histogram->Max;
+        }
+    }
+
+    return Histogram->Max;
+}
+
+void HistogramReset(histogram *Histogram)
+{
+    memset(Histogram, 0, sizeof(histogram));
+}
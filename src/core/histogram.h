@@ -0,0 +1,30 @@
+#ifndef CHUNKWM_CORE_HISTOGRAM_H
+#define CHUNKWM_CORE_HISTOGRAM_H
+
+#include <stdint.h>
+
+/*
+ * NOTE(koekeishiya): Log-linear (HDR-style) histogram of nanosecond durations.
+ * Every power of two is split into HISTOGRAM_SUB_BUCKET_COUNT linear sub-buckets,
+ * which bounds the relative error of a reported value to 1 / HISTOGRAM_SUB_BUCKET_COUNT.
+ * Values above 2^HISTOGRAM_MAX_BITS ns (~68 seconds) are clamped into the last bucket.
+ */
+#define HISTOGRAM_SUB_BUCKET_BITS  3
+#define HISTOGRAM_SUB_BUCKET_COUNT (1 << HISTOGRAM_SUB_BUCKET_BITS)
+#define HISTOGRAM_MAX_BITS         36
+#define HISTOGRAM_BUCKET_COUNT     ((HISTOGRAM_MAX_BITS - HISTOGRAM_SUB_BUCKET_BITS + 1) * HISTOGRAM_SUB_BUCKET_COUNT)
+
+struct histogram
+{
+    uint64_t Count;
+    uint64_t Total;
+    uint64_t Min;
+    uint64_t Max;
+    uint32_t Buckets[HISTOGRAM_BUCKET_COUNT];
+};
+
+void HistogramRecord(histogram *Histogram, uint64_t Value);
+uint64_t HistogramPercentile(histogram *Histogram, double Percentile);
+void HistogramReset(histogram *Histogram);
+
+#endif
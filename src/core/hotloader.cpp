@@ -9,39 +9,59 @@
 
 #include <sys/stat.h>
 #include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
 
 #define internal static
 
+/*
+ * NOTE(koekeishiya): Both commands are sent over the same connection, so that the daemon
+ * is guaranteed to handle the unload before the load.
+ */
 internal void
-PerformIOOperation(const char *Op, char *Filename)
+PerformIOOperations(const char **Ops, int Count, char *Filename)
 {
+    char *User = getenv("USER");
+    if (!User) return;
+
+    char SocketPath[255];
+    snprintf(SocketPath, sizeof(SocketPath), SOCKET_PATH_FMT, User);
+
     int SockFD;
-    if (ConnectToDaemon(&SockFD, CHUNKWM_PORT)) {
-        char Message[256];
-        Message[0] = '\0';
-        snprintf(Message, sizeof(Message), "%s %s", Op, Filename);
-        WriteToSocket(Message, SockFD);
-        CloseSocket(SockFD);
+    if (ConnectToDaemon(&SockFD, SocketPath)) {
+        daemon_reader Reader = {};
+        for (int Index = 0; Index < Count; ++Index) {
+            char Message[256];
+            snprintf(Message, sizeof(Message), "%s %s", Ops[Index], Filename);
+            if (!SendDaemonRequest(Message, SockFD)) break;
+            if (!ReadDaemonResponse(&Reader, SockFD)) break;
+        }
+        FreeDaemonReader(&Reader);
     }
+    CloseSocket(SockFD);
 }
 
 internal HOTLOADER_CALLBACK(HotloadPluginCallback)
 {
     c_log(C_LOG_LEVEL_DEBUG, "hotloader: plugin '%s' changed!\n", filename);
 
+    const char *Ops[2] = { "core::unload", "core::load" };
+    int Count = 1;
+
     c_log(C_LOG_LEVEL_DEBUG, "hotloader: unloading plugin '%s'\n", filename);
-    PerformIOOperation("core::unload", filename);
 
     struct stat Buffer;
     if (stat(absolutepath, &Buffer) == 0) {
         c_log(C_LOG_LEVEL_DEBUG, "hotloader: loading plugin '%s'\n", filename);
-        PerformIOOperation("core::load", filename);
+        ++Count;
     }
+
+    PerformIOOperations(Ops, Count, filename);
 }
 
 void HotloadPlugins(hotloader *Hotloader, hotloader_callback Callback)
 {
-    char *PluginDirectory = CVarStringValue(CVAR_PLUGIN_DIR);
+    char *PluginDirectory = CVarStringDuplicate(CVAR_PLUGIN_DIR);
     if (PluginDirectory && CVarIntegerValue(CVAR_PLUGIN_HOTLOAD)) {
         if (hotloader_add_catalog(Hotloader, PluginDirectory, ".so") &&
             hotloader_begin(Hotloader, Callback)) {
@@ -50,4 +70,5 @@ void HotloadPlugins(hotloader *Hotloader, hotloader_callback Callback)
             c_log(C_LOG_LEVEL_WARN, "chunkwm: could not watch directory '%s' for changes to plugins!\n", PluginDirectory);
         }
     }
+    free(PluginDirectory);
 }
@@ -1,4 +1,5 @@
 #include "plugin.h"
+#include "delivery.h"
 #include "cvar.h"
 #include "clog.h"
 
@@ -10,16 +11,24 @@
 #include <pthread.h>
 #include <dirent.h>
 #include <map>
+#include <vector>
 
 #define internal static
 
 internal std::map<const char *, loaded_plugin *, string_comparator> LoadedPlugins;
 internal pthread_mutex_t LoadedPluginLock;
 
-internal pthread_mutex_t Mutexes[chunkwm_export_count];
-internal plugin_list ExportedPlugins[chunkwm_export_count];
+internal plugin_list EmptyPluginList;
+internal plugin_list *volatile ExportedPlugins[chunkwm_export_count];
+internal pthread_mutex_t ExportedPluginLock;
 
-internal chunkwm_api API = { UpdateCVarAPI,  AcquireCVarAPI, FindCVarAPI, ChunkwmBroadcast, (chunkwm_log*)c_log };
+internal uint32_t volatile PluginListReaders;
+internal uint32_t volatile RetiredPluginListCount;
+internal std::vector<plugin_list *> RetiredPluginLists;
+
+internal chunkwm_api API = { UpdateCVarAPI,  AcquireCVarAPI, FindCVarAPI, ChunkwmBroadcast, (chunkwm_log*)c_log,
+                             AcquireCVarHandleAPI, WatchCVarAPI, UnwatchCVarAPI, CopyCVarAPI,
+                             CopyCVarHandleAPI };
 
 internal bool
 VerifyPluginFormat(plugin_details *Info)
@@ -33,13 +42,32 @@ VerifyPluginFormat(plugin_details *Info)
     return Result;
 }
 
+/*
+ * NOTE(koekeishiya): Plugins built against an older API version are still accepted, as long as
+ * the API only grew at the end of 'chunkwm_api'. Plugins older than version 9 do not have a
+ * handler table in their plugin struct, so every event is passed to them by name.
+ */
+#define CHUNKWM_PLUGIN_API_VERSION_LEGACY   8
+#define CHUNKWM_PLUGIN_API_VERSION_HANDLERS 9
+
 internal bool
 VerifyPluginABI(plugin_details *Info)
 {
-    bool Result = (Info->ApiVersion == CHUNKWM_PLUGIN_API_VERSION);
+    bool Result = ((Info->ApiVersion >= CHUNKWM_PLUGIN_API_VERSION_LEGACY) &&
+                   (Info->ApiVersion <= CHUNKWM_PLUGIN_API_VERSION));
     return Result;
 }
 
+internal inline plugin_event_func *
+GetPluginEventHandler(loaded_plugin *LoadedPlugin, chunkwm_plugin_export Export)
+{
+    if (LoadedPlugin->Info->ApiVersion < CHUNKWM_PLUGIN_API_VERSION_HANDLERS) {
+        return NULL;
+    }
+
+    return LoadedPlugin->Plugin->Handlers[Export];
+}
+
 internal void
 PrintPluginDetails(plugin_details *Info)
 {
@@ -55,41 +83,108 @@ PrintPluginDetails(plugin_details *Info)
            Info->PluginVersion);
 }
 
+/*
+ * NOTE(koekeishiya): Snapshots are swapped and retired while holding ExportedPluginLock, so
+ * every retired snapshot was unpublished before the reader count is checked. If there are no
+ * readers at that point, no reader can still hold one of them, and they can all be freed.
+ */
+internal void
+ReclaimPluginListsLocked()
+{
+    if (__atomic_load_n(&PluginListReaders, __ATOMIC_SEQ_CST) == 0) {
+        for (size_t Index = 0; Index < RetiredPluginLists.size(); ++Index) {
+            free(RetiredPluginLists[Index]);
+        }
+
+        RetiredPluginLists.clear();
+        __atomic_store_n(&RetiredPluginListCount, 0, __ATOMIC_RELAXED);
+    }
+}
+
 plugin_list *BeginPluginList(chunkwm_plugin_export Export)
 {
-    pthread_mutex_lock(&Mutexes[Export]);
-    return &ExportedPlugins[Export];
+    __atomic_add_fetch(&PluginListReaders, 1, __ATOMIC_SEQ_CST);
+    return __atomic_load_n(&ExportedPlugins[Export], __ATOMIC_SEQ_CST);
 }
 
-void EndPluginList(chunkwm_plugin_export Export)
+void EndPluginList()
 {
-    pthread_mutex_unlock(&Mutexes[Export]);
+    if ((__atomic_sub_fetch(&PluginListReaders, 1, __ATOMIC_SEQ_CST) == 0) &&
+        (__atomic_load_n(&RetiredPluginListCount, __ATOMIC_RELAXED) != 0)) {
+        // NOTE(koekeishiya): Never block the dispatch path; the next writer reclaims instead.
+        if (pthread_mutex_trylock(&ExportedPluginLock) == 0) {
+            ReclaimPluginListsLocked();
+            pthread_mutex_unlock(&ExportedPluginLock);
+        }
+    }
+}
+
+internal plugin_list *
+AllocatePluginList(unsigned Count)
+{
+    plugin_list *List = (plugin_list *) malloc(sizeof(plugin_list) + Count * sizeof(plugin_subscriber));
+    List->Count = Count;
+    List->Subscribers = (plugin_subscriber *) (List + 1);
+    return List;
+}
+
+// NOTE(koekeishiya): Caller must hold ExportedPluginLock.
+internal void
+PublishPluginList(chunkwm_plugin_export Export, plugin_list *List)
+{
+    plugin_list *Old = __atomic_exchange_n(&ExportedPlugins[Export], List, __ATOMIC_SEQ_CST);
+    if (Old != &EmptyPluginList) {
+        RetiredPluginLists.push_back(Old);
+        __atomic_add_fetch(&RetiredPluginListCount, 1, __ATOMIC_RELAXED);
+    }
+
+    ReclaimPluginListsLocked();
 }
 
 internal void
-SubscribeToEvent(plugin *Plugin, chunkwm_plugin_export Export)
+SubscribeToEvent(plugin *Plugin, chunkwm_plugin_export Export, plugin_event_func *Handler)
 {
-    plugin_list *List = BeginPluginList(Export);
+    pthread_mutex_lock(&ExportedPluginLock);
 
-    plugin_list_iter It = List->find(Plugin);
-    if (It == List->end()) {
-       (*List)[Plugin] = true;
+    plugin_list *Old = ExportedPlugins[Export];
+    for (unsigned Index = 0; Index < Old->Count; ++Index) {
+        if (Old->Subscribers[Index].Plugin == Plugin) {
+            pthread_mutex_unlock(&ExportedPluginLock);
+            return;
+        }
     }
 
-    EndPluginList(Export);
+    plugin_list *List = AllocatePluginList(Old->Count + 1);
+    memcpy(List->Subscribers, Old->Subscribers, Old->Count * sizeof(plugin_subscriber));
+    List->Subscribers[Old->Count].Plugin = Plugin;
+    List->Subscribers[Old->Count].Handler = Handler;
+    PublishPluginList(Export, List);
+
+    pthread_mutex_unlock(&ExportedPluginLock);
 }
 
 internal void
 UnsubscribeFromEvent(plugin *Plugin, chunkwm_plugin_export Export)
 {
-    plugin_list *List = BeginPluginList(Export);
+    pthread_mutex_lock(&ExportedPluginLock);
+
+    plugin_list *Old = ExportedPlugins[Export];
+    for (unsigned Index = 0; Index < Old->Count; ++Index) {
+        if (Old->Subscribers[Index].Plugin != Plugin) continue;
+
+        plugin_list *List = &EmptyPluginList;
+        if (Old->Count > 1) {
+            List = AllocatePluginList(Old->Count - 1);
+            memcpy(List->Subscribers, Old->Subscribers, Index * sizeof(plugin_subscriber));
+            memcpy(List->Subscribers + Index, Old->Subscribers + Index + 1,
+                   (Old->Count - Index - 1) * sizeof(plugin_subscriber));
+        }
 
-    plugin_list_iter It = List->find(Plugin);
-    if (It != List->end()) {
-        List->erase(It);
+        PublishPluginList(Export, List);
+        break;
     }
 
-    EndPluginList(Export);
+    pthread_mutex_unlock(&ExportedPluginLock);
 }
 
 internal void
@@ -103,7 +198,7 @@ HookPlugin(loaded_plugin *LoadedPlugin)
                   "Plugin '%s' subscribed to '%s'\n",
                   LoadedPlugin->Info->PluginName,
                   chunkwm_plugin_export_str[*Export]);
-            SubscribeToEvent(Plugin, *Export);
+            SubscribeToEvent(Plugin, *Export, GetPluginEventHandler(LoadedPlugin, *Export));
         }
     }
     Plugin->Run("chunkwm_events_subscribed", NULL);
@@ -221,8 +316,8 @@ bool LoadPlugin(const char *Absolutepath, const char *Filename)
     }
 
     if (!VerifyPluginABI(Info)) {
-        c_log(C_LOG_LEVEL_ERROR, "chunkwm: plugin '%s' ABI mismatch; expected %d, was %d\n",
-              Info->PluginName, CHUNKWM_PLUGIN_API_VERSION, Info->ApiVersion);
+        c_log(C_LOG_LEVEL_ERROR, "chunkwm: plugin '%s' ABI mismatch; expected %d to %d, was %d\n",
+              Info->PluginName, CHUNKWM_PLUGIN_API_VERSION_LEGACY, CHUNKWM_PLUGIN_API_VERSION, Info->ApiVersion);
         goto abi_err;
     }
 
@@ -243,6 +338,10 @@ bool LoadPlugin(const char *Absolutepath, const char *Filename)
     LoadedPlugin->Filename = strdup(Filename);
     StoreLoadedPlugin(LoadedPlugin);
     HookPlugin(LoadedPlugin);
+
+    if (PluginDeliveryIsAsync(Filename)) {
+        BeginPluginQueue(Plugin, Filename);
+    }
     goto out;
 
 plugin_init_err:
@@ -270,6 +369,7 @@ bool UnloadPlugin(const char *Absolutepath, const char *Filename)
         UnhookPlugin(LoadedPlugin);
 
         plugin *Plugin = LoadedPlugin->Plugin;
+        EndPluginQueue(Plugin);
         Plugin->DeInit();
 
         Result = dlclose(LoadedPlugin->Handle) == 0;
@@ -306,9 +406,11 @@ bool UnloadPlugin(const char *Absolutepath, const char *Filename)
 bool BeginPlugins()
 {
     for (int Index = 0; Index < chunkwm_export_count; ++Index) {
-        if (pthread_mutex_init(&Mutexes[Index], NULL) != 0) {
-            return false;
-        }
+        ExportedPlugins[Index] = &EmptyPluginList;
+    }
+
+    if (pthread_mutex_init(&ExportedPluginLock, NULL) != 0) {
+        return false;
     }
 
     return (pthread_mutex_init(&LoadedPluginLock, NULL) == 0);
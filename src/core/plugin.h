@@ -6,10 +6,15 @@
 
 #include <map>
 
+/*
+ * NOTE(koekeishiya): 'SockFD' is the response socket of the request that asked for the plugin
+ * to be loaded or unloaded, and is completed once the load or unload has run; -1 if none.
+ */
 struct plugin_fs
 {
     char *Absolutepath;
     char *Filename;
+    int SockFD;
 };
 
 struct loaded_plugin
@@ -20,13 +25,31 @@ struct loaded_plugin
     plugin_details *Info;
 };
 
-typedef std::map<plugin *, bool>  plugin_list;
-typedef plugin_list::iterator plugin_list_iter;
+/*
+ * NOTE(koekeishiya): 'Handler' is NULL if the event must be passed
+ * by name through 'plugin->Run'.
+ */
+struct plugin_subscriber
+{
+    plugin *Plugin;
+    plugin_event_func *Handler;
+};
+
+/*
+ * NOTE(koekeishiya): An immutable snapshot of the subscribers of an export. Subscribing and
+ * unsubscribing publishes a new snapshot; a snapshot returned by BeginPluginList stays valid
+ * until the matching EndPluginList, after which it may be reclaimed.
+ */
+struct plugin_list
+{
+    unsigned Count;
+    plugin_subscriber *Subscribers;
+};
 
 bool BeginPlugins();
 
 plugin_list *BeginPluginList(chunkwm_plugin_export Export);
-void EndPluginList(chunkwm_plugin_export Export);
+void EndPluginList();
 
 bool LoadPlugin(const char *Absolutepath, const char *Filename);
 bool UnloadPlugin(const char *Absolutepath, const char *Filename);
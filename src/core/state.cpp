@@ -351,13 +351,17 @@ void ConstructAndAddApplication(carbon_application_details *Info)
     ConstructAndAddApplicationDispatch(Application, Info, 0.0f);
 }
 
-void RemoveAndDestroyApplication(macos_application *Application)
+void RemoveApplication(macos_application *Application)
 {
     macos_application_map_it It = Applications.find(Application->PID);
     if (It != Applications.end()) {
         Applications.erase(It);
     }
+}
 
+void RemoveAndDestroyApplication(macos_application *Application)
+{
+    RemoveApplication(Application);
     AXLibDestroyApplication(Application);
 }
 
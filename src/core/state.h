@@ -13,6 +13,7 @@ void UpdateWindowTitle(macos_window *Window);
 struct macos_application;
 macos_application *GetApplicationFromPID(pid_t PID);
 void ConstructAndAddApplication(carbon_application_details *Info);
+void RemoveApplication(macos_application *Application);
 void RemoveAndDestroyApplication(macos_application *Application);
 
 bool InitState();
@@ -0,0 +1,298 @@
+#include "subscription.h"
+#include "clog.h"
+
+#include "../common/ipc/daemon.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <vector>
+
+#define internal static
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+#define EVENT_RECORD_SIZE 512
+#define EVENT_BROADCAST_HEX_LIMIT 64
+
+struct event_subscription
+{
+    int SockFD;
+    uint32_t Topics;
+
+    char Pending[EVENT_RECORD_SIZE];
+    size_t PendingOffset;
+    size_t PendingLength;
+
+    uint64_t Dropped;
+    uint64_t TotalDropped;
+    uint64_t Published;
+};
+
+enum subscription_write_result
+{
+    SubscriptionWrite_Accepted,
+    SubscriptionWrite_Blocked,
+    SubscriptionWrite_Failed,
+};
+
+internal std::vector<event_subscription *> Subscriptions;
+internal uint32_t SubscribedTopics;
+
+internal const char *EventTopicNames[] =
+{
+    "focus",
+    "space",
+    "window",
+    "broadcast",
+};
+
+bool ParseEventTopic(const char *Text, size_t Length, uint32_t *Topic)
+{
+    for (size_t Index = 0; Index < sizeof(EventTopicNames) / sizeof(EventTopicNames[0]); ++Index) {
+        if ((strlen(EventTopicNames[Index]) == Length) &&
+            (strncmp(EventTopicNames[Index], Text, Length) == 0)) {
+            *Topic = 1 << Index;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void EventTopicsToString(uint32_t Topics, char *Buffer, size_t Size)
+{
+    size_t Length = 0;
+    Buffer[0] = '\0';
+
+    for (size_t Index = 0; Index < sizeof(EventTopicNames) / sizeof(EventTopicNames[0]); ++Index) {
+        if ((Topics & (1 << Index)) && (Length < Size)) {
+            Length += snprintf(Buffer + Length, Size - Length, "%s%s", Length ? "," : "", EventTopicNames[Index]);
+        }
+    }
+}
+
+internal void
+UpdateSubscribedTopics()
+{
+    SubscribedTopics = 0;
+    for (size_t Index = 0; Index < Subscriptions.size(); ++Index) {
+        SubscribedTopics |= Subscriptions[Index]->Topics;
+    }
+}
+
+internal bool
+FlushPendingRecord(event_subscription *Subscription)
+{
+    while (Subscription->PendingLength) {
+        ssize_t Count = send(Subscription->SockFD,
+                             Subscription->Pending + Subscription->PendingOffset,
+                             Subscription->PendingLength,
+                             MSG_NOSIGNAL);
+        if (Count == -1) {
+            if (errno == EINTR) continue;
+            return (errno == EAGAIN) || (errno == EWOULDBLOCK);
+        }
+
+        Subscription->PendingOffset += Count;
+        Subscription->PendingLength -= Count;
+    }
+
+    Subscription->PendingOffset = 0;
+    return true;
+}
+
+/*
+ * NOTE(koekeishiya): If only part of a record fits in the socket buffer, the remainder is kept
+ * and written before anything else, so that a record is never interleaved with another.
+ */
+internal subscription_write_result
+WriteRecord(event_subscription *Subscription, const char *Record, size_t Length)
+{
+    ssize_t Count;
+    do {
+        Count = send(Subscription->SockFD, Record, Length, MSG_NOSIGNAL);
+    } while ((Count == -1) && (errno == EINTR));
+
+    if (Count == -1) {
+        if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
+            return SubscriptionWrite_Blocked;
+        }
+        return SubscriptionWrite_Failed;
+    }
+
+    if ((size_t) Count < Length) {
+        memcpy(Subscription->Pending, Record + Count, Length - Count);
+        Subscription->PendingOffset = 0;
+        Subscription->PendingLength = Length - Count;
+    }
+
+    return SubscriptionWrite_Accepted;
+}
+
+// NOTE(koekeishiya): Returns false if the subscriber is gone.
+internal bool
+DeliverRecord(event_subscription *Subscription, const char *Record, size_t Length)
+{
+    if (!FlushPendingRecord(Subscription)) {
+        return false;
+    }
+
+    if (Subscription->PendingLength) {
+        goto dropped;
+    }
+
+    if (Subscription->Dropped) {
+        char Notice[64];
+        size_t NoticeLength = snprintf(Notice, sizeof(Notice), "dropped %llu\n", Subscription->Dropped);
+
+        subscription_write_result Result = WriteRecord(Subscription, Notice, NoticeLength);
+        if (Result == SubscriptionWrite_Failed) return false;
+        if (Result == SubscriptionWrite_Blocked) goto dropped;
+
+        Subscription->Dropped = 0;
+        if (Subscription->PendingLength) goto dropped;
+    }
+
+    switch (WriteRecord(Subscription, Record, Length)) {
+    case SubscriptionWrite_Accepted: { ++Subscription->Published; } break;
+    case SubscriptionWrite_Blocked:  { goto dropped; } break;
+    case SubscriptionWrite_Failed:   { return false; } break;
+    }
+
+    return true;
+
+dropped:
+    ++Subscription->Dropped;
+    ++Subscription->TotalDropped;
+    return true;
+}
+
+internal void
+EndEventSubscription(size_t Index)
+{
+    event_subscription *Subscription = Subscriptions[Index];
+    c_log(C_LOG_LEVEL_DEBUG, "chunkwm: event subscription %d ended\n", Subscription->SockFD);
+
+    CloseSocket(Subscription->SockFD);
+    Subscriptions.erase(Subscriptions.begin() + Index);
+    free(Subscription);
+    UpdateSubscribedTopics();
+}
+
+internal void
+PublishRecord(uint32_t Topic, const char *Record, size_t Length)
+{
+    for (size_t Index = 0; Index < Subscriptions.size();) {
+        event_subscription *Subscription = Subscriptions[Index];
+        if ((Subscription->Topics & Topic) && !DeliverRecord(Subscription, Record, Length)) {
+            EndEventSubscription(Index);
+        } else {
+            ++Index;
+        }
+    }
+}
+
+/*
+ * NOTE(koekeishiya): Takes ownership of the response socket of a daemon request. The client
+ * receives a 'subscribed' record once the subscription is active, and can safely query the
+ * current state after that without missing any changes.
+ */
+bool BeginEventSubscription(int SockFD, uint32_t Topics)
+{
+    int Flags = fcntl(SockFD, F_GETFL, 0);
+    if ((Flags == -1) || (fcntl(SockFD, F_SETFL, Flags | O_NONBLOCK) == -1)) {
+        c_log(C_LOG_LEVEL_WARN, "chunkwm: could not begin event subscription\n");
+        return false;
+    }
+
+    event_subscription *Subscription = (event_subscription *) calloc(1, sizeof(event_subscription));
+    Subscription->SockFD = SockFD;
+    Subscription->Topics = Topics;
+
+    const char Record[] = "subscribed\n";
+    if (!DeliverRecord(Subscription, Record, sizeof(Record) - 1)) {
+        free(Subscription);
+        return false;
+    }
+
+    Subscriptions.push_back(Subscription);
+    SubscribedTopics |= Topics;
+
+    c_log(C_LOG_LEVEL_DEBUG, "chunkwm: event subscription %d began\n", SockFD);
+    return true;
+}
+
+void PublishEventRecord(uint32_t Topic, const char *Format, ...)
+{
+    if (!(SubscribedTopics & Topic)) {
+        return;
+    }
+
+    char Record[EVENT_RECORD_SIZE];
+
+    va_list Args;
+    va_start(Args, Format);
+    int Length = vsnprintf(Record, sizeof(Record) - 1, Format, Args);
+    va_end(Args);
+
+    if (Length < 0) {
+        return;
+    } else if (Length > (int) sizeof(Record) - 2) {
+        Length = sizeof(Record) - 2;
+    }
+
+    Record[Length++] = '\n';
+    PublishRecord(Topic, Record, Length);
+}
+
+/*
+ * NOTE(koekeishiya): Broadcast data is opaque to us. A null-terminated string that fits on a single
+ * line is passed through as is, anything else is written as hex.
+ */
+void PublishBroadcastRecord(const char *PluginEvent, void *Data, size_t Size)
+{
+    if (!(SubscribedTopics & EventTopic_Broadcast)) {
+        return;
+    }
+
+    const unsigned char *Bytes = (const unsigned char *) Data;
+    bool IsString = (Size > 0) && (Bytes[Size - 1] == '\0');
+    for (size_t Index = 0; IsString && (Index < Size - 1); ++Index) {
+        IsString = isprint(Bytes[Index]) != 0;
+    }
+
+    if (Size == 0) {
+        PublishEventRecord(EventTopic_Broadcast, "broadcast %s", PluginEvent);
+    } else if (IsString) {
+        PublishEventRecord(EventTopic_Broadcast, "broadcast %s %s", PluginEvent, (const char *) Bytes);
+    } else {
+        char Hex[2 * EVENT_BROADCAST_HEX_LIMIT + 1];
+        size_t Count = Size < EVENT_BROADCAST_HEX_LIMIT ? Size : EVENT_BROADCAST_HEX_LIMIT;
+        for (size_t Index = 0; Index < Count; ++Index) {
+            snprintf(Hex + 2 * Index, 3, "%02x", Bytes[Index]);
+        }
+        Hex[2 * Count] = '\0';
+        PublishEventRecord(EventTopic_Broadcast, "broadcast %s 0x%s", PluginEvent, Hex);
+    }
+}
+
+int EventSubscriptionStats(event_subscription_stats *Stats, int MaxCount)
+{
+    int Count = 0;
+    for (size_t Index = 0; (Index < Subscriptions.size()) && (Count < MaxCount); ++Index) {
+        event_subscription *Subscription = Subscriptions[Index];
+        event_subscription_stats *Entry = Stats + Count++;
+        Entry->Topics = Subscription->Topics;
+        Entry->Published = Subscription->Published;
+        Entry->Dropped = Subscription->TotalDropped;
+    }
+    return Count;
+}
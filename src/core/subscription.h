@@ -0,0 +1,45 @@
+#ifndef CHUNKWM_CORE_SUBSCRIPTION_H
+#define CHUNKWM_CORE_SUBSCRIPTION_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+enum event_topic
+{
+    EventTopic_Focus     = (1 << 0),
+    EventTopic_Space     = (1 << 1),
+    EventTopic_Window    = (1 << 2),
+    EventTopic_Broadcast = (1 << 3),
+
+    EventTopic_All       = EventTopic_Focus |
+                           EventTopic_Space |
+                           EventTopic_Window |
+                           EventTopic_Broadcast,
+};
+
+/*
+ * NOTE(koekeishiya): Every record is a single line of text, and is either written to a
+ * subscriber in full or dropped. Records are dropped while a subscriber has not caught up
+ * with the output of a previous record, and the number of dropped records is reported as
+ * 'dropped <count>' in front of the next record that is written.
+ *
+ * Subscriptions are only touched from the event-loop thread, and end when a write fails
+ * because the client has disconnected.
+ */
+struct event_subscription_stats
+{
+    uint32_t Topics;
+    uint64_t Published;
+    uint64_t Dropped;
+};
+
+bool ParseEventTopic(const char *Text, size_t Length, uint32_t *Topic);
+void EventTopicsToString(uint32_t Topics, char *Buffer, size_t Size);
+
+bool BeginEventSubscription(int SockFD, uint32_t Topics);
+void PublishEventRecord(uint32_t Topic, const char *Format, ...);
+void PublishBroadcastRecord(const char *PluginEvent, void *Data, size_t Size);
+
+int EventSubscriptionStats(event_subscription_stats *Stats, int MaxCount);
+
+#endif
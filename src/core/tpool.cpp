@@ -0,0 +1,319 @@
+#include "tpool.h"
+#include "clog.h"
+
+#include <string.h>
+#include <sched.h>
+
+#define internal static
+
+internal inline void
+CompleteTask(thread_pool *Pool, thread_pool_task *Task)
+{
+    Task->Callback(Task->Data);
+
+    if (__atomic_sub_fetch(&Task->Group->Pending, 1, __ATOMIC_ACQ_REL) == 0) {
+        pthread_mutex_lock(&Pool->JoinLock);
+        pthread_cond_broadcast(&Pool->JoinDone);
+        pthread_mutex_unlock(&Pool->JoinLock);
+    }
+}
+
+// NOTE(koekeishiya): The owner takes the oldest task from the head of its own deque.
+internal bool
+PopTask(thread_pool_worker *Worker, thread_pool_task *Task)
+{
+    bool Result = false;
+    pthread_mutex_lock(&Worker->Lock);
+    if (Worker->Head != Worker->Tail) {
+        *Task = Worker->Tasks[Worker->Head % THREAD_POOL_DEQUE_SIZE];
+        __atomic_store_n(&Worker->Head, Worker->Head + 1, __ATOMIC_RELAXED);
+        Result = true;
+    }
+    pthread_mutex_unlock(&Worker->Lock);
+    return Result;
+}
+
+internal inline bool
+IsDequeEmpty(thread_pool_worker *Worker)
+{
+    return __atomic_load_n(&Worker->Head, __ATOMIC_SEQ_CST) == __atomic_load_n(&Worker->Tail, __ATOMIC_SEQ_CST);
+}
+
+/*
+ * NOTE(koekeishiya): A joining thread only helps with tasks of its own group. Running a task of
+ * another group could make it wait for an unrelated (and possibly slow) plugin, and that group's
+ * own joiner would then wait on us. Takes the newest task of 'Group' from any deque.
+ */
+internal bool
+StealGroupTask(thread_pool *Pool, task_group *Group, thread_pool_task *Task)
+{
+    for (unsigned Index = 0; Index < Pool->WorkerCount; ++Index) {
+        thread_pool_worker *Victim = Pool->Workers + Index;
+        if (IsDequeEmpty(Victim)) continue;
+
+        bool Result = false;
+        pthread_mutex_lock(&Victim->Lock);
+        for (uint32_t Position = Victim->Tail; Position != Victim->Head; --Position) {
+            if (Victim->Tasks[(Position - 1) % THREAD_POOL_DEQUE_SIZE].Group != Group) continue;
+
+            *Task = Victim->Tasks[(Position - 1) % THREAD_POOL_DEQUE_SIZE];
+            for (uint32_t Next = Position; Next != Victim->Tail; ++Next) {
+                Victim->Tasks[(Next - 1) % THREAD_POOL_DEQUE_SIZE] = Victim->Tasks[Next % THREAD_POOL_DEQUE_SIZE];
+            }
+            __atomic_store_n(&Victim->Tail, Victim->Tail - 1, __ATOMIC_RELAXED);
+            Result = true;
+            break;
+        }
+        pthread_mutex_unlock(&Victim->Lock);
+
+        if (Result) return true;
+    }
+
+    return false;
+}
+
+// NOTE(koekeishiya): Thieves take the newest task from the tail of a victim's deque.
+internal bool
+StealTask(thread_pool *Pool, unsigned Start, thread_pool_task *Task)
+{
+    for (unsigned Offset = 0; Offset < Pool->WorkerCount; ++Offset) {
+        thread_pool_worker *Victim = Pool->Workers + ((Start + Offset) % Pool->WorkerCount);
+        if (IsDequeEmpty(Victim)) continue;
+
+        bool Result = false;
+        pthread_mutex_lock(&Victim->Lock);
+        if (Victim->Head != Victim->Tail) {
+            __atomic_store_n(&Victim->Tail, Victim->Tail - 1, __ATOMIC_RELAXED);
+            *Task = Victim->Tasks[Victim->Tail % THREAD_POOL_DEQUE_SIZE];
+            Result = true;
+        }
+        pthread_mutex_unlock(&Victim->Lock);
+
+        if (Result) return true;
+    }
+
+    return false;
+}
+
+internal bool
+HasPendingTasks(thread_pool *Pool)
+{
+    for (unsigned Index = 0; Index < Pool->WorkerCount; ++Index) {
+        if (!IsDequeEmpty(Pool->Workers + Index)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// NOTE(koekeishiya): Wakes one parked worker, if there is one, so that it can steal a task.
+internal void
+WakeParkedWorker(thread_pool *Pool, unsigned Start)
+{
+    for (unsigned Offset = 0; Offset < Pool->WorkerCount; ++Offset) {
+        thread_pool_worker *Worker = Pool->Workers + ((Start + Offset) % Pool->WorkerCount);
+        if (!__atomic_load_n(&Worker->Sleeping, __ATOMIC_SEQ_CST)) continue;
+
+        pthread_mutex_lock(&Worker->Lock);
+        bool Sleeping = Worker->Sleeping;
+        if (Sleeping) {
+            pthread_cond_signal(&Worker->Wake);
+        }
+        pthread_mutex_unlock(&Worker->Lock);
+
+        if (Sleeping) return;
+    }
+}
+
+internal void *
+ThreadPoolWorkerProc(void *Data)
+{
+    thread_pool_worker *Worker = (thread_pool_worker *) Data;
+    thread_pool *Pool = Worker->Pool;
+    thread_pool_task Task;
+    unsigned Spins = 0;
+
+    for (;;) {
+        if (PopTask(Worker, &Task)) {
+            CompleteTask(Pool, &Task);
+            __atomic_add_fetch(&Worker->Executed, 1, __ATOMIC_RELAXED);
+            Spins = 0;
+        } else if (StealTask(Pool, Worker->Index + 1, &Task)) {
+            CompleteTask(Pool, &Task);
+            __atomic_add_fetch(&Worker->Executed, 1, __ATOMIC_RELAXED);
+            __atomic_add_fetch(&Worker->Stolen, 1, __ATOMIC_RELAXED);
+            Spins = 0;
+        } else if (Spins++ < THREAD_POOL_SPIN_COUNT) {
+            /*
+             * NOTE(koekeishiya): Plugin fan-out arrives in short bursts, one per event.
+             * Yielding for a little while is a lot cheaper than a park and wake round-trip.
+             */
+            sched_yield();
+        } else {
+            Spins = 0;
+            /*
+             * NOTE(koekeishiya): A task may be pushed to the deque of a busy worker, and the
+             * submitter then wakes a parked worker to steal it. We flag that we are sleeping
+             * before we look at the other deques one last time, and the submitter looks for
+             * sleeping workers after it has pushed the task, so one of us always sees the other.
+             */
+            pthread_mutex_lock(&Worker->Lock);
+            if (Worker->Head == Worker->Tail) {
+                __atomic_store_n(&Worker->Sleeping, true, __ATOMIC_SEQ_CST);
+                if (!HasPendingTasks(Pool)) {
+                    __atomic_add_fetch(&Worker->Parked, 1, __ATOMIC_RELAXED);
+                    pthread_cond_wait(&Worker->Wake, &Worker->Lock);
+                }
+                __atomic_store_n(&Worker->Sleeping, false, __ATOMIC_SEQ_CST);
+            }
+            pthread_mutex_unlock(&Worker->Lock);
+        }
+    }
+
+    return NULL;
+}
+
+bool BeginThreadPool(thread_pool *Pool, unsigned Count)
+{
+    if (Count > THREAD_POOL_MAX_WORKERS) {
+        Count = THREAD_POOL_MAX_WORKERS;
+    }
+
+    if ((pthread_mutex_init(&Pool->JoinLock, NULL) != 0) ||
+        (pthread_cond_init(&Pool->JoinDone, NULL) != 0)) {
+        return false;
+    }
+
+    for (unsigned Index = 0; Index < Count; ++Index) {
+        thread_pool_worker *Worker = Pool->Workers + Index;
+        Worker->Pool = Pool;
+        Worker->Index = Index;
+        Worker->Head = Worker->Tail = 0;
+
+        if ((pthread_mutex_init(&Worker->Lock, NULL) != 0) ||
+            (pthread_cond_init(&Worker->Wake, NULL) != 0)) {
+            return false;
+        }
+    }
+
+    /*
+     * NOTE(koekeishiya): Workers read 'WorkerCount' without a lock when they look for tasks to
+     * steal, so it must be set before the first of them is started. Failing to start a worker
+     * is fatal to the caller.
+     */
+    Pool->WorkerCount = Count;
+    for (unsigned Index = 0; Index < Count; ++Index) {
+        thread_pool_worker *Worker = Pool->Workers + Index;
+        if (pthread_create(&Worker->Thread, NULL, &ThreadPoolWorkerProc, Worker) != 0) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+unsigned ThreadPoolSize(thread_pool *Pool)
+{
+    return Pool->WorkerCount;
+}
+
+/*
+ * NOTE(koekeishiya): Counters are updated atomically from any thread, but are read one at a
+ * time, so the values are approximate while the pool is busy.
+ */
+void ThreadPoolStats(thread_pool *Pool, thread_pool_stats *Stats)
+{
+    memset(Stats, 0, sizeof(thread_pool_stats));
+    Stats->WorkerCount = Pool->WorkerCount;
+    Stats->Submitted = __atomic_load_n(&Pool->Submitted, __ATOMIC_RELAXED);
+    Stats->Inline = __atomic_load_n(&Pool->Inline, __ATOMIC_RELAXED);
+    Stats->Helped = __atomic_load_n(&Pool->Helped, __ATOMIC_RELAXED);
+    Stats->Joins = __atomic_load_n(&Pool->Joins, __ATOMIC_RELAXED);
+    Stats->JoinParks = __atomic_load_n(&Pool->JoinParks, __ATOMIC_RELAXED);
+
+    for (unsigned Index = 0; Index < Pool->WorkerCount; ++Index) {
+        thread_pool_worker *Worker = Pool->Workers + Index;
+        Stats->Executed += __atomic_load_n(&Worker->Executed, __ATOMIC_RELAXED);
+        Stats->Stolen += __atomic_load_n(&Worker->Stolen, __ATOMIC_RELAXED);
+        Stats->WorkerParks += __atomic_load_n(&Worker->Parked, __ATOMIC_RELAXED);
+    }
+}
+
+// NOTE(koekeishiya): Returns false if the deque is full; wakes the worker if it is parked.
+internal bool
+PushTask(thread_pool_worker *Worker, thread_pool_task *Task, bool *Woken)
+{
+    bool Result = false;
+    pthread_mutex_lock(&Worker->Lock);
+    if (Worker->Tail - Worker->Head < THREAD_POOL_DEQUE_SIZE) {
+        Worker->Tasks[Worker->Tail % THREAD_POOL_DEQUE_SIZE] = *Task;
+        __atomic_store_n(&Worker->Tail, Worker->Tail + 1, __ATOMIC_SEQ_CST);
+        *Woken = Worker->Sleeping;
+        if (*Woken) {
+            pthread_cond_signal(&Worker->Wake);
+        }
+        Result = true;
+    }
+    pthread_mutex_unlock(&Worker->Lock);
+    return Result;
+}
+
+/*
+ * NOTE(koekeishiya): Tasks go to a parked worker if there is one, and are otherwise distributed
+ * round-robin over the worker deques. A worker that is running a slow plugin may then hold the
+ * task, so a parked worker is woken to steal it. If every deque is full (or there are no
+ * workers), the task is executed on the calling thread.
+ */
+void ThreadPoolSubmit(thread_pool *Pool, task_group *Group, work_queue_callback *Callback, void *Data)
+{
+    thread_pool_task Task = { Callback, Data, Group };
+    __atomic_add_fetch(&Group->Pending, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&Pool->Submitted, 1, __ATOMIC_RELAXED);
+
+    bool Woken = false;
+    unsigned Start = __atomic_fetch_add(&Pool->NextWorker, 1, __ATOMIC_RELAXED);
+    for (unsigned Offset = 0; Offset < Pool->WorkerCount; ++Offset) {
+        thread_pool_worker *Worker = Pool->Workers + ((Start + Offset) % Pool->WorkerCount);
+        if ((__atomic_load_n(&Worker->Sleeping, __ATOMIC_RELAXED)) && (PushTask(Worker, &Task, &Woken))) {
+            if (!Woken) WakeParkedWorker(Pool, Start + Offset + 1);
+            return;
+        }
+    }
+
+    for (unsigned Offset = 0; Offset < Pool->WorkerCount; ++Offset) {
+        thread_pool_worker *Worker = Pool->Workers + ((Start + Offset) % Pool->WorkerCount);
+        if (PushTask(Worker, &Task, &Woken)) {
+            if (!Woken) WakeParkedWorker(Pool, Start + Offset + 1);
+            return;
+        }
+    }
+
+    __atomic_add_fetch(&Pool->Inline, 1, __ATOMIC_RELAXED);
+    CompleteTask(Pool, &Task);
+}
+
+/*
+ * NOTE(koekeishiya): The joining thread helps by stealing pending tasks of its own group, and
+ * parks on a condition variable once there is nothing left to steal but the group is still running.
+ */
+void ThreadPoolJoin(thread_pool *Pool, task_group *Group)
+{
+    thread_pool_task Task;
+    __atomic_add_fetch(&Pool->Joins, 1, __ATOMIC_RELAXED);
+
+    while (__atomic_load_n(&Group->Pending, __ATOMIC_ACQUIRE) != 0) {
+        if (!StealGroupTask(Pool, Group, &Task)) break;
+        CompleteTask(Pool, &Task);
+        __atomic_add_fetch(&Pool->Helped, 1, __ATOMIC_RELAXED);
+    }
+
+    if (__atomic_load_n(&Group->Pending, __ATOMIC_ACQUIRE) != 0) {
+        pthread_mutex_lock(&Pool->JoinLock);
+        __atomic_add_fetch(&Pool->JoinParks, 1, __ATOMIC_RELAXED);
+        while (__atomic_load_n(&Group->Pending, __ATOMIC_ACQUIRE) != 0) {
+            pthread_cond_wait(&Pool->JoinDone, &Pool->JoinLock);
+        }
+        pthread_mutex_unlock(&Pool->JoinLock);
+    }
+}
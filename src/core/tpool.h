@@ -0,0 +1,92 @@
+#ifndef CHUNKWM_CORE_TPOOL_H
+#define CHUNKWM_CORE_TPOOL_H
+
+#include "wqueue.h"
+
+#include <stdint.h>
+#include <pthread.h>
+
+#define THREAD_POOL_MAX_WORKERS 16
+#define THREAD_POOL_DEQUE_SIZE  256
+#define THREAD_POOL_SPIN_COUNT  64
+
+/*
+ * NOTE(koekeishiya): Tasks are forked into a task_group and joined through ThreadPoolJoin.
+ * The group is only a counter, so it can live on the stack of the forking thread; a worker
+ * never touches the group after it has decremented the counter.
+ */
+struct task_group
+{
+    uint32_t volatile Pending;
+};
+
+struct thread_pool_task
+{
+    work_queue_callback *Callback;
+    void *Data;
+    task_group *Group;
+};
+
+/*
+ * NOTE(koekeishiya): 'Head' and 'Tail' are only changed while holding 'Lock', but are stored
+ * atomically, because other threads peek at them without the lock to skip empty deques.
+ * 'Sleeping' is likewise set under 'Lock' and read without it by ThreadPoolSubmit.
+ */
+struct thread_pool;
+struct thread_pool_worker
+{
+    pthread_mutex_t Lock;
+    pthread_cond_t Wake;
+    bool volatile Sleeping;
+
+    uint32_t volatile Head;
+    uint32_t volatile Tail;
+    thread_pool_task Tasks[THREAD_POOL_DEQUE_SIZE];
+
+    pthread_t Thread;
+    thread_pool *Pool;
+    unsigned Index;
+
+    uint64_t volatile Executed;
+    uint64_t volatile Stolen;
+    uint64_t volatile Parked;
+} __attribute__((aligned(64)));
+
+struct thread_pool
+{
+    unsigned WorkerCount;
+    uint32_t volatile NextWorker;
+
+    pthread_mutex_t JoinLock;
+    pthread_cond_t JoinDone;
+
+    uint64_t volatile Submitted;
+    uint64_t volatile Inline;
+    uint64_t volatile Helped;
+    uint64_t volatile Joins;
+    uint64_t volatile JoinParks;
+
+    thread_pool_worker Workers[THREAD_POOL_MAX_WORKERS];
+};
+
+struct thread_pool_stats
+{
+    unsigned WorkerCount;
+    uint64_t Submitted;
+    uint64_t Executed;
+    uint64_t Stolen;
+    uint64_t WorkerParks;
+    uint64_t Inline;
+    uint64_t Helped;
+    uint64_t Joins;
+    uint64_t JoinParks;
+};
+
+bool BeginThreadPool(thread_pool *Pool, unsigned Count);
+unsigned ThreadPoolSize(thread_pool *Pool);
+void ThreadPoolStats(thread_pool *Pool, thread_pool_stats *Stats);
+
+void ThreadPoolSubmit(thread_pool *Pool, task_group *Group, work_queue_callback *Callback, void *Data);
+void ThreadPoolJoin(thread_pool *Pool, task_group *Group);
+
+#endif
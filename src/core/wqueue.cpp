@@ -15,7 +15,7 @@ DoNextWorkQueueEntry(work_queue *Queue)
     uint32_t EntryToRead = Queue->EntryToRead;
     uint32_t NextEntryToRead = (EntryToRead + 1) % ArrayCount(Queue->Entries);
     if (EntryToRead != Queue->EntryToWrite) {
-        int Index = __sync_val_compare_and_swap(&Queue->EntryToRead, EntryToRead, NextEntryToRead);
+        uint32_t Index = __sync_val_compare_and_swap(&Queue->EntryToRead, EntryToRead, NextEntryToRead);
         if (Index == EntryToRead) {
             work_queue_entry Entry = Queue->Entries[Index];
             Entry.Callback(Entry.Data);
@@ -0,0 +1,295 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <getopt.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include <map>
+
+#define CHUNKWM_CORE
+#define internal static
+
+#include "../core/clog.h"
+#include "../api/plugin_cvar.h"
+#include "../common/misc/string.h"
+
+#include "../core/cvar.h"
+
+chunkwm_api API =
+{
+    UpdateCVarAPI, AcquireCVarAPI, FindCVarAPI, NULL, NULL,
+    AcquireCVarHandleAPI, WatchCVarAPI, UnwatchCVarAPI, CopyCVarAPI,
+    CopyCVarHandleAPI
+};
+
+#include "../core/cvar.cpp"
+#include "../common/config/cvar.cpp"
+
+/*
+ * NOTE(koekeishiya): Every value that is written has the form '<sequence>:<payload>', where the
+ * length and contents of the payload are derived from the sequence number. A reader that sees a
+ * torn or freed value fails validation. Each cvar has a single writer, so the sequence number
+ * observed through its handle never decreases.
+ */
+#define CVARBENCH_VALUE_SIZE 256
+
+struct cvarbench_reader
+{
+    pthread_t Thread;
+    unsigned Index;
+    uint64_t Reads;
+    uint64_t Failures;
+};
+
+struct cvarbench_writer
+{
+    pthread_t Thread;
+    unsigned Index;
+    uint64_t Writes;
+};
+
+internal unsigned ReaderCount = 4;
+internal unsigned WriterCount = 1;
+internal unsigned CVarCount = 16;
+internal double Duration = 2.0;
+internal bool UseLock;
+
+internal bool volatile Running;
+internal char **Names;
+
+/*
+ * NOTE(koekeishiya): The baseline is a mutex-guarded store, where the reader copies the value
+ * while holding the lock, which is the cheapest way to make the old store safe.
+ */
+internal std::map<const char *, char *, string_comparator> LockedCVars;
+internal pthread_mutex_t LockedCVarsLock = PTHREAD_MUTEX_INITIALIZER;
+
+internal void
+LockedUpdate(const char *Name, char *Value)
+{
+    pthread_mutex_lock(&LockedCVarsLock);
+    std::map<const char *, char *, string_comparator>::iterator It = LockedCVars.find(Name);
+    if (It != LockedCVars.end()) {
+        free(It->second);
+        It->second = strdup(Value);
+    } else {
+        LockedCVars[strdup(Name)] = strdup(Value);
+    }
+    pthread_mutex_unlock(&LockedCVarsLock);
+}
+
+internal int
+LockedCopy(const char *Name, char *Buffer, size_t Size)
+{
+    int Result = -1;
+    pthread_mutex_lock(&LockedCVarsLock);
+    std::map<const char *, char *, string_comparator>::iterator It = LockedCVars.find(Name);
+    if (It != LockedCVars.end()) {
+        Result = snprintf(Buffer, Size, "%s", It->second);
+    }
+    pthread_mutex_unlock(&LockedCVarsLock);
+    return Result;
+}
+
+internal void
+LockedClear()
+{
+    for (std::map<const char *, char *, string_comparator>::iterator It = LockedCVars.begin();
+         It != LockedCVars.end();
+         ++It) {
+        free((char *) It->first);
+        free(It->second);
+    }
+
+    LockedCVars.clear();
+}
+
+internal inline uint64_t
+BenchTime()
+{
+    struct timespec Time;
+    clock_gettime(CLOCK_MONOTONIC, &Time);
+    return (uint64_t) Time.tv_sec * 1000000000ULL + Time.tv_nsec;
+}
+
+internal void
+FormatValue(char *Buffer, unsigned Sequence)
+{
+    int Length = snprintf(Buffer, CVARBENCH_VALUE_SIZE, "%u:", Sequence);
+    int PayloadLength = Sequence % (CVARBENCH_VALUE_SIZE - 16);
+    memset(Buffer + Length, 'a' + (Sequence % 26), PayloadLength);
+    Buffer[Length + PayloadLength] = '\0';
+}
+
+internal bool
+ValidateValue(const char *Value, int Length)
+{
+    char *End;
+    unsigned long Sequence = strtoul(Value, &End, 10);
+    if (*End != ':') return false;
+
+    char Expected[CVARBENCH_VALUE_SIZE];
+    FormatValue(Expected, (unsigned) Sequence);
+    return (Length == (int) strlen(Expected)) && (strcmp(Value, Expected) == 0);
+}
+
+internal void
+UpdateValue(const char *Name, char *Value)
+{
+    if (UseLock) {
+        LockedUpdate(Name, Value);
+    } else {
+        UpdateCVar(Name, Value);
+    }
+}
+
+internal void *
+WriterThreadProc(void *Data)
+{
+    cvarbench_writer *Writer = (cvarbench_writer *) Data;
+    char Value[CVARBENCH_VALUE_SIZE];
+    unsigned Sequence = 1;
+
+    while (__atomic_load_n(&Running, __ATOMIC_RELAXED)) {
+        for (unsigned Index = Writer->Index; Index < CVarCount; Index += WriterCount) {
+            FormatValue(Value, Sequence);
+            UpdateValue(Names[Index], Value);
+            ++Writer->Writes;
+        }
+        ++Sequence;
+    }
+
+    return NULL;
+}
+
+internal void *
+ReaderThreadProc(void *Data)
+{
+    cvarbench_reader *Reader = (cvarbench_reader *) Data;
+    char Value[CVARBENCH_VALUE_SIZE];
+
+    cvar_handle **Handles = (cvar_handle **) malloc(CVarCount * sizeof(cvar_handle *));
+    int *LastSequence = (int *) calloc(CVarCount, sizeof(int));
+    for (unsigned Index = 0; Index < CVarCount; ++Index) {
+        Handles[Index] = UseLock ? NULL : CVarHandle(Names[Index]);
+    }
+
+    unsigned Index = Reader->Index;
+    while (__atomic_load_n(&Running, __ATOMIC_RELAXED)) {
+        Index = (Index + 1) % CVarCount;
+
+        int Length = UseLock ? LockedCopy(Names[Index], Value, sizeof(Value))
+                             : CVarStringCopy(Names[Index], Value, sizeof(Value));
+        if ((Length < 0) || !ValidateValue(Value, Length)) {
+            ++Reader->Failures;
+        }
+
+        if (!UseLock) {
+            int Sequence = CVarIntegerValue(Handles[Index]);
+            if (Sequence < LastSequence[Index]) {
+                ++Reader->Failures;
+            }
+            LastSequence[Index] = Sequence;
+        }
+
+        ++Reader->Reads;
+    }
+
+    free(LastSequence);
+    free(Handles);
+    return NULL;
+}
+
+internal bool
+ParseArguments(int Count, char **Args)
+{
+    int Option;
+    while ((Option = getopt(Count, Args, "r:w:c:d:l")) != -1) {
+        switch (Option) {
+        case 'r': { ReaderCount = atoi(optarg); } break;
+        case 'w': { WriterCount = atoi(optarg); } break;
+        case 'c': { CVarCount = atoi(optarg); } break;
+        case 'd': { Duration = atof(optarg); } break;
+        case 'l': { UseLock = true; } break;
+        default: { return false; } break;
+        }
+    }
+
+    return (WriterCount > 0) && (CVarCount >= WriterCount);
+}
+
+int main(int Count, char **Args)
+{
+    if (!ParseArguments(Count, Args)) {
+        fprintf(stderr, "usage: cvarbench [-r readers] [-w writers] [-c cvars] [-d seconds] [-l]\n");
+        return EXIT_FAILURE;
+    }
+
+    if (!BeginCVars()) {
+        fprintf(stderr, "cvarbench: could not initialize cvars!\n");
+        return EXIT_FAILURE;
+    }
+
+    char Value[CVARBENCH_VALUE_SIZE];
+    FormatValue(Value, 0);
+
+    Names = (char **) malloc(CVarCount * sizeof(char *));
+    for (unsigned Index = 0; Index < CVarCount; ++Index) {
+        char Name[64];
+        snprintf(Name, sizeof(Name), "cvarbench_%u", Index);
+        Names[Index] = strdup(Name);
+        UpdateValue(Names[Index], Value);
+    }
+
+    cvarbench_reader *Readers = (cvarbench_reader *) calloc(ReaderCount, sizeof(cvarbench_reader));
+    cvarbench_writer *Writers = (cvarbench_writer *) calloc(WriterCount, sizeof(cvarbench_writer));
+
+    Running = true;
+    uint64_t Begin = BenchTime();
+
+    for (unsigned Index = 0; Index < WriterCount; ++Index) {
+        Writers[Index].Index = Index;
+        pthread_create(&Writers[Index].Thread, NULL, &WriterThreadProc, Writers + Index);
+    }
+
+    for (unsigned Index = 0; Index < ReaderCount; ++Index) {
+        Readers[Index].Index = Index;
+        pthread_create(&Readers[Index].Thread, NULL, &ReaderThreadProc, Readers + Index);
+    }
+
+    usleep((useconds_t)(Duration * 1000000.0));
+    __atomic_store_n(&Running, false, __ATOMIC_RELAXED);
+
+    uint64_t Reads = 0, Writes = 0, Failures = 0;
+    for (unsigned Index = 0; Index < WriterCount; ++Index) {
+        pthread_join(Writers[Index].Thread, NULL);
+        Writes += Writers[Index].Writes;
+    }
+
+    for (unsigned Index = 0; Index < ReaderCount; ++Index) {
+        pthread_join(Readers[Index].Thread, NULL);
+        Reads += Readers[Index].Reads;
+        Failures += Readers[Index].Failures;
+    }
+
+    double Seconds = (BenchTime() - Begin) / 1000000000.0;
+    printf("%s store, %u readers, %u writers, %u cvars: %.0f reads/s, %.0f writes/s, %llu failed reads\n",
+           UseLock ? "locked" : "lock-free",
+           ReaderCount, WriterCount, CVarCount,
+           Reads / Seconds, Writes / Seconds,
+           (unsigned long long) Failures);
+
+    for (unsigned Index = 0; Index < CVarCount; ++Index) {
+        free(Names[Index]);
+    }
+
+    free(Names);
+    free(Readers);
+    free(Writers);
+    LockedClear();
+    EndCVars();
+    return Failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
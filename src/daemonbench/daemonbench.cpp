@@ -0,0 +1,391 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <getopt.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include <queue>
+
+#define internal static
+
+#include "../core/histogram.h"
+#include "../core/histogram.cpp"
+
+#include "../common/ipc/daemon.h"
+#include "../common/ipc/daemon.cpp"
+
+/*
+ * NOTE(koekeishiya): Every request has the form '<sequence> <size>', and the response is <size>
+ * bytes derived from the sequence number, so that a response that was cut short, merged with
+ * another one, or delivered to the wrong request fails validation.
+ * Requests are handed off from the daemon thread to a set of handler threads, which stand in
+ * for the event-loop of the core.
+ */
+struct daemonbench_request
+{
+    char *Message;
+    int SockFD;
+};
+
+struct daemonbench_client
+{
+    pthread_t Thread;
+    unsigned Index;
+    bool Framed;
+    uint64_t Requests;
+    uint64_t Failures;
+    histogram Latency;
+};
+
+internal unsigned FramedCount = 8;
+internal unsigned LegacyCount = 2;
+internal unsigned IdleCount = 16;
+internal unsigned HandlerCount = 1;
+internal unsigned Pipeline = 1;
+internal unsigned ResponseSize = 64;
+internal unsigned HandlerDelay;
+internal double Duration = 2.0;
+
+internal char SocketPath[255];
+internal bool volatile Running;
+
+internal std::queue<daemonbench_request> Requests;
+internal pthread_mutex_t RequestLock = PTHREAD_MUTEX_INITIALIZER;
+internal pthread_cond_t RequestReady = PTHREAD_COND_INITIALIZER;
+internal bool HandlersRunning;
+
+internal inline uint64_t
+BenchTime()
+{
+    struct timespec Time;
+    clock_gettime(CLOCK_MONOTONIC, &Time);
+    return (uint64_t) Time.tv_sec * 1000000000ULL + Time.tv_nsec;
+}
+
+internal inline char
+ResponseByte(uint64_t Sequence, size_t Index)
+{
+    return 'a' + (char) ((Sequence + Index) % 26);
+}
+
+internal bool
+ValidateResponse(uint64_t Sequence, unsigned Size, const char *Response, size_t Length)
+{
+    if (Length != Size) return false;
+
+    for (size_t Index = 0; Index < Length; ++Index) {
+        if (Response[Index] != ResponseByte(Sequence, Index)) return false;
+    }
+
+    return true;
+}
+
+internal
+DAEMON_CALLBACK(BenchCallback)
+{
+    daemonbench_request Request = { strdup(Message), SockFD };
+
+    pthread_mutex_lock(&RequestLock);
+    Requests.push(Request);
+    pthread_cond_signal(&RequestReady);
+    pthread_mutex_unlock(&RequestLock);
+}
+
+internal void *
+HandlerThreadProc(void *)
+{
+    for (;;) {
+        pthread_mutex_lock(&RequestLock);
+        while (HandlersRunning && Requests.empty()) {
+            pthread_cond_wait(&RequestReady, &RequestLock);
+        }
+
+        if (Requests.empty()) {
+            pthread_mutex_unlock(&RequestLock);
+            break;
+        }
+
+        daemonbench_request Request = Requests.front();
+        Requests.pop();
+        pthread_mutex_unlock(&RequestLock);
+
+        unsigned long long Sequence;
+        unsigned Size;
+        if (sscanf(Request.Message, "%llu %u", &Sequence, &Size) == 2) {
+            if (HandlerDelay) usleep(HandlerDelay);
+
+            char *Response = (char *) malloc(Size + 1);
+            for (unsigned Index = 0; Index < Size; ++Index) {
+                Response[Index] = ResponseByte(Sequence, Index);
+            }
+            Response[Size] = '\0';
+            WriteToSocket(Response, Request.SockFD);
+            free(Response);
+        }
+
+        CloseSocket(Request.SockFD);
+        free(Request.Message);
+    }
+
+    return NULL;
+}
+
+internal bool
+WriteExact(int SockFD, const void *Buffer, size_t Size)
+{
+    const char *Cursor = (const char *) Buffer;
+    while (Size) {
+        ssize_t Length = write(SockFD, Cursor, Size);
+        if (Length <= 0) return false;
+        Cursor += Length;
+        Size -= Length;
+    }
+    return true;
+}
+
+internal bool
+SendFramedRequest(int SockFD, uint64_t Sequence)
+{
+    char Message[64];
+    snprintf(Message, sizeof(Message), "%llu %u", (unsigned long long) Sequence, ResponseSize);
+    return SendDaemonRequest(Message, SockFD);
+}
+
+internal void
+RunFramedClient(daemonbench_client *Client)
+{
+    int SockFD;
+    if (!ConnectToDaemon(&SockFD, SocketPath)) {
+        ++Client->Failures;
+        return;
+    }
+
+    daemon_reader Reader = {};
+    uint64_t Sequence = (uint64_t) Client->Index << 32;
+    uint64_t *SendTimes = (uint64_t *) malloc(sizeof(uint64_t) * Pipeline);
+
+    while (Running) {
+        for (unsigned Index = 0; Index < Pipeline; ++Index) {
+            SendTimes[Index] = BenchTime();
+            if (!SendFramedRequest(SockFD, Sequence + Index)) goto out;
+        }
+
+        for (unsigned Index = 0; Index < Pipeline; ++Index) {
+            char *Response = ReadDaemonResponse(&Reader, SockFD);
+            if (!Response) {
+                ++Client->Failures;
+                goto out;
+            }
+
+            HistogramRecord(&Client->Latency, BenchTime() - SendTimes[Index]);
+            if (!ValidateResponse(Sequence + Index, ResponseSize, Response, Reader.Length)) {
+                ++Client->Failures;
+            }
+
+            ++Client->Requests;
+        }
+
+        Sequence += Pipeline;
+    }
+
+out:
+    FreeDaemonReader(&Reader);
+    free(SendTimes);
+    CloseSocket(SockFD);
+}
+
+internal void
+RunLegacyClient(daemonbench_client *Client)
+{
+    uint64_t Sequence = (uint64_t) Client->Index << 32;
+    char *Response = (char *) malloc(ResponseSize + 1);
+
+    while (Running) {
+        uint64_t Begin = BenchTime();
+
+        int SockFD;
+        if (!ConnectToDaemon(&SockFD, SocketPath)) {
+            ++Client->Failures;
+            break;
+        }
+
+        char Message[64];
+        int Length = snprintf(Message, sizeof(Message), "%llu %u", (unsigned long long) Sequence, ResponseSize);
+        WriteExact(SockFD, Message, Length + 1);
+
+        size_t Received = 0;
+        ssize_t Count;
+        while ((Count = read(SockFD, Response + Received, ResponseSize + 1 - Received)) > 0) {
+            Received += Count;
+            if (Received > ResponseSize) break;
+        }
+        CloseSocket(SockFD);
+
+        HistogramRecord(&Client->Latency, BenchTime() - Begin);
+        if (!ValidateResponse(Sequence, ResponseSize, Response, Received)) {
+            ++Client->Failures;
+        }
+
+        ++Client->Requests;
+        ++Sequence;
+    }
+
+    free(Response);
+}
+
+internal void *
+ClientThreadProc(void *Data)
+{
+    daemonbench_client *Client = (daemonbench_client *) Data;
+
+    if (Client->Framed) {
+        RunFramedClient(Client);
+    } else {
+        RunLegacyClient(Client);
+    }
+
+    return NULL;
+}
+
+internal inline double
+NanosecondsToMilliseconds(uint64_t Value)
+{
+    return Value / 1000000.0;
+}
+
+internal uint64_t
+PrintClientStats(const char *Name, daemonbench_client *Clients, unsigned Count, double Elapsed)
+{
+    histogram *Latency = (histogram *) malloc(sizeof(histogram));
+    HistogramReset(Latency);
+
+    uint64_t Total = 0;
+    uint64_t Failures = 0;
+
+    for (unsigned Index = 0; Index < Count; ++Index) {
+        daemonbench_client *Client = Clients + Index;
+        Total += Client->Requests;
+        Failures += Client->Failures;
+
+        for (int Bucket = 0; Bucket < HISTOGRAM_BUCKET_COUNT; ++Bucket) {
+            Latency->Buckets[Bucket] += Client->Latency.Buckets[Bucket];
+        }
+        Latency->Count += Client->Latency.Count;
+        Latency->Total += Client->Latency.Total;
+        if (Client->Latency.Max > Latency->Max) Latency->Max = Client->Latency.Max;
+    }
+
+    if (Count) {
+        printf("%-7s clients:%-4u requests:%-9llu %10.0f req/s  latency[p50:%.3f p99:%.3f max:%.3f]ms  failures:%llu\n",
+               Name, Count,
+               (unsigned long long) Total,
+               Total / Elapsed,
+               NanosecondsToMilliseconds(HistogramPercentile(Latency, 50.0)),
+               NanosecondsToMilliseconds(HistogramPercentile(Latency, 99.0)),
+               NanosecondsToMilliseconds(Latency->Max),
+               (unsigned long long) Failures);
+    }
+
+    free(Latency);
+    return Failures;
+}
+
+internal bool
+ParseArguments(int Count, char **Args)
+{
+    int Option;
+    while ((Option = getopt(Count, Args, "f:l:i:t:p:s:w:d:")) != -1) {
+        switch (Option) {
+        case 'f': { FramedCount = atoi(optarg); } break;
+        case 'l': { LegacyCount = atoi(optarg); } break;
+        case 'i': { IdleCount = atoi(optarg); } break;
+        case 't': { HandlerCount = atoi(optarg); } break;
+        case 'p': { Pipeline = atoi(optarg); } break;
+        case 's': { ResponseSize = atoi(optarg); } break;
+        case 'w': { HandlerDelay = atoi(optarg); } break;
+        case 'd': { Duration = atof(optarg); } break;
+        default: { return false; } break;
+        }
+    }
+
+    return (HandlerCount > 0) && (Pipeline > 0) && (Duration > 0.0);
+}
+
+int main(int Count, char **Args)
+{
+    if (!ParseArguments(Count, Args)) {
+        fprintf(stderr, "usage: daemonbench [-f framed] [-l legacy] [-i idle] [-t handlers] "
+                        "[-p pipeline] [-s response_size] [-w handler_us] [-d seconds]\n");
+        return EXIT_FAILURE;
+    }
+
+    snprintf(SocketPath, sizeof(SocketPath), "/tmp/daemonbench_%d.socket", getpid());
+    if (!StartDaemon(SocketPath, BenchCallback)) {
+        fprintf(stderr, "daemonbench: could not start daemon at '%s'!\n", SocketPath);
+        return EXIT_FAILURE;
+    }
+
+    HandlersRunning = true;
+    pthread_t *Handlers = (pthread_t *) malloc(sizeof(pthread_t) * HandlerCount);
+    for (unsigned Index = 0; Index < HandlerCount; ++Index) {
+        pthread_create(Handlers + Index, NULL, &HandlerThreadProc, NULL);
+    }
+
+    // NOTE(koekeishiya): Idle clients connect but never send anything, and must not stall anyone else.
+    int *IdleSockets = (int *) malloc(sizeof(int) * (IdleCount + 1));
+    for (unsigned Index = 0; Index < IdleCount; ++Index) {
+        if (!ConnectToDaemon(IdleSockets + Index, SocketPath)) {
+            IdleSockets[Index] = -1;
+        }
+    }
+
+    unsigned ClientCount = FramedCount + LegacyCount;
+    daemonbench_client *Clients = (daemonbench_client *) calloc(ClientCount + 1, sizeof(daemonbench_client));
+
+    Running = true;
+    uint64_t Begin = BenchTime();
+    for (unsigned Index = 0; Index < ClientCount; ++Index) {
+        daemonbench_client *Client = Clients + Index;
+        Client->Index = Index;
+        Client->Framed = Index < FramedCount;
+        HistogramReset(&Client->Latency);
+        pthread_create(&Client->Thread, NULL, &ClientThreadProc, Client);
+    }
+
+    usleep((useconds_t) (Duration * 1000000.0));
+    Running = false;
+
+    for (unsigned Index = 0; Index < ClientCount; ++Index) {
+        pthread_join(Clients[Index].Thread, NULL);
+    }
+    double Elapsed = (BenchTime() - Begin) / 1000000000.0;
+
+    uint64_t Failures = 0;
+    Failures += PrintClientStats("framed", Clients, FramedCount, Elapsed);
+    Failures += PrintClientStats("legacy", Clients + FramedCount, LegacyCount, Elapsed);
+
+    for (unsigned Index = 0; Index < IdleCount; ++Index) {
+        if (IdleSockets[Index] != -1) CloseSocket(IdleSockets[Index]);
+    }
+
+    StopDaemon();
+
+    pthread_mutex_lock(&RequestLock);
+    HandlersRunning = false;
+    pthread_cond_broadcast(&RequestReady);
+    pthread_mutex_unlock(&RequestLock);
+
+    for (unsigned Index = 0; Index < HandlerCount; ++Index) {
+        pthread_join(Handlers[Index], NULL);
+    }
+
+    unlink(SocketPath);
+    free(IdleSockets);
+    free(Handlers);
+    free(Clients);
+
+    return Failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
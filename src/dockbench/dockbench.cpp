@@ -0,0 +1,304 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <poll.h>
+#include <getopt.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#define internal static
+
+#include "../core/histogram.h"
+#include "../core/histogram.cpp"
+
+#include "../common/ipc/daemon.h"
+#include "../common/ipc/daemon.cpp"
+#include "../common/ipc/dock.h"
+#include "../common/ipc/dock.cpp"
+
+/*
+ * NOTE(koekeishiya): The stand-in server behaves like the payload that chwm-sa injects into the Dock:
+ * it listens on the loopback interface with a backlog of 10, accepts one connection at a time,
+ * reads a single message of at most 256 bytes, and closes the connection once the message has
+ * been processed. Every message has the form 'window_move <window> <sequence> 0', so that
+ * lost and reordered messages can be counted. Every batch moves 'BatchSize' windows at once, like
+ * fading all windows on a focus change. By default every batch uses windows of its own, so that
+ * the client has no values to coalesce and every message is actually delivered. With 'Replace'
+ * every producer moves the same windows in every batch, so that a batch replaces the previous
+ * one in full if it has not yet been sent. The window id tells which producer sent the message.
+ */
+struct dockbench_producer
+{
+    pthread_t Thread;
+    unsigned Index;
+    uint64_t Failures;
+    histogram Latency;
+};
+
+internal unsigned ProducerCount = 4;
+internal unsigned MessageCount = 1000;
+internal unsigned BatchSize = 1;
+internal unsigned ServerDelay;
+internal int Port = 15050;
+internal bool UseClient = true;
+internal bool Replace;
+
+internal int ServerSockFD;
+internal bool volatile ServerRunning;
+internal uint64_t volatile Received;
+internal uint64_t Reordered;
+internal int64_t *LastSequence;
+
+internal inline unsigned
+WindowsPerProducer()
+{
+    return Replace ? BatchSize : MessageCount * BatchSize;
+}
+
+internal inline uint64_t
+BenchTime()
+{
+    struct timespec Time;
+    clock_gettime(CLOCK_MONOTONIC, &Time);
+    return (uint64_t) Time.tv_sec * 1000000000ULL + Time.tv_nsec;
+}
+
+internal inline double
+NanosecondsToMilliseconds(uint64_t Value)
+{
+    return Value / 1000000.0;
+}
+
+internal void *
+ServerThreadProc(void *)
+{
+    struct pollfd Listener = { ServerSockFD, POLLIN, 0 };
+
+    while (ServerRunning) {
+        if (poll(&Listener, 1, 10) <= 0) continue;
+
+        int SockFD = accept(ServerSockFD, NULL, 0);
+        if (SockFD == -1) continue;
+
+        char Buffer[256];
+        ssize_t Length = recv(SockFD, Buffer, sizeof(Buffer) - 1, 0);
+        if (Length > 0) {
+            Buffer[Length] = '\0';
+
+            unsigned Window;
+            int64_t Sequence;
+            if ((sscanf(Buffer, "window_move %u %lld", &Window, (long long *) &Sequence) == 2) &&
+                (Window < ProducerCount * WindowsPerProducer())) {
+                unsigned Producer = Window / WindowsPerProducer();
+                if (Sequence < LastSequence[Producer]) ++Reordered;
+                LastSequence[Producer] = Sequence;
+            }
+
+            if (ServerDelay) usleep(ServerDelay);
+            __atomic_add_fetch(&Received, 1, __ATOMIC_RELEASE);
+        }
+
+        CloseSocket(SockFD);
+    }
+
+    return NULL;
+}
+
+internal bool
+StartServer()
+{
+    if ((ServerSockFD = socket(PF_INET, SOCK_STREAM, 0)) == -1) {
+        return false;
+    }
+
+    int Reuse = 1;
+    setsockopt(ServerSockFD, SOL_SOCKET, SO_REUSEADDR, &Reuse, sizeof(Reuse));
+
+    struct sockaddr_in Address;
+    memset(&Address, 0, sizeof(Address));
+    Address.sin_family = AF_INET;
+    Address.sin_port = htons(Port);
+    Address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    if ((bind(ServerSockFD, (struct sockaddr *) &Address, sizeof(Address)) == -1) ||
+        (listen(ServerSockFD, 10) == -1)) {
+        close(ServerSockFD);
+        return false;
+    }
+
+    return true;
+}
+
+// NOTE(koekeishiya): The way every message was sent before the dock client existed.
+internal bool
+SendLegacyMessage(const char *Message)
+{
+    int SockFD;
+    bool Result = ConnectToDaemon(&SockFD, Port);
+    if (Result) {
+        WriteToSocket(Message, SockFD);
+    }
+    CloseSocket(SockFD);
+    return Result;
+}
+
+internal void *
+ProducerThreadProc(void *Data)
+{
+    dockbench_producer *Producer = (dockbench_producer *) Data;
+    dock_window_value *Values = (dock_window_value *) malloc(sizeof(dock_window_value) * BatchSize);
+
+    for (unsigned Sequence = 0; Sequence < MessageCount; ++Sequence) {
+        uint64_t Begin = BenchTime();
+        for (unsigned Index = 0; Index < BatchSize; ++Index) {
+            dock_window_value *Value = Values + Index;
+            Value->WindowId = Producer->Index * WindowsPerProducer() + (Replace ? 0 : Sequence * BatchSize) + Index;
+            Value->X = Sequence;
+            Value->Y = 0;
+
+            if (!UseClient) {
+                char Message[64];
+                snprintf(Message, sizeof(Message), "window_move %u %d 0", Value->WindowId, Value->X);
+                if (!SendLegacyMessage(Message)) ++Producer->Failures;
+            }
+        }
+
+        if (UseClient) {
+            SendDockWindowBatch(DockWindow_Move, Values, BatchSize, 0.0f);
+        }
+        HistogramRecord(&Producer->Latency, BenchTime() - Begin);
+    }
+
+    free(Values);
+    return NULL;
+}
+
+internal bool
+ParseArguments(int Count, char **Args)
+{
+    int Option;
+    while ((Option = getopt(Count, Args, "m:c:t:n:b:w:p:")) != -1) {
+        switch (Option) {
+        case 'm': {
+            if (strcmp(optarg, "client") == 0)      UseClient = true;
+            else if (strcmp(optarg, "legacy") == 0) UseClient = false;
+            else                                    return false;
+        } break;
+        case 'c': {
+            if (strcmp(optarg, "distinct") == 0)     Replace = false;
+            else if (strcmp(optarg, "replace") == 0) Replace = true;
+            else                                     return false;
+        } break;
+        case 't': { ProducerCount = atoi(optarg); } break;
+        case 'n': { MessageCount = atoi(optarg); } break;
+        case 'b': { BatchSize = atoi(optarg); } break;
+        case 'w': { ServerDelay = atoi(optarg); } break;
+        case 'p': { Port = atoi(optarg); } break;
+        default: { return false; } break;
+        }
+    }
+
+    return (ProducerCount > 0) && (MessageCount > 0) && (BatchSize > 0);
+}
+
+int main(int Count, char **Args)
+{
+    if (!ParseArguments(Count, Args)) {
+        fprintf(stderr, "usage: dockbench [-m client|legacy] [-c distinct|replace] [-t producers] [-n batches] [-b batch_size] [-w server_us] [-p port]\n");
+        return EXIT_FAILURE;
+    }
+
+    if (!StartServer()) {
+        fprintf(stderr, "dockbench: could not listen on port %d!\n", Port);
+        return EXIT_FAILURE;
+    }
+
+    LastSequence = (int64_t *) malloc(sizeof(int64_t) * ProducerCount);
+    for (unsigned Index = 0; Index < ProducerCount; ++Index) {
+        LastSequence[Index] = -1;
+    }
+
+    pthread_t Server;
+    ServerRunning = true;
+    pthread_create(&Server, NULL, &ServerThreadProc, NULL);
+
+    if (UseClient && !BeginDockClient(Port)) {
+        fprintf(stderr, "dockbench: could not start dock client!\n");
+        return EXIT_FAILURE;
+    }
+
+    dockbench_producer *Producers = (dockbench_producer *) calloc(ProducerCount, sizeof(dockbench_producer));
+
+    uint64_t Begin = BenchTime();
+    for (unsigned Index = 0; Index < ProducerCount; ++Index) {
+        Producers[Index].Index = Index;
+        HistogramReset(&Producers[Index].Latency);
+        pthread_create(&Producers[Index].Thread, NULL, &ProducerThreadProc, Producers + Index);
+    }
+
+    histogram *Latency = (histogram *) malloc(sizeof(histogram));
+    HistogramReset(Latency);
+
+    uint64_t Failures = 0;
+    for (unsigned Index = 0; Index < ProducerCount; ++Index) {
+        dockbench_producer *Producer = Producers + Index;
+        pthread_join(Producer->Thread, NULL);
+        Failures += Producer->Failures;
+
+        for (int Bucket = 0; Bucket < HISTOGRAM_BUCKET_COUNT; ++Bucket) {
+            Latency->Buckets[Bucket] += Producer->Latency.Buckets[Bucket];
+        }
+        Latency->Count += Producer->Latency.Count;
+        Latency->Total += Producer->Latency.Total;
+        if (Producer->Latency.Max > Latency->Max) Latency->Max = Producer->Latency.Max;
+    }
+    uint64_t Submitted = BenchTime() - Begin;
+
+    dock_client_stats Stats = {};
+    if (UseClient) {
+        FlushDockClient();
+        EndDockClient();
+        DockClientStats(&Stats);
+        Failures = Stats.Dropped;
+    }
+
+    uint64_t Total = (uint64_t) ProducerCount * MessageCount * BatchSize;
+    uint64_t Expected = Total - Failures - Stats.Coalesced;
+    uint64_t Deadline = BenchTime() + 10000000000ULL;
+    while ((__atomic_load_n(&Received, __ATOMIC_ACQUIRE) < Expected) && (BenchTime() < Deadline)) {
+        usleep(100);
+    }
+    uint64_t Elapsed = BenchTime() - Begin;
+
+    ServerRunning = false;
+    pthread_join(Server, NULL);
+    close(ServerSockFD);
+
+    // NOTE(koekeishiya): A coalesced message was replaced by a later one for the same window, and is not lost.
+    uint64_t Delivered = __atomic_load_n(&Received, __ATOMIC_ACQUIRE);
+    uint64_t Lost = Total - Stats.Coalesced - Delivered;
+    double Seconds = Elapsed / 1000000000.0;
+    printf("%-6s %-8s producers:%-3u messages:%-8llu delivered:%-8llu %10.0f msg/s  coalesced:%-8llu %10.0f msg/s  "
+           "submit:%.3fms  caller[p50:%.3f p99:%.3f max:%.3f]ms  lost:%llu reordered:%llu retried:%llu\n",
+           UseClient ? "client" : "legacy", Replace ? "replace" : "distinct", ProducerCount,
+           (unsigned long long) Total,
+           (unsigned long long) Delivered,
+           Delivered / Seconds,
+           (unsigned long long) Stats.Coalesced,
+           Stats.Coalesced / Seconds,
+           NanosecondsToMilliseconds(Submitted),
+           NanosecondsToMilliseconds(HistogramPercentile(Latency, 50.0)),
+           NanosecondsToMilliseconds(HistogramPercentile(Latency, 99.0)),
+           NanosecondsToMilliseconds(Latency->Max),
+           (unsigned long long) Lost,
+           (unsigned long long) Reordered,
+           (unsigned long long) Stats.Retried);
+
+    free(Latency);
+    free(Producers);
+    free(LastSequence);
+
+    return Lost ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,324 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <getopt.h>
+
+#define internal static
+
+#include "../plugins/tiling/layout.h"
+#include "../plugins/tiling/node.h"
+#include "../plugins/tiling/vspace.h"
+#include "../plugins/tiling/layout.cpp"
+
+/*
+ * NOTE(koekeishiya): Relayouts a bsp tree the way the tiling plugin does after a ratio, gap
+ * or padding change, and counts the display lookups it needs. 'legacy' resolves the display
+ * for every node it visits, like CreateNodeRegion used to; 'context' resolves it once through
+ * a layout_context. A display lookup is a private window server call, so its cost can not be
+ * reproduced here; it is simulated by spinning for the time given with '-c'.
+ */
+internal unsigned RepeatCount = 1000;
+internal unsigned LookupCost;
+internal uint64_t Lookups;
+
+internal inline uint64_t
+BenchTime()
+{
+    struct timespec Time;
+    clock_gettime(CLOCK_MONOTONIC, &Time);
+    return (uint64_t) Time.tv_sec * 1000000000ULL + Time.tv_nsec;
+}
+
+internal void
+LookupDisplay()
+{
+    ++Lookups;
+    if (LookupCost) {
+        uint64_t End = BenchTime() + LookupCost;
+        while (BenchTime() < End);
+    }
+}
+
+region LayoutFullRegion(layout_context *Context)
+{
+    if (!Context->Resolved) {
+        LookupDisplay();
+        region Full = { 0.0f, 22.0f, 2560.0f, 1418.0f, Region_Full };
+        Context->Full = Full;
+        Context->Resolved = true;
+    }
+
+    return Context->Full;
+}
+
+node_split OptimalSplitMode(node *Node)
+{
+    float NodeRatio = Node->Region.Width / Node->Region.Height;
+    return NodeRatio >= 1.618f ? Split_Vertical : Split_Horizontal;
+}
+
+internal node *
+CreateBenchNode(node *Parent, uint32_t WindowId)
+{
+    node *Node = (node *) calloc(1, sizeof(node));
+    Node->Parent = Parent;
+    Node->WindowId = WindowId;
+    Node->Ratio = 0.5f;
+    return Node;
+}
+
+internal node *
+FirstMinDepthLeaf(node *Tree)
+{
+    node **Queue = (node **) malloc(sizeof(node *) * 4096);
+    unsigned Head = 0, Tail = 0;
+    node *Result = NULL;
+
+    Queue[Tail++] = Tree;
+    while (Head != Tail) {
+        node *Node = Queue[Head++ % 4096];
+        if (Node->WindowId != Node_Root) {
+            Result = Node;
+            break;
+        }
+        Queue[Tail++ % 4096] = Node->Left;
+        Queue[Tail++ % 4096] = Node->Right;
+    }
+
+    free(Queue);
+    return Result;
+}
+
+/*
+ * NOTE(koekeishiya): Builds the tree the same way CreateWindowTreeForSpaceWithWindows does;
+ * every window splits the first leaf with minimum depth along its optimal axis.
+ */
+internal node *
+CreateBenchTree(unsigned LeafCount, layout_context *Context)
+{
+    node *Root = CreateBenchNode(NULL, 1);
+    LayoutNodeRegion(Root, Region_Full, Context);
+
+    for (unsigned Index = 1; Index < LeafCount; ++Index) {
+        node *Leaf = FirstMinDepthLeaf(Root);
+        Leaf->Split = OptimalSplitMode(Leaf);
+        Leaf->Left = CreateBenchNode(Leaf, Leaf->WindowId);
+        Leaf->Right = CreateBenchNode(Leaf, Index + 1);
+        Leaf->WindowId = Node_Root;
+        LayoutNodeTree(Leaf, false, Context);
+    }
+
+    return Root;
+}
+
+internal void
+FreeBenchTree(node *Node)
+{
+    if (Node->Left)  FreeBenchTree(Node->Left);
+    if (Node->Right) FreeBenchTree(Node->Right);
+    free(Node);
+}
+
+internal void
+LegacyLayoutNodeTree(node *Node, virtual_space *VirtualSpace)
+{
+    if (Node && Node->Left && Node->Right) {
+        region_type LeftType = Node->Split == Split_Vertical ? Region_Left : Region_Upper;
+        region_type RightType = Node->Split == Split_Vertical ? Region_Right : Region_Lower;
+
+        LookupDisplay();
+        Node->Left->Region = SplitRegion(&Node->Region, Node->Ratio, LeftType, VirtualSpace->Offset);
+        LookupDisplay();
+        Node->Right->Region = SplitRegion(&Node->Region, Node->Ratio, RightType, VirtualSpace->Offset);
+
+        LegacyLayoutNodeTree(Node->Left, VirtualSpace);
+        LegacyLayoutNodeTree(Node->Right, VirtualSpace);
+    }
+}
+
+internal uint64_t
+ChecksumTree(node *Node)
+{
+    uint64_t Result = (uint64_t)(Node->Region.X * 7 + Node->Region.Y * 13 +
+                                 Node->Region.Width * 17 + Node->Region.Height * 19);
+    if (Node->Left)  Result += ChecksumTree(Node->Left);
+    if (Node->Right) Result += ChecksumTree(Node->Right);
+    return Result;
+}
+
+internal void
+RunBench(unsigned LeafCount)
+{
+    virtual_space VirtualSpace = {};
+    VirtualSpace.Mode = Virtual_Space_Bsp;
+    VirtualSpace._Offset.Gap = 10.0f;
+    VirtualSpace.Offset = &VirtualSpace._Offset;
+
+    layout_context Context;
+    BeginLayoutContext(&Context, NULL, &VirtualSpace);
+    node *Tree = CreateBenchTree(LeafCount, &Context);
+
+    Lookups = 0;
+    uint64_t Begin = BenchTime();
+    for (unsigned Index = 0; Index < RepeatCount; ++Index) {
+        LookupDisplay();
+        LegacyLayoutNodeTree(Tree, &VirtualSpace);
+    }
+    uint64_t LegacyTime = BenchTime() - Begin;
+    uint64_t LegacyLookups = Lookups;
+    uint64_t LegacyChecksum = ChecksumTree(Tree);
+
+    Lookups = 0;
+    Begin = BenchTime();
+    for (unsigned Index = 0; Index < RepeatCount; ++Index) {
+        BeginLayoutContext(&Context, NULL, &VirtualSpace);
+        LayoutNodeRegion(Tree, Region_Full, &Context);
+        LayoutNodeTree(Tree, false, &Context);
+    }
+    uint64_t ContextTime = BenchTime() - Begin;
+    uint64_t ContextLookups = Lookups;
+    uint64_t ContextChecksum = ChecksumTree(Tree);
+
+    printf("%6u leaves %6u nodes | legacy: %8.2fus %6.0f lookups | context: %8.2fus %4.0f lookups | %s\n",
+           LeafCount, 2 * LeafCount - 1,
+           LegacyTime / 1000.0 / RepeatCount, (double) LegacyLookups / RepeatCount,
+           ContextTime / 1000.0 / RepeatCount, (double) ContextLookups / RepeatCount,
+           LegacyChecksum == ContextChecksum ? "regions match" : "REGIONS DIFFER");
+
+    FreeBenchTree(Tree);
+}
+
+internal unsigned
+CountTreeNodes(node *Node, unsigned *Leaves)
+{
+    if (!Node->Left || !Node->Right) {
+        ++*Leaves;
+        return 1;
+    }
+
+    return 1 + CountTreeNodes(Node->Left, Leaves) + CountTreeNodes(Node->Right, Leaves);
+}
+
+// NOTE(koekeishiya): Counts and clears the leaves that ApplyDirtyNodeRegion would move.
+internal unsigned
+ApplyBenchDirtyTree(node *Node)
+{
+    unsigned Result = 0;
+
+    if (Node->Dirty & Node_Dirty_Frame) {
+        ++Result;
+    }
+
+    if (Node->Dirty & Node_Dirty_Child) {
+        if (Node->Left)  Result += ApplyBenchDirtyTree(Node->Left);
+        if (Node->Right) Result += ApplyBenchDirtyTree(Node->Right);
+    }
+
+    Node->Dirty = 0;
+    return Result;
+}
+
+/*
+ * NOTE(koekeishiya): Changes the ratio of the parent of the last leaf, like AdjustWindowRatio or a
+ * mouse-resize tick, and compares the number of regions recomputed and windows moved by a dirty
+ * relayout against a relayout of the subtree below the node and of the whole tree.
+ */
+internal void
+RunDirtyBench(unsigned LeafCount)
+{
+    virtual_space VirtualSpace = {};
+    VirtualSpace.Mode = Virtual_Space_Bsp;
+    VirtualSpace._Offset.Gap = 10.0f;
+    VirtualSpace.Offset = &VirtualSpace._Offset;
+
+    layout_context Context;
+    BeginLayoutContext(&Context, NULL, &VirtualSpace);
+    node *Tree = CreateBenchTree(LeafCount, &Context);
+
+    node *Node = Tree;
+    while (Node->Right && Node->Right->Right) {
+        Node = Node->Right;
+    }
+
+    if (!Node->Left || !Node->Right) {
+        printf("%6u leaves | dirty: nothing to resize\n", LeafCount);
+        FreeBenchTree(Tree);
+        return;
+    }
+
+    unsigned TreeLeaves = 0, SubtreeLeaves = 0;
+    unsigned TreeNodes = CountTreeNodes(Tree, &TreeLeaves);
+    unsigned SubtreeNodes = CountTreeNodes(Node, &SubtreeLeaves) - 1;
+
+    uint64_t Touched = 0, Windows = 0;
+    uint64_t Begin = BenchTime();
+    for (unsigned Index = 0; Index < RepeatCount; ++Index) {
+        Node->Ratio = (Index & 1) ? 0.5f : 0.6f;
+        MarkNodeSplitDirty(Node);
+
+        BeginLayoutContext(&Context, NULL, &VirtualSpace);
+        LayoutDirtyNodeTree(Tree, &Context);
+        Touched += Context.Touched;
+        Windows += ApplyBenchDirtyTree(Tree);
+    }
+    uint64_t DirtyTime = BenchTime() - Begin;
+    uint64_t DirtyChecksum = ChecksumTree(Tree);
+
+    BeginLayoutContext(&Context, NULL, &VirtualSpace);
+    LayoutNodeRegion(Tree, Region_Full, &Context);
+    LayoutNodeTree(Tree, false, &Context);
+    uint64_t FullChecksum = ChecksumTree(Tree);
+
+    printf("%6u leaves | tree: %6u nodes %6u windows | subtree: %6u nodes %6u windows | "
+           "dirty: %6.0f nodes %6.0f windows %8.2fus | %s\n",
+           LeafCount, TreeNodes, TreeLeaves, SubtreeNodes, SubtreeLeaves,
+           (double) Touched / RepeatCount, (double) Windows / RepeatCount,
+           DirtyTime / 1000.0 / RepeatCount,
+           DirtyChecksum == FullChecksum ? "regions match" : "REGIONS DIFFER");
+
+    FreeBenchTree(Tree);
+}
+
+internal bool
+ParseArguments(int Count, char **Args)
+{
+    int Option;
+    while ((Option = getopt(Count, Args, "r:c:")) != -1) {
+        switch (Option) {
+        case 'r': { RepeatCount = atoi(optarg); } break;
+        case 'c': { LookupCost = atoi(optarg); } break;
+        default: { return false; } break;
+        }
+    }
+
+    return RepeatCount > 0;
+}
+
+int main(int Count, char **Args)
+{
+    if (!ParseArguments(Count, Args)) {
+        fprintf(stderr, "usage: layoutbench [-r repeats] [-c lookup_ns] [leaves ...]\n");
+        return EXIT_FAILURE;
+    }
+
+    if (optind < Count) {
+        for (int Index = optind; Index < Count; ++Index) {
+            RunBench(atoi(Args[Index]));
+        }
+        for (int Index = optind; Index < Count; ++Index) {
+            RunDirtyBench(atoi(Args[Index]));
+        }
+    } else {
+        unsigned Sizes[] = { 1, 4, 16, 64, 256, 1024 };
+        for (size_t Index = 0; Index < sizeof(Sizes) / sizeof(Sizes[0]); ++Index) {
+            RunBench(Sizes[Index]);
+        }
+        for (size_t Index = 0; Index < sizeof(Sizes) / sizeof(Sizes[0]); ++Index) {
+            RunDirtyBench(Sizes[Index]);
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,16 @@
+#ifndef LAYOUTBENCH_SHIM_CGGEOMETRY_H
+#define LAYOUTBENCH_SHIM_CGGEOMETRY_H
+
+/*
+ * NOTE(koekeishiya): The tiling headers only need the geometry types from CoreGraphics.
+ * This header stands in for them when the benchmark is built on a platform without it,
+ * and is not on the include path on macOS.
+ */
+typedef double CGFloat;
+typedef const struct __CFString *CFStringRef;
+
+typedef struct CGPoint { CGFloat x; CGFloat y; } CGPoint;
+typedef struct CGSize { CGFloat width; CGFloat height; } CGSize;
+typedef struct CGRect { CGPoint origin; CGSize size; } CGRect;
+
+#endif
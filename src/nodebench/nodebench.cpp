@@ -0,0 +1,335 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <getopt.h>
+
+#define internal static
+
+#include "../plugins/tiling/node.h"
+#include "../plugins/tiling/vspace.h"
+#include "../plugins/tiling/pool.h"
+#include "../plugins/tiling/pool.cpp"
+
+/*
+ * NOTE(koekeishiya): Inserts, removes and traverses bsp trees the way the tiling plugin does, with
+ * every node allocated either by malloc, like the plugin used to, or from the node pool of a
+ * virtual space. The plugin allocates windows, strings and CoreFoundation objects in between the
+ * nodes of a tree; every insert makes '-n' allocations of a random size to reproduce this, in both modes.
+ * Both modes run the same sequence of operations, and must end up with the same trees.
+ */
+internal unsigned RoundCount = 100;
+internal unsigned TraverseCount = 10;
+internal unsigned NoiseCount = 1;
+
+#define NOISE_RING_SIZE 4096
+internal void *NoiseRing[NOISE_RING_SIZE];
+internal unsigned NoiseIndex;
+
+enum bench_mode
+{
+    Bench_Malloc,
+    Bench_Pool
+};
+
+struct bench_tree
+{
+    bench_mode Mode;
+    node_pool Pool;
+    node *Root;
+    uint32_t NextWindowId;
+    uint32_t Random;
+};
+
+struct bench_result
+{
+    uint64_t Insert;
+    uint64_t Churn;
+    uint64_t Traverse;
+    uint64_t TraverseChurned;
+    uint64_t Destroy;
+    uint64_t Checksum;
+};
+
+internal inline uint64_t
+BenchTime()
+{
+    struct timespec Time;
+    clock_gettime(CLOCK_MONOTONIC, &Time);
+    return (uint64_t) Time.tv_sec * 1000000000ULL + Time.tv_nsec;
+}
+
+internal inline uint32_t
+NextRandom(uint32_t *State)
+{
+    uint32_t Value = *State;
+    Value ^= Value << 13;
+    Value ^= Value >> 17;
+    Value ^= Value << 5;
+    return *State = Value;
+}
+
+internal void
+AllocateNoise(uint32_t *Random)
+{
+    for (unsigned Index = 0; Index < NoiseCount; ++Index) {
+        unsigned Slot = NoiseIndex++ % NOISE_RING_SIZE;
+        free(NoiseRing[Slot]);
+        NoiseRing[Slot] = malloc(16 + NextRandom(Random) % 240);
+    }
+}
+
+internal void
+FreeNoise()
+{
+    for (unsigned Index = 0; Index < NOISE_RING_SIZE; ++Index) {
+        free(NoiseRing[Index]);
+        NoiseRing[Index] = NULL;
+    }
+}
+
+internal node *
+CreateBenchNode(bench_tree *Tree, node *Parent, uint32_t WindowId)
+{
+    node *Node;
+    if (Tree->Mode == Bench_Pool) {
+        Node = AllocateNode(&Tree->Pool);
+    } else {
+        Node = (node *) malloc(sizeof(node));
+        memset(Node, 0, sizeof(node));
+    }
+
+    Node->Parent = Parent;
+    Node->WindowId = WindowId;
+    Node->Ratio = 0.5f;
+    return Node;
+}
+
+internal void
+FreeBenchNode(bench_tree *Tree, node *Node)
+{
+    if (Tree->Mode == Bench_Pool) {
+        ReleaseNode(&Tree->Pool, Node);
+    } else {
+        free(Node);
+    }
+}
+
+internal void
+FreeBenchNodeTree(node *Node)
+{
+    if (Node->Left)  FreeBenchNodeTree(Node->Left);
+    if (Node->Right) FreeBenchNodeTree(Node->Right);
+    free(Node);
+}
+
+// NOTE(koekeishiya): The pool is rewound like FreeNodeTree does; malloc'd trees are freed node by node.
+internal void
+DestroyBenchTree(bench_tree *Tree)
+{
+    if (Tree->Mode == Bench_Pool) {
+        ResetNodePool(&Tree->Pool);
+    } else if (Tree->Root) {
+        FreeBenchNodeTree(Tree->Root);
+    }
+
+    Tree->Root = NULL;
+}
+
+internal node *
+RandomLeaf(bench_tree *Tree)
+{
+    node *Node = Tree->Root;
+    while (Node->Left && Node->Right) {
+        Node = (NextRandom(&Tree->Random) & 1) ? Node->Right : Node->Left;
+    }
+    return Node;
+}
+
+// NOTE(koekeishiya): Splits a leaf into a pair of leaves, like CreateLeafNodePair.
+internal void
+InsertBenchWindow(bench_tree *Tree)
+{
+    AllocateNoise(&Tree->Random);
+
+    uint32_t WindowId = Tree->NextWindowId++;
+    if (!Tree->Root) {
+        Tree->Root = CreateBenchNode(Tree, NULL, WindowId);
+        return;
+    }
+
+    node *Leaf = RandomLeaf(Tree);
+    Leaf->Split = (NextRandom(&Tree->Random) & 1) ? Split_Vertical : Split_Horizontal;
+    Leaf->Left = CreateBenchNode(Tree, Leaf, Leaf->WindowId);
+    Leaf->Right = CreateBenchNode(Tree, Leaf, WindowId);
+    Leaf->WindowId = Node_Root;
+}
+
+// NOTE(koekeishiya): The sibling of the removed leaf takes the place of their parent, like RemoveWindowFromBSPTree.
+internal void
+RemoveBenchWindow(bench_tree *Tree)
+{
+    node *Leaf = RandomLeaf(Tree);
+    node *Parent = Leaf->Parent;
+    if (!Parent) {
+        FreeBenchNode(Tree, Leaf);
+        Tree->Root = NULL;
+        return;
+    }
+
+    node *Sibling = Parent->Left == Leaf ? Parent->Right : Parent->Left;
+    Parent->WindowId = Sibling->WindowId;
+    Parent->Split = Sibling->Split;
+    Parent->Ratio = Sibling->Ratio;
+    Parent->Left = Sibling->Left;
+    Parent->Right = Sibling->Right;
+
+    if (Parent->Left)  Parent->Left->Parent = Parent;
+    if (Parent->Right) Parent->Right->Parent = Parent;
+
+    FreeBenchNode(Tree, Sibling);
+    FreeBenchNode(Tree, Leaf);
+}
+
+// NOTE(koekeishiya): Recomputes the region of every node from its parent, like a full relayout.
+internal uint64_t
+TraverseBenchTree(node *Node)
+{
+    if (Node->Left && Node->Right) {
+        region Left = Node->Region;
+        region Right = Node->Region;
+
+        if (Node->Split == Split_Vertical) {
+            Left.Width = Node->Region.Width * Node->Ratio;
+            Right.X += Left.Width;
+            Right.Width -= Left.Width;
+        } else {
+            Left.Height = Node->Region.Height * Node->Ratio;
+            Right.Y += Left.Height;
+            Right.Height -= Left.Height;
+        }
+
+        Node->Left->Region = Left;
+        Node->Right->Region = Right;
+        return TraverseBenchTree(Node->Left) + TraverseBenchTree(Node->Right);
+    }
+
+    return (uint64_t)(Node->Region.X * 7 + Node->Region.Y * 13 +
+                      Node->Region.Width * 17 + Node->Region.Height * 19) + Node->WindowId;
+}
+
+internal uint64_t
+TraverseBenchTree(bench_tree *Tree, uint64_t *Checksum)
+{
+    region Full = { 0.0f, 22.0f, 2560.0f, 1418.0f, Region_Full };
+
+    uint64_t Begin = BenchTime();
+    for (unsigned Index = 0; Index < TraverseCount; ++Index) {
+        Tree->Root->Region = Full;
+        *Checksum += TraverseBenchTree(Tree->Root);
+    }
+    return BenchTime() - Begin;
+}
+
+/*
+ * NOTE(koekeishiya): Every round builds a tree of the given size, traverses it, replaces every
+ * window once by removing a random leaf and inserting a new one, traverses it again and destroys it.
+ */
+internal bench_result
+RunMode(bench_mode Mode, unsigned LeafCount)
+{
+    bench_result Result = {};
+    bench_tree Tree = {};
+    Tree.Mode = Mode;
+    Tree.NextWindowId = 1;
+    Tree.Random = 0x9e3779b9;
+
+    for (unsigned Round = 0; Round < RoundCount; ++Round) {
+        uint64_t Begin = BenchTime();
+        for (unsigned Index = 0; Index < LeafCount; ++Index) {
+            InsertBenchWindow(&Tree);
+        }
+        Result.Insert += BenchTime() - Begin;
+
+        Result.Traverse += TraverseBenchTree(&Tree, &Result.Checksum);
+
+        Begin = BenchTime();
+        for (unsigned Index = 0; Index < LeafCount; ++Index) {
+            RemoveBenchWindow(&Tree);
+            InsertBenchWindow(&Tree);
+        }
+        Result.Churn += BenchTime() - Begin;
+
+        Result.TraverseChurned += TraverseBenchTree(&Tree, &Result.Checksum);
+
+        Begin = BenchTime();
+        DestroyBenchTree(&Tree);
+        Result.Destroy += BenchTime() - Begin;
+    }
+
+    FreeNodePool(&Tree.Pool);
+    FreeNoise();
+    return Result;
+}
+
+internal void
+PrintResult(const char *Name, bench_result *Result, unsigned LeafCount)
+{
+    double Operations = (double) RoundCount * LeafCount;
+    double Traversals = (double) RoundCount * TraverseCount;
+
+    printf(" %s: insert %6.1fns churn %6.1fns traverse %8.2fus %8.2fus destroy %8.2fus |",
+           Name, Result->Insert / Operations, Result->Churn / Operations,
+           Result->Traverse / 1000.0 / Traversals, Result->TraverseChurned / 1000.0 / Traversals,
+           Result->Destroy / 1000.0 / RoundCount);
+}
+
+internal void
+RunBench(unsigned LeafCount)
+{
+    bench_result Malloc = RunMode(Bench_Malloc, LeafCount);
+    bench_result Pool = RunMode(Bench_Pool, LeafCount);
+
+    printf("%5u leaves |", LeafCount);
+    PrintResult("malloc", &Malloc, LeafCount);
+    PrintResult("pool", &Pool, LeafCount);
+    printf(" %s\n", Malloc.Checksum == Pool.Checksum ? "trees match" : "TREES DIFFER");
+}
+
+internal bool
+ParseArguments(int Count, char **Args)
+{
+    int Option;
+    while ((Option = getopt(Count, Args, "r:t:n:")) != -1) {
+        switch (Option) {
+        case 'r': { RoundCount = atoi(optarg); } break;
+        case 't': { TraverseCount = atoi(optarg); } break;
+        case 'n': { NoiseCount = atoi(optarg); } break;
+        default: { return false; } break;
+        }
+    }
+
+    return RoundCount > 0 && TraverseCount > 0;
+}
+
+int main(int Count, char **Args)
+{
+    if (!ParseArguments(Count, Args)) {
+        fprintf(stderr, "usage: nodebench [-r rounds] [-t traversals] [-n noise] [leaves ...]\n");
+        return EXIT_FAILURE;
+    }
+
+    if (optind < Count) {
+        for (int Index = optind; Index < Count; ++Index) {
+            RunBench(atoi(Args[Index]));
+        }
+    } else {
+        unsigned Sizes[] = { 10, 32, 100, 316, 1000 };
+        for (size_t Index = 0; Index < sizeof(Sizes) / sizeof(Sizes[0]); ++Index) {
+            RunBench(Sizes[Index]);
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
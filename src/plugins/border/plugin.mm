@@ -20,18 +20,41 @@
 #include "../../common/border/border.mm"
 
 #define internal static
+#define ArrayCount(a) (sizeof(a) / sizeof((*a)))
 #define DESKTOP_MODE_BSP      0
 #define DESKTOP_MODE_MONOCLE  1
 #define DESKTOP_MODE_FLOATING 2
 
+/*
+ * NOTE(koekeishiya): 'Border' and our settings are only used by our own handlers, but
+ * BorderConfigChanged runs on the thread that changed the cvar. It only flags which cvars
+ * changed, and ApplyBorderConfig picks them up before the next handler uses the border.
+ */
+enum border_config_flags
+{
+    Border_Config_Color         = (1 << 0),
+    Border_Config_Width         = (1 << 1),
+    Border_Config_SkipFloating  = (1 << 2),
+    Border_Config_SkipMonocle   = (1 << 3),
+};
+
 internal macos_application *Application;
 internal border_window *Border;
+internal uint32_t volatile BorderConfigDirty;
 internal bool SkipFloating;
 internal bool SkipMonocle;
 internal bool DrawBorder;
 internal int DesktopMode;
 internal chunkwm_api API;
 
+internal const char *WatchedCVars[] =
+{
+    "focused_border_color",
+    "focused_border_width",
+    "focused_border_skip_floating",
+    "focused_border_skip_monocle",
+};
+
 internal AXUIElementRef
 GetFocusedWindow()
 {
@@ -60,6 +83,38 @@ CreateBorder(int X, int Y, int W, int H)
     Border = CreateBorderWindow(X, Y, W, H, Width, Radius, Color, Outline);
 }
 
+internal void
+DestroyBorder()
+{
+    if (Border) {
+        DestroyBorderWindow(Border);
+        Border = NULL;
+    }
+}
+
+internal void
+ApplyBorderConfig()
+{
+    uint32_t Dirty = __atomic_exchange_n(&BorderConfigDirty, 0, __ATOMIC_ACQUIRE);
+    if (!Dirty) return;
+
+    if ((Dirty & Border_Config_Color) && (Border)) {
+        UpdateBorderWindowColor(Border, CVarUnsignedValue("focused_border_color"));
+    }
+
+    if ((Dirty & Border_Config_Width) && (Border)) {
+        UpdateBorderWindowWidth(Border, CVarIntegerValue("focused_border_width"));
+    }
+
+    if (Dirty & Border_Config_SkipFloating) {
+        SkipFloating = CVarIntegerValue("focused_border_skip_floating");
+    }
+
+    if (Dirty & Border_Config_SkipMonocle) {
+        SkipMonocle = CVarIntegerValue("focused_border_skip_monocle");
+    }
+}
+
 internal inline void
 ClearBorderWindow(border_window *Border)
 {
@@ -79,6 +134,7 @@ FuckingMacOSMonitorBoundsChangingBetweenPrimaryAndMainMonitor(AXUIElementRef Win
     CFRelease(DisplayRef);
 
     int InvertY = DisplayBounds.size.height - (Position.y + Size.height);
+    ApplyBorderConfig();
     if (Border) {
         UpdateBorderWindowRect(Border, Position.x, InvertY, Size.width, Size.height);
     } else {
@@ -206,7 +262,7 @@ NewWindowHandler(macos_space *Space)
 }
 
 internal inline void
-NewWindowHandler()
+NewWindowHandler(void *Data)
 {
     AXUIElementRef WindowRef = GetFocusedWindow();
     if (WindowRef) {
@@ -269,16 +325,13 @@ WindowMinimizedHandler(void *Data)
 }
 
 internal inline void
-SpaceChangedHandler()
+SpaceChangedHandler(void *Data)
 {
     macos_space *Space;
     bool Success = AXLibActiveSpace(&Space);
     ASSERT(Success);
 
-    if (Border) {
-        DestroyBorderWindow(Border);
-        Border = NULL;
-    }
+    DestroyBorder();
 
     if (Space->Type == kCGSSpaceUser) {
         NewWindowHandler(Space);
@@ -294,6 +347,30 @@ StringEquals(const char *A, const char *B)
     return Result;
 }
 
+/*
+ * NOTE(koekeishiya): Records changes to our cvars, both from 'chunkc border::' commands and
+ * from 'chunkc set', so that we do not have to read them when handling events. A change made
+ * by 'chunkc set' shows once the border is next updated, or the plugin handles its next event.
+ */
+internal
+CVAR_WATCH_FUNC(BorderConfigChanged)
+{
+    uint32_t Dirty = 0;
+    for (unsigned Index = 0; Index < Count; ++Index) {
+        cvar_change *Change = Changes + Index;
+        if (StringEquals(Change->Name, "focused_border_color")) {
+            Dirty |= Border_Config_Color;
+        } else if (StringEquals(Change->Name, "focused_border_width")) {
+            Dirty |= Border_Config_Width;
+        } else if (StringEquals(Change->Name, "focused_border_skip_floating")) {
+            Dirty |= Border_Config_SkipFloating;
+        } else if (StringEquals(Change->Name, "focused_border_skip_monocle")) {
+            Dirty |= Border_Config_SkipMonocle;
+        }
+    }
+    __atomic_or_fetch(&BorderConfigDirty, Dirty, __ATOMIC_RELEASE);
+}
+
 internal void
 CommandHandler(void *Data)
 {
@@ -301,18 +378,12 @@ CommandHandler(void *Data)
     if (StringEquals(Payload->Command, "color")) {
         token Token = GetToken(&Payload->Message);
         if (Token.Length > 0) {
-            unsigned Color = TokenToUnsigned(Token);
-            UpdateCVar("focused_border_color", Color);
-            if (Border) {
-                UpdateBorderWindowColor(Border, Color);
-            }
+            UpdateCVar("focused_border_color", TokenToUnsigned(Token));
         }
     } else if (StringEquals(Payload->Command, "width")) {
         token Token = GetToken(&Payload->Message);
         if (Token.Length > 0) {
-            int Width = TokenToInt(Token);
-            UpdateCVar("focused_border_width", Width);
-            UpdateBorderWindowWidth(Border, Width);
+            UpdateCVar("focused_border_width", TokenToInt(Token));
         }
     } else if (StringEquals(Payload->Command, "clear")) {
         if (Border) {
@@ -401,38 +472,11 @@ TilingFocusedDesktopMode(void *Data)
 
 PLUGIN_MAIN_FUNC(PluginMain)
 {
-    if ((StringEquals(Node, "chunkwm_export_application_launched")) ||
-        (StringEquals(Node, "chunkwm_export_window_created")) ||
-        (StringEquals(Node, "chunkwm_export_application_unhidden")) ||
-        (StringEquals(Node, "chunkwm_export_window_deminimized"))) {
-        NewWindowHandler();
-        return true;
-    } else if (StringEquals(Node, "chunkwm_export_application_activated")) {
-        ApplicationActivatedHandler(Data);
-        return true;
-    } else if (StringEquals(Node, "chunkwm_export_application_deactivated")) {
-        ApplicationDeactivatedHandler(Data);
-        return true;
-    } else if (StringEquals(Node, "chunkwm_export_window_destroyed")) {
-        WindowDestroyedHandler(Data);
-        return true;
-    } else if (StringEquals(Node, "chunkwm_export_window_focused")) {
-        WindowFocusedHandler(Data);
-        return true;
-    } else if (StringEquals(Node, "chunkwm_export_window_moved")) {
-        WindowMovedHandler(Data);
-        return true;
-    } else if (StringEquals(Node, "chunkwm_export_window_resized")) {
-        WindowResizedHandler(Data);
-        return true;
-    } else if (StringEquals(Node, "chunkwm_export_window_minimized")) {
-        WindowMinimizedHandler(Data);
-        return true;
-    } else if (StringEquals(Node, "chunkwm_export_space_changed")) {
-        SpaceChangedHandler();
-        return true;
-    } else if (StringEquals(Node, "chunkwm_daemon_command")) {
+    ApplyBorderConfig();
+
+    if (StringEquals(Node, "chunkwm_daemon_command")) {
         CommandHandler(Data);
+        ApplyBorderConfig();
         return true;
     } else if (StringEquals(Node, "chunkwm_events_subscribed")) {
         UpdateToFocusedWindow();
@@ -463,33 +507,37 @@ PLUGIN_BOOL_FUNC(PluginInit)
     SkipMonocle = CVarIntegerValue("focused_border_skip_monocle");
     DrawBorder = true;
     CreateBorder(0, 0, 0, 0);
+    for (size_t Index = 0; Index < ArrayCount(WatchedCVars); ++Index) {
+        WatchCVar(WatchedCVars[Index], BorderConfigChanged, NULL, true);
+    }
     return true;
 }
 
 PLUGIN_VOID_FUNC(PluginDeInit)
 {
-    if (Border) {
-        DestroyBorderWindow(Border);
+    for (size_t Index = 0; Index < ArrayCount(WatchedCVars); ++Index) {
+        UnwatchCVar(WatchedCVars[Index], BorderConfigChanged);
     }
+    DestroyBorder();
 }
 
 CHUNKWM_PLUGIN_VTABLE(PluginInit, PluginDeInit, PluginMain)
-chunkwm_plugin_export Subscriptions[] =
-{
-    chunkwm_export_application_launched,
-    chunkwm_export_application_unhidden,
-    chunkwm_export_application_activated,
-    chunkwm_export_application_deactivated,
-
-    chunkwm_export_window_created,
-    chunkwm_export_window_focused,
-    chunkwm_export_window_destroyed,
-    chunkwm_export_window_moved,
-    chunkwm_export_window_resized,
-    chunkwm_export_window_minimized,
-    chunkwm_export_window_deminimized,
-
-    chunkwm_export_space_changed
+chunkwm_plugin_handler Subscriptions[] =
+{
+    { chunkwm_export_application_launched,    NewWindowHandler },
+    { chunkwm_export_application_unhidden,    NewWindowHandler },
+    { chunkwm_export_application_activated,   ApplicationActivatedHandler },
+    { chunkwm_export_application_deactivated, ApplicationDeactivatedHandler },
+
+    { chunkwm_export_window_created,          NewWindowHandler },
+    { chunkwm_export_window_focused,          WindowFocusedHandler },
+    { chunkwm_export_window_destroyed,        WindowDestroyedHandler },
+    { chunkwm_export_window_moved,            WindowMovedHandler },
+    { chunkwm_export_window_resized,          WindowResizedHandler },
+    { chunkwm_export_window_minimized,        WindowMinimizedHandler },
+    { chunkwm_export_window_deminimized,      NewWindowHandler },
+
+    { chunkwm_export_space_changed,           SpaceChangedHandler }
 };
-CHUNKWM_PLUGIN_SUBSCRIBE(Subscriptions)
+CHUNKWM_PLUGIN_SUBSCRIBE_HANDLERS(Subscriptions)
 CHUNKWM_PLUGIN("Border", "0.3.5")
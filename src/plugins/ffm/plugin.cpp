@@ -307,13 +307,7 @@ SetMouseModifier(const char *Mod)
 
 PLUGIN_MAIN_FUNC(PluginMain)
 {
-    if (strcmp(Node, "chunkwm_export_application_activated") == 0) {
-        ApplicationActivatedHandler(Data);
-        return true;
-    } else if (strcmp(Node, "chunkwm_export_window_focused") == 0) {
-        WindowFocusedHandler(Data);
-        return true;
-    } else if (strcmp(Node, "Tiling_focused_window_float") == 0) {
+    if (strcmp(Node, "Tiling_focused_window_float") == 0) {
         TilingWindowFloatHandler(Data);
         return true;
     }
@@ -336,7 +330,9 @@ PLUGIN_BOOL_FUNC(PluginInit)
         CreateCVar("ffm_standby_on_float", 1);
         CreateCVar("ffm_disable_autoraise", 0);
         CreateCVar("mouse_motion_interval", 35.0f);
-        SetMouseModifier(CVarStringValue("ffm_bypass_modifier"));
+        char *BypassModifier = CVarStringDuplicate("ffm_bypass_modifier");
+        SetMouseModifier(BypassModifier);
+        free(BypassModifier);
         DisableAutoraise = CVarIntegerValue("ffm_disable_autoraise");
         StandbyOnFloat = CVarIntegerValue("ffm_standby_on_float");
         MouseMotionInterval = CVarFloatingPointValue("mouse_motion_interval");
@@ -351,10 +347,10 @@ PLUGIN_VOID_FUNC(PluginDeInit)
 }
 
 CHUNKWM_PLUGIN_VTABLE(PluginInit, PluginDeInit, PluginMain)
-chunkwm_plugin_export Subscriptions[] =
+chunkwm_plugin_handler Subscriptions[] =
 {
-    chunkwm_export_application_activated,
-    chunkwm_export_window_focused
+    { chunkwm_export_application_activated, ApplicationActivatedHandler },
+    { chunkwm_export_window_focused,        WindowFocusedHandler }
 };
-CHUNKWM_PLUGIN_SUBSCRIBE(Subscriptions)
+CHUNKWM_PLUGIN_SUBSCRIBE_HANDLERS(Subscriptions)
 CHUNKWM_PLUGIN("Focus Follows Mouse", "0.4.0")
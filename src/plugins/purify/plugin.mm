@@ -11,6 +11,7 @@
 #include "../../common/accessibility/element.h"
 #include "../../common/accessibility/observer.h"
 #include "../../common/ipc/daemon.h"
+#include "../../common/ipc/dock.h"
 
 #include "../../common/misc/carbon.cpp"
 #include "../../common/misc/workspace.mm"
@@ -20,6 +21,7 @@
 #include "../../common/accessibility/element.cpp"
 #include "../../common/accessibility/observer.cpp"
 #include "../../common/ipc/daemon.cpp"
+#include "../../common/ipc/dock.cpp"
 
 #define internal static
 
@@ -30,19 +32,31 @@ internal chunkwm_api API;
 internal void
 ExtendedDockDisableWindowShadow(uint32_t WindowId)
 {
-    int SockFD;
-    if (ConnectToDaemon(&SockFD, 5050)) {
-        char Message[64];
-        sprintf(Message, "window_shadow_irreversible %d", WindowId);
-        WriteToSocket(Message, SockFD);
+    SendDockMessage("window_shadow_irreversible %d", WindowId);
+}
+
+internal void
+ApplicationLaunchedHandler(void *Data)
+{
+    macos_application *Application = (macos_application *) Data;
+    macos_window **WindowList = AXLibWindowListForApplication(Application);
+    if (WindowList) {
+        macos_window **List = WindowList;
+        macos_window *Window;
+        while ((Window = *List++)) {
+            ExtendedDockDisableWindowShadow(Window->Id);
+            AXLibDestroyWindow(Window);
+        }
+
+        free(WindowList);
     }
-    CloseSocket(SockFD);
 }
-inline bool
-StringsAreEqual(const char *A, const char *B)
+
+internal void
+WindowCreatedHandler(void *Data)
 {
-    bool Result = (strcmp(A, B) == 0);
-    return Result;
+    macos_window *Window = (macos_window *) Data;
+    ExtendedDockDisableWindowShadow(Window->Id);
 }
 
 /*
@@ -50,29 +64,12 @@ StringsAreEqual(const char *A, const char *B)
  * parameter: const char *Node
  * parameter: void *Data
  * return: bool
+ *
+ * Subscribed events are passed to their handler directly; this only
+ * receives daemon commands and broadcasts from other plugins.
  */
 PLUGIN_MAIN_FUNC(PluginMain)
 {
-    if (StringsAreEqual(Node, "chunkwm_export_application_launched")) {
-        macos_application *Application = (macos_application *) Data;
-        macos_window **WindowList = AXLibWindowListForApplication(Application);
-        if (WindowList) {
-            macos_window **List = WindowList;
-            macos_window *Window;
-            while ((Window = *List++)) {
-                ExtendedDockDisableWindowShadow(Window->Id);
-                AXLibDestroyWindow(Window);
-            }
-
-            free(WindowList);
-        }
-        return true;
-    } else if (StringsAreEqual(Node, "chunkwm_export_window_created")) {
-        macos_window *Window = (macos_window *) Data;
-        ExtendedDockDisableWindowShadow(Window->Id);
-        return true;
-    }
-
     return false;
 }
 
@@ -85,6 +82,10 @@ PLUGIN_BOOL_FUNC(PluginInit)
 {
     API = ChunkwmAPI;
 
+    if (!BeginDockClient(DOCK_PORT)) {
+        API.Log(C_LOG_LEVEL_WARN, "chunkwm-purify: could not start dock client, messages are sent synchronously!\n");
+    }
+
     int Count = 0;
     int *WindowList = AXLibAllWindows(&Count);
     if (WindowList) {
@@ -99,6 +100,7 @@ PLUGIN_BOOL_FUNC(PluginInit)
 
 PLUGIN_VOID_FUNC(PluginDeInit)
 {
+    EndDockClient();
 }
 
 // NOTE(koekeishiya): Enable to manually trigger ABI mismatch
@@ -110,13 +112,13 @@ PLUGIN_VOID_FUNC(PluginDeInit)
 // NOTE(koekeishiya): Initialize plugin function pointers.
 CHUNKWM_PLUGIN_VTABLE(PluginInit, PluginDeInit, PluginMain)
 
-// NOTE(koekeishiya): Subscribe to ChunkWM events!
-chunkwm_plugin_export Subscriptions[] =
+// NOTE(koekeishiya): Subscribe to ChunkWM events and register their handlers!
+chunkwm_plugin_handler Subscriptions[] =
 {
-    chunkwm_export_application_launched,
-    chunkwm_export_window_created,
+    { chunkwm_export_application_launched, ApplicationLaunchedHandler },
+    { chunkwm_export_window_created,       WindowCreatedHandler },
 };
-CHUNKWM_PLUGIN_SUBSCRIBE(Subscriptions)
+CHUNKWM_PLUGIN_SUBSCRIBE_HANDLERS(Subscriptions)
 
 // NOTE(koekeishiya): Generate plugin
 CHUNKWM_PLUGIN(PluginName, PluginVersion);
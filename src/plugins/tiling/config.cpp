@@ -519,6 +519,7 @@ query_func QueryCommandDispatch(char Flag)
     case 'W': return QueryWindowsForDesktop;  break;
     case 'D': return QueryDesktopsForMonitor; break;
     case 'M': return QueryMonitorForDesktop;  break;
+    case 'S': return QueryState;              break;
 
     // NOTE(koekeishiya): silence compiler warning.
     default: return 0; break;
@@ -532,7 +533,7 @@ ParseQueryCommand(const char *Message, command *Chain)
 
     int Option;
     bool Success = true;
-    const char *Short = "w:d:m:D:M:";
+    const char *Short = "w:d:m:D:M:S";
 
     struct option Long[] = {
         { "window", required_argument, NULL, 'w' },
@@ -541,6 +542,7 @@ ParseQueryCommand(const char *Message, command *Chain)
         { "windows-for-desktop", required_argument, NULL, 'W' },
         { "desktops-for-monitor", required_argument, NULL, 'D' },
         { "monitor-for-desktop", required_argument, NULL, 'M' },
+        { "state", no_argument, NULL, 'S' },
         { NULL, 0, NULL, 0 }
     };
 
@@ -610,6 +612,11 @@ ParseQueryCommand(const char *Message, command *Chain)
                 goto End;
             }
         } break;
+        case 'S': {
+            command *Entry = ConstructCommand(Option, NULL);
+            Command->Next = Entry;
+            Command = Entry;
+        } break;
         case '?': {
             Success = false;
             FreeCommandChain(Chain);
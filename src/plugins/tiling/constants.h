@@ -52,6 +52,8 @@
 
 #define CVAR_WINDOW_FLOAT_NEXT      "window_float_next"
 #define CVAR_WINDOW_REGION_LOCKED   "window_region_locked"
+#define CVAR_WINDOW_FRAME_WORKERS   "window_frame_workers"
+#define CVAR_WINDOW_FRAME_TIMEOUT   "window_frame_timeout"
 
 #define CVAR_PRE_BORDER_COLOR       "preselect_border_color"
 #define CVAR_PRE_BORDER_WIDTH       "preselect_border_width"
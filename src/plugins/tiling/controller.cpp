@@ -6,18 +6,24 @@
 #include "../../common/accessibility/element.h"
 #include "../../common/config/cvar.h"
 #include "../../common/ipc/daemon.h"
+#include "../../common/ipc/dock.h"
 #include "../../common/misc/assert.h"
 
 #include "presel.h"
 #include "region.h"
+#include "layout.h"
+#include "frame.h"
 #include "node.h"
 #include "vspace.h"
 #include "misc.h"
 #include "constants.h"
 
 #include <math.h>
+#include <stdarg.h>
 #include <vector>
+#include <map>
 #include <poll.h>
+#include <sched.h>
 
 #define internal static
 
@@ -25,6 +31,8 @@ typedef std::map<uint32_t, macos_window *> macos_window_map;
 typedef macos_window_map::iterator macos_window_map_it;
 
 extern macos_window_map CopyWindowCache();
+extern macos_window_map *TryLockWindowCache();
+extern void UnlockWindowCache();
 extern macos_window *GetWindowByID(uint32_t Id);
 extern macos_window *GetFocusedWindow();
 extern uint32_t GetFocusedWindowId();
@@ -104,7 +112,7 @@ CenterMouseInRegionAndClick(region *Region)
         AXLibSetFocusedWindow(WindowRef);
         AXLibSetFocusedApplication(WindowPid);
 
-        if (StringEquals(CVarStringValue(CVAR_MOUSE_FOLLOWS_FOCUS), Mouse_Follows_Focus_Intr)) {
+        if (CVarStringEquals(CVAR_MOUSE_FOLLOWS_FOCUS, Mouse_Follows_Focus_Intr)) {
             CenterMouseInWindowRef(WindowRef);
         }
 
@@ -230,15 +238,16 @@ bool FindClosestWindow(macos_space *Space, virtual_space *VirtualSpace,
                        char *Direction, bool Wrap)
 {
     float MinDist = 0xFFFFFFFF;
-    std::vector<uint32_t> Windows = GetAllVisibleWindowsForSpace(Space);
+    node *NodeA = GetNodeWithId(VirtualSpace, Match->Id);
+    if (!NodeA) return false;
 
+    std::vector<uint32_t> Windows = GetAllVisibleWindowsForSpace(Space);
     for (int Index = 0; Index < Windows.size(); ++Index) {
         macos_window *Window = GetWindowByID(Windows[Index]);
         if ((!Window) || (Match->Id == Window->Id)) continue;
 
-        node *NodeA = GetNodeWithId(VirtualSpace->Tree, Match->Id, VirtualSpace->Mode);
-        node *NodeB = GetNodeWithId(VirtualSpace->Tree, Window->Id, VirtualSpace->Mode);
-        if ((!NodeA) || (!NodeB) || NodeA == NodeB) continue;
+        node *NodeB = GetNodeWithId(VirtualSpace, Window->Id);
+        if ((!NodeB) || NodeA == NodeB) continue;
 
         region *A = &NodeA->Region;
         region *B = &NodeB->Region;
@@ -362,7 +371,7 @@ FocusWindow(macos_window *Window)
     AXLibSetFocusedWindow(Window->Ref);
     AXLibSetFocusedApplication(Window->Owner->PSN);
 
-    if (StringEquals(CVarStringValue(CVAR_MOUSE_FOLLOWS_FOCUS), Mouse_Follows_Focus_Intr)) {
+    if (CVarStringEquals(CVAR_MOUSE_FOLLOWS_FOCUS, Mouse_Follows_Focus_Intr)) {
         CenterMouseInWindow(Window);
     }
 }
@@ -373,7 +382,8 @@ FocusWindowInFullscreenSpace(macos_space *Space, char *Direction)
     macos_window *Window = GetFocusedWindow();
     if (!Window) return;
 
-    char *FocusCycleMode = CVarStringValue(CVAR_WINDOW_FOCUS_CYCLE);
+    char FocusCycleMode[BUFFER_SIZE];
+    CVarStringCopy(CVAR_WINDOW_FOCUS_CYCLE, FocusCycleMode, sizeof(FocusCycleMode));
     bool WrapMonitor = StringEquals(FocusCycleMode, Window_Focus_Cycle_All)
                      ? AXLibDisplayCount() == 1
                      : StringEquals(FocusCycleMode, Window_Focus_Cycle_Monitor);
@@ -422,8 +432,8 @@ FocusWindowNoFocus(char *Direction)
         ASSERT(Window);
         FocusWindow(Window);
     } else {
-        char *FocusCycleMode = CVarStringValue(CVAR_WINDOW_FOCUS_CYCLE);
-        ASSERT(FocusCycleMode);
+        char FocusCycleMode[BUFFER_SIZE];
+        CVarStringCopy(CVAR_WINDOW_FOCUS_CYCLE, FocusCycleMode, sizeof(FocusCycleMode));
 
         if (StringEquals(FocusCycleMode, Window_Focus_Cycle_All)) {
             if ((StringEquals(Direction, "east")) ||
@@ -468,10 +478,10 @@ FocusWindowFocus(char *Direction, macos_window *Window)
     }
 
     if (VirtualSpace->Mode == Virtual_Space_Bsp) {
-        char *FocusCycleMode = CVarStringValue(CVAR_WINDOW_FOCUS_CYCLE);
-        ASSERT(FocusCycleMode);
+        char FocusCycleMode[BUFFER_SIZE];
+        CVarStringCopy(CVAR_WINDOW_FOCUS_CYCLE, FocusCycleMode, sizeof(FocusCycleMode));
 
-        node *WindowNode = GetNodeWithId(VirtualSpace->Tree, Window->Id, VirtualSpace->Mode);
+        node *WindowNode = GetNodeWithId(VirtualSpace, Window->Id);
         if (WindowNode) {
             if (StringEquals(FocusCycleMode, Window_Focus_Cycle_All)) {
                 bool WrapMonitor = AXLibDisplayCount() == 1;
@@ -496,10 +506,10 @@ FocusWindowFocus(char *Direction, macos_window *Window)
             }
         }
     } else if (VirtualSpace->Mode == Virtual_Space_Monocle) {
-        char *FocusCycleMode = CVarStringValue(CVAR_WINDOW_FOCUS_CYCLE);
-        ASSERT(FocusCycleMode);
+        char FocusCycleMode[BUFFER_SIZE];
+        CVarStringCopy(CVAR_WINDOW_FOCUS_CYCLE, FocusCycleMode, sizeof(FocusCycleMode));
 
-        node *WindowNode = GetNodeWithId(VirtualSpace->Tree, Window->Id, VirtualSpace->Mode);
+        node *WindowNode = GetNodeWithId(VirtualSpace, Window->Id);
         if (WindowNode) {
             node *Node = NULL;
             if ((StringEquals(Direction, "west")) ||
@@ -594,7 +604,7 @@ void SwapWindow(char *Direction)
     }
 
     if (VirtualSpace->Mode == Virtual_Space_Bsp) {
-        WindowNode = GetNodeWithId(VirtualSpace->Tree, Window->Id, VirtualSpace->Mode);
+        WindowNode = GetNodeWithId(VirtualSpace, Window->Id);
         if (!WindowNode) {
             goto vspace_release;
         }
@@ -605,18 +615,18 @@ void SwapWindow(char *Direction)
             }
         }
 
-        ClosestNode = GetNodeWithId(VirtualSpace->Tree, ClosestWindow->Id, VirtualSpace->Mode);
+        ClosestNode = GetNodeWithId(VirtualSpace, ClosestWindow->Id);
         ASSERT(ClosestNode);
 
-        SwapNodeIds(WindowNode, ClosestNode);
+        SwapNodeIds(WindowNode, ClosestNode, VirtualSpace);
         ResizeWindowToRegionSize(WindowNode);
         ResizeWindowToRegionSize(ClosestNode);
 
-        if (!StringEquals(CVarStringValue(CVAR_MOUSE_FOLLOWS_FOCUS), Mouse_Follows_Focus_Off)) {
+        if (!CVarStringEquals(CVAR_MOUSE_FOLLOWS_FOCUS, Mouse_Follows_Focus_Off)) {
             CenterMouseInRegion(&ClosestNode->Region);
         }
     } else if (VirtualSpace->Mode == Virtual_Space_Monocle) {
-        WindowNode = GetNodeWithId(VirtualSpace->Tree, Window->Id, VirtualSpace->Mode);
+        WindowNode = GetNodeWithId(VirtualSpace, Window->Id);
         if (!WindowNode) {
             goto vspace_release;
         }
@@ -636,7 +646,7 @@ void SwapWindow(char *Direction)
         if (ClosestNode && ClosestNode != WindowNode) {
             // NOTE(koekeishiya): Swapping windows in monocle mode
             // should not trigger mouse_follows_focus.
-            SwapNodeIds(WindowNode, ClosestNode);
+            SwapNodeIds(WindowNode, ClosestNode, VirtualSpace);
         }
     }
 
@@ -676,7 +686,7 @@ void WarpWindow(char *Direction)
     }
 
     if (VirtualSpace->Mode == Virtual_Space_Bsp) {
-        WindowNode = GetNodeWithId(VirtualSpace->Tree, Window->Id, VirtualSpace->Mode);
+        WindowNode = GetNodeWithId(VirtualSpace, Window->Id);
         ASSERT(WindowNode);
 
         if (!FindWindowUndirected(Space, VirtualSpace, WindowNode, &ClosestWindow, Direction, false)) {
@@ -685,12 +695,12 @@ void WarpWindow(char *Direction)
             }
         }
 
-        ClosestNode = GetNodeWithId(VirtualSpace->Tree, ClosestWindow->Id, VirtualSpace->Mode);
+        ClosestNode = GetNodeWithId(VirtualSpace, ClosestWindow->Id);
         ASSERT(ClosestNode);
 
         if (WindowNode->Parent == ClosestNode->Parent) {
             // NOTE(koekeishiya): Windows have the same parent, perform a regular swap.
-            SwapNodeIds(WindowNode, ClosestNode);
+            SwapNodeIds(WindowNode, ClosestNode, VirtualSpace);
             ResizeWindowToRegionSize(WindowNode);
             ResizeWindowToRegionSize(ClosestNode);
             FocusedNode = ClosestNode;
@@ -701,16 +711,16 @@ void WarpWindow(char *Direction)
             TileWindowOnSpace(Window, Space, VirtualSpace);
             UpdateCVar(CVAR_BSP_INSERTION_POINT, 0);
 
-            FocusedNode = GetNodeWithId(VirtualSpace->Tree, Window->Id, VirtualSpace->Mode);
+            FocusedNode = GetNodeWithId(VirtualSpace, Window->Id);
         }
 
         ASSERT(FocusedNode);
 
-        if (!StringEquals(CVarStringValue(CVAR_MOUSE_FOLLOWS_FOCUS), Mouse_Follows_Focus_Off)) {
+        if (!CVarStringEquals(CVAR_MOUSE_FOLLOWS_FOCUS, Mouse_Follows_Focus_Off)) {
             CenterMouseInRegion(&ClosestNode->Region);
         }
     } else if (VirtualSpace->Mode == Virtual_Space_Monocle) {
-        WindowNode = GetNodeWithId(VirtualSpace->Tree, Window->Id, VirtualSpace->Mode);
+        WindowNode = GetNodeWithId(VirtualSpace, Window->Id);
         if (!WindowNode) {
             goto vspace_release;
         }
@@ -730,7 +740,7 @@ void WarpWindow(char *Direction)
         if (ClosestNode && ClosestNode != WindowNode) {
             // NOTE(koekeishiya): Swapping windows in monocle mode
             // should not trigger mouse_follows_focus.
-            SwapNodeIds(WindowNode, ClosestNode);
+            SwapNodeIds(WindowNode, ClosestNode, VirtualSpace);
         }
     }
 
@@ -751,24 +761,14 @@ void TemporaryRatio(char *Ratio)
 
 void ExtendedDockSetWindowAlpha(uint32_t WindowId, float Value, float Duration)
 {
-    int SockFD;
-    if (ConnectToDaemon(&SockFD, 5050)) {
-        char Message[64];
-        sprintf(Message, "window_alpha_fade %d %f %f", WindowId, Value, Duration);
-        WriteToSocket(Message, SockFD);
-    }
-    CloseSocket(SockFD);
+    dock_window_value Alpha = { WindowId, Value, 0, 0 };
+    SendDockWindowBatch(DockWindow_AlphaFade, &Alpha, 1, Duration);
 }
 
 void ExtendedDockSetWindowAlpha(uint32_t WindowId, float Value)
 {
-    int SockFD;
-    if (ConnectToDaemon(&SockFD, 5050)) {
-        char Message[64];
-        sprintf(Message, "window_alpha %d %f", WindowId, Value);
-        WriteToSocket(Message, SockFD);
-    }
-    CloseSocket(SockFD);
+    dock_window_value Alpha = { WindowId, Value, 0, 0 };
+    SendDockWindowBatch(DockWindow_Alpha, &Alpha, 1, 0.0f);
 }
 
 void EnableWindowFading(uint32_t FocusedWindowId)
@@ -777,13 +777,21 @@ void EnableWindowFading(uint32_t FocusedWindowId)
     float Duration = CVarFloatingPointValue(CVAR_WINDOW_FADE_DURATION);
     macos_window_map Copy = CopyWindowCache();
 
-    ExtendedDockSetWindowAlpha(FocusedWindowId, 1.0f, Duration);
+    std::vector<dock_window_value> Values;
+    Values.reserve(Copy.size() + 1);
+
+    dock_window_value Focused = { FocusedWindowId, 1.0f, 0, 0 };
+    Values.push_back(Focused);
+
     for (macos_window_map_it It = Copy.begin(); It != Copy.end(); ++It) {
         macos_window *Window = It->second;
         if (Window->Id == FocusedWindowId) continue;
-        ExtendedDockSetWindowAlpha(Window->Id, Alpha, Duration);
+
+        dock_window_value Value = { Window->Id, Alpha, 0, 0 };
+        Values.push_back(Value);
     }
 
+    SendDockWindowBatch(DockWindow_AlphaFade, &Values[0], Values.size(), Duration);
     UpdateCVar(CVAR_WINDOW_FADE_INACTIVE, 1);
 }
 
@@ -792,9 +800,16 @@ void DisableWindowFading()
     float Duration = CVarFloatingPointValue(CVAR_WINDOW_FADE_DURATION);
     macos_window_map Copy = CopyWindowCache();
 
+    std::vector<dock_window_value> Values;
+    Values.reserve(Copy.size());
+
     for (macos_window_map_it It = Copy.begin(); It != Copy.end(); ++It) {
-        macos_window *Window = It->second;
-        ExtendedDockSetWindowAlpha(Window->Id, 1.0f, Duration);
+        dock_window_value Value = { It->second->Id, 1.0f, 0, 0 };
+        Values.push_back(Value);
+    }
+
+    if (!Values.empty()) {
+        SendDockWindowBatch(DockWindow_AlphaFade, &Values[0], Values.size(), Duration);
     }
 
     UpdateCVar(CVAR_WINDOW_FADE_INACTIVE, 0);
@@ -802,35 +817,20 @@ void DisableWindowFading()
 
 void ExtendedDockSetWindowPosition(uint32_t WindowId, int X, int Y)
 {
-    int SockFD;
-    if (ConnectToDaemon(&SockFD, 5050)) {
-        char Message[64];
-        sprintf(Message, "window_move %d %d %d", WindowId, X, Y);
-        WriteToSocket(Message, SockFD);
-    }
-    CloseSocket(SockFD);
+    dock_window_value Position = { WindowId, 0.0f, X, Y };
+    SendDockWindowBatch(DockWindow_Move, &Position, 1, 0.0f);
 }
 
 void ExtendedDockSetWindowLevel(macos_window *Window, int WindowLevelKey)
 {
-    int SockFD;
-    if (ConnectToDaemon(&SockFD, 5050)) {
-        char Message[64];
-        sprintf(Message, "window_level %d %d", Window->Id, WindowLevelKey);
-        WriteToSocket(Message, SockFD);
-    }
-    CloseSocket(SockFD);
+    dock_window_value Level = { Window->Id, (float) WindowLevelKey, 0, 0 };
+    SendDockWindowBatch(DockWindow_Level, &Level, 1, 0.0f);
 }
 
 void ExtendedDockSetWindowSticky(macos_window *Window, int Value)
 {
-    int SockFD;
-    if (ConnectToDaemon(&SockFD, 5050)) {
-        char Message[64];
-        sprintf(Message, "window_sticky %d %d", Window->Id, Value);
-        WriteToSocket(Message, SockFD);
-    }
-    CloseSocket(SockFD);
+    dock_window_value Sticky = { Window->Id, (float) Value, 0, 0 };
+    SendDockWindowBatch(DockWindow_Sticky, &Sticky, 1, 0.0f);
 }
 
 void FloatWindow(macos_window *Window)
@@ -922,6 +922,8 @@ ToggleWindowNativeFullscreen()
     }
 
     bool Fullscreen = AXLibIsWindowFullscreen(Window->Ref);
+    InvalidateWindowFrame(Window->Id);
+
     if (Fullscreen) {
         AXLibSetWindowFullscreen(Window->Ref, !Fullscreen);
 
@@ -963,7 +965,7 @@ ToggleWindowFullscreenZoom()
         goto vspace_release;
     }
 
-    Node = GetNodeWithId(VirtualSpace->Tree, Window->Id, VirtualSpace->Mode);
+    Node = GetNodeWithId(VirtualSpace, Window->Id);
     if (!Node) {
         goto vspace_release;
     }
@@ -1026,7 +1028,7 @@ ToggleWindowParentZoom()
         goto vspace_release;
     }
 
-    Node = GetNodeWithId(VirtualSpace->Tree, Window->Id, VirtualSpace->Mode);
+    Node = GetNodeWithId(VirtualSpace, Window->Id);
     if (!Node || !Node->Parent) {
         goto vspace_release;
     }
@@ -1089,7 +1091,7 @@ ToggleWindowSplitMode()
         goto vspace_release;
     }
 
-    Node = GetNodeWithId(VirtualSpace->Tree, Window->Id, VirtualSpace->Mode);
+    Node = GetNodeWithId(VirtualSpace, Window->Id);
     if (!Node || !Node->Parent) {
         goto vspace_release;
     }
@@ -1100,8 +1102,8 @@ ToggleWindowSplitMode()
         Node->Parent->Split = Split_Horizontal;
     }
 
-    CreateNodeRegionRecursive(Node->Parent, false, Space, VirtualSpace);
-    ApplyNodeRegion(Node->Parent, VirtualSpace->Mode);
+    MarkNodeSplitDirty(Node->Parent);
+    RelayoutDirtyNodes("toggle split", Space, VirtualSpace);
 
 vspace_release:
     ReleaseVirtualSpace(VirtualSpace);
@@ -1155,7 +1157,7 @@ void UseInsertionPoint(char *Direction)
         goto vspace_release;
     }
 
-    Node = GetNodeWithId(VirtualSpace->Tree, Window->Id, VirtualSpace->Mode);
+    Node = GetNodeWithId(VirtualSpace, Window->Id);
     if (!Node) {
         goto vspace_release;
     }
@@ -1368,7 +1370,7 @@ void AdjustWindowRatio(char *Direction)
         goto vspace_release;
     }
 
-    WindowNode = GetNodeWithId(VirtualSpace->Tree, Window->Id, VirtualSpace->Mode);
+    WindowNode = GetNodeWithId(VirtualSpace, Window->Id);
     if (!WindowNode) {
         goto vspace_release;
     }
@@ -1379,7 +1381,7 @@ void AdjustWindowRatio(char *Direction)
         }
     }
 
-    ClosestNode = GetNodeWithId(VirtualSpace->Tree, ClosestWindow->Id, VirtualSpace->Mode);
+    ClosestNode = GetNodeWithId(VirtualSpace, ClosestWindow->Id);
     ASSERT(ClosestNode);
 
     Ancestor = GetLowestCommonAncestor(WindowNode, ClosestNode);
@@ -1395,8 +1397,8 @@ void AdjustWindowRatio(char *Direction)
     Ratio = Ancestor->Ratio + Offset;
     if (Ratio >= 0.1 && Ratio <= 0.9) {
         Ancestor->Ratio = Ratio;
-        ResizeNodeRegion(Ancestor, Space, VirtualSpace);
-        ApplyNodeRegion(Ancestor, VirtualSpace->Mode);
+        MarkNodeSplitDirty(Ancestor);
+        RelayoutDirtyNodes("adjust ratio", Space, VirtualSpace);
     }
 
 vspace_release:
@@ -1431,8 +1433,7 @@ void ActivateSpaceLayout(char *Layout)
     }
 
     if (VirtualSpace->Tree) {
-        FreeNodeTree(VirtualSpace->Tree, VirtualSpace->Mode);
-        VirtualSpace->Tree = NULL;
+        FreeNodeTree(VirtualSpace);
     }
 
     VirtualSpace->Mode = NewLayout;
@@ -1696,6 +1697,7 @@ bool SendWindowToDesktop(macos_window *Window, char *Op)
     NormalizedWindow = NormalizeWindowRect(Window->Ref, SourceMonitorRef, DestinationMonitorRef);
     AXLibSetWindowPosition(Window->Ref, NormalizedWindow.origin.x, NormalizedWindow.origin.y);
     AXLibSetWindowSize(Window->Ref, NormalizedWindow.size.width, NormalizedWindow.size.height);
+    InvalidateWindowFrame(Window->Id);
 
     // NOTE(koekeishiya): We need to update our cached window dimensions, as they are
     // used when we attempt to tile the window on the new monitor. If we don't update
@@ -1826,6 +1828,7 @@ bool SendWindowToMonitor(macos_window *Window, char *Op)
     NormalizedWindow = NormalizeWindowRect(Window->Ref, SourceMonitorRef, DestinationMonitorRef);
     AXLibSetWindowPosition(Window->Ref, NormalizedWindow.origin.x, NormalizedWindow.origin.y);
     AXLibSetWindowSize(Window->Ref, NormalizedWindow.size.width, NormalizedWindow.size.height);
+    InvalidateWindowFrame(Window->Id);
 
     // NOTE(koekeishiya): We need to update our cached window dimensions, as they are
     // used when we attempt to tile the window on the new monitor. If we don't update
@@ -1942,8 +1945,8 @@ void FocusMonitor(char *Op)
     switch (Operation) {
     case -1: {
         if (!FocusMonitor(DestinationMonitor)) {
-            char *FocusCycleMode = CVarStringValue(CVAR_WINDOW_FOCUS_CYCLE);
-            ASSERT(FocusCycleMode);
+            char FocusCycleMode[BUFFER_SIZE];
+            CVarStringCopy(CVAR_WINDOW_FOCUS_CYCLE, FocusCycleMode, sizeof(FocusCycleMode));
             if ((StringEquals(FocusCycleMode, Window_Focus_Cycle_All)) ||
                 (CVarIntegerValue(CVAR_MONITOR_FOCUS_CYCLE))) {
                 DestinationMonitor = AXLibDisplayCount() - 1;
@@ -1956,8 +1959,8 @@ void FocusMonitor(char *Op)
     } break;
     case 1: {
         if (!FocusMonitor(DestinationMonitor)) {
-            char *FocusCycleMode = CVarStringValue(CVAR_WINDOW_FOCUS_CYCLE);
-            ASSERT(FocusCycleMode);
+            char FocusCycleMode[BUFFER_SIZE];
+            CVarStringCopy(CVAR_WINDOW_FOCUS_CYCLE, FocusCycleMode, sizeof(FocusCycleMode));
             if ((StringEquals(FocusCycleMode, Window_Focus_Cycle_All)) ||
                 (CVarIntegerValue(CVAR_MONITOR_FOCUS_CYCLE))) {
                 DestinationMonitor = 0;
@@ -1997,6 +2000,7 @@ void GridLayout(macos_window *Window, char *Op)
                                    Region.X + Region.Width - CellWidth * (GridCols - WinX),
                                    Region.Y + Region.Height - CellHeight * (GridRows - WinY));
             AXLibSetWindowSize(Window->Ref, CellWidth * WinWidth, CellHeight * WinHeight);
+            InvalidateWindowFrame(Window->Id);
         }
     }
 
@@ -2029,8 +2033,7 @@ void EqualizeWindowTree(char *Unused)
     }
 
     EqualizeNodeTree(VirtualSpace->Tree);
-    ResizeNodeRegion(VirtualSpace->Tree, Space, VirtualSpace);
-    ApplyNodeRegion(VirtualSpace->Tree, VirtualSpace->Mode);
+    RelayoutDirtyNodes("equalize", Space, VirtualSpace);
 
 vspace_release:
     ReleaseVirtualSpace(VirtualSpace);
@@ -2099,10 +2102,10 @@ void DeserializeDesktop(char *Op)
     Buffer = ReadFile(Op);
     if (Buffer) {
         if (VirtualSpace->Tree) {
-            FreeNodeTree(VirtualSpace->Tree, VirtualSpace->Mode);
+            FreeNodeTree(VirtualSpace);
         }
 
-        VirtualSpace->Tree = DeserializeNodeFromBuffer(Buffer);
+        VirtualSpace->Tree = DeserializeNodeFromBuffer(Buffer, VirtualSpace);
         CreateDeserializedWindowTreeForSpace(Space, VirtualSpace);
         free(Buffer);
     } else {
@@ -2152,8 +2155,14 @@ void FocusDesktop(char *Op)
     unsigned DestArrangement = 0;
     bool Success = AXLibCGSSpaceIDFromDesktopID(DesktopId, &DestArrangement, &SpaceId, IncludeFullscreenSpaces);
     if (Success) {
+        /*
+         * NOTE(koekeishiya): Alpha, level and sticky changes are queued. Send them before we switch
+         * desktop, or the Dock would apply them after the switch has been made.
+         */
+        FlushDockClient();
+
         int SockFD;
-        if (ConnectToDaemon(&SockFD, 5050)) {
+        if (ConnectToDock(&SockFD)) {
             char Message[64];
             sprintf(Message, "space %d", SpaceId);
             WriteToSocket(Message, SockFD);
@@ -2202,7 +2211,8 @@ void CreateDesktop(char *Unused)
     Space = GetActiveSpace();
     if (!Space) goto out;
 
-    if (ConnectToDaemon(&SockFD, 5050)) {
+    FlushDockClient();
+    if (ConnectToDock(&SockFD)) {
         char Message[64];
         sprintf(Message, "space_create %d", Space->Id);
         WriteToSocket(Message, SockFD);
@@ -2225,7 +2235,8 @@ void DestroyDesktop(char *Unused)
     // and can not be destroyed using this method, so we guard for improper usage.
     if (Space->Type != kCGSSpaceUser) goto space_free;
 
-    if (ConnectToDaemon(&SockFD, 5050)) {
+    FlushDockClient();
+    if (ConnectToDock(&SockFD)) {
         char Message[64];
         sprintf(Message, "space_destroy %d", Space->Id);
         WriteToSocket(Message, SockFD);
@@ -2272,8 +2283,10 @@ void MoveDesktop(char *Op)
     ASSERT(Space);
     CFRelease(DisplayRef);
 
+    FlushDockClient();
+
     int SockFD;
-    if (ConnectToDaemon(&SockFD, 5050)) {
+    if (ConnectToDock(&SockFD)) {
         char Message[64];
         sprintf(Message, "space_move %d %d", CurrentSpaceId, Space->Id);
         WriteToSocket(Message, SockFD);
@@ -2615,7 +2628,7 @@ QueryMonocleDesktopWindowIndex(int SockFD)
     VirtualSpace = AcquireVirtualSpace(Space);
     if (VirtualSpace->Mode == Virtual_Space_Monocle) {
         if (VirtualSpace->Tree) {
-            ActiveNode = GetNodeWithId(VirtualSpace->Tree, Window->Id, VirtualSpace->Mode);
+            ActiveNode = GetNodeWithId(VirtualSpace, Window->Id);
             Node = VirtualSpace->Tree;
             while (Node) {
                 ++Index;
@@ -2792,3 +2805,509 @@ void QueryMonitorForDesktop(char *Op, int SockFD)
         WriteToSocket(Message, SockFD);
     }
 }
+
+/*
+ * NOTE(koekeishiya): The state query captures everything it reports before any output is
+ * formatted. Monitors, spaces, the windows on every space and window geometry are read from
+ * the window server first. The window cache and every virtual space are then copied in a
+ * single critical section, so the list of windows, the windows of every desktop and the
+ * trees all agree with each other; output is formatted after the locks are released.
+ */
+struct state_window
+{
+    uint32_t Id;
+    int PID;
+    char *Owner;
+    char *Name;
+    uint32_t Flags;
+    uint32_t Level;
+    bool Valid;
+    CGRect Frame;
+};
+
+struct state_node
+{
+    uint32_t WindowId;
+    node_split Split;
+    float Ratio;
+    region Region;
+    int Left;
+    int Right;
+};
+
+struct state_desktop
+{
+    unsigned Id;
+    CGSSpaceID SpaceId;
+    char *Uuid;
+    bool Fullscreen;
+    bool Active;
+    virtual_space_mode Mode;
+    region_offset Offset;
+    std::vector<state_node> Nodes;
+    std::vector<uint32_t> Windows;
+};
+
+struct state_monitor
+{
+    unsigned Id;
+    char *Uuid;
+    CGRect Frame;
+    std::vector<state_desktop> Desktops;
+};
+
+struct state_buffer
+{
+    char *Data;
+    size_t Length;
+    size_t Capacity;
+};
+
+internal void
+StateBufferAppend(state_buffer *Buffer, const char *Format, ...)
+{
+    va_list Args;
+
+    for (;;) {
+        size_t Available = Buffer->Capacity - Buffer->Length;
+
+        va_start(Args, Format);
+        int Written = vsnprintf(Buffer->Data + Buffer->Length, Available, Format, Args);
+        va_end(Args);
+
+        if (Written < 0) {
+            return;
+        }
+
+        if ((size_t) Written < Available) {
+            Buffer->Length += Written;
+            return;
+        }
+
+        Buffer->Capacity = Buffer->Capacity * 2 + Written;
+        Buffer->Data = (char *) realloc(Buffer->Data, Buffer->Capacity);
+    }
+}
+
+internal void
+StateBufferAppendBytes(state_buffer *Buffer, const char *Data, size_t Length)
+{
+    if (Buffer->Length + Length + 1 > Buffer->Capacity) {
+        Buffer->Capacity = Buffer->Capacity * 2 + Length + 1;
+        Buffer->Data = (char *) realloc(Buffer->Data, Buffer->Capacity);
+    }
+
+    memcpy(Buffer->Data + Buffer->Length, Data, Length);
+    Buffer->Length += Length;
+    Buffer->Data[Buffer->Length] = '\0';
+}
+
+internal inline bool
+StateStringNeedsEscape(unsigned char Char)
+{
+    return (Char < 0x20) || (Char == '"') || (Char == '\\');
+}
+
+// NOTE(koekeishiya): Characters that need no escaping are appended in runs rather than one at a time.
+internal void
+StateBufferAppendString(state_buffer *Buffer, const char *String)
+{
+    if (!String) {
+        StateBufferAppendBytes(Buffer, "null", 4);
+        return;
+    }
+
+    StateBufferAppendBytes(Buffer, "\"", 1);
+    const unsigned char *Cursor = (const unsigned char *) String;
+    while (*Cursor) {
+        const unsigned char *Run = Cursor;
+        while (*Cursor && !StateStringNeedsEscape(*Cursor)) ++Cursor;
+        if (Cursor != Run) {
+            StateBufferAppendBytes(Buffer, (const char *) Run, Cursor - Run);
+        }
+
+        if (!*Cursor) break;
+
+        switch (*Cursor) {
+        case '"':  StateBufferAppendBytes(Buffer, "\\\"", 2); break;
+        case '\\': StateBufferAppendBytes(Buffer, "\\\\", 2); break;
+        case '\n': StateBufferAppendBytes(Buffer, "\\n", 2);  break;
+        case '\r': StateBufferAppendBytes(Buffer, "\\r", 2);  break;
+        case '\t': StateBufferAppendBytes(Buffer, "\\t", 2);  break;
+        default:   StateBufferAppend(Buffer, "\\u%04x", *Cursor); break;
+        }
+        ++Cursor;
+    }
+    StateBufferAppendBytes(Buffer, "\"", 1);
+}
+
+internal void
+StateBufferAppendRect(state_buffer *Buffer, float X, float Y, float Width, float Height)
+{
+    StateBufferAppend(Buffer, "{\"x\":%.2f,\"y\":%.2f,\"w\":%.2f,\"h\":%.2f}", X, Y, Width, Height);
+}
+
+internal std::map<uint32_t, CGRect>
+CopyWindowFrames()
+{
+    std::map<uint32_t, CGRect> Result;
+
+    CFArrayRef WindowList = CGWindowListCopyWindowInfo(kCGWindowListOptionAll | kCGWindowListExcludeDesktopElements, kCGNullWindowID);
+    if (!WindowList) {
+        return Result;
+    }
+
+    CFIndex Count = CFArrayGetCount(WindowList);
+    for (CFIndex Index = 0; Index < Count; ++Index) {
+        CFDictionaryRef Entry = (CFDictionaryRef) CFArrayGetValueAtIndex(WindowList, Index);
+        CFNumberRef WindowNumber = (CFNumberRef) CFDictionaryGetValue(Entry, kCGWindowNumber);
+        CFDictionaryRef WindowBounds = (CFDictionaryRef) CFDictionaryGetValue(Entry, kCGWindowBounds);
+
+        uint32_t WindowId;
+        CGRect Frame;
+        if ((WindowNumber) &&
+            (WindowBounds) &&
+            (CFNumberGetValue(WindowNumber, kCFNumberSInt32Type, &WindowId)) &&
+            (CGRectMakeWithDictionaryRepresentation(WindowBounds, &Frame))) {
+            Result[WindowId] = Frame;
+        }
+    }
+
+    CFRelease(WindowList);
+    return Result;
+}
+
+// NOTE(koekeishiya): The caller must hold the window cache.
+internal void
+SnapshotWindows(macos_window_map *Cache, std::map<uint32_t, CGRect> &Frames, std::vector<state_window> *Windows)
+{
+    Windows->reserve(Cache->size());
+
+    for (macos_window_map_it It = Cache->begin(); It != Cache->end(); ++It) {
+        macos_window *Window = It->second;
+
+        state_window Entry;
+        Entry.Id = Window->Id;
+        Entry.PID = Window->Owner->PID;
+        Entry.Owner = Window->Owner->Name ? strdup(Window->Owner->Name) : NULL;
+        Entry.Name = Window->Name ? strdup(Window->Name) : NULL;
+        Entry.Flags = Window->Flags;
+        Entry.Level = Window->Level;
+        Entry.Valid = IsWindowValid(Window);
+
+        std::map<uint32_t, CGRect>::iterator Frame = Frames.find(Window->Id);
+        if (Frame != Frames.end()) {
+            Entry.Frame = Frame->second;
+        } else {
+            Entry.Frame = CGRectMake(Window->Position.x, Window->Position.y, Window->Size.width, Window->Size.height);
+        }
+
+        Windows->push_back(Entry);
+    }
+}
+
+internal int
+SnapshotNode(node *Node, std::vector<state_node> *Nodes)
+{
+    int Index = Nodes->size();
+
+    state_node Entry;
+    Entry.WindowId = Node->WindowId;
+    Entry.Split = Node->Split;
+    Entry.Ratio = Node->Ratio;
+    Entry.Region = Node->Region;
+    Entry.Left = -1;
+    Entry.Right = -1;
+    Nodes->push_back(Entry);
+
+    if (!IsLeafNode(Node)) {
+        int Left = SnapshotNode(Node->Left, Nodes);
+        int Right = SnapshotNode(Node->Right, Nodes);
+        (*Nodes)[Index].Left = Left;
+        (*Nodes)[Index].Right = Right;
+    }
+
+    return Index;
+}
+
+/*
+ * NOTE(koekeishiya): The caller must hold the window cache and every virtual space. 'Windows'
+ * holds every window that the window server reported for the space, and only the windows
+ * that we have cached are kept, like GetAllVisibleWindowsForSpace does.
+ */
+internal void
+SnapshotDesktop(macos_window_map *Cache, state_desktop *Desktop)
+{
+    std::vector<uint32_t> SpaceWindows;
+    SpaceWindows.swap(Desktop->Windows);
+    for (size_t Index = 0; Index < SpaceWindows.size(); ++Index) {
+        if (Cache->find(SpaceWindows[Index]) != Cache->end()) {
+            Desktop->Windows.push_back(SpaceWindows[Index]);
+        }
+    }
+
+    virtual_space *VirtualSpace = FindVirtualSpaceLocked(Desktop->Uuid);
+    if (!VirtualSpace) return;
+
+    Desktop->Mode = VirtualSpace->Mode;
+    Desktop->Offset = *VirtualSpace->Offset;
+
+    if (VirtualSpace->Tree) {
+        if (VirtualSpace->Mode == Virtual_Space_Monocle) {
+            for (node *Node = VirtualSpace->Tree; Node; Node = Node->Right) {
+                state_node Entry = { Node->WindowId, Node->Split, Node->Ratio, Node->Region, -1, -1 };
+                Desktop->Nodes.push_back(Entry);
+            }
+        } else {
+            SnapshotNode(VirtualSpace->Tree, &Desktop->Nodes);
+        }
+    }
+}
+
+internal void
+SnapshotMonitors(std::vector<state_monitor> *Monitors)
+{
+    unsigned DesktopId = 0;
+    unsigned DisplayCount = AXLibDisplayCount();
+    Monitors->resize(DisplayCount);
+
+    for (unsigned Arrangement = 0; Arrangement < DisplayCount; ++Arrangement) {
+        state_monitor *Monitor = &(*Monitors)[Arrangement];
+        CFStringRef DisplayRef = AXLibGetDisplayIdentifierFromArrangement(Arrangement);
+        ASSERT(DisplayRef);
+
+        Monitor->Id = Arrangement + 1;
+        Monitor->Uuid = CopyCFStringToC(DisplayRef);
+        Monitor->Frame = AXLibGetDisplayBounds(DisplayRef);
+
+        CGSSpaceID ActiveSpaceId = AXLibActiveCGSSpaceID(DisplayRef);
+        macos_space *Space, **List, **Spaces;
+        List = Spaces = AXLibSpacesForDisplay(DisplayRef);
+
+        while (Spaces && (Space = *List++)) {
+            Monitor->Desktops.push_back(state_desktop());
+            state_desktop *Desktop = &Monitor->Desktops.back();
+
+            Desktop->Fullscreen = Space->Type != kCGSSpaceUser;
+            Desktop->Id = Desktop->Fullscreen ? 0 : ++DesktopId;
+            Desktop->SpaceId = Space->Id;
+            Desktop->Uuid = CopyCFStringToC(Space->Ref);
+            Desktop->Active = Space->Id == ActiveSpaceId;
+            Desktop->Mode = Virtual_Space_Float;
+            Desktop->Offset = {};
+
+            /*
+             * NOTE(koekeishiya): Fullscreen spaces are never tiled and do not get a virtual space.
+             * Every other space gets one now, so that SnapshotState finds it.
+             */
+            if (!Desktop->Fullscreen) {
+                ReleaseVirtualSpace(AcquireVirtualSpace(Space));
+
+                int WindowCount;
+                int *WindowList = AXLibSpaceWindows(Space->Id, &WindowCount);
+                if (WindowList) {
+                    Desktop->Windows.assign(WindowList, WindowList + WindowCount);
+                    free(WindowList);
+                }
+            }
+
+            AXLibDestroySpace(Space);
+        }
+
+        free(Spaces);
+        CFRelease(DisplayRef);
+    }
+}
+
+/*
+ * NOTE(koekeishiya): A thread that holds a virtual space may acquire another virtual space or
+ * the window cache, so we can not wait for these locks in any fixed order. Either all of them
+ * are taken, or none, and we try again.
+ */
+internal macos_window_map *
+LockStateSnapshot()
+{
+    for (;;) {
+        if (TryLockVirtualSpaces()) {
+            macos_window_map *Cache = TryLockWindowCache();
+            if (Cache) return Cache;
+            UnlockVirtualSpaces();
+        }
+        sched_yield();
+    }
+}
+
+internal void
+SnapshotState(std::vector<state_window> *Windows, std::vector<state_monitor> *Monitors)
+{
+    std::map<uint32_t, CGRect> Frames = CopyWindowFrames();
+    SnapshotMonitors(Monitors);
+
+    macos_window_map *Cache = LockStateSnapshot();
+    SnapshotWindows(Cache, Frames, Windows);
+    for (size_t MonitorIndex = 0; MonitorIndex < Monitors->size(); ++MonitorIndex) {
+        state_monitor *Monitor = &(*Monitors)[MonitorIndex];
+        for (size_t DesktopIndex = 0; DesktopIndex < Monitor->Desktops.size(); ++DesktopIndex) {
+            state_desktop *Desktop = &Monitor->Desktops[DesktopIndex];
+            if (!Desktop->Fullscreen) {
+                SnapshotDesktop(Cache, Desktop);
+            }
+        }
+    }
+    UnlockWindowCache();
+    UnlockVirtualSpaces();
+}
+
+internal void
+FormatStateNode(state_buffer *Buffer, std::vector<state_node> &Nodes, int Index)
+{
+    state_node *Node = &Nodes[Index];
+
+    StateBufferAppend(Buffer, "{\"region\":");
+    StateBufferAppendRect(Buffer, Node->Region.X, Node->Region.Y, Node->Region.Width, Node->Region.Height);
+
+    if (Node->Left == -1) {
+        StateBufferAppend(Buffer, ",\"window\":%u}", Node->WindowId);
+    } else {
+        StateBufferAppend(Buffer, ",\"split\":\"%s\",\"ratio\":%.4f,\"left\":", node_split_str[Node->Split], Node->Ratio);
+        FormatStateNode(Buffer, Nodes, Node->Left);
+        StateBufferAppend(Buffer, ",\"right\":");
+        FormatStateNode(Buffer, Nodes, Node->Right);
+        StateBufferAppend(Buffer, "}");
+    }
+}
+
+internal void
+FormatStateDesktop(state_buffer *Buffer, state_desktop *Desktop)
+{
+    StateBufferAppend(Buffer, "{\"id\":%u,\"space\":%d,\"uuid\":", Desktop->Id, Desktop->SpaceId);
+    StateBufferAppendString(Buffer, Desktop->Uuid);
+    StateBufferAppend(Buffer, ",\"active\":%s,\"fullscreen\":%s",
+                      Desktop->Active ? "true" : "false",
+                      Desktop->Fullscreen ? "true" : "false");
+
+    if (Desktop->Fullscreen) {
+        StateBufferAppend(Buffer, ",\"mode\":null");
+    } else {
+        StateBufferAppend(Buffer, ",\"mode\":\"%s\"", virtual_space_mode_str[Desktop->Mode]);
+        StateBufferAppend(Buffer, ",\"offset\":{\"top\":%.2f,\"bottom\":%.2f,\"left\":%.2f,\"right\":%.2f,\"gap\":%.2f}",
+                          Desktop->Offset.Top, Desktop->Offset.Bottom,
+                          Desktop->Offset.Left, Desktop->Offset.Right,
+                          Desktop->Offset.Gap);
+    }
+
+    StateBufferAppend(Buffer, ",\"windows\":[");
+    for (size_t Index = 0; Index < Desktop->Windows.size(); ++Index) {
+        StateBufferAppend(Buffer, "%s%u", Index ? "," : "", Desktop->Windows[Index]);
+    }
+    StateBufferAppend(Buffer, "]");
+
+    // NOTE(koekeishiya): A monocle desktop is a list of windows rather than a tree.
+    if (Desktop->Nodes.empty()) {
+        StateBufferAppend(Buffer, ",\"tree\":null");
+    } else if (Desktop->Mode == Virtual_Space_Monocle) {
+        StateBufferAppend(Buffer, ",\"tree\":[");
+        for (size_t Index = 0; Index < Desktop->Nodes.size(); ++Index) {
+            if (Index) StateBufferAppend(Buffer, ",");
+            FormatStateNode(Buffer, Desktop->Nodes, Index);
+        }
+        StateBufferAppend(Buffer, "]");
+    } else {
+        StateBufferAppend(Buffer, ",\"tree\":");
+        FormatStateNode(Buffer, Desktop->Nodes, 0);
+    }
+
+    StateBufferAppend(Buffer, "}");
+}
+
+internal void
+FormatStateWindow(state_buffer *Buffer, state_window *Window)
+{
+    StateBufferAppend(Buffer, "{\"id\":%u,\"pid\":%d,\"owner\":", Window->Id, Window->PID);
+    StateBufferAppendString(Buffer, Window->Owner);
+    StateBufferAppend(Buffer, ",\"name\":");
+    StateBufferAppendString(Buffer, Window->Name);
+    StateBufferAppend(Buffer, ",\"level\":%u,\"frame\":", Window->Level);
+    StateBufferAppendRect(Buffer, Window->Frame.origin.x, Window->Frame.origin.y,
+                          Window->Frame.size.width, Window->Frame.size.height);
+    StateBufferAppend(Buffer, ",\"valid\":%s,\"float\":%s,\"sticky\":%s,\"minimized\":%s,\"movable\":%s,\"resizable\":%s}",
+                      Window->Valid ? "true" : "false",
+                      (Window->Flags & Window_Float) ? "true" : "false",
+                      (Window->Flags & Window_Sticky) ? "true" : "false",
+                      (Window->Flags & Window_Minimized) ? "true" : "false",
+                      (Window->Flags & Window_Movable) ? "true" : "false",
+                      (Window->Flags & Window_Resizable) ? "true" : "false");
+}
+
+void QueryState(char *Unused, int SockFD)
+{
+    std::vector<state_window> Windows;
+    std::vector<state_monitor> Monitors;
+
+    uint32_t FocusedWindowId = GetFocusedWindowId();
+    SnapshotState(&Windows, &Monitors);
+
+    unsigned FocusedMonitorId = 0;
+    unsigned FocusedDesktopId = 0;
+    macos_space *FocusedSpace = GetActiveSpace();
+    if (FocusedSpace) {
+        for (size_t MonitorIndex = 0; MonitorIndex < Monitors.size(); ++MonitorIndex) {
+            state_monitor *Monitor = &Monitors[MonitorIndex];
+            for (size_t DesktopIndex = 0; DesktopIndex < Monitor->Desktops.size(); ++DesktopIndex) {
+                if (Monitor->Desktops[DesktopIndex].SpaceId == FocusedSpace->Id) {
+                    FocusedMonitorId = Monitor->Id;
+                    FocusedDesktopId = Monitor->Desktops[DesktopIndex].Id;
+                }
+            }
+        }
+        AXLibDestroySpace(FocusedSpace);
+    }
+
+    state_buffer Buffer = {};
+    Buffer.Capacity = 4096 + 512 * Windows.size();
+    Buffer.Data = (char *) malloc(Buffer.Capacity);
+    Buffer.Data[0] = '\0';
+
+    StateBufferAppend(&Buffer, "{\"focused\":{\"window\":%u,\"desktop\":%u,\"monitor\":%u},\"monitors\":[",
+                      FocusedWindowId, FocusedDesktopId, FocusedMonitorId);
+
+    for (size_t MonitorIndex = 0; MonitorIndex < Monitors.size(); ++MonitorIndex) {
+        state_monitor *Monitor = &Monitors[MonitorIndex];
+        StateBufferAppend(&Buffer, "%s{\"id\":%u,\"uuid\":", MonitorIndex ? "," : "", Monitor->Id);
+        StateBufferAppendString(&Buffer, Monitor->Uuid);
+        StateBufferAppend(&Buffer, ",\"frame\":");
+        StateBufferAppendRect(&Buffer, Monitor->Frame.origin.x, Monitor->Frame.origin.y,
+                              Monitor->Frame.size.width, Monitor->Frame.size.height);
+        StateBufferAppend(&Buffer, ",\"desktops\":[");
+
+        for (size_t DesktopIndex = 0; DesktopIndex < Monitor->Desktops.size(); ++DesktopIndex) {
+            state_desktop *Desktop = &Monitor->Desktops[DesktopIndex];
+            if (DesktopIndex) StateBufferAppend(&Buffer, ",");
+            FormatStateDesktop(&Buffer, Desktop);
+            free(Desktop->Uuid);
+        }
+
+        StateBufferAppend(&Buffer, "]}");
+        free(Monitor->Uuid);
+    }
+
+    StateBufferAppend(&Buffer, "],\"windows\":[");
+    for (size_t Index = 0; Index < Windows.size(); ++Index) {
+        if (Index) StateBufferAppend(&Buffer, ",");
+        FormatStateWindow(&Buffer, &Windows[Index]);
+        free(Windows[Index].Owner);
+        free(Windows[Index].Name);
+    }
+    relayout_stats Relayout = GetRelayoutStats();
+    StateBufferAppend(&Buffer, "],\"relayout\":{\"operations\":%llu,\"nodes\":%llu,\"windows\":%llu}",
+                      Relayout.Operations, Relayout.Nodes, Relayout.Windows);
+
+    window_frame_stats Frames = GetWindowFrameStats();
+    StateBufferAppend(&Buffer, ",\"frames\":{\"applied\":%llu,\"skipped\":%llu,\"position_calls\":%llu,\"size_calls\":%llu,"
+                      "\"batches\":%llu,\"groups\":%llu,\"timed_out\":%llu}}\n",
+                      Frames.Applied, Frames.Skipped, Frames.PositionCalls, Frames.SizeCalls,
+                      Frames.Batches, Frames.Groups, Frames.TimedOut);
+
+    WriteToSocket(Buffer.Data, SockFD);
+    free(Buffer.Data);
+}
@@ -64,5 +64,6 @@ void QueryMonitor(char *Op, int SockFD);
 void QueryWindowsForDesktop(char *Op, int SockFD);
 void QueryDesktopsForMonitor(char *Op, int SockFD);
 void QueryMonitorForDesktop(char *Op, int SockFD);
+void QueryState(char *Unused, int SockFD);
 
 #endif
@@ -0,0 +1,411 @@
+#include "frame.h"
+#include "constants.h"
+
+#include "../../common/accessibility/application.h"
+#include "../../common/accessibility/window.h"
+#include "../../common/accessibility/element.h"
+#include "../../common/config/cvar.h"
+
+#include <math.h>
+#include <time.h>
+#include <pthread.h>
+#include <algorithm>
+#include <queue>
+#include <map>
+
+#define internal static
+
+#define FRAME_POOL_MAX_WORKERS 8
+
+struct frame_job
+{
+    frame_update *Updates;
+    size_t Count;
+    float Timeout;
+    uint32_t *Pending;
+};
+
+struct frame_pool
+{
+    bool Running;
+    unsigned WorkerCount;
+    pthread_t Workers[FRAME_POOL_MAX_WORKERS];
+
+    pthread_mutex_t Lock;
+    pthread_cond_t Ready;
+    pthread_cond_t Done;
+    std::queue<frame_job> Jobs;
+};
+
+internal std::map<uint32_t, window_frame> WindowFrames;
+internal pthread_mutex_t WindowFramesLock = PTHREAD_MUTEX_INITIALIZER;
+internal window_frame_stats WindowFrameStats;
+internal frame_pool FramePool;
+
+internal inline window_frame
+RoundWindowFrame(float X, float Y, float Width, float Height)
+{
+    window_frame Result = { (int32_t) lroundf(X), (int32_t) lroundf(Y),
+                            (int32_t) lroundf(Width), (int32_t) lroundf(Height) };
+    return Result;
+}
+
+internal bool
+FindWindowFrame(uint32_t WindowId, window_frame *Frame)
+{
+    pthread_mutex_lock(&WindowFramesLock);
+    std::map<uint32_t, window_frame>::iterator It = WindowFrames.find(WindowId);
+    bool Result = It != WindowFrames.end();
+    if (Result) *Frame = It->second;
+    pthread_mutex_unlock(&WindowFramesLock);
+    return Result;
+}
+
+/*
+ * NOTE(koekeishiya): Only the attributes that changed are set, so a window that keeps its size
+ * costs a single position call and vice versa. Returns the attributes that were set successfully.
+ */
+uint32_t CommitWindowFrame(macos_window *Window, region Region)
+{
+    uint32_t Result = 0;
+    window_frame Last;
+    window_frame Frame = RoundWindowFrame(Region.X, Region.Y, Region.Width, Region.Height);
+
+    bool Cached = FindWindowFrame(Window->Id, &Last);
+    bool Move = !Cached || Last.X != Frame.X || Last.Y != Frame.Y;
+    bool Resize = !Cached || Last.Width != Frame.Width || Last.Height != Frame.Height;
+
+    if (!Move && !Resize) {
+        __atomic_add_fetch(&WindowFrameStats.Skipped, 1, __ATOMIC_RELAXED);
+        return Result;
+    }
+
+    bool Failed = false;
+
+    if (Move) {
+        __atomic_add_fetch(&WindowFrameStats.PositionCalls, 1, __ATOMIC_RELAXED);
+        if (AXLibSetWindowPosition(Window->Ref, Region.X, Region.Y)) {
+            Result |= Window_Frame_Moved;
+        } else {
+            Failed = true;
+        }
+    }
+
+    if (Resize) {
+        __atomic_add_fetch(&WindowFrameStats.SizeCalls, 1, __ATOMIC_RELAXED);
+        if (AXLibSetWindowSize(Window->Ref, Region.Width, Region.Height)) {
+            Result |= Window_Frame_Resized;
+        } else {
+            Failed = true;
+        }
+    }
+
+    __atomic_add_fetch(&WindowFrameStats.Applied, 1, __ATOMIC_RELAXED);
+
+    pthread_mutex_lock(&WindowFramesLock);
+    if (Failed) {
+        WindowFrames.erase(Window->Id);
+        Result |= Window_Frame_Failed;
+    } else {
+        WindowFrames[Window->Id] = Frame;
+    }
+    pthread_mutex_unlock(&WindowFramesLock);
+
+    return Result;
+}
+
+/*
+ * NOTE(koekeishiya): Called with the frame reported by a moved or resized event. A moved event
+ * only reports the position, so the size is not compared. Events caused by CommitWindowFrame
+ * report the cached frame, unless the application refused it.
+ */
+void ValidateWindowFrame(macos_window *Window, bool Resized)
+{
+    window_frame Frame = RoundWindowFrame(Window->Position.x, Window->Position.y,
+                                          Window->Size.width, Window->Size.height);
+
+    pthread_mutex_lock(&WindowFramesLock);
+    std::map<uint32_t, window_frame>::iterator It = WindowFrames.find(Window->Id);
+    if (It != WindowFrames.end()) {
+        window_frame *Last = &It->second;
+        if ((Last->X != Frame.X) || (Last->Y != Frame.Y) ||
+            (Resized && ((Last->Width != Frame.Width) || (Last->Height != Frame.Height)))) {
+            WindowFrames.erase(It);
+        }
+    }
+    pthread_mutex_unlock(&WindowFramesLock);
+}
+
+void InvalidateWindowFrame(uint32_t WindowId)
+{
+    pthread_mutex_lock(&WindowFramesLock);
+    WindowFrames.erase(WindowId);
+    pthread_mutex_unlock(&WindowFramesLock);
+}
+
+internal inline void
+CenterWindowInRegion(macos_window *Window, region Region)
+{
+    CGPoint Position = AXLibGetWindowPosition(Window->Ref);
+    CGSize Size = AXLibGetWindowSize(Window->Ref);
+
+    float DiffX = (Region.X + Region.Width) - (Position.x + Size.width);
+    float DiffY = (Region.Y + Region.Height) - (Position.y + Size.height);
+
+    if ((DiffX > 0.0f) || (DiffY > 0.0f)) {
+        float OffsetX = DiffX / 2.0f;
+        Region.X += OffsetX;
+        Region.Width -= OffsetX;
+
+        float OffsetY = DiffY / 2.0f;
+        Region.Y += OffsetY;
+        Region.Height -= OffsetY;
+
+        AXLibSetWindowPosition(Window->Ref, Region.X, Region.Y);
+        AXLibSetWindowSize(Window->Ref, Region.Width, Region.Height);
+        InvalidateWindowFrame(Window->Id);
+    }
+}
+
+uint32_t ApplyWindowFrame(macos_window *Window, region Region, bool Center)
+{
+    uint32_t Committed = CommitWindowFrame(Window, Region);
+    if (Center && (Committed & (Window_Frame_Moved | Window_Frame_Resized))) {
+        CenterWindowInRegion(Window, Region);
+    }
+    return Committed;
+}
+
+internal inline uint64_t
+GetFrameTime()
+{
+    struct timespec Time;
+    clock_gettime(CLOCK_MONOTONIC, &Time);
+    return (uint64_t) Time.tv_sec * 1000000000ULL + Time.tv_nsec;
+}
+
+/*
+ * NOTE(koekeishiya): Every AX call to the application is bounded by the timeout, and the budget
+ * of the group is checked before each window. Windows that are skipped lose their cached frame and
+ * are reported as deferred, so that the caller can leave them for the next relayout.
+ *
+ * The first window is always applied so that a group makes progress, and a window that is started
+ * before the budget runs out is finished. Applying a window takes at most six calls (set position
+ * and size, and read and set both again when centering), so a group returns within seven times
+ * the timeout.
+ *
+ * The timeout is set on the element of the window and reset to the global timeout afterwards
+ * (a timeout of 0), so that it does not affect later calls from other threads. No other code
+ * sets a timeout on a window element.
+ */
+internal void
+ApplyFrameGroup(frame_update *Updates, size_t Count, float Timeout)
+{
+    uint64_t Deadline = GetFrameTime() + (uint64_t)(Timeout * 1000000000.0f);
+
+    for (size_t Index = 0; Index < Count; ++Index) {
+        frame_update *Update = Updates + Index;
+
+        if ((Timeout > 0.0f) && (Index > 0) && (GetFrameTime() > Deadline)) {
+            InvalidateWindowFrame(Update->Window->Id);
+            __atomic_add_fetch(&WindowFrameStats.TimedOut, 1, __ATOMIC_RELAXED);
+            Update->Status = Frame_Update_Deferred;
+            continue;
+        }
+
+        if (Timeout > 0.0f) AXUIElementSetMessagingTimeout(Update->Window->Ref, Timeout);
+        uint32_t Committed = ApplyWindowFrame(Update->Window, Update->Region, Update->Center);
+        if (Timeout > 0.0f) AXUIElementSetMessagingTimeout(Update->Window->Ref, 0.0f);
+
+        Update->Status = (Committed & Window_Frame_Failed) ? Frame_Update_Deferred : Frame_Update_Applied;
+    }
+}
+
+internal void *
+FramePoolThreadProc(void *Data)
+{
+    for (;;) {
+        pthread_mutex_lock(&FramePool.Lock);
+        while (FramePool.Running && FramePool.Jobs.empty()) {
+            pthread_cond_wait(&FramePool.Ready, &FramePool.Lock);
+        }
+
+        if (FramePool.Jobs.empty()) {
+            pthread_mutex_unlock(&FramePool.Lock);
+            break;
+        }
+
+        frame_job Job = FramePool.Jobs.front();
+        FramePool.Jobs.pop();
+        pthread_mutex_unlock(&FramePool.Lock);
+
+        ApplyFrameGroup(Job.Updates, Job.Count, Job.Timeout);
+
+        pthread_mutex_lock(&FramePool.Lock);
+        if (--*Job.Pending == 0) {
+            pthread_cond_broadcast(&FramePool.Done);
+        }
+        pthread_mutex_unlock(&FramePool.Lock);
+    }
+
+    return NULL;
+}
+
+bool BeginFramePool(unsigned WorkerCount)
+{
+    if (WorkerCount > FRAME_POOL_MAX_WORKERS) {
+        WorkerCount = FRAME_POOL_MAX_WORKERS;
+    }
+
+    if (WorkerCount == 0) {
+        return true;
+    }
+
+    if (pthread_mutex_init(&FramePool.Lock, NULL) != 0) {
+        goto lock_err;
+    }
+
+    if (pthread_cond_init(&FramePool.Ready, NULL) != 0) {
+        goto ready_err;
+    }
+
+    if (pthread_cond_init(&FramePool.Done, NULL) != 0) {
+        goto done_err;
+    }
+
+    FramePool.Running = true;
+    for (FramePool.WorkerCount = 0; FramePool.WorkerCount < WorkerCount; ++FramePool.WorkerCount) {
+        if (pthread_create(&FramePool.Workers[FramePool.WorkerCount], NULL, &FramePoolThreadProc, NULL) != 0) {
+            break;
+        }
+    }
+
+    if (FramePool.WorkerCount != 0) {
+        return true;
+    }
+
+    FramePool.Running = false;
+    pthread_cond_destroy(&FramePool.Done);
+
+done_err:
+    pthread_cond_destroy(&FramePool.Ready);
+
+ready_err:
+    pthread_mutex_destroy(&FramePool.Lock);
+
+lock_err:
+    return false;
+}
+
+void EndFramePool()
+{
+    if (FramePool.WorkerCount == 0) {
+        return;
+    }
+
+    pthread_mutex_lock(&FramePool.Lock);
+    FramePool.Running = false;
+    pthread_cond_broadcast(&FramePool.Ready);
+    pthread_mutex_unlock(&FramePool.Lock);
+
+    for (unsigned Index = 0; Index < FramePool.WorkerCount; ++Index) {
+        pthread_join(FramePool.Workers[Index], NULL);
+    }
+
+    FramePool.WorkerCount = 0;
+    pthread_cond_destroy(&FramePool.Done);
+    pthread_cond_destroy(&FramePool.Ready);
+    pthread_mutex_destroy(&FramePool.Lock);
+}
+
+void AddFrameUpdate(frame_batch *Batch, macos_window *Window, region Region, bool Center, void *Context)
+{
+    frame_update Update = { Window, Region, Center, Context, Frame_Update_Pending };
+    Batch->Updates.push_back(Update);
+}
+
+internal bool
+FrameUpdateOwnerLess(const frame_update &A, const frame_update &B)
+{
+    return A.Window->Owner->PID < B.Window->Owner->PID;
+}
+
+internal size_t
+FrameGroupEnd(std::vector<frame_update> &Updates, size_t Begin)
+{
+    size_t End = Begin + 1;
+    while ((End < Updates.size()) &&
+           (Updates[End].Window->Owner->PID == Updates[Begin].Window->Owner->PID)) {
+        ++End;
+    }
+    return End;
+}
+
+void CommitFrameBatch(frame_batch *Batch)
+{
+    std::vector<frame_update> &Updates = Batch->Updates;
+    if (Updates.empty()) {
+        return;
+    }
+
+    float Timeout = CVarFloatingPointValue(CVAR_WINDOW_FRAME_TIMEOUT);
+    uint32_t Pending = 0;
+    uint32_t Groups = 1;
+
+    /*
+     * NOTE(koekeishiya): The sort is stable, so the windows of an application are still applied
+     * in the order of the tree.
+     */
+    std::stable_sort(Updates.begin(), Updates.end(), FrameUpdateOwnerLess);
+    size_t First = FrameGroupEnd(Updates, 0);
+
+    if (FramePool.WorkerCount != 0) {
+        pthread_mutex_lock(&FramePool.Lock);
+        for (size_t Begin = First, End; Begin < Updates.size(); Begin = End) {
+            End = FrameGroupEnd(Updates, Begin);
+            frame_job Job = { &Updates[Begin], End - Begin, Timeout, &Pending };
+            FramePool.Jobs.push(Job);
+            ++Pending;
+            ++Groups;
+        }
+
+        if (Pending) {
+            pthread_cond_broadcast(&FramePool.Ready);
+        }
+        pthread_mutex_unlock(&FramePool.Lock);
+    }
+
+    ApplyFrameGroup(&Updates[0], First, Timeout);
+
+    if (FramePool.WorkerCount == 0) {
+        for (size_t Begin = First, End; Begin < Updates.size(); Begin = End) {
+            End = FrameGroupEnd(Updates, Begin);
+            ApplyFrameGroup(&Updates[Begin], End - Begin, Timeout);
+            ++Groups;
+        }
+    }
+
+    if (FramePool.WorkerCount != 0) {
+        pthread_mutex_lock(&FramePool.Lock);
+        while (Pending) {
+            pthread_cond_wait(&FramePool.Done, &FramePool.Lock);
+        }
+        pthread_mutex_unlock(&FramePool.Lock);
+    }
+
+    __atomic_add_fetch(&WindowFrameStats.Batches, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&WindowFrameStats.Groups, Groups, __ATOMIC_RELAXED);
+}
+
+window_frame_stats GetWindowFrameStats()
+{
+    window_frame_stats Result;
+    Result.Applied = __atomic_load_n(&WindowFrameStats.Applied, __ATOMIC_RELAXED);
+    Result.Skipped = __atomic_load_n(&WindowFrameStats.Skipped, __ATOMIC_RELAXED);
+    Result.PositionCalls = __atomic_load_n(&WindowFrameStats.PositionCalls, __ATOMIC_RELAXED);
+    Result.SizeCalls = __atomic_load_n(&WindowFrameStats.SizeCalls, __ATOMIC_RELAXED);
+    Result.Batches = __atomic_load_n(&WindowFrameStats.Batches, __ATOMIC_RELAXED);
+    Result.Groups = __atomic_load_n(&WindowFrameStats.Groups, __ATOMIC_RELAXED);
+    Result.TimedOut = __atomic_load_n(&WindowFrameStats.TimedOut, __ATOMIC_RELAXED);
+    return Result;
+}
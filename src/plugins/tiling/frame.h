@@ -0,0 +1,87 @@
+#ifndef PLUGIN_FRAME_H
+#define PLUGIN_FRAME_H
+
+#include <stdint.h>
+#include <vector>
+
+#include "region.h"
+
+struct macos_window;
+
+/*
+ * NOTE(koekeishiya): The last frame that was applied to a tiled window, rounded to whole points.
+ * Setting the position or size of a window is a synchronous AX round-trip to the application that
+ * owns it, so a frame is only committed for the attributes that differ from the cached frame.
+ * The cache entry of a window is dropped when a moved or resized event reports a different frame,
+ * when a set fails, and when the window is moved by anything other than CommitWindowFrame.
+ */
+struct window_frame
+{
+    int32_t X, Y;
+    int32_t Width, Height;
+};
+
+enum window_frame_commit
+{
+    Window_Frame_Moved = 1 << 0,
+    Window_Frame_Resized = 1 << 1,
+    Window_Frame_Failed = 1 << 2
+};
+
+struct window_frame_stats
+{
+    uint64_t Applied;
+    uint64_t Skipped;
+    uint64_t PositionCalls;
+    uint64_t SizeCalls;
+
+    uint64_t Batches;
+    uint64_t Groups;
+    uint64_t TimedOut;
+};
+
+/*
+ * NOTE(koekeishiya): The frames of a relayout are collected into a batch and committed together.
+ * CommitFrameBatch groups the updates by owning application, applies the first group on the calling
+ * thread and hands the others to a bounded pool of worker threads, and returns once every group
+ * is done. The windows of an application share a budget of CVAR_WINDOW_FRAME_TIMEOUT seconds;
+ * once it is spent, the remaining windows of that application are left for the next relayout.
+ * 'Context' is not used by the commit; it lets the caller find the update again, and 'Status'
+ * tells it whether the frame was applied or deferred (out of budget, or refused by the application).
+ */
+enum frame_update_status
+{
+    Frame_Update_Pending,
+    Frame_Update_Applied,
+    Frame_Update_Deferred
+};
+
+struct frame_update
+{
+    macos_window *Window;
+    region Region;
+    bool Center;
+
+    void *Context;
+    frame_update_status Status;
+};
+
+struct frame_batch
+{
+    std::vector<frame_update> Updates;
+};
+
+bool BeginFramePool(unsigned WorkerCount);
+void EndFramePool();
+
+void AddFrameUpdate(frame_batch *Batch, macos_window *Window, region Region, bool Center, void *Context);
+void CommitFrameBatch(frame_batch *Batch);
+
+uint32_t ApplyWindowFrame(macos_window *Window, region Region, bool Center);
+uint32_t CommitWindowFrame(macos_window *Window, region Region);
+void ValidateWindowFrame(macos_window *Window, bool Resized);
+void InvalidateWindowFrame(uint32_t WindowId);
+
+window_frame_stats GetWindowFrameStats();
+
+#endif
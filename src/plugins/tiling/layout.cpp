@@ -0,0 +1,193 @@
+#include "layout.h"
+#include "node.h"
+#include "vspace.h"
+
+#include "../../common/misc/assert.h"
+
+#define internal static
+
+void BeginLayoutContext(layout_context *Context, macos_space *Space, virtual_space *VirtualSpace)
+{
+    Context->Space = Space;
+    Context->VirtualSpace = VirtualSpace;
+    Context->Offset = VirtualSpace->Offset;
+    Context->Resolved = false;
+    Context->Optimal = false;
+    Context->Touched = 0;
+}
+
+region SplitRegion(region *Region, float Ratio, region_type Type, region_offset *Offset)
+{
+    region Result = *Region;
+    float Gap = Offset ? Offset->Gap / 2 : 0.0f;
+
+    switch (Type) {
+    case Region_Left: {
+        Result.Width = Region->Width * Ratio - Gap;
+    } break;
+    case Region_Right: {
+        Result.X = Region->X + (Region->Width * Ratio) + Gap;
+        Result.Width = Region->Width * (1 - Ratio) - Gap;
+    } break;
+    case Region_Upper: {
+        Result.Height = Region->Height * Ratio - Gap;
+    } break;
+    case Region_Lower: {
+        Result.Y = Region->Y + (Region->Height * Ratio) + Gap;
+        Result.Height = Region->Height * (1 - Ratio) - Gap;
+    } break;
+    default: { /* NOTE(koekeishiya): A full region does not depend on a parent. */ } break;
+    }
+
+    Result.Type = Type;
+    return Result;
+}
+
+void LayoutNodeRegion(node *Node, region_type Type, layout_context *Context)
+{
+    ASSERT(Type >= Region_Full && Type <= Region_Lower);
+
+    if (Type == Region_Full) {
+        Node->Region = LayoutFullRegion(Context);
+        Node->Region.Type = Type;
+    } else {
+        ASSERT(Node->Parent);
+        Node->Region = SplitRegion(&Node->Parent->Region, Node->Parent->Ratio, Type, Context->Offset);
+    }
+}
+
+internal void
+LayoutNodeRegionPair(node *Left, node *Right, node_split Split, layout_context *Context)
+{
+    ASSERT(Split == Split_Vertical || Split == Split_Horizontal);
+    if (Split == Split_Vertical) {
+        LayoutNodeRegion(Left, Region_Left, Context);
+        LayoutNodeRegion(Right, Region_Right, Context);
+    } else if (Split == Split_Horizontal) {
+        LayoutNodeRegion(Left, Region_Upper, Context);
+        LayoutNodeRegion(Right, Region_Lower, Context);
+    }
+}
+
+void LayoutNodeTree(node *Node, bool Optimal, layout_context *Context)
+{
+    virtual_space_mode Mode = Context->VirtualSpace->Mode;
+    if (Mode == Virtual_Space_Bsp) {
+        if (Node && Node->Left && Node->Right) {
+            Node->Split = Optimal ? OptimalSplitMode(Node) : Node->Split;
+            LayoutNodeRegionPair(Node->Left, Node->Right, Node->Split, Context);
+
+            LayoutNodeTree(Node->Left, Optimal, Context);
+            LayoutNodeTree(Node->Right, Optimal, Context);
+        }
+    } else if (Mode == Virtual_Space_Monocle) {
+        for (Node = Node ? Node->Right : NULL; Node; Node = Node->Right) {
+            LayoutNodeRegion(Node, Region_Full, Context);
+        }
+    }
+}
+
+void MarkNodeDirty(node *Node, uint32_t Flags)
+{
+    Node->Dirty |= Flags;
+    for (node *Parent = Node->Parent;
+         Parent && !(Parent->Dirty & Node_Dirty_Child);
+         Parent = Parent->Parent) {
+        Parent->Dirty |= Node_Dirty_Child;
+    }
+}
+
+void MarkNodeChildrenDirty(node *Node, uint32_t Flags)
+{
+    if (Node->Left && Node->Right) {
+        MarkNodeDirty(Node->Left, Flags);
+        MarkNodeDirty(Node->Right, Flags);
+    }
+}
+
+void MarkNodeSplitDirty(node *Node)
+{
+    MarkNodeChildrenDirty(Node, Node_Dirty_Region);
+}
+
+internal inline bool
+RegionEquals(region *A, region *B)
+{
+    return ((A->X == B->X) &&
+            (A->Y == B->Y) &&
+            (A->Width == B->Width) &&
+            (A->Height == B->Height) &&
+            (A->Type == B->Type));
+}
+
+/*
+ * NOTE(koekeishiya): The region type is derived from the split of the parent instead of
+ * the type stored in the region, because the split may be what changed.
+ */
+internal region_type
+LayoutRegionType(node *Node)
+{
+    if (!Node->Parent) {
+        return Region_Full;
+    }
+
+    bool Left = Node == Node->Parent->Left;
+    if (Node->Parent->Split == Split_Vertical) {
+        return Left ? Region_Left : Region_Right;
+    } else {
+        ASSERT(Node->Parent->Split == Split_Horizontal);
+        return Left ? Region_Upper : Region_Lower;
+    }
+}
+
+void LayoutDirtyNodeTree(node *Node, layout_context *Context)
+{
+    ASSERT(Context->VirtualSpace->Mode == Virtual_Space_Bsp);
+
+    if (Node->Dirty & Node_Dirty_Region) {
+        region Region = Node->Region;
+        LayoutNodeRegion(Node, LayoutRegionType(Node), Context);
+        ++Context->Touched;
+
+        bool Changed = !RegionEquals(&Region, &Node->Region);
+        if (Context->Optimal && Node->Left && Node->Right) {
+            node_split Split = Node->Split;
+            Node->Split = OptimalSplitMode(Node);
+            Changed |= Node->Split != Split;
+        }
+
+        if (Changed) {
+            if (Node->Left && Node->Right) {
+                Node->Left->Dirty |= Node_Dirty_Region;
+                Node->Right->Dirty |= Node_Dirty_Region;
+                Node->Dirty |= Node_Dirty_Child;
+            } else {
+                Node->Dirty |= Node_Dirty_Frame;
+            }
+        }
+
+        Node->Dirty &= ~Node_Dirty_Region;
+    }
+
+    if (Node->Dirty & Node_Dirty_Child) {
+        bool Pending = false;
+
+        if (Node->Left) {
+            if (Node->Left->Dirty & (Node_Dirty_Region | Node_Dirty_Child)) {
+                LayoutDirtyNodeTree(Node->Left, Context);
+            }
+            Pending |= Node->Left->Dirty != 0;
+        }
+
+        if (Node->Right) {
+            if (Node->Right->Dirty & (Node_Dirty_Region | Node_Dirty_Child)) {
+                LayoutDirtyNodeTree(Node->Right, Context);
+            }
+            Pending |= Node->Right->Dirty != 0;
+        }
+
+        if (!Pending) {
+            Node->Dirty &= ~Node_Dirty_Child;
+        }
+    }
+}
@@ -0,0 +1,53 @@
+#ifndef PLUGIN_LAYOUT_H
+#define PLUGIN_LAYOUT_H
+
+#include "region.h"
+
+#include <stdint.h>
+
+struct node;
+struct macos_space;
+struct virtual_space;
+
+/*
+ * NOTE(koekeishiya): Holds what a relayout of a virtual space needs from outside the tree.
+ * Only full regions (the root of a bsp tree and every monocle window) depend on the display,
+ * and the full region is resolved once, the first time it is needed. Every other region is
+ * computed from the region and ratio of its parent.
+ */
+struct layout_context
+{
+    macos_space *Space;
+    virtual_space *VirtualSpace;
+    region_offset *Offset;
+
+    bool Resolved;
+    region Full;
+
+    bool Optimal;
+    uint32_t Touched;
+};
+
+void BeginLayoutContext(layout_context *Context, macos_space *Space, virtual_space *VirtualSpace);
+
+// NOTE(koekeishiya): Resolves the display of the space and is defined in region.cpp.
+region LayoutFullRegion(layout_context *Context);
+
+region SplitRegion(region *Region, float Ratio, region_type Type, region_offset *Offset);
+
+void LayoutNodeRegion(node *Node, region_type Type, layout_context *Context);
+void LayoutNodeTree(node *Node, bool Optimal, layout_context *Context);
+
+/*
+ * NOTE(koekeishiya): Dirty relayout of a bsp tree. 'MarkNodeSplitDirty' is called after the
+ * ratio or split of a node changes, and 'LayoutDirtyNodeTree' recomputes only the regions that
+ * were marked, starting from the root. Leaves whose region changed are left with Node_Dirty_Frame
+ * set, and are moved by ApplyDirtyNodeRegion; 'Touched' counts the regions that were recomputed.
+ * If 'Optimal' is set, every recomputed node also gets its optimal split.
+ */
+void MarkNodeDirty(node *Node, uint32_t Flags);
+void MarkNodeChildrenDirty(node *Node, uint32_t Flags);
+void MarkNodeSplitDirty(node *Node);
+void LayoutDirtyNodeTree(node *Node, layout_context *Context);
+
+#endif
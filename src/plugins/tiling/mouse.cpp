@@ -10,6 +10,8 @@
 #include "../../common/misc/assert.h"
 
 #include "node.h"
+#include "layout.h"
+#include "frame.h"
 #include "vspace.h"
 #include "controller.h"
 #include "constants.h"
@@ -48,6 +50,7 @@ struct resize_border_state
     virtual_space *VirtualSpace;
     macos_window *Window;
     uint64_t LastEventTime;
+    uint32_t Touched;
 };
 
 struct resize_border
@@ -275,14 +278,14 @@ BeginTiledWindow(macos_space *Space, virtual_space *VirtualSpace, drag_mode Drag
         else                   HorizontalWindow = NULL;
 
         if (VerticalWindow) {
-            node *VerticalNode = GetNodeWithId(Root, VerticalWindow->Id, VirtualSpace->Mode);
+            node *VerticalNode = GetNodeWithId(VirtualSpace, VerticalWindow->Id);
             ASSERT(VerticalNode);
             ResizeState.Vertical = GetLowestCommonAncestor(NodeBelowCursor, VerticalNode);
             ResizeState.InitialRatioV = ResizeState.Vertical->Ratio;
         }
 
         if (HorizontalWindow) {
-            node *HorizontalNode = GetNodeWithId(Root, HorizontalWindow->Id, VirtualSpace->Mode);
+            node *HorizontalNode = GetNodeWithId(VirtualSpace, HorizontalWindow->Id);
             ASSERT(HorizontalNode);
             ResizeState.Horizontal = GetLowestCommonAncestor(NodeBelowCursor, HorizontalNode);
             ResizeState.InitialRatioH = ResizeState.Horizontal->Ratio;
@@ -364,7 +367,8 @@ MouseMoveWindowTick()
                                               (int)(ResizeState.InitialRatioH + DeltaX),
                                               (int)(ResizeState.InitialRatioV + DeltaY));
             } else {
-                float MouseMotionInterval = CVarFloatingPointValue(CVAR_MOUSE_MOTION_INTERVAL);
+                local_persist cvar_handle *MouseMotionIntervalHandle;
+                float MouseMotionInterval = CVarFloatingPointValue(CVarHandle(&MouseMotionIntervalHandle, CVAR_MOUSE_MOTION_INTERVAL));
                 uint64_t CurrentEventTime = CGEventGetTimestamp(CurrentEvent);
                 float DeltaEventTime = ((float)CurrentEventTime - ResizeState.LastEventTime) * (1.0f / 1E6);
 
@@ -377,6 +381,7 @@ MouseMoveWindowTick()
                 AXLibSetWindowPosition(ResizeState.Window->Ref,
                                        (int)(ResizeState.InitialRatioH + DeltaX),
                                        (int)(ResizeState.InitialRatioV + DeltaY));
+                InvalidateWindowFrame(ResizeState.Window->Id);
             }
         }
     }
@@ -390,7 +395,7 @@ MouseMoveWindowEnd()
 
         if ((ResizeState.Horizontal && ResizeState.Vertical) &&
             (ResizeState.Horizontal != ResizeState.Vertical)) {
-            SwapNodeIds(ResizeState.Horizontal, ResizeState.Vertical);
+            SwapNodeIds(ResizeState.Horizontal, ResizeState.Vertical, ResizeState.VirtualSpace);
             ResizeWindowToRegionSize(ResizeState.Horizontal);
             ResizeWindowToRegionSize(ResizeState.Vertical);
         }
@@ -451,7 +456,7 @@ MouseResizeWindowTick()
             if ((fabs(Ratio - ResizeState.Vertical->Ratio) > RatioMinDiff) &&
                 (Ratio >= 0.1f && Ratio <= 0.9f)) {
                 ResizeState.Vertical->Ratio = Ratio;
-                ResizeNodeRegion(ResizeState.Vertical, ResizeState.Space, ResizeState.VirtualSpace);
+                MarkNodeSplitDirty(ResizeState.Vertical);
             }
         }
 
@@ -469,13 +474,24 @@ MouseResizeWindowTick()
             if ((fabs(Ratio - ResizeState.Horizontal->Ratio) > RatioMinDiff) &&
                 (Ratio >= 0.1f && Ratio <= 0.9f)) {
                 ResizeState.Horizontal->Ratio = Ratio;
-                ResizeNodeRegion(ResizeState.Horizontal, ResizeState.Space, ResizeState.VirtualSpace);
+                MarkNodeSplitDirty(ResizeState.Horizontal);
             }
         }
 
+        /*
+         * NOTE(koekeishiya): Regions are updated on every tick so that the borders follow the cursor,
+         * but windows are only moved when the resize ends. Leaves that changed keep Node_Dirty_Frame
+         * set until then.
+         */
+        layout_context Context;
+        BeginLayoutContext(&Context, ResizeState.Space, ResizeState.VirtualSpace);
+        LayoutDirtyNodeTree(ResizeState.VirtualSpace->Tree, &Context);
+        ResizeState.Touched += Context.Touched;
+
         UpdateResizeBorders();
     } else if (ResizeState.Mode == Drag_Mode_Resize_Floating) {
-        float MouseMotionInterval = CVarFloatingPointValue(CVAR_MOUSE_MOTION_INTERVAL);
+        local_persist cvar_handle *MouseMotionIntervalHandle;
+        float MouseMotionInterval = CVarFloatingPointValue(CVarHandle(&MouseMotionIntervalHandle, CVAR_MOUSE_MOTION_INTERVAL));
         uint64_t CurrentEventTime = CGEventGetTimestamp(CurrentEvent);
         float DeltaEventTime = ((float)CurrentEventTime - ResizeState.LastEventTime) * (1.0f / 1E6);
 
@@ -486,6 +502,7 @@ MouseResizeWindowTick()
         ResizeState.LastEventTime = CurrentEventTime;
 
         macos_window *Window = ResizeState.Window;
+        InvalidateWindowFrame(Window->Id);
 
         CGPoint InitialCursor = ResizeState.InitialCursor;
         CGPoint InitialCursorInWindow = {
@@ -579,13 +596,8 @@ MouseResizeWindowEnd()
     if (ResizeState.Mode == Drag_Mode_Resize) {
         FreeResizeBorders();
 
-        if (ResizeState.Horizontal) {
-            ApplyNodeRegion(ResizeState.Horizontal, ResizeState.VirtualSpace->Mode, true);
-        }
-
-        if (ResizeState.Vertical) {
-            ApplyNodeRegion(ResizeState.Vertical, ResizeState.VirtualSpace->Mode, true);
-        }
+        uint32_t Windows = ApplyDirtyNodeRegion(ResizeState.VirtualSpace->Tree, true);
+        RecordRelayout("mouse resize", ResizeState.Touched, Windows);
 
         ReleaseVirtualSpace(ResizeState.VirtualSpace);
         AXLibDestroySpace(ResizeState.Space);
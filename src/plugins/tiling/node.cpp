@@ -1,5 +1,7 @@
 #include "node.h"
 #include "vspace.h"
+#include "layout.h"
+#include "frame.h"
 #include "constants.h"
 
 #include "presel.h"
@@ -47,12 +49,32 @@ node_split NodeSplitFromString(char *Value)
     return Split_None;
 }
 
-node *CreateRootNode(uint32_t WindowId, macos_space *Space, virtual_space *VirtualSpace)
+internal inline bool
+IsWindowNodeId(uint32_t WindowId)
 {
-    node *Node = (node *) malloc(sizeof(node));
-    memset(Node, 0, sizeof(node));
+    return ((WindowId != Node_Root) &&
+            (WindowId != (uint32_t) Node_PseudoLeaf));
+}
+
+// NOTE(koekeishiya): Every change to the window id of a node in a tree must go through this function.
+void SetNodeWindowId(node *Node, uint32_t WindowId, virtual_space *VirtualSpace)
+{
+    if (IsWindowNodeId(Node->WindowId)) {
+        NodeMapRemove(&VirtualSpace->Nodes, Node->WindowId, Node);
+    }
 
     Node->WindowId = WindowId;
+
+    if (IsWindowNodeId(WindowId)) {
+        NodeMapInsert(&VirtualSpace->Nodes, WindowId, Node);
+    }
+}
+
+node *CreateRootNode(uint32_t WindowId, macos_space *Space, virtual_space *VirtualSpace)
+{
+    node *Node = AllocateNode(&VirtualSpace->NodePool);
+
+    SetNodeWindowId(Node, WindowId, VirtualSpace);
     CreateNodeRegion(Node, Region_Full, Space, VirtualSpace);
     Node->Split = OptimalSplitMode(Node);
     Node->Ratio = CVarFloatingPointValue(CVAR_BSP_SPLIT_RATIO);
@@ -63,11 +85,10 @@ node *CreateRootNode(uint32_t WindowId, macos_space *Space, virtual_space *Virtu
 node *CreateLeafNode(node *Parent, uint32_t WindowId, region_type Type,
                      macos_space *Space, virtual_space *VirtualSpace)
 {
-    node *Node = (node *) malloc(sizeof(node));
-    memset(Node, 0, sizeof(node));
+    node *Node = AllocateNode(&VirtualSpace->NodePool);
 
     Node->Parent = Parent;
-    Node->WindowId = WindowId;
+    SetNodeWindowId(Node, WindowId, VirtualSpace);
     CreateNodeRegion(Node, Type, Space, VirtualSpace);
     Node->Split = OptimalSplitMode(Node);
     Node->Ratio = CVarFloatingPointValue(CVAR_BSP_SPLIT_RATIO);
@@ -78,7 +99,7 @@ node *CreateLeafNode(node *Parent, uint32_t WindowId, region_type Type,
 void CreateLeafNodePair(node *Parent, uint32_t ExistingWindowId, uint32_t SpawnedWindowId,
                         node_split Split, macos_space *Space, virtual_space *VirtualSpace)
 {
-    Parent->WindowId = Node_Root;
+    SetNodeWindowId(Parent, Node_Root, VirtualSpace);
     Parent->Split = Split;
     Parent->Ratio = CVarFloatingPointValue(CVAR_BSP_SPLIT_RATIO);
 
@@ -98,7 +119,7 @@ void CreateLeafNodePair(node *Parent, uint32_t ExistingWindowId, uint32_t Spawne
 void CreateLeafNodePairPreselect(node *Parent, uint32_t ExistingWindowId, uint32_t SpawnedWindowId,
                                  macos_space *Space, virtual_space *VirtualSpace)
 {
-    Parent->WindowId = Node_Root;
+    SetNodeWindowId(Parent, Node_Root, VirtualSpace);
     Parent->Split = VirtualSpace->Preselect->Split;
     Parent->Ratio = VirtualSpace->Preselect->Ratio;
 
@@ -114,29 +135,6 @@ void CreateLeafNodePairPreselect(node *Parent, uint32_t ExistingWindowId, uint32
     }
 }
 
-internal inline void
-CenterWindowInRegion(macos_window *Window, region Region)
-{
-    CGPoint Position = AXLibGetWindowPosition(Window->Ref);
-    CGSize Size = AXLibGetWindowSize(Window->Ref);
-
-    float DiffX = (Region.X + Region.Width) - (Position.x + Size.width);
-    float DiffY = (Region.Y + Region.Height) - (Position.y + Size.height);
-
-    if ((DiffX > 0.0f) || (DiffY > 0.0f)) {
-        float OffsetX = DiffX / 2.0f;
-        Region.X += OffsetX;
-        Region.Width -= OffsetX;
-
-        float OffsetY = DiffY / 2.0f;
-        Region.Y += OffsetY;
-        Region.Height -= OffsetY;
-
-        AXLibSetWindowPosition(Window->Ref, Region.X, Region.Y);
-        AXLibSetWindowSize(Window->Ref, Region.Width, Region.Height);
-    }
-}
-
 void ResizeWindowToRegionSize(node *Node, bool Center)
 {
     macos_window *Window = GetWindowByID(Node->WindowId);
@@ -151,14 +149,7 @@ void ResizeWindowToRegionSize(node *Node, bool Center)
         return;
     }
 
-    bool WindowMoved  = AXLibSetWindowPosition(Window->Ref, Node->Region.X, Node->Region.Y);
-    bool WindowResized = AXLibSetWindowSize(Window->Ref, Node->Region.Width, Node->Region.Height);
-
-    if (Center) {
-        if (WindowMoved || WindowResized) {
-            CenterWindowInRegion(Window, Node->Region);
-        }
-    }
+    ApplyWindowFrame(Window, Node->Region, Center);
 }
 
 // NOTE(koekeishiya): Call ResizeWindowToRegionSize with center -> true
@@ -186,14 +177,7 @@ void ResizeWindowToExternalRegionSize(node *Node, region Region, bool Center)
         return;
     }
 
-    bool WindowMoved  = AXLibSetWindowPosition(Window->Ref, Region.X, Region.Y);
-    bool WindowResized = AXLibSetWindowSize(Window->Ref, Region.Width, Region.Height);
-
-    if (Center) {
-        if (WindowMoved || WindowResized) {
-            CenterWindowInRegion(Window, Region);
-        }
-    }
+    ApplyWindowFrame(Window, Region, Center);
 }
 
 // NOTE(koekeishiya): Call ResizeWindowToExternalRegionSize with center -> true
@@ -202,39 +186,88 @@ void ResizeWindowToExternalRegionSize(node *Node, region Region)
     ResizeWindowToExternalRegionSize(Node, Region, true);
 }
 
-void ApplyNodeRegionWithPotentialZoom(node *Node, virtual_space *VirtualSpace)
+/*
+ * NOTE(koekeishiya): The functions that apply the regions of a tree only collect the frames
+ * of its windows; the frames are committed together through CommitFrameBatch, which applies
+ * the windows of different applications in parallel.
+ */
+internal void
+AddNodeFrameUpdate(frame_batch *Batch, node *Node, region Region, bool Center)
+{
+    macos_window *Window = GetWindowByID(Node->WindowId);
+    if (Window) {
+        AddFrameUpdate(Batch, Window, Region, Center, Node);
+    }
+}
+
+/*
+ * NOTE(koekeishiya): A window whose frame was deferred keeps Node_Dirty_Frame set (and its ancestors
+ * Node_Dirty_Child), so that the next dirty relayout of the tree applies it again.
+ */
+internal void
+MarkDeferredFrameUpdates(frame_batch *Batch)
+{
+    for (size_t Index = 0; Index < Batch->Updates.size(); ++Index) {
+        frame_update *Update = &Batch->Updates[Index];
+        if (Update->Status == Frame_Update_Deferred) {
+            MarkNodeDirty((node *) Update->Context, Node_Dirty_Frame);
+        }
+    }
+}
+
+internal void
+CollectNodeRegionWithPotentialZoom(frame_batch *Batch, node *Node, virtual_space *VirtualSpace)
 {
     if (Node->WindowId && Node->WindowId != Node_PseudoLeaf) {
         if (Node == VirtualSpace->Tree->Zoom) {
-            ResizeWindowToExternalRegionSize(Node, VirtualSpace->Tree->Region);
+            AddNodeFrameUpdate(Batch, Node, VirtualSpace->Tree->Region, true);
         } else if (Node->Parent && Node == Node->Parent->Zoom) {
-            ResizeWindowToExternalRegionSize(Node, Node->Parent->Region);
+            AddNodeFrameUpdate(Batch, Node, Node->Parent->Region, true);
         } else {
-            ResizeWindowToRegionSize(Node, true);
+            AddNodeFrameUpdate(Batch, Node, Node->Region, true);
         }
     }
 
     if (Node->Left && VirtualSpace->Mode == Virtual_Space_Bsp) {
-        ApplyNodeRegionWithPotentialZoom(Node->Left, VirtualSpace);
+        CollectNodeRegionWithPotentialZoom(Batch, Node->Left, VirtualSpace);
     }
 
     if (Node->Right) {
-        ApplyNodeRegionWithPotentialZoom(Node->Right, VirtualSpace);
+        CollectNodeRegionWithPotentialZoom(Batch, Node->Right, VirtualSpace);
     }
 }
 
-void ApplyNodeRegion(node *Node, virtual_space_mode VirtualSpaceMode, bool Center)
+void ApplyNodeRegionWithPotentialZoom(node *Node, virtual_space *VirtualSpace)
+{
+    frame_batch Batch;
+    CollectNodeRegionWithPotentialZoom(&Batch, Node, VirtualSpace);
+    CommitFrameBatch(&Batch);
+}
+
+internal void
+CollectNodeRegion(frame_batch *Batch, node *Node, virtual_space_mode VirtualSpaceMode, bool Center)
 {
     if (Node->WindowId && Node->WindowId != Node_PseudoLeaf) {
-        ResizeWindowToRegionSize(Node, Center);
+        AddNodeFrameUpdate(Batch, Node, Node->Region, Center);
     }
 
     if (Node->Left && VirtualSpaceMode == Virtual_Space_Bsp) {
-        ApplyNodeRegion(Node->Left, VirtualSpaceMode, Center);
+        CollectNodeRegion(Batch, Node->Left, VirtualSpaceMode, Center);
     }
 
     if (Node->Right) {
-        ApplyNodeRegion(Node->Right, VirtualSpaceMode, Center);
+        CollectNodeRegion(Batch, Node->Right, VirtualSpaceMode, Center);
+    }
+}
+
+void ApplyNodeRegion(node *Node, virtual_space_mode VirtualSpaceMode, bool Center)
+{
+    frame_batch Batch;
+    CollectNodeRegion(&Batch, Node, VirtualSpaceMode, Center);
+    CommitFrameBatch(&Batch);
+
+    if (VirtualSpaceMode == Virtual_Space_Bsp) {
+        MarkDeferredFrameUpdates(&Batch);
     }
 }
 
@@ -244,6 +277,80 @@ void ApplyNodeRegion(node *Node, virtual_space_mode VirtualSpaceMode)
     ApplyNodeRegion(Node, VirtualSpaceMode, true);
 }
 
+internal uint32_t
+CollectDirtyNodeRegion(frame_batch *Batch, node *Node, bool Center)
+{
+    uint32_t Result = 0;
+    ASSERT(!(Node->Dirty & Node_Dirty_Region));
+
+    if ((Node->Dirty & Node_Dirty_Frame) &&
+        (Node->WindowId && Node->WindowId != Node_PseudoLeaf)) {
+        AddNodeFrameUpdate(Batch, Node, Node->Region, Center);
+        ++Result;
+    }
+
+    if (Node->Dirty & Node_Dirty_Child) {
+        if (Node->Left) {
+            Result += CollectDirtyNodeRegion(Batch, Node->Left, Center);
+        }
+
+        if (Node->Right) {
+            Result += CollectDirtyNodeRegion(Batch, Node->Right, Center);
+        }
+    }
+
+    Node->Dirty = 0;
+    return Result;
+}
+
+// NOTE(koekeishiya): Moves the leaves that LayoutDirtyNodeTree left with Node_Dirty_Frame set.
+uint32_t ApplyDirtyNodeRegion(node *Node, bool Center)
+{
+    frame_batch Batch;
+    uint32_t Result = CollectDirtyNodeRegion(&Batch, Node, Center);
+    CommitFrameBatch(&Batch);
+    MarkDeferredFrameUpdates(&Batch);
+    return Result;
+}
+
+internal relayout_stats RelayoutStats;
+
+void RecordRelayout(const char *Operation, uint32_t Nodes, uint32_t Windows)
+{
+    __atomic_add_fetch(&RelayoutStats.Operations, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&RelayoutStats.Nodes, Nodes, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&RelayoutStats.Windows, Windows, __ATOMIC_RELAXED);
+    c_log(C_LOG_LEVEL_DEBUG, "tiling: %s touched %u nodes and %u windows\n", Operation, Nodes, Windows);
+}
+
+relayout_stats GetRelayoutStats()
+{
+    relayout_stats Result;
+    Result.Operations = __atomic_load_n(&RelayoutStats.Operations, __ATOMIC_RELAXED);
+    Result.Nodes = __atomic_load_n(&RelayoutStats.Nodes, __ATOMIC_RELAXED);
+    Result.Windows = __atomic_load_n(&RelayoutStats.Windows, __ATOMIC_RELAXED);
+    return Result;
+}
+
+// NOTE(koekeishiya): The caller marks the nodes that changed, and must hold the virtual space.
+void RelayoutDirtyNodes(const char *Operation, macos_space *Space, virtual_space *VirtualSpace, bool Optimal)
+{
+    layout_context Context;
+    BeginLayoutContext(&Context, Space, VirtualSpace);
+    Context.Optimal = Optimal;
+
+    LayoutDirtyNodeTree(VirtualSpace->Tree, &Context);
+    uint32_t Windows = ApplyDirtyNodeRegion(VirtualSpace->Tree, true);
+
+    RecordRelayout(Operation, Context.Touched, Windows);
+}
+
+// NOTE(koekeishiya): Call RelayoutDirtyNodes with optimal -> false
+void RelayoutDirtyNodes(const char *Operation, macos_space *Space, virtual_space *VirtualSpace)
+{
+    RelayoutDirtyNodes(Operation, Space, VirtualSpace, false);
+}
+
 void ConstrainWindowToRegion(macos_window *Window)
 {
     if (AXLibHasFlags(Window, Window_Float) || AXLibIsWindowFullscreen(Window->Ref)) {
@@ -271,7 +378,7 @@ void ConstrainWindowToRegion(macos_window *Window)
         if (ActiveSpace->Type == kCGSSpaceUser) {
             virtual_space *VirtualSpace = AcquireVirtualSpace(ActiveSpace);
             if ((VirtualSpace->Tree) && (VirtualSpace->Mode != Virtual_Space_Float)) {
-                node *WindowNode = GetNodeWithId(VirtualSpace->Tree, Window->Id, VirtualSpace->Mode);
+                node *WindowNode = GetNodeWithId(VirtualSpace, Window->Id);
                 if (WindowNode) {
                     if (WindowNode == VirtualSpace->Tree->Zoom) {
                         ResizeWindowToExternalRegionSize(WindowNode, VirtualSpace->Tree->Region);
@@ -319,22 +426,29 @@ void FreePreselectNode(virtual_space *VirtualSpace)
     VirtualSpace->Preselect = NULL;
 }
 
-void FreeNodeTree(node *Node, virtual_space_mode VirtualSpaceMode)
+/*
+ * NOTE(koekeishiya): Every node in the pool of a virtual space belongs to its tree (or monocle list),
+ * so the tree is destroyed by rewinding the pool and clearing the window map instead of visiting every node.
+ * A preselection refers to a node of the tree, and would otherwise alias whichever node reuses its slot.
+ */
+void FreeNodeTree(virtual_space *VirtualSpace)
 {
-    if (Node->Left && VirtualSpaceMode == Virtual_Space_Bsp) {
-        FreeNodeTree(Node->Left, VirtualSpaceMode);
-    }
-
-    if (Node->Right) {
-        FreeNodeTree(Node->Right, VirtualSpaceMode);
+    if (VirtualSpace->Preselect) {
+        FreePreselectNode(VirtualSpace);
     }
 
-    free(Node);
+    NodeMapClear(&VirtualSpace->Nodes);
+    ResetNodePool(&VirtualSpace->NodePool);
+    VirtualSpace->Tree = NULL;
 }
 
-void FreeNode(node *Node)
+void FreeNode(node *Node, virtual_space *VirtualSpace)
 {
-    free(Node);
+    if (IsWindowNodeId(Node->WindowId)) {
+        NodeMapRemove(&VirtualSpace->Nodes, Node->WindowId, Node);
+    }
+
+    ReleaseNode(&VirtualSpace->NodePool, Node);
 }
 
 bool IsRightChild(node *Node)
@@ -518,6 +632,7 @@ equalize_node EqualizeNodeTree(node *Tree)
     equalize_node LeftLeafs = EqualizeNodeTree(Tree->Left);
     equalize_node RightLeafs = EqualizeNodeTree(Tree->Right);
     equalize_node TotalLeafs = LeftLeafs + RightLeafs;
+    float Ratio = Tree->Ratio;
 
     if (Tree->Split == Split_Vertical) {
         Tree->Ratio = (float) LeftLeafs.VerticalCount / TotalLeafs.VerticalCount;
@@ -527,6 +642,10 @@ equalize_node EqualizeNodeTree(node *Tree)
         --TotalLeafs.HorizontalCount;
     }
 
+    if (Tree->Ratio != Ratio) {
+        MarkNodeSplitDirty(Tree);
+    }
+
     if (Tree->Parent) {
         TotalLeafs.VerticalCount += Tree->Parent->Split == Split_Vertical;
         TotalLeafs.HorizontalCount += Tree->Parent->Split == Split_Horizontal;
@@ -535,15 +654,28 @@ equalize_node EqualizeNodeTree(node *Tree)
     return TotalLeafs;
 }
 
-node *GetNodeWithId(node *Tree, uint32_t WindowId, virtual_space_mode VirtualSpaceMode)
+/*
+ * NOTE(koekeishiya): Window ids are looked up through the node map of the virtual space.
+ * Pseudo-leaves are not windows and are not stored in the map, so they are still found
+ * by walking the tree.
+ */
+node *GetNodeWithId(virtual_space *VirtualSpace, uint32_t WindowId)
 {
-    node *Node = GetFirstLeafNode(Tree);
+    if (!VirtualSpace->Tree) {
+        return NULL;
+    }
+
+    if (IsWindowNodeId(WindowId)) {
+        return NodeMapFind(&VirtualSpace->Nodes, WindowId);
+    }
+
+    node *Node = GetFirstLeafNode(VirtualSpace->Tree);
     while (Node) {
         if (Node->WindowId == WindowId) {
             return Node;
-        } else if (VirtualSpaceMode == Virtual_Space_Bsp) {
+        } else if (VirtualSpace->Mode == Virtual_Space_Bsp) {
             Node = GetNextLeafNode(Node);
-        } else if (VirtualSpaceMode == Virtual_Space_Monocle) {
+        } else if (VirtualSpace->Mode == Virtual_Space_Monocle) {
             Node = Node->Right;
         }
     }
@@ -551,11 +683,19 @@ node *GetNodeWithId(node *Tree, uint32_t WindowId, virtual_space_mode VirtualSpa
     return NULL;
 }
 
-void SwapNodeIds(node *A, node *B)
+void SwapNodeIds(node *A, node *B, virtual_space *VirtualSpace)
 {
     uint32_t TempId = A->WindowId;
     A->WindowId = B->WindowId;
     B->WindowId = TempId;
+
+    if (IsWindowNodeId(A->WindowId)) {
+        NodeMapInsert(&VirtualSpace->Nodes, A->WindowId, A);
+    }
+
+    if (IsWindowNodeId(B->WindowId)) {
+        NodeMapInsert(&VirtualSpace->Nodes, B->WindowId, B);
+    }
 }
 
 node *GetNodeForPoint(node *Node, CGPoint *Point)
@@ -682,11 +822,10 @@ char *SerializeNodeToBuffer(node *Node)
     return Buffer;
 }
 
-node *DeserializeNodeFromBuffer(char *Buffer)
+node *DeserializeNodeFromBuffer(char *Buffer, virtual_space *VirtualSpace)
 {
     node *Tree, *Current;
-    Current = Tree = (node *) malloc(sizeof(node));
-    memset(Tree, 0, sizeof(node));
+    Current = Tree = AllocateNode(&VirtualSpace->NodePool);
 
     const char *Cursor = Buffer;
 
@@ -705,8 +844,7 @@ node *DeserializeNodeFromBuffer(char *Buffer)
     Token = GetToken(&Cursor);
     while (Token.Length > 0) {
         if (TokenEquals(Token, "left_root")) {
-            node *Left = (node *) malloc(sizeof(node));
-            memset(Left, 0, sizeof(node));
+            node *Left = AllocateNode(&VirtualSpace->NodePool);
 
             token Split = GetToken(&Cursor);
             char *SplitString = TokenToString(Split);
@@ -721,8 +859,7 @@ node *DeserializeNodeFromBuffer(char *Buffer)
             Current->Left = Left;
             Current = Left;
         } else if (TokenEquals(Token, "right_root")) {
-            node *Right = (node *) malloc(sizeof(node));
-            memset(Right, 0, sizeof(node));
+            node *Right = AllocateNode(&VirtualSpace->NodePool);
 
             token Split = GetToken(&Cursor);
             char *SplitString = TokenToString(Split);
@@ -737,16 +874,14 @@ node *DeserializeNodeFromBuffer(char *Buffer)
             Current->Right = Right;
             Current = Right;
         } else if (TokenEquals(Token, "left_leaf")) {
-            node *Leaf = (node *) malloc(sizeof(node));
-            memset(Leaf, 0, sizeof(node));
+            node *Leaf = AllocateNode(&VirtualSpace->NodePool);
 
             Leaf->WindowId = Node_PseudoLeaf;
             Leaf->Parent = Current;
             Leaf->Ratio = CVarFloatingPointValue(CVAR_BSP_SPLIT_RATIO);
             Current->Left = Leaf;
         } else if (TokenEquals(Token, "right_leaf")) {
-            node *Leaf = (node *) malloc(sizeof(node));
-            memset(Leaf, 0, sizeof(node));
+            node *Leaf = AllocateNode(&VirtualSpace->NodePool);
 
             Leaf->WindowId = Node_PseudoLeaf;
             Leaf->Parent = Current;
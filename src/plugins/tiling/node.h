@@ -32,6 +32,19 @@ enum node_split
     Split_Horizontal = 3
 };
 
+/*
+ * NOTE(koekeishiya): Marks what an operation changed, so that a relayout only visits the
+ * affected parts of the tree. 'Region' means that the region of the node must be recomputed,
+ * 'Frame' that the window of the leaf must be moved, and 'Child' that some node below has a
+ * flag set. A node whose region is recomputed without changing does not dirty its children.
+ */
+enum node_dirty
+{
+    Node_Dirty_Region = 1 << 0,
+    Node_Dirty_Frame = 1 << 1,
+    Node_Dirty_Child = 1 << 2
+};
+
 struct node_ids
 {
     uint32_t Left;
@@ -63,6 +76,15 @@ struct node
 
     node *Zoom;
     region Region;
+
+    uint32_t Dirty;
+};
+
+struct relayout_stats
+{
+    uint64_t Operations;
+    uint64_t Nodes;
+    uint64_t Windows;
 };
 
 struct equalize_node
@@ -80,18 +102,26 @@ node_ids AssignNodeIds(uint32_t ExistingId, uint32_t NewId, bool SpawnLeft);
 node_split OptimalSplitMode(node *Node);
 node_split NodeSplitFromString(char *Value);
 
+void SetNodeWindowId(node *Node, uint32_t WindowId, virtual_space *VirtualSpace);
+
 node *CreateRootNode(uint32_t WindowId, macos_space *Space, virtual_space *VirtualSpace);
 node *CreateLeafNode(node *Parent, uint32_t WindowId, region_type Type, macos_space *Space, virtual_space *VirtualSpace);
 void CreateLeafNodePair(node *Parent, uint32_t ExistingWindowId, uint32_t SpawnedWindowId, node_split Split, macos_space *Space, virtual_space *VirtualSpace);
 void CreateLeafNodePairPreselect(node *Parent, uint32_t ExistingWindowId, uint32_t SpawnedWindowId, macos_space *Space, virtual_space *VirtualSpace);
 equalize_node EqualizeNodeTree(node *Tree);
-void FreeNodeTree(node *Node, virtual_space_mode VirtualSpaceMode);
+void FreeNodeTree(virtual_space *VirtualSpace);
 void FreePreselectNode(virtual_space *VirtualSpace);
-void FreeNode(node *Node);
+void FreeNode(node *Node, virtual_space *VirtualSpace);
 
 void ApplyNodeRegion(node *Node, virtual_space_mode VirtualSpaceMode);
 void ApplyNodeRegion(node *Node, virtual_space_mode VirtualSpaceMode, bool Center);
 void ApplyNodeRegionWithPotentialZoom(node *Node, virtual_space *VirtualSpace);
+uint32_t ApplyDirtyNodeRegion(node *Node, bool Center);
+
+void RelayoutDirtyNodes(const char *Operation, macos_space *Space, virtual_space *VirtualSpace);
+void RelayoutDirtyNodes(const char *Operation, macos_space *Space, virtual_space *VirtualSpace, bool Optimal);
+void RecordRelayout(const char *Operation, uint32_t Nodes, uint32_t Windows);
+relayout_stats GetRelayoutStats();
 
 void ResizeWindowToRegionSize(node *Node);
 void ResizeWindowToRegionSize(node *Node, bool Center);
@@ -116,14 +146,14 @@ node *GetLowestCommonAncestor(node *A, node *B);
 
 node *GetNextLeafNode(node *Node);
 node *GetPrevLeafNode(node *Node);
-node *GetNodeWithId(node *Tree, uint32_t WindowId, virtual_space_mode VirtualSpaceMode);
+node *GetNodeWithId(virtual_space *VirtualSpace, uint32_t WindowId);
 
 struct CGPoint;
 node *GetNodeForPoint(node *Node, CGPoint *Point);
 
-void SwapNodeIds(node *A, node *B);
+void SwapNodeIds(node *A, node *B, virtual_space *VirtualSpace);
 
 char *SerializeNodeToBuffer(node *Node);
-node *DeserializeNodeFromBuffer(char *Buffer);
+node *DeserializeNodeFromBuffer(char *Buffer, virtual_space *VirtualSpace);
 
 #endif
@@ -5,6 +5,7 @@
 
 #include <map>
 #include <vector>
+#include <algorithm>
 
 #include "../../api/plugin_api.h"
 #include "../../common/accessibility/display.h"
@@ -16,6 +17,7 @@
 #include "../../common/config/cvar.h"
 #include "../../common/config/tokenize.h"
 #include "../../common/ipc/daemon.h"
+#include "../../common/ipc/dock.h"
 #include "../../common/misc/carbon.h"
 #include "../../common/misc/workspace.h"
 #include "../../common/misc/assert.h"
@@ -31,6 +33,7 @@
 #include "../../common/config/cvar.cpp"
 #include "../../common/config/tokenize.cpp"
 #include "../../common/ipc/daemon.cpp"
+#include "../../common/ipc/dock.cpp"
 #include "../../common/misc/carbon.cpp"
 #include "../../common/misc/workspace.mm"
 #include "../../common/border/border.mm"
@@ -38,6 +41,9 @@
 #include "presel.h"
 #include "config.h"
 #include "region.h"
+#include "layout.h"
+#include "frame.h"
+#include "pool.h"
 #include "node.h"
 #include "vspace.h"
 #include "controller.h"
@@ -51,6 +57,9 @@ extern chunkwm_log *c_log;
 #include "presel.mm"
 #include "config.cpp"
 #include "region.cpp"
+#include "layout.cpp"
+#include "frame.cpp"
+#include "pool.cpp"
 #include "node.cpp"
 #include "vspace.cpp"
 #include "controller.cpp"
@@ -126,6 +135,17 @@ macos_window_map CopyWindowCache()
     return Copy;
 }
 
+// NOTE(koekeishiya): Returns NULL if the window cache is busy; otherwise it stays locked until UnlockWindowCache.
+macos_window_map *TryLockWindowCache()
+{
+    return pthread_mutex_trylock(&WindowsLock) == 0 ? &Windows : NULL;
+}
+
+void UnlockWindowCache()
+{
+    pthread_mutex_unlock(&WindowsLock);
+}
+
 internal void
 FadeWindows(uint32_t FocusedWindowId)
 {
@@ -133,16 +153,20 @@ FadeWindows(uint32_t FocusedWindowId)
     float Duration = CVarFloatingPointValue(CVAR_WINDOW_FADE_DURATION);
     macos_window_map Copy = CopyWindowCache();
 
+    std::vector<dock_window_value> Values;
+    Values.reserve(Copy.size());
+
     for (macos_window_map_it It = Copy.begin(); It != Copy.end(); ++It) {
         macos_window *Window = It->second;
         if (!AXLibHasFlags(Window, Rule_Alpha_Changed)) {
-            if (Window->Id == FocusedWindowId) {
-                ExtendedDockSetWindowAlpha(FocusedWindowId, 1.0f, Duration);
-            } else {
-                ExtendedDockSetWindowAlpha(Window->Id, Alpha, Duration);
-            }
+            dock_window_value Value = { Window->Id, Window->Id == FocusedWindowId ? 1.0f : Alpha, 0, 0 };
+            Values.push_back(Value);
         }
     }
+
+    if (!Values.empty()) {
+        SendDockWindowBatch(DockWindow_AlphaFade, &Values[0], Values.size(), Duration);
+    }
 }
 
 /*
@@ -328,6 +352,14 @@ IsWindowFocusable(macos_window *Window)
     return Result;
 }
 
+internal inline node_split
+GetBspSplitMode()
+{
+    char SplitMode[BUFFER_SIZE];
+    CVarStringCopy(CVAR_BSP_SPLIT_MODE, SplitMode, sizeof(SplitMode));
+    return NodeSplitFromString(SplitMode);
+}
+
 internal bool
 TileWindowPreValidation(macos_window *Window)
 {
@@ -373,7 +405,7 @@ void TileWindowOnSpace(macos_window *Window, macos_space *Space, virtual_space *
     }
 
     if (VirtualSpace->Tree) {
-        node *Exists = GetNodeWithId(VirtualSpace->Tree, Window->Id, VirtualSpace->Mode);
+        node *Exists = GetNodeWithId(VirtualSpace, Window->Id);
         if (Exists) {
             goto display_free;
         }
@@ -399,7 +431,8 @@ void TileWindowOnSpace(macos_window *Window, macos_space *Space, virtual_space *
                 CreateLeafNodePairPreselect(VirtualSpace->Preselect->Node,
                                             VirtualSpace->Preselect->Node->WindowId,
                                             Window->Id, Space, VirtualSpace);
-                ApplyNodeRegion(VirtualSpace->Preselect->Node, VirtualSpace->Mode);
+                MarkNodeChildrenDirty(VirtualSpace->Preselect->Node, Node_Dirty_Frame);
+                RelayoutDirtyNodes("insert", Space, VirtualSpace);
                 FreePreselectNode(VirtualSpace);
             } else {
                 Node = GetFirstMinDepthPseudoLeafNode(VirtualSpace->Tree);
@@ -407,21 +440,21 @@ void TileWindowOnSpace(macos_window *Window, macos_space *Space, virtual_space *
                     if (Node->Parent) {
                         int SpawnLeft = CVarIntegerValue(CVAR_BSP_SPAWN_LEFT);
                         node_ids NodeIds = AssignNodeIds(Node->Parent->WindowId, Window->Id, SpawnLeft);
-                        Node->Parent->WindowId = Node_Root;
-                        Node->Parent->Left->WindowId = NodeIds.Left;
-                        Node->Parent->Right->WindowId = NodeIds.Right;
-                        CreateNodeRegionRecursive(Node->Parent, false, Space, VirtualSpace);
-                        ApplyNodeRegion(Node->Parent, VirtualSpace->Mode);
+                        SetNodeWindowId(Node->Parent, Node_Root, VirtualSpace);
+                        SetNodeWindowId(Node->Parent->Left, NodeIds.Left, VirtualSpace);
+                        SetNodeWindowId(Node->Parent->Right, NodeIds.Right, VirtualSpace);
+                        MarkNodeChildrenDirty(Node->Parent, Node_Dirty_Region | Node_Dirty_Frame);
+                        RelayoutDirtyNodes("insert", Space, VirtualSpace);
                     } else {
-                        Node->WindowId = Window->Id;
-                        CreateNodeRegion(Node, Region_Full, Space, VirtualSpace);
-                        ApplyNodeRegion(Node, VirtualSpace->Mode);
+                        SetNodeWindowId(Node, Window->Id, VirtualSpace);
+                        MarkNodeDirty(Node, Node_Dirty_Region | Node_Dirty_Frame);
+                        RelayoutDirtyNodes("insert", Space, VirtualSpace);
                     }
                     goto display_free;
                 }
 
                 if (InsertionPoint) {
-                    Node = GetNodeWithId(VirtualSpace->Tree, InsertionPoint, VirtualSpace->Mode);
+                    Node = GetNodeWithId(VirtualSpace, InsertionPoint);
                 }
 
                 if (!Node) {
@@ -429,13 +462,14 @@ void TileWindowOnSpace(macos_window *Window, macos_space *Space, virtual_space *
                     ASSERT(Node != NULL);
                 }
 
-                node_split Split = NodeSplitFromString(CVarStringValue(CVAR_BSP_SPLIT_MODE));
+                node_split Split = GetBspSplitMode();
                 if (Split == Split_Optimal) {
                     Split = OptimalSplitMode(Node);
                 }
 
                 CreateLeafNodePair(Node, Node->WindowId, Window->Id, Split, Space, VirtualSpace);
-                ApplyNodeRegion(Node, VirtualSpace->Mode);
+                MarkNodeChildrenDirty(Node, Node_Dirty_Frame);
+                RelayoutDirtyNodes("insert", Space, VirtualSpace);
             }
 
             // NOTE(koekeishiya): Reset fullscreen-zoom state.
@@ -444,7 +478,7 @@ void TileWindowOnSpace(macos_window *Window, macos_space *Space, virtual_space *
             }
         } else if (VirtualSpace->Mode == Virtual_Space_Monocle) {
             if (InsertionPoint) {
-                Node = GetNodeWithId(VirtualSpace->Tree, InsertionPoint, VirtualSpace->Mode);
+                Node = GetNodeWithId(VirtualSpace, InsertionPoint);
             }
 
             if (!Node) {
@@ -468,8 +502,8 @@ void TileWindowOnSpace(macos_window *Window, macos_space *Space, virtual_space *
         char *Buffer;
         if ((ShouldDeserializeVirtualSpace(VirtualSpace)) &&
             ((Buffer = ReadFile(VirtualSpace->TreeLayout)))) {
-            VirtualSpace->Tree = DeserializeNodeFromBuffer(Buffer);
-            VirtualSpace->Tree->WindowId = Window->Id;
+            VirtualSpace->Tree = DeserializeNodeFromBuffer(Buffer, VirtualSpace);
+            SetNodeWindowId(VirtualSpace->Tree, Window->Id, VirtualSpace);
             CreateNodeRegion(VirtualSpace->Tree, Region_Full, Space, VirtualSpace);
             CreateNodeRegionRecursive(VirtualSpace->Tree, false, Space, VirtualSpace);
             ResizeWindowToRegionSize(VirtualSpace->Tree);
@@ -527,7 +561,7 @@ UntileWindowFromSpace(uint32_t WindowId, macos_space *Space, virtual_space *Virt
         return;
     }
 
-    node *Node = GetNodeWithId(VirtualSpace->Tree, WindowId, VirtualSpace->Mode);
+    node *Node = GetNodeWithId(VirtualSpace, WindowId);
     if (!Node) {
         return;
     }
@@ -557,7 +591,7 @@ UntileWindowFromSpace(uint32_t WindowId, macos_space *Space, virtual_space *Virt
             NewLeaf->Right = NULL;
             NewLeaf->Zoom = NULL;
 
-            NewLeaf->WindowId = RemainingLeaf->WindowId;
+            SetNodeWindowId(NewLeaf, RemainingLeaf->WindowId, VirtualSpace);
             if (RemainingLeaf->Left && RemainingLeaf->Right) {
                 NewLeaf->Left = RemainingLeaf->Left;
                 NewLeaf->Left->Parent = NewLeaf;
@@ -565,23 +599,26 @@ UntileWindowFromSpace(uint32_t WindowId, macos_space *Space, virtual_space *Virt
                 NewLeaf->Right = RemainingLeaf->Right;
                 NewLeaf->Right->Parent = NewLeaf;
 
-                CreateNodeRegionRecursive(NewLeaf, true, Space, VirtualSpace);
+                NewLeaf->Split = OptimalSplitMode(NewLeaf);
+                MarkNodeSplitDirty(NewLeaf);
+            } else {
+                MarkNodeDirty(NewLeaf, Node_Dirty_Frame);
             }
 
             /*
              * NOTE(koekeishiya): Re-zoom window after spawned window closes.
              * see reference: https://github.com/koekeishiya/chunkwm/issues/20
              */
-            ApplyNodeRegion(NewLeaf, VirtualSpace->Mode);
+            RelayoutDirtyNodes("remove", Space, VirtualSpace, true);
             if (NewLeaf->Parent && NewLeaf->Parent->Zoom) {
                 ResizeWindowToExternalRegionSize(NewLeaf->Parent->Zoom,
                                                  NewLeaf->Parent->Region);
             }
 
-            FreeNode(RemainingLeaf);
-            FreeNode(Node);
+            FreeNode(RemainingLeaf, VirtualSpace);
+            FreeNode(Node, VirtualSpace);
         } else if (!Node->Parent) {
-            FreeNode(VirtualSpace->Tree);
+            FreeNode(VirtualSpace->Tree, VirtualSpace);
             VirtualSpace->Tree = NULL;
         }
     } else if (VirtualSpace->Mode == Virtual_Space_Monocle) {
@@ -600,7 +637,7 @@ UntileWindowFromSpace(uint32_t WindowId, macos_space *Space, virtual_space *Virt
             VirtualSpace->Tree = Next;
         }
 
-        FreeNode(Node);
+        FreeNode(Node, VirtualSpace);
     }
 }
 
@@ -712,21 +749,12 @@ GetAllWindowsInTree(node *Tree, virtual_space_mode VirtualSpaceMode)
 }
 
 internal std::vector<uint32_t>
-GetAllWindowsToAddToTree(std::vector<uint32_t> &VisibleWindows, std::vector<uint32_t> &WindowsInTree)
+GetAllWindowsToAddToTree(std::vector<uint32_t> &VisibleWindows, virtual_space *VirtualSpace)
 {
     std::vector<uint32_t> Windows;
     for (size_t WindowIndex = 0; WindowIndex < VisibleWindows.size(); ++WindowIndex) {
-        bool Found = false;
         uint32_t WindowId = VisibleWindows[WindowIndex];
-
-        for (size_t Index = 0; Index < WindowsInTree.size(); ++Index) {
-            if (WindowId == WindowsInTree[Index]) {
-                Found = true;
-                break;
-            }
-        }
-
-        if ((!Found) && (!AXLibStickyWindow(WindowId))) {
+        if ((!GetNodeWithId(VirtualSpace, WindowId)) && (!AXLibStickyWindow(WindowId))) {
             Windows.push_back(WindowId);
         }
     }
@@ -737,19 +765,12 @@ GetAllWindowsToAddToTree(std::vector<uint32_t> &VisibleWindows, std::vector<uint
 internal std::vector<uint32_t>
 GetAllWindowsToRemoveFromTree(std::vector<uint32_t> &VisibleWindows, std::vector<uint32_t> &WindowsInTree)
 {
+    std::vector<uint32_t> Visible(VisibleWindows);
+    std::sort(Visible.begin(), Visible.end());
+
     std::vector<uint32_t> Windows;
     for (size_t Index = 0; Index < WindowsInTree.size(); ++Index) {
-        bool Found = false;
-        uint32_t WindowId = WindowsInTree[Index];
-
-        for (size_t WindowIndex = 0; WindowIndex < VisibleWindows.size(); ++WindowIndex) {
-            if (VisibleWindows[WindowIndex] == WindowId) {
-                Found = true;
-                break;
-            }
-        }
-
-        if (!Found) {
+        if (!std::binary_search(Visible.begin(), Visible.end(), WindowsInTree[Index])) {
             Windows.push_back(WindowsInTree[Index]);
         }
     }
@@ -774,7 +795,7 @@ CreateWindowTreeForSpaceWithWindows(macos_space *Space, virtual_space *VirtualSp
             New = GetFirstMinDepthLeafNode(Root);
             ASSERT(New != NULL);
 
-            node_split Split = NodeSplitFromString(CVarStringValue(CVAR_BSP_SPLIT_MODE));
+            node_split Split = GetBspSplitMode();
             if (Split == Split_Optimal) {
                 Split = OptimalSplitMode(New);
             }
@@ -804,7 +825,7 @@ CreateDeserializedWindowTreeForSpaceWithWindows(macos_space *Space, virtual_spac
     if (!VirtualSpace->Tree) {
         char *Buffer = ReadFile(VirtualSpace->TreeLayout);
         if (Buffer) {
-            VirtualSpace->Tree = DeserializeNodeFromBuffer(Buffer);
+            VirtualSpace->Tree = DeserializeNodeFromBuffer(Buffer, VirtualSpace);
             free(Buffer);
         } else {
             c_log(C_LOG_LEVEL_ERROR, "failed to open '%s' for reading!\n", VirtualSpace->TreeLayout);
@@ -823,13 +844,13 @@ CreateDeserializedWindowTreeForSpaceWithWindows(macos_space *Space, virtual_spac
                 // existing node configuration.
                 int SpawnLeft = CVarIntegerValue(CVAR_BSP_SPAWN_LEFT);
                 node_ids NodeIds = AssignNodeIds(Node->Parent->WindowId, Windows[Index], SpawnLeft);
-                Node->Parent->WindowId = Node_Root;
-                Node->Parent->Left->WindowId = NodeIds.Left;
-                Node->Parent->Right->WindowId = NodeIds.Right;
+                SetNodeWindowId(Node->Parent, Node_Root, VirtualSpace);
+                SetNodeWindowId(Node->Parent->Left, NodeIds.Left, VirtualSpace);
+                SetNodeWindowId(Node->Parent->Right, NodeIds.Right, VirtualSpace);
             } else {
                 // NOTE(koekeishiya): This is the root node, we temporarily
                 // use it as a leaf node, even though it really isn't.
-                Node->WindowId = Windows[Index];
+                SetNodeWindowId(Node, Windows[Index], VirtualSpace);
             }
         } else {
             // NOTE(koekeishiya): There are more windows than containers in the layout
@@ -837,7 +858,7 @@ CreateDeserializedWindowTreeForSpaceWithWindows(macos_space *Space, virtual_spac
             Node = GetFirstMinDepthLeafNode(Root);
             ASSERT(Node != NULL);
 
-            node_split Split = NodeSplitFromString(CVarStringValue(CVAR_BSP_SPLIT_MODE));
+            node_split Split = GetBspSplitMode();
             if (Split == Split_Optimal) {
                 Split = OptimalSplitMode(Node);
             }
@@ -925,7 +946,7 @@ internal void
 RebalanceWindowTreeForSpaceWithWindows(macos_space *Space, virtual_space *VirtualSpace, std::vector<uint32_t> Windows)
 {
     std::vector<uint32_t> WindowsInTree = GetAllWindowsInTree(VirtualSpace->Tree, VirtualSpace->Mode);
-    std::vector<uint32_t> WindowsToAdd = GetAllWindowsToAddToTree(Windows, WindowsInTree);
+    std::vector<uint32_t> WindowsToAdd = GetAllWindowsToAddToTree(Windows, VirtualSpace);
     std::vector<uint32_t> WindowsToRemove = GetAllWindowsToRemoveFromTree(Windows, WindowsInTree);
 
     for (size_t Index = 0; Index < WindowsToRemove.size(); ++Index) {
@@ -1030,7 +1051,7 @@ WindowFocusedHandler(uint32_t WindowId)
         }
 
         if ((FocusedWindowId != WindowId) &&
-            (StringEquals(CVarStringValue(CVAR_MOUSE_FOLLOWS_FOCUS), Mouse_Follows_Focus_All))) {
+            (CVarStringEquals(CVAR_MOUSE_FOLLOWS_FOCUS, Mouse_Follows_Focus_All))) {
             CenterMouseInWindow(Window);
         }
 
@@ -1167,6 +1188,8 @@ WindowDestroyedHandler(void *Data)
 {
     macos_window *Window = (macos_window *) Data;
 
+    InvalidateWindowFrame(Window->Id);
+
     macos_window *Copy = RemoveWindowFromCollection(Window);
     if (Copy) {
         if (AXLibHasFlags(Copy, Window_Float)) {
@@ -1209,6 +1232,7 @@ WindowMinimizedHandler(void *Data)
         UpdateCVar(CVAR_LAST_FOCUSED_WINDOW, FocusedWindowId);
     }
 
+    InvalidateWindowFrame(Copy->Id);
     UntileWindow(Copy);
 }
 
@@ -1271,6 +1295,7 @@ WindowMovedHandler(void *Data)
     if (Copy) {
         if (Copy->Position != Window->Position) {
             Copy->Position = Window->Position;
+            ValidateWindowFrame(Copy, false);
             if (CVarIntegerValue(CVAR_WINDOW_REGION_LOCKED)) {
                 ConstrainWindowToRegion(Copy);
             }
@@ -1289,6 +1314,7 @@ WindowResizedHandler(void *Data)
             (Copy->Size != Window->Size)) {
             Copy->Position = Window->Position;
             Copy->Size = Window->Size;
+            ValidateWindowFrame(Copy, true);
 
             if (CVarIntegerValue(CVAR_WINDOW_REGION_LOCKED)) {
                 ConstrainWindowToRegion(Copy);
@@ -1578,67 +1604,11 @@ ChunkwmDaemonCommandHandler(void *Data)
 
 PLUGIN_MAIN_FUNC(PluginMain)
 {
-    if (StringEquals(Node, "chunkwm_export_application_launched")) {
-        ApplicationLaunchedHandler(Data);
-        return true;
-    } else if (StringEquals(Node, "chunkwm_export_application_terminated")) {
-        ApplicationTerminatedHandler(Data);
-        return true;
-    } else if (StringEquals(Node, "chunkwm_export_application_hidden")) {
-        ApplicationHiddenHandler(Data);
-        return true;
-    } else if (StringEquals(Node, "chunkwm_export_application_unhidden")) {
-        ApplicationUnhiddenHandler(Data);
-        return true;
-    } else if (StringEquals(Node, "chunkwm_export_application_activated")) {
-        ApplicationActivatedHandler(Data);
-        return true;
-    } else if (StringEquals(Node, "chunkwm_export_window_created")) {
-        WindowCreatedHandler(Data);
-        return true;
-    } else if (StringEquals(Node, "chunkwm_export_window_destroyed")) {
-        WindowDestroyedHandler(Data);
-        return true;
-    } else if(StringEquals(Node, "chunkwm_export_window_minimized")) {
-        WindowMinimizedHandler(Data);
-        return true;
-    } else if (StringEquals(Node, "chunkwm_export_window_deminimized")) {
-        WindowDeminimizedHandler(Data);
-        return true;
-    } else if (StringEquals(Node, "chunkwm_export_window_focused")) {
-        WindowFocusedHandler(Data);
-        return true;
-    } else if (StringEquals(Node, "chunkwm_export_window_moved")) {
-        WindowMovedHandler(Data);
-        return true;
-    } else if (StringEquals(Node, "chunkwm_export_window_resized")) {
-        WindowResizedHandler(Data);
-        return true;
-    } else if (StringEquals(Node, "chunkwm_export_window_sheet_created")) {
-        WindowSheetCreatedHandler(Data);
-        return true;
-    } else if (StringEquals(Node, "chunkwm_export_window_title_changed")) {
-        WindowTitleChangedHandler(Data);
-        return true;
-    } else if ((StringEquals(Node, "chunkwm_export_space_changed")) ||
-               (StringEquals(Node, "chunkwm_export_display_changed"))) {
-        SpaceAndDisplayChangedHandler(Data);
-        return true;
-    } else if (StringEquals(Node, "chunkwm_export_display_resized")) {
-        DisplayResizedHandler(Data);
-        return true;
-    } else if (StringEquals(Node, "chunkwm_export_display_moved")) {
-        DisplayMovedHandler(Data);
-        return true;
-#if 0
-    } else if (StringEquals(Node, "chunkwm_export_display_added")) {
-        DisplayAddedHandler(Data);
-        return true;
-    } else if (StringEquals(Node, "chunkwm_export_display_removed")) {
-        DisplayRemovedHandler(Data);
-        return true;
-#endif
-    } else if (StringEquals(Node, "chunkwm_daemon_command")) {
+    /*
+     * NOTE(koekeishiya): Exported events are passed directly to the handlers
+     * registered in 'Subscriptions' and never reach this function.
+     */
+    if (StringEquals(Node, "chunkwm_daemon_command")) {
         ChunkwmDaemonCommandHandler(Data);
         return true;
     } else if (StringEquals(Node, "chunkwm_events_subscribed")) {
@@ -1715,6 +1685,8 @@ Init(chunkwm_api ChunkwmAPI)
 
     CreateCVar(CVAR_WINDOW_FLOAT_NEXT, 0);
     CreateCVar(CVAR_WINDOW_REGION_LOCKED, 0);
+    CreateCVar(CVAR_WINDOW_FRAME_WORKERS, 4);
+    CreateCVar(CVAR_WINDOW_FRAME_TIMEOUT, 1.0f);
 
     CreateCVar(CVAR_PRE_BORDER_COLOR, 0xffffff00);
     CreateCVar(CVAR_PRE_BORDER_WIDTH, 4);
@@ -1755,10 +1727,22 @@ Init(chunkwm_api ChunkwmAPI)
     UpdateCVar(CVAR_ACTIVE_DESKTOP, (int)DesktopId);
     UpdateCVar(CVAR_LAST_ACTIVE_DESKTOP, (int)DesktopId);
 
+    if (!BeginDockClient(DOCK_PORT)) {
+        c_log(C_LOG_LEVEL_WARN, "chunkwm-tiling: could not start dock client, messages are sent synchronously!\n");
+    }
+
+    if (!BeginFramePool(CVarIntegerValue(CVAR_WINDOW_FRAME_WORKERS))) {
+        c_log(C_LOG_LEVEL_WARN, "chunkwm-tiling: could not start frame workers, windows are moved one at a time!\n");
+    }
+
     Success = BeginVirtualSpaces();
     if (Success) {
-        bool MouseMoveBound = BindMouseMoveAction(CVarStringValue(CVAR_MOUSE_MOVE_BINDING));
-        bool MouseResizeBound = BindMouseResizeAction(CVarStringValue(CVAR_MOUSE_RESIZE_BINDING));
+        char *MouseMoveBinding = CVarStringDuplicate(CVAR_MOUSE_MOVE_BINDING);
+        char *MouseResizeBinding = CVarStringDuplicate(CVAR_MOUSE_RESIZE_BINDING);
+        bool MouseMoveBound = BindMouseMoveAction(MouseMoveBinding);
+        bool MouseResizeBound = BindMouseResizeAction(MouseResizeBinding);
+        free(MouseResizeBinding);
+        free(MouseMoveBinding);
         if (MouseMoveBound || MouseResizeBound) {
             EventTap.Mask = ((1 << kCGEventLeftMouseDown) |
                              (1 << kCGEventLeftMouseDragged) |
@@ -1773,6 +1757,8 @@ Init(chunkwm_api ChunkwmAPI)
 
     c_log(C_LOG_LEVEL_ERROR, "chunkwm-tiling: failed to initialize virtual space system!\n");
 
+    EndFramePool();
+    EndDockClient();
     EndEventTap(&EventTap);
     ClearApplicationCache();
     ClearWindowCache();
@@ -1785,6 +1771,8 @@ internal void
 Deinit()
 {
     EndEventTap(&EventTap);
+    EndFramePool();
+    EndDockClient();
 
     ClearApplicationCache();
     ClearWindowCache();
@@ -1804,35 +1792,35 @@ PLUGIN_VOID_FUNC(PluginDeInit)
 }
 
 CHUNKWM_PLUGIN_VTABLE(PluginInit, PluginDeInit, PluginMain)
-chunkwm_plugin_export Subscriptions[] =
+chunkwm_plugin_handler Subscriptions[] =
 {
-    chunkwm_export_application_launched,
-    chunkwm_export_application_terminated,
-    chunkwm_export_application_hidden,
-    chunkwm_export_application_unhidden,
-    chunkwm_export_application_activated,
+    { chunkwm_export_application_launched,    ApplicationLaunchedHandler },
+    { chunkwm_export_application_terminated,  ApplicationTerminatedHandler },
+    { chunkwm_export_application_hidden,      ApplicationHiddenHandler },
+    { chunkwm_export_application_unhidden,    ApplicationUnhiddenHandler },
+    { chunkwm_export_application_activated,   ApplicationActivatedHandler },
 
-    chunkwm_export_window_created,
-    chunkwm_export_window_destroyed,
-    chunkwm_export_window_minimized,
-    chunkwm_export_window_deminimized,
-    chunkwm_export_window_focused,
+    { chunkwm_export_window_created,          WindowCreatedHandler },
+    { chunkwm_export_window_destroyed,        WindowDestroyedHandler },
+    { chunkwm_export_window_minimized,        WindowMinimizedHandler },
+    { chunkwm_export_window_deminimized,      WindowDeminimizedHandler },
+    { chunkwm_export_window_focused,          WindowFocusedHandler },
 
-    chunkwm_export_window_moved,
-    chunkwm_export_window_resized,
-    chunkwm_export_window_title_changed,
-    chunkwm_export_window_sheet_created,
+    { chunkwm_export_window_moved,            WindowMovedHandler },
+    { chunkwm_export_window_resized,          WindowResizedHandler },
+    { chunkwm_export_window_title_changed,    WindowTitleChangedHandler },
+    { chunkwm_export_window_sheet_created,    WindowSheetCreatedHandler },
 
-    chunkwm_export_space_changed,
-    chunkwm_export_display_changed,
+    { chunkwm_export_space_changed,           SpaceAndDisplayChangedHandler },
+    { chunkwm_export_display_changed,         SpaceAndDisplayChangedHandler },
 
-    chunkwm_export_display_resized,
-    chunkwm_export_display_moved,
+    { chunkwm_export_display_resized,         DisplayResizedHandler },
+    { chunkwm_export_display_moved,           DisplayMovedHandler },
 
 #if 0
-    chunkwm_export_display_added,
-    chunkwm_export_display_removed,
+    { chunkwm_export_display_added,           DisplayAddedHandler },
+    { chunkwm_export_display_removed,         DisplayRemovedHandler },
 #endif
 };
-CHUNKWM_PLUGIN_SUBSCRIBE(Subscriptions)
+CHUNKWM_PLUGIN_SUBSCRIBE_HANDLERS(Subscriptions)
 CHUNKWM_PLUGIN(PluginName, PluginVersion)
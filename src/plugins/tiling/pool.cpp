@@ -0,0 +1,86 @@
+#include "pool.h"
+#include "node.h"
+
+#include "../../common/misc/assert.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+struct node_pool_block
+{
+    node_pool_block *Next;
+    node Nodes[NODE_POOL_BLOCK_SIZE];
+};
+
+// NOTE(koekeishiya): Blocks that were rewound by ResetNodePool are reused before a new one is allocated.
+internal node *
+AllocateNodeFromBlock(node_pool *Pool)
+{
+    if (!Pool->Current || Pool->CurrentUsed == NODE_POOL_BLOCK_SIZE) {
+        node_pool_block *Next = Pool->Current ? Pool->Current->Next : Pool->Blocks;
+        if (!Next) {
+            Next = (node_pool_block *) malloc(sizeof(node_pool_block));
+            Next->Next = NULL;
+            Pool->Capacity += NODE_POOL_BLOCK_SIZE;
+
+            if (Pool->Current) {
+                Pool->Current->Next = Next;
+            } else {
+                Pool->Blocks = Next;
+            }
+        }
+
+        Pool->Current = Next;
+        Pool->CurrentUsed = 0;
+    }
+
+    return &Pool->Current->Nodes[Pool->CurrentUsed++];
+}
+
+node *AllocateNode(node_pool *Pool)
+{
+    node *Node;
+    if (Pool->FreeList) {
+        Node = Pool->FreeList;
+        Pool->FreeList = Node->Parent;
+    } else {
+        Node = AllocateNodeFromBlock(Pool);
+    }
+
+    memset(Node, 0, sizeof(node));
+    ++Pool->Count;
+    return Node;
+}
+
+// NOTE(koekeishiya): The parent pointer of a released node links it into the free-list.
+void ReleaseNode(node_pool *Pool, node *Node)
+{
+    ASSERT(Pool->Count > 0);
+    Node->Parent = Pool->FreeList;
+    Pool->FreeList = Node;
+    --Pool->Count;
+}
+
+/*
+ * NOTE(koekeishiya): Releases every node of the pool at once. The caller is responsible for
+ * making sure that nothing refers to a node of this pool anymore.
+ */
+void ResetNodePool(node_pool *Pool)
+{
+    Pool->Current = NULL;
+    Pool->CurrentUsed = 0;
+    Pool->FreeList = NULL;
+    Pool->Count = 0;
+}
+
+void FreeNodePool(node_pool *Pool)
+{
+    node_pool_block *Block = Pool->Blocks;
+    while (Block) {
+        node_pool_block *Next = Block->Next;
+        free(Block);
+        Block = Next;
+    }
+
+    memset(Pool, 0, sizeof(node_pool));
+}
@@ -0,0 +1,34 @@
+#ifndef PLUGIN_POOL_H
+#define PLUGIN_POOL_H
+
+#include <stdint.h>
+
+struct node;
+
+/*
+ * NOTE(koekeishiya): Every virtual space allocates the nodes of its tree from a pool of its own.
+ * Nodes are handed out from blocks of NODE_POOL_BLOCK_SIZE contiguous nodes, and a node that is
+ * released is put on a free-list that the next allocation takes from first. Blocks are kept until
+ * the pool is freed, so destroying a whole tree only rewinds the pool, and a tree that is rebuilt
+ * afterwards is laid out in the order that its nodes are created.
+ */
+#define NODE_POOL_BLOCK_SIZE 64
+
+struct node_pool_block;
+struct node_pool
+{
+    node_pool_block *Blocks;
+    node_pool_block *Current;
+    uint32_t CurrentUsed;
+
+    node *FreeList;
+    uint32_t Count;
+    uint32_t Capacity;
+};
+
+node *AllocateNode(node_pool *Pool);
+void ReleaseNode(node_pool *Pool, node *Node);
+void ResetNodePool(node_pool *Pool);
+void FreeNodePool(node_pool *Pool);
+
+#endif
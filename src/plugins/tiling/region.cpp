@@ -1,4 +1,5 @@
 #include "region.h"
+#include "layout.h"
 #include "node.h"
 #include "vspace.h"
 #include "constants.h"
@@ -8,6 +9,7 @@
 #include "../../common/accessibility/window.h"
 
 #define internal static
+#define local_persist static
 
 extern macos_window *GetWindowByID(uint32_t Id);
 
@@ -55,15 +57,23 @@ region RoundPreselRegion(region Region, CGPoint Position, CGSize Size)
 #define OSX_MENU_BAR_HEIGHT 22.0f
 void ConstrainRegion(CFStringRef DisplayRef, region *Region)
 {
+    local_persist cvar_handle *Handles[6];
+    cvar_handle *BarEnabled = CVarHandle(&Handles[0], CVAR_BAR_ENABLED);
+    cvar_handle *BarAllMonitors = CVarHandle(&Handles[1], CVAR_BAR_ALL_MONITORS);
+    cvar_handle *BarOffsetTop = CVarHandle(&Handles[2], CVAR_BAR_OFFSET_TOP);
+    cvar_handle *BarOffsetBottom = CVarHandle(&Handles[3], CVAR_BAR_OFFSET_BOTTOM);
+    cvar_handle *BarOffsetLeft = CVarHandle(&Handles[4], CVAR_BAR_OFFSET_LEFT);
+    cvar_handle *BarOffsetRight = CVarHandle(&Handles[5], CVAR_BAR_OFFSET_RIGHT);
+
     // NOTE(koekeishiya): Automatically adjust padding to account for osx menubar status.
     if (!AXLibIsMenuBarAutoHideEnabled()) {
         Region->Y += OSX_MENU_BAR_HEIGHT;
         Region->Height -= OSX_MENU_BAR_HEIGHT;
     }
 
-    if (CVarIntegerValue(CVAR_BAR_ENABLED)) {
+    if (CVarIntegerValue(BarEnabled)) {
         bool ShouldApplyOffset = true;
-        if (!CVarIntegerValue(CVAR_BAR_ALL_MONITORS)) {
+        if (!CVarIntegerValue(BarAllMonitors)) {
             CFStringRef MainDisplayRef = AXLibGetDisplayIdentifierForMainDisplay();
             ASSERT(MainDisplayRef);
 
@@ -75,14 +85,14 @@ void ConstrainRegion(CFStringRef DisplayRef, region *Region)
         }
 
         if (ShouldApplyOffset) {
-            Region->X += CVarFloatingPointValue(CVAR_BAR_OFFSET_LEFT);
-            Region->Width -= CVarFloatingPointValue(CVAR_BAR_OFFSET_LEFT);
+            Region->X += CVarFloatingPointValue(BarOffsetLeft);
+            Region->Width -= CVarFloatingPointValue(BarOffsetLeft);
 
-            Region->Y += CVarFloatingPointValue(CVAR_BAR_OFFSET_TOP);
-            Region->Height -= CVarFloatingPointValue(CVAR_BAR_OFFSET_TOP);
+            Region->Y += CVarFloatingPointValue(BarOffsetTop);
+            Region->Height -= CVarFloatingPointValue(BarOffsetTop);
 
-            Region->Width -= CVarFloatingPointValue(CVAR_BAR_OFFSET_RIGHT);
-            Region->Height -= CVarFloatingPointValue(CVAR_BAR_OFFSET_BOTTOM);
+            Region->Width -= CVarFloatingPointValue(BarOffsetRight);
+            Region->Height -= CVarFloatingPointValue(BarOffsetBottom);
         }
     }
 
@@ -143,170 +153,44 @@ region FullscreenRegion(CFStringRef DisplayRef, virtual_space *VirtualSpace)
     return Result;
 }
 
-internal region
-LeftVerticalRegion(node *Node, virtual_space *VirtualSpace)
-{
-    ASSERT(Node);
-
-    region *Region = &Node->Region;
-    region Result;
-
-    Result.X = Region->X;
-    Result.Y = Region->Y;
-    Result.Width = Region->Width * Node->Ratio;
-    Result.Height = Region->Height;
-
-    region_offset *Offset = VirtualSpace->Offset;
-    if (Offset) {
-        Result.Width -= (Offset->Gap / 2);
-    }
-
-    return Result;
-}
-
-internal region
-RightVerticalRegion(node *Node, virtual_space *VirtualSpace)
-{
-    ASSERT(Node);
-
-    region *Region = &Node->Region;
-    region Result;
-
-    Result.X = Region->X + (Region->Width * Node->Ratio);
-    Result.Y = Region->Y;
-    Result.Width = Region->Width * (1 - Node->Ratio);
-    Result.Height = Region->Height;
-
-    region_offset *Offset = VirtualSpace->Offset;
-    if (Offset) {
-        Result.X += (Offset->Gap / 2);
-        Result.Width -= (Offset->Gap / 2);
-    }
-
-    return Result;
-}
-
-internal region
-UpperHorizontalRegion(node *Node, virtual_space *VirtualSpace)
+region LayoutFullRegion(layout_context *Context)
 {
-    ASSERT(Node);
+    if (!Context->Resolved) {
+        CFStringRef DisplayRef = AXLibGetDisplayIdentifierFromSpace(Context->Space->Id);
+        ASSERT(DisplayRef);
 
-    region *Region = &Node->Region;
-    region Result;
-
-    Result.X = Region->X;
-    Result.Y = Region->Y;
-    Result.Width = Region->Width;
-    Result.Height = Region->Height * Node->Ratio;
-
-    region_offset *Offset = VirtualSpace->Offset;
-    if (Offset) {
-        Result.Height -= (Offset->Gap / 2);
+        Context->Full = FullscreenRegion(DisplayRef, Context->VirtualSpace);
+        Context->Resolved = true;
+        CFRelease(DisplayRef);
     }
 
-    return Result;
-}
-
-internal region
-LowerHorizontalRegion(node *Node, virtual_space *VirtualSpace)
-{
-    ASSERT(Node);
-
-    region *Region = &Node->Region;
-    region Result;
-
-    Result.X = Region->X;
-    Result.Y = Region->Y + (Region->Height * Node->Ratio);
-    Result.Width = Region->Width;
-    Result.Height = Region->Height * (1 - Node->Ratio);
-
-    region_offset *Offset = VirtualSpace->Offset;
-    if (Offset) {
-        Result.Y += (Offset->Gap / 2);
-        Result.Height -= (Offset->Gap / 2);
-    }
-
-    return Result;
+    return Context->Full;
 }
 
 void CreateNodeRegion(node *Node, region_type Type, macos_space *Space, virtual_space *VirtualSpace)
 {
-    ASSERT(Type >= Region_Full && Type <= Region_Lower);
-
-    CFStringRef DisplayRef = AXLibGetDisplayIdentifierFromSpace(Space->Id);
-    ASSERT(DisplayRef);
-
-    switch (Type) {
-    case Region_Full:   { Node->Region = FullscreenRegion(DisplayRef, VirtualSpace);        } break;
-    case Region_Left:   { Node->Region = LeftVerticalRegion(Node->Parent, VirtualSpace);    } break;
-    case Region_Right:  { Node->Region = RightVerticalRegion(Node->Parent, VirtualSpace);   } break;
-    case Region_Upper:  { Node->Region = UpperHorizontalRegion(Node->Parent, VirtualSpace); } break;
-    case Region_Lower:  { Node->Region = LowerHorizontalRegion(Node->Parent, VirtualSpace); } break;
-    default:            { /* NOTE(koekeishiya): Invalid region specified. */                } break;
-    }
-
-    Node->Region.Type = Type;
-    CFRelease(DisplayRef);
+    layout_context Context;
+    BeginLayoutContext(&Context, Space, VirtualSpace);
+    LayoutNodeRegion(Node, Type, &Context);
 }
 
 void CreatePreselectRegion(preselect_node *Preselect, region_type Type, macos_space *Space, virtual_space *VirtualSpace)
 {
     ASSERT(Type >= Region_Full && Type <= Region_Lower);
 
-    CFStringRef DisplayRef = AXLibGetDisplayIdentifierFromSpace(Space->Id);
-    ASSERT(DisplayRef);
-
-    switch (Type) {
-    case Region_Full:   { Preselect->Region = FullscreenRegion(DisplayRef, VirtualSpace);           } break;
-    case Region_Left:   { Preselect->Region = LeftVerticalRegion(Preselect->Node, VirtualSpace);    } break;
-    case Region_Right:  { Preselect->Region = RightVerticalRegion(Preselect->Node, VirtualSpace);   } break;
-    case Region_Upper:  { Preselect->Region = UpperHorizontalRegion(Preselect->Node, VirtualSpace); } break;
-    case Region_Lower:  { Preselect->Region = LowerHorizontalRegion(Preselect->Node, VirtualSpace); } break;
-    default:            { /* NOTE(koekeishiya): Invalid region specified. */                        } break;
-    }
-
-    Preselect->Region.Type = Type;
-    CFRelease(DisplayRef);
-}
-
-internal void
-CreateNodeRegionPair(node *Left, node *Right, node_split Split, macos_space *Space, virtual_space *VirtualSpace)
-{
-    ASSERT(Split == Split_Vertical || Split == Split_Horizontal);
-    if (Split == Split_Vertical) {
-        CreateNodeRegion(Left, Region_Left, Space, VirtualSpace);
-        CreateNodeRegion(Right, Region_Right, Space, VirtualSpace);
-    } else if (Split == Split_Horizontal) {
-        CreateNodeRegion(Left, Region_Upper, Space, VirtualSpace);
-        CreateNodeRegion(Right, Region_Lower, Space, VirtualSpace);
-    }
-}
-
-void ResizeNodeRegion(node *Node, macos_space *Space, virtual_space *VirtualSpace)
-{
-    if (Node && Node->Left && Node->Right) {
-        CreateNodeRegion(Node->Left, Node->Left->Region.Type, Space, VirtualSpace);
-        ResizeNodeRegion(Node->Left, Space, VirtualSpace);
-
-        CreateNodeRegion(Node->Right, Node->Right->Region.Type, Space, VirtualSpace);
-        ResizeNodeRegion(Node->Right, Space, VirtualSpace);
+    if (Type == Region_Full) {
+        layout_context Context;
+        BeginLayoutContext(&Context, Space, VirtualSpace);
+        Preselect->Region = LayoutFullRegion(&Context);
+        Preselect->Region.Type = Type;
+    } else {
+        Preselect->Region = SplitRegion(&Preselect->Node->Region, Preselect->Node->Ratio, Type, VirtualSpace->Offset);
     }
 }
 
 void CreateNodeRegionRecursive(node *Node, bool Optimal, macos_space *Space, virtual_space *VirtualSpace)
 {
-    if (VirtualSpace->Mode == Virtual_Space_Bsp) {
-        if (Node && Node->Left && Node->Right) {
-            Node->Split = Optimal ? OptimalSplitMode(Node) : Node->Split;
-            CreateNodeRegionPair(Node->Left, Node->Right, Node->Split, Space, VirtualSpace);
-
-            CreateNodeRegionRecursive(Node->Left, Optimal, Space, VirtualSpace);
-            CreateNodeRegionRecursive(Node->Right, Optimal, Space, VirtualSpace);
-        }
-    } else if (VirtualSpace->Mode == Virtual_Space_Monocle) {
-        if (Node && Node->Right) {
-            CreateNodeRegion(Node->Right, Region_Full, Space, VirtualSpace);
-            CreateNodeRegionRecursive(Node->Right, Optimal, Space, VirtualSpace);
-        }
-    }
+    layout_context Context;
+    BeginLayoutContext(&Context, Space, VirtualSpace);
+    LayoutNodeTree(Node, Optimal, &Context);
 }
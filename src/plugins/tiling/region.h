@@ -43,6 +43,5 @@ void CreateNodeRegionRecursive(node *Node, bool Optimal, macos_space *Space, vir
 
 void CreatePreselectRegion(preselect_node *Preselect, region_type Type, macos_space *Space, virtual_space *VirtualSpace);
 
-void ResizeNodeRegion(node *Node, macos_space *Space, virtual_space *VirtualSpace);
 
 #endif
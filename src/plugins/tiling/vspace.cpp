@@ -17,6 +17,9 @@
 internal virtual_space_map VirtualSpaces;
 internal pthread_mutex_t VirtualSpacesLock;
 
+internal std::map<unsigned, virtual_space_config> VirtualSpaceConfigs;
+internal pthread_mutex_t VirtualSpaceConfigsLock;
+
 internal virtual_space_mode
 VirtualSpaceModeFromString(char *Value)
 {
@@ -30,14 +33,17 @@ VirtualSpaceModeFromString(char *Value)
 }
 
 internal virtual_space_config
-GetVirtualSpaceConfig(unsigned SpaceIndex)
+ReadVirtualSpaceConfig(unsigned SpaceIndex)
 {
     virtual_space_config Config;
 
     char KeyMode[BUFFER_SIZE];
+    char Mode[BUFFER_SIZE];
     snprintf(KeyMode, BUFFER_SIZE, "%d_%s", SpaceIndex, _CVAR_SPACE_MODE);
-    Config.Mode = CVarExists(KeyMode) ? VirtualSpaceModeFromString(CVarStringValue(KeyMode))
-                                      : VirtualSpaceModeFromString(CVarStringValue(CVAR_SPACE_MODE));
+    if (CVarStringCopy(KeyMode, Mode, sizeof(Mode)) < 0) {
+        CVarStringCopy(CVAR_SPACE_MODE, Mode, sizeof(Mode));
+    }
+    Config.Mode = VirtualSpaceModeFromString(Mode);
     char KeyTop[BUFFER_SIZE];
     snprintf(KeyTop, BUFFER_SIZE, "%d_%s", SpaceIndex, _CVAR_SPACE_OFFSET_TOP);
     Config.Offset.Top = CVarExists(KeyTop) ? CVarFloatingPointValue(KeyTop)
@@ -60,16 +66,197 @@ GetVirtualSpaceConfig(unsigned SpaceIndex)
                                            : CVarFloatingPointValue(CVAR_SPACE_OFFSET_GAP);
     char KeyTree[BUFFER_SIZE];
     snprintf(KeyTree, BUFFER_SIZE, "%d_%s", SpaceIndex, _CVAR_SPACE_TREE);
-    Config.TreeLayout = CVarExists(KeyTree) ? CVarStringValue(KeyTree)
-                                            : NULL;
+    Config.TreeLayout = CVarStringDuplicate(KeyTree);
+    return Config;
+}
+
+/*
+ * NOTE(koekeishiya): The config of a desktop is resolved from the per-desktop and global
+ * cvars once, and cached until one of the desktop cvars change. The cache owns 'TreeLayout',
+ * so the caller receives its own copy.
+ */
+internal virtual_space_config
+GetVirtualSpaceConfig(unsigned SpaceIndex)
+{
+    virtual_space_config Config;
+
+    pthread_mutex_lock(&VirtualSpaceConfigsLock);
+    std::map<unsigned, virtual_space_config>::iterator It = VirtualSpaceConfigs.find(SpaceIndex);
+    if (It != VirtualSpaceConfigs.end()) {
+        Config = It->second;
+    } else {
+        Config = ReadVirtualSpaceConfig(SpaceIndex);
+        VirtualSpaceConfigs[SpaceIndex] = Config;
+    }
+
+    if (Config.TreeLayout) {
+        Config.TreeLayout = strdup(Config.TreeLayout);
+    }
+    pthread_mutex_unlock(&VirtualSpaceConfigsLock);
+
     return Config;
 }
 
+internal void
+ClearVirtualSpaceConfigs()
+{
+    for (std::map<unsigned, virtual_space_config>::iterator It = VirtualSpaceConfigs.begin();
+         It != VirtualSpaceConfigs.end();
+         ++It) {
+        free(It->second.TreeLayout);
+    }
+
+    VirtualSpaceConfigs.clear();
+}
+
+internal
+CVAR_WATCH_FUNC(VirtualSpaceConfigChanged)
+{
+    for (unsigned Index = 0; Index < Count; ++Index) {
+        if (strstr(Changes[Index].Name, "desktop_")) {
+            pthread_mutex_lock(&VirtualSpaceConfigsLock);
+            ClearVirtualSpaceConfigs();
+            pthread_mutex_unlock(&VirtualSpaceConfigsLock);
+            break;
+        }
+    }
+}
+
+internal inline uint32_t
+NodeMapSlot(node_map *Map, uint32_t WindowId)
+{
+    return (WindowId * 2654435761u) & (Map->Capacity - 1);
+}
+
+node *NodeMapFind(node_map *Map, uint32_t WindowId)
+{
+    if (Map->Count == 0) {
+        return NULL;
+    }
+
+    uint32_t Slot = NodeMapSlot(Map, WindowId);
+    while (Map->Entries[Slot].WindowId) {
+        if (Map->Entries[Slot].WindowId == WindowId) {
+            return Map->Entries[Slot].Node;
+        }
+        Slot = (Slot + 1) & (Map->Capacity - 1);
+    }
+
+    return NULL;
+}
+
+internal void
+NodeMapGrow(node_map *Map)
+{
+    node_map_entry *Entries = Map->Entries;
+    uint32_t Capacity = Map->Capacity;
+
+    Map->Capacity = Capacity ? Capacity * 2 : 16;
+    Map->Entries = (node_map_entry *) calloc(Map->Capacity, sizeof(node_map_entry));
+
+    for (uint32_t Index = 0; Index < Capacity; ++Index) {
+        if (Entries[Index].WindowId) {
+            uint32_t Slot = NodeMapSlot(Map, Entries[Index].WindowId);
+            while (Map->Entries[Slot].WindowId) {
+                Slot = (Slot + 1) & (Map->Capacity - 1);
+            }
+            Map->Entries[Slot] = Entries[Index];
+        }
+    }
+
+    free(Entries);
+}
+
+void NodeMapInsert(node_map *Map, uint32_t WindowId, node *Node)
+{
+    ASSERT(WindowId != Node_Root);
+    ASSERT(WindowId != (uint32_t) Node_PseudoLeaf);
+
+    // NOTE(koekeishiya): Keep the load factor at or below 3/4.
+    if (4 * (Map->Count + 1) > 3 * Map->Capacity) {
+        NodeMapGrow(Map);
+    }
+
+    uint32_t Slot = NodeMapSlot(Map, WindowId);
+    while (Map->Entries[Slot].WindowId) {
+        if (Map->Entries[Slot].WindowId == WindowId) {
+            Map->Entries[Slot].Node = Node;
+            return;
+        }
+        Slot = (Slot + 1) & (Map->Capacity - 1);
+    }
+
+    Map->Entries[Slot].WindowId = WindowId;
+    Map->Entries[Slot].Node = Node;
+    ++Map->Count;
+}
+
+/*
+ * NOTE(koekeishiya): The entry is only removed if it still refers to the given node, because
+ * the window may already have been moved to a different node. Entries that follow the removed
+ * slot are shifted back so that lookups never have to skip over deleted slots.
+ */
+void NodeMapRemove(node_map *Map, uint32_t WindowId, node *Node)
+{
+    if (Map->Count == 0) {
+        return;
+    }
+
+    uint32_t Mask = Map->Capacity - 1;
+    uint32_t Slot = NodeMapSlot(Map, WindowId);
+    while (Map->Entries[Slot].WindowId != WindowId) {
+        if (!Map->Entries[Slot].WindowId) {
+            return;
+        }
+        Slot = (Slot + 1) & Mask;
+    }
+
+    if (Map->Entries[Slot].Node != Node) {
+        return;
+    }
+
+    uint32_t Next = Slot;
+    for (;;) {
+        Next = (Next + 1) & Mask;
+        if (!Map->Entries[Next].WindowId) {
+            break;
+        }
+
+        uint32_t Home = NodeMapSlot(Map, Map->Entries[Next].WindowId);
+        if (((Next - Home) & Mask) >= ((Next - Slot) & Mask)) {
+            Map->Entries[Slot] = Map->Entries[Next];
+            Slot = Next;
+        }
+    }
+
+    Map->Entries[Slot].WindowId = 0;
+    Map->Entries[Slot].Node = NULL;
+    --Map->Count;
+}
+
+void NodeMapClear(node_map *Map)
+{
+    if (Map->Entries) {
+        memset(Map->Entries, 0, Map->Capacity * sizeof(node_map_entry));
+    }
+    Map->Count = 0;
+}
+
+void NodeMapFree(node_map *Map)
+{
+    free(Map->Entries);
+    Map->Entries = NULL;
+    Map->Capacity = 0;
+    Map->Count = 0;
+}
+
 internal virtual_space *
 CreateAndInitVirtualSpace(macos_space *Space)
 {
     virtual_space *VirtualSpace = (virtual_space *) malloc(sizeof(virtual_space));
     VirtualSpace->Tree = NULL;
+    VirtualSpace->Nodes = {};
+    VirtualSpace->NodePool = {};
     VirtualSpace->Preselect = NULL;
 
     // TODO(koekeishiya): How do we react if this call fails ??
@@ -143,9 +330,63 @@ void ReleaseVirtualSpace(virtual_space *VirtualSpace)
     pthread_mutex_unlock(&VirtualSpace->Lock);
 }
 
+/*
+ * NOTE(koekeishiya): Takes VirtualSpacesLock and the lock of every virtual space, or nothing at all.
+ * A thread that holds one virtual space may acquire another, so the locks are never waited for;
+ * the caller retries if any of them is busy.
+ */
+bool TryLockVirtualSpaces()
+{
+    if (pthread_mutex_trylock(&VirtualSpacesLock) != 0) {
+        return false;
+    }
+
+    for (virtual_space_map_it It = VirtualSpaces.begin(); It != VirtualSpaces.end(); ++It) {
+        if (pthread_mutex_trylock(&It->second->Lock) != 0) {
+            for (virtual_space_map_it Locked = VirtualSpaces.begin(); Locked != It; ++Locked) {
+                pthread_mutex_unlock(&Locked->second->Lock);
+            }
+            pthread_mutex_unlock(&VirtualSpacesLock);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void UnlockVirtualSpaces()
+{
+    for (virtual_space_map_it It = VirtualSpaces.begin(); It != VirtualSpaces.end(); ++It) {
+        pthread_mutex_unlock(&It->second->Lock);
+    }
+    pthread_mutex_unlock(&VirtualSpacesLock);
+}
+
+// NOTE(koekeishiya): The caller must hold every virtual space through TryLockVirtualSpaces.
+virtual_space *FindVirtualSpaceLocked(const char *SpaceRef)
+{
+    virtual_space_map_it It = VirtualSpaces.find(SpaceRef);
+    return It != VirtualSpaces.end() ? It->second : NULL;
+}
+
 bool BeginVirtualSpaces()
 {
-    return pthread_mutex_init(&VirtualSpacesLock, NULL) == 0;
+    if (pthread_mutex_init(&VirtualSpacesLock, NULL) != 0) {
+        goto err;
+    }
+
+    if (pthread_mutex_init(&VirtualSpaceConfigsLock, NULL) != 0) {
+        goto config_err;
+    }
+
+    WatchCVar(NULL, VirtualSpaceConfigChanged, NULL, true);
+    return true;
+
+config_err:
+    pthread_mutex_destroy(&VirtualSpacesLock);
+
+err:
+    return false;
 }
 
 void EndVirtualSpaces()
@@ -153,10 +394,9 @@ void EndVirtualSpaces()
     for (virtual_space_map_it It = VirtualSpaces.begin(); It != VirtualSpaces.end(); ++It) {
         virtual_space *VirtualSpace = It->second;
 
-        if (VirtualSpace->Tree) {
-            FreeNodeTree(VirtualSpace->Tree, VirtualSpace->Mode);
-        }
-
+        FreeNodePool(&VirtualSpace->NodePool);
+        NodeMapFree(&VirtualSpace->Nodes);
+        free(VirtualSpace->TreeLayout);
         pthread_mutex_destroy(&VirtualSpace->Lock);
         free(VirtualSpace);
         free((char *) It->first);
@@ -164,6 +404,10 @@ void EndVirtualSpaces()
 
     VirtualSpaces.clear();
     pthread_mutex_destroy(&VirtualSpacesLock);
+
+    UnwatchCVar(NULL, VirtualSpaceConfigChanged);
+    ClearVirtualSpaceConfigs();
+    pthread_mutex_destroy(&VirtualSpaceConfigsLock);
 }
 
 void VirtualSpaceRecreateRegions(macos_space *Space, virtual_space *VirtualSpace)
@@ -2,6 +2,7 @@
 #define PLUGIN_VSPACE_H
 
 #include "region.h"
+#include "pool.h"
 
 #include "../../common/misc/string.h"
 #include <stdint.h>
@@ -34,6 +35,30 @@ enum virtual_space_flags
     Virtual_Space_Require_Region_Update = 1 << 1,
 };
 
+/*
+ * NOTE(koekeishiya): Open-addressing hash map from window id to the node that holds the window,
+ * using linear probing. A window id of 0 (Node_Root) marks an empty slot; pseudo-leaves are
+ * never stored. The capacity is always a power of two.
+ */
+struct node_map_entry
+{
+    uint32_t WindowId;
+    node *Node;
+};
+
+struct node_map
+{
+    node_map_entry *Entries;
+    uint32_t Capacity;
+    uint32_t Count;
+};
+
+node *NodeMapFind(node_map *Map, uint32_t WindowId);
+void NodeMapInsert(node_map *Map, uint32_t WindowId, node *Node);
+void NodeMapRemove(node_map *Map, uint32_t WindowId, node *Node);
+void NodeMapClear(node_map *Map);
+void NodeMapFree(node_map *Map);
+
 struct preselect_node;
 struct virtual_space
 {
@@ -43,6 +68,8 @@ struct virtual_space
     region_offset *Offset;
     char *TreeLayout;
     node *Tree;
+    node_map Nodes;
+    node_pool NodePool;
     uint32_t Flags;
     preselect_node *Preselect;
 
@@ -59,6 +86,9 @@ void VirtualSpaceAddFlags(virtual_space *VirtualSpace, uint32_t Flag);
 void VirtualSpaceClearFlags(virtual_space *VirtualSpace, uint32_t Flag);
 virtual_space *AcquireVirtualSpace(macos_space *Space);
 void ReleaseVirtualSpace(virtual_space *VirtualSpace);
+bool TryLockVirtualSpaces();
+void UnlockVirtualSpaces();
+virtual_space *FindVirtualSpaceLocked(const char *SpaceRef);
 
 void VirtualSpaceRecreateRegions(macos_space *Space, virtual_space *VirtualSpace);
 void VirtualSpaceUpdateRegions(virtual_space *VirtualSpace);
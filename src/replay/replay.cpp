@@ -0,0 +1,337 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include <map>
+
+#define internal static
+
+#ifndef __APPLE__
+internal inline int
+pthread_threadid_np(void *Thread, uint64_t *ID)
+{
+    *ID = (uint64_t) pthread_self();
+    return 0;
+}
+#endif
+
+#include "../core/clog.h"
+#include "../core/clog.c"
+
+#include "../core/histogram.h"
+#include "../core/histogram.cpp"
+
+#include "../core/dispatch/event.h"
+#include "../core/dispatch/event.cpp"
+#include "../core/dispatch/journal.h"
+#include "../core/dispatch/journal.cpp"
+
+#include "../core/wqueue.h"
+#include "../core/wqueue.cpp"
+#include "../core/tpool.h"
+#include "../core/tpool.cpp"
+
+/*
+ * NOTE(koekeishiya): Stand-ins for the platform state that the real callbacks operate on.
+ * Window events reference a persistent replay_window, just like the real events reference
+ * a persistent macos_window, so that coalescing behaves the same way.
+ */
+struct replay_window
+{
+    uint32_t Id;
+    int32_t PID;
+    float X, Y;
+    float Width, Height;
+};
+
+struct replay_plugin_work
+{
+    unsigned Plugin;
+    event_type Type;
+    void *Context;
+};
+
+internal std::map<uint32_t, replay_window *> Windows;
+internal work_queue Queue;
+internal thread_pool Pool;
+internal bool UseQueue;
+
+internal unsigned PluginCount = 3;
+internal unsigned PluginWork;
+internal unsigned ThreadCount = 4;
+internal double Speed;
+
+internal uint64_t volatile Processed;
+internal uint64_t volatile Checksum;
+
+internal inline uint64_t
+ReplayTime()
+{
+    struct timespec Time;
+    clock_gettime(CLOCK_MONOTONIC, &Time);
+    return (uint64_t) Time.tv_sec * 1000000000ULL + Time.tv_nsec;
+}
+
+internal inline bool
+IsWindowEvent(event_type Type)
+{
+    return ((Type >= ChunkWM_WindowCreated) && (Type <= ChunkWM_WindowTitleChanged));
+}
+
+internal
+WORK_QUEUE_CALLBACK(ReplayPluginCallback)
+{
+    replay_plugin_work *Work = (replay_plugin_work *) Data;
+
+    uint64_t End = ReplayTime() + PluginWork * 1000ULL;
+    uint64_t Hash = ((uint64_t) Work->Plugin << 32) ^ Work->Type ^ (uintptr_t) Work->Context;
+    do {
+        Hash = (Hash ^ (Hash >> 33)) * 0xff51afd7ed558ccdULL;
+    } while (ReplayTime() < End);
+
+    __atomic_fetch_xor(&Checksum, Hash, __ATOMIC_RELAXED);
+}
+
+internal
+CHUNKWM_CALLBACK(ReplayCallback)
+{
+    replay_plugin_work WorkArray[PluginCount];
+    task_group Group = {};
+
+    for (unsigned Index = 0; Index < PluginCount; ++Index) {
+        replay_plugin_work *Work = WorkArray + Index;
+        Work->Plugin = Index;
+        Work->Type = Event->Type;
+        Work->Context = Event->Context;
+
+        if (UseQueue) {
+            AddWorkQueueEntry(&Queue, &ReplayPluginCallback, Work);
+        } else {
+            ThreadPoolSubmit(&Pool, &Group, &ReplayPluginCallback, Work);
+        }
+    }
+
+    if (UseQueue) {
+        CompleteWorkQueue(&Queue);
+    } else {
+        ThreadPoolJoin(&Pool, &Group);
+    }
+
+    if (!IsWindowEvent(Event->Type)) {
+        free(Event->Context);
+    }
+
+    __atomic_add_fetch(&Processed, 1, __ATOMIC_RELEASE);
+}
+
+internal replay_window *
+GetReplayWindow(event_journal_record *Record)
+{
+    replay_window *Window;
+    std::map<uint32_t, replay_window *>::iterator It = Windows.find(Record->WindowId);
+
+    if (It != Windows.end()) {
+        Window = It->second;
+    } else {
+        Window = (replay_window *) malloc(sizeof(replay_window));
+        Window->Id = Record->WindowId;
+        Window->PID = Record->PID;
+        Windows[Window->Id] = Window;
+    }
+
+    Window->X = Record->X;
+    Window->Y = Record->Y;
+    Window->Width = Record->Width;
+    Window->Height = Record->Height;
+
+    return Window;
+}
+
+internal void
+ReplayRecord(event_journal_record *Record)
+{
+    chunk_event Event = {};
+    Event.Type = (event_type) Record->Type;
+    Event.Name = event_type_str[Event.Type];
+    Event.Handle = &ReplayCallback;
+
+    if (IsWindowEvent(Event.Type)) {
+        Event.Context = GetReplayWindow(Record);
+    } else {
+        event_journal_record *Copy = (event_journal_record *) malloc(sizeof(event_journal_record));
+        memcpy(Copy, Record, sizeof(event_journal_record));
+        Event.Context = Copy;
+    }
+
+    AddEvent(Event);
+}
+
+internal uint64_t
+CoalescedTotal()
+{
+    uint64_t Result = 0;
+    for (int Index = 0; Index < ChunkWM_EventTypeCount; ++Index) {
+        Result += EventCoalescedCount((event_type) Index);
+    }
+    return Result;
+}
+
+internal inline double
+NanosecondsToMilliseconds(uint64_t Value)
+{
+    return Value / 1000000.0;
+}
+
+internal void
+PrintReplayStats(uint64_t Count, uint64_t Elapsed)
+{
+    printf("replayed %llu events in %.3fms (%.0f events/s), %llu coalesced, checksum %016llx\n",
+           (unsigned long long) Count,
+           NanosecondsToMilliseconds(Elapsed),
+           Count / (Elapsed / 1000000000.0),
+           (unsigned long long) CoalescedTotal(),
+           (unsigned long long) Checksum);
+
+    for (int Index = 0; Index < ChunkWM_EventTypeCount; ++Index) {
+        event_type_stats Stats;
+        EventTypeStats((event_type) Index, &Stats);
+
+        histogram *Wait = Stats.QueueWait;
+        histogram *Handler = Stats.Handler;
+        if ((Handler->Count == 0) && (Stats.Coalesced == 0)) continue;
+
+        printf("%-32s count:%-8llu coalesced:%-8llu "
+               "queue[p50:%.3f p99:%.3f max:%.3f] "
+               "handler[p50:%.3f p99:%.3f max:%.3f]\n",
+               event_type_str[Index],
+               (unsigned long long) Handler->Count,
+               (unsigned long long) Stats.Coalesced,
+               NanosecondsToMilliseconds(HistogramPercentile(Wait, 50.0)),
+               NanosecondsToMilliseconds(HistogramPercentile(Wait, 99.0)),
+               NanosecondsToMilliseconds(Wait->Max),
+               NanosecondsToMilliseconds(HistogramPercentile(Handler, 50.0)),
+               NanosecondsToMilliseconds(HistogramPercentile(Handler, 99.0)),
+               NanosecondsToMilliseconds(Handler->Max));
+    }
+
+    if (!UseQueue) {
+        thread_pool_stats Stats;
+        ThreadPoolStats(&Pool, &Stats);
+        printf("pool workers:%u submitted:%llu executed:%llu stolen:%llu inline:%llu "
+               "helped:%llu joins:%llu join_parks:%llu worker_parks:%llu\n",
+               Stats.WorkerCount,
+               (unsigned long long) Stats.Submitted,
+               (unsigned long long) Stats.Executed,
+               (unsigned long long) Stats.Stolen,
+               (unsigned long long) Stats.Inline,
+               (unsigned long long) Stats.Helped,
+               (unsigned long long) Stats.Joins,
+               (unsigned long long) Stats.JoinParks,
+               (unsigned long long) Stats.WorkerParks);
+    }
+}
+
+internal bool
+BeginReplayThreads()
+{
+    if (!UseQueue) {
+        return BeginThreadPool(&Pool, ThreadCount);
+    }
+
+    if ((Queue.Semaphore = sem_open("replay_work_queue_semaphore", O_CREAT, 0644, 0)) == SEM_FAILED) {
+        return false;
+    }
+
+    for (unsigned Index = 0; Index < ThreadCount; ++Index) {
+        pthread_t Thread;
+        pthread_create(&Thread, NULL, &WorkQueueThreadProc, &Queue);
+    }
+
+    return true;
+}
+
+internal bool
+ParseArguments(int Count, char **Args)
+{
+    int Option;
+    while ((Option = getopt(Count, Args, "s:p:w:t:q:")) != -1) {
+        switch (Option) {
+        case 's': { Speed = atof(optarg); } break;
+        case 'p': { PluginCount = atoi(optarg); } break;
+        case 'w': { PluginWork = atoi(optarg); } break;
+        case 't': { ThreadCount = atoi(optarg); } break;
+        case 'q': {
+            if (strcmp(optarg, "queue") == 0)     UseQueue = true;
+            else if (strcmp(optarg, "pool") == 0) UseQueue = false;
+            else                                  return false;
+        } break;
+        default: { return false; } break;
+        }
+    }
+
+    return optind < Count;
+}
+
+int main(int Count, char **Args)
+{
+    if (!ParseArguments(Count, Args)) {
+        fprintf(stderr, "usage: replay [-s speed] [-p plugins] [-w work_us] [-t threads] [-q queue|pool] journal\n");
+        return EXIT_FAILURE;
+    }
+
+    FILE *Handle = OpenEventJournal(Args[optind]);
+    if (!Handle) {
+        fprintf(stderr, "replay: '%s' is not a valid event journal!\n", Args[optind]);
+        return EXIT_FAILURE;
+    }
+
+    if (!BeginEventLoop()) {
+        fprintf(stderr, "replay: could not initialize event-loop!\n");
+        return EXIT_FAILURE;
+    }
+
+    if (!BeginReplayThreads()) {
+        fprintf(stderr, "replay: could not initialize callback threads!\n");
+        return EXIT_FAILURE;
+    }
+
+    StartEventLoop();
+
+    event_journal_record Record;
+    uint64_t RecordCount = 0;
+    uint64_t FirstTimestamp = 0;
+    uint64_t Begin = ReplayTime();
+
+    while (ReadEventJournal(Handle, &Record)) {
+        if (Record.Type >= ChunkWM_EventTypeCount) continue;
+
+        if (Speed > 0.0) {
+            if (RecordCount == 0) FirstTimestamp = Record.Timestamp;
+            uint64_t Offset = (Record.Timestamp > FirstTimestamp) ? Record.Timestamp - FirstTimestamp : 0;
+            uint64_t Target = Begin + (uint64_t)(Offset / Speed);
+            uint64_t Now = ReplayTime();
+            if (Target > Now) usleep((Target - Now) / 1000);
+        }
+
+        ReplayRecord(&Record);
+        ++RecordCount;
+    }
+
+    fclose(Handle);
+
+    while (__atomic_load_n(&Processed, __ATOMIC_ACQUIRE) + CoalescedTotal() < RecordCount) {
+        usleep(100);
+    }
+
+    PrintReplayStats(RecordCount, ReplayTime() - Begin);
+
+    sem_unlink("eventloop_semaphore");
+    sem_unlink("replay_work_queue_semaphore");
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,383 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <unistd.h>
+#include <sched.h>
+#include <pthread.h>
+
+#define internal static
+
+#ifndef __APPLE__
+internal inline int
+pthread_threadid_np(void *Thread, uint64_t *ID)
+{
+    *ID = (uint64_t) pthread_self();
+    return 0;
+}
+#endif
+
+#include "../core/clog.h"
+#include "../core/clog.c"
+
+#include "../core/histogram.h"
+#include "../core/histogram.cpp"
+
+#include "../core/dispatch/event.h"
+#include "../core/dispatch/event.cpp"
+
+/*
+ * NOTE(koekeishiya): Every producer pushes a numbered sequence of events, with the producer and
+ * the sequence number packed into the context. The consumer checks that the events of every
+ * producer arrive exactly once and in the order they were pushed, and that every producer
+ * delivered all of its events.
+ *
+ * 'ring' mode pushes straight into one event_ring, retrying while it is full, and pops from it on
+ * the main thread. 'loop' mode goes through AddEvent and the real event-loop, so that events are
+ * spilled to the overflow queue when the consumer falls behind; producers alternate between a
+ * bulk and a critical event type, which are only ordered within their own lane.
+ *
+ * 'order' mode queues pairs of events that the core handles in a fixed order, such as the launch
+ * and activation of the same application, behind a burst of slow bulk events, and checks that the
+ * event-loop serves the second event of every pair after the first.
+ */
+#define RING_STRESS_MAX_PRODUCERS 64
+#define RING_STRESS_ORDER_FILLER  4
+
+enum ring_stress_mode
+{
+    Ring_Stress_Ring,
+    Ring_Stress_Loop,
+    Ring_Stress_Order
+};
+
+struct ring_stress_pair
+{
+    event_type First;
+    event_type Second;
+};
+
+internal const ring_stress_pair OrderPairs[] =
+{
+    { ChunkWM_ApplicationLaunched, ChunkWM_ApplicationActivated },
+    { ChunkWM_ApplicationDeactivated, ChunkWM_ApplicationTerminated },
+    { ChunkWM_DisplayAdded, ChunkWM_DisplayChanged },
+};
+#define RING_STRESS_PAIR_COUNT (sizeof(OrderPairs) / sizeof(OrderPairs[0]))
+
+struct ring_stress_producer
+{
+    unsigned Index;
+    pthread_t Thread;
+};
+
+internal ring_stress_mode Mode = Ring_Stress_Ring;
+internal unsigned ProducerCount = 8;
+internal uint32_t EventCount = 200000;
+internal unsigned ConsumerWork;
+internal unsigned Rounds = 1;
+
+internal event_ring Ring;
+internal uint32_t volatile Started;
+
+internal uint32_t Received[RING_STRESS_MAX_PRODUCERS];
+internal uint64_t volatile ReceivedTotal;
+internal uint64_t OutOfOrder;
+internal uint64_t Unknown;
+internal bool *OrderSeen[RING_STRESS_PAIR_COUNT];
+
+internal inline uint64_t
+StressTime()
+{
+    struct timespec Time;
+    clock_gettime(CLOCK_MONOTONIC, &Time);
+    return (uint64_t) Time.tv_sec * 1000000000ULL + Time.tv_nsec;
+}
+
+internal inline void *
+PackContext(unsigned Producer, uint32_t Sequence)
+{
+    return (void *)(((uintptr_t) Producer << 32) | Sequence);
+}
+
+internal inline void
+BusyWork(unsigned Nanoseconds)
+{
+    uint64_t End = StressTime() + Nanoseconds;
+    while (StressTime() < End);
+}
+
+// NOTE(koekeishiya): Called on the consumer only; the counters are read once the consumer is done.
+internal void
+ConsumeEvent(chunk_event *Event)
+{
+    uintptr_t Context = (uintptr_t) Event->Context;
+    unsigned Producer = (unsigned)(Context >> 32);
+    uint32_t Sequence = (uint32_t) Context;
+
+    if (Producer >= ProducerCount) {
+        ++Unknown;
+    } else {
+        if (Sequence != Received[Producer] + 1) {
+            if (OutOfOrder < 10) {
+                fprintf(stderr, "ringstress: producer %u: expected %u, got %u\n",
+                        Producer, Received[Producer] + 1, Sequence);
+            }
+            ++OutOfOrder;
+        }
+        Received[Producer] = Sequence;
+    }
+
+    if (ConsumerWork) BusyWork(ConsumerWork);
+    __atomic_add_fetch(&ReceivedTotal, 1, __ATOMIC_RELEASE);
+}
+
+CHUNKWM_CALLBACK(StressCallback)
+{
+    ConsumeEvent(Event);
+}
+
+/*
+ * NOTE(koekeishiya): The context of a paired event is the pair and the id it was queued for, which
+ * stands in for the pid of an application or the id of a display.
+ */
+CHUNKWM_CALLBACK(OrderCallback)
+{
+    uintptr_t Context = (uintptr_t) Event->Context;
+    unsigned Pair = (unsigned)(Context >> 32);
+    uint32_t Id = (uint32_t) Context;
+
+    if (Event->Type == ChunkWM_WindowCreated) {
+        BusyWork(ConsumerWork);
+    } else if ((Pair >= RING_STRESS_PAIR_COUNT) || (Id >= EventCount)) {
+        ++Unknown;
+    } else if (Event->Type == OrderPairs[Pair].First) {
+        OrderSeen[Pair][Id] = true;
+    } else if (!OrderSeen[Pair][Id]) {
+        if (OutOfOrder < 10) {
+            fprintf(stderr, "ringstress: id %u: '%s' was served before '%s'\n",
+                    Id, event_type_str[OrderPairs[Pair].Second], event_type_str[OrderPairs[Pair].First]);
+        }
+        ++OutOfOrder;
+    }
+
+    __atomic_add_fetch(&ReceivedTotal, 1, __ATOMIC_RELEASE);
+}
+
+internal inline void
+QueueOrderEvent(event_type Type, void *Context)
+{
+    chunk_event Event = {};
+    Event.Name = event_type_str[Type];
+    Event.Type = Type;
+    Event.Context = Context;
+    Event.Handle = &OrderCallback;
+    AddEvent(Event);
+}
+
+// NOTE(koekeishiya): The events are queued from the main thread, so that the order they were queued in is well defined.
+internal bool
+RunOrderRound(unsigned Round)
+{
+    uint64_t Expected = (uint64_t) EventCount * (RING_STRESS_ORDER_FILLER + 2 * RING_STRESS_PAIR_COUNT);
+
+    for (unsigned Pair = 0; Pair < RING_STRESS_PAIR_COUNT; ++Pair) {
+        memset(OrderSeen[Pair], 0, sizeof(bool) * EventCount);
+    }
+    ReceivedTotal = 0;
+    OutOfOrder = 0;
+    Unknown = 0;
+
+    uint64_t Begin = StressTime();
+    for (uint32_t Id = 0; Id < EventCount; ++Id) {
+        for (int Filler = 0; Filler < RING_STRESS_ORDER_FILLER; ++Filler) {
+            QueueOrderEvent(ChunkWM_WindowCreated, NULL);
+        }
+
+        for (unsigned Pair = 0; Pair < RING_STRESS_PAIR_COUNT; ++Pair) {
+            QueueOrderEvent(OrderPairs[Pair].First, PackContext(Pair, Id));
+            QueueOrderEvent(OrderPairs[Pair].Second, PackContext(Pair, Id));
+        }
+    }
+
+    uint64_t Deadline = StressTime() + 30ULL * 1000000000ULL;
+    while ((__atomic_load_n(&ReceivedTotal, __ATOMIC_ACQUIRE) < Expected) && (StressTime() < Deadline)) {
+        usleep(1000);
+    }
+    uint64_t Elapsed = StressTime() - Begin;
+
+    bool Success = (OutOfOrder == 0) && (Unknown == 0) && (ReceivedTotal == Expected);
+    printf("round %u: %s ids:%u events:%llu of %llu in %.3fms out_of_order:%llu unknown:%llu\n",
+           Round + 1, Success ? "ok" : "FAILED", EventCount,
+           (unsigned long long) ReceivedTotal, (unsigned long long) Expected,
+           Elapsed / 1000000.0, (unsigned long long) OutOfOrder, (unsigned long long) Unknown);
+
+    return Success;
+}
+
+internal void *
+ProducerThreadProc(void *Data)
+{
+    ring_stress_producer *Producer = (ring_stress_producer *) Data;
+
+    // NOTE(koekeishiya): Line the producers up, so that they actually contend for the ring.
+    __atomic_add_fetch(&Started, 1, __ATOMIC_ACQ_REL);
+    while (__atomic_load_n(&Started, __ATOMIC_ACQUIRE) < ProducerCount);
+
+    for (uint32_t Sequence = 1; Sequence <= EventCount; ++Sequence) {
+        chunk_event Event = {};
+        Event.Context = PackContext(Producer->Index, Sequence);
+        Event.Handle = &StressCallback;
+
+        if (Mode == Ring_Stress_Ring) {
+            Event.Name = "ring";
+            Event.Type = ChunkWM_PluginCommand;
+            while (!PushEventRing(&Ring, &Event)) {
+                sched_yield();
+            }
+        } else {
+            bool Critical = Producer->Index & 1;
+            Event.Name = Critical ? "critical" : "bulk";
+            Event.Type = Critical ? ChunkWM_PluginCommand : ChunkWM_ApplicationLaunched;
+            AddEvent(Event);
+        }
+    }
+
+    return NULL;
+}
+
+internal bool
+RunRound(unsigned Round)
+{
+    ring_stress_producer Producers[RING_STRESS_MAX_PRODUCERS];
+    uint64_t Expected = (uint64_t) ProducerCount * EventCount;
+
+    memset(Received, 0, sizeof(Received));
+    ReceivedTotal = 0;
+    OutOfOrder = 0;
+    Unknown = 0;
+    Started = 0;
+
+    uint32_t Spilled[Event_Lane_Count];
+    for (int Lane = 0; Lane < Event_Lane_Count; ++Lane) {
+        Spilled[Lane] = EventLoop.Lanes[Lane].Ring.OverflowTotal;
+    }
+
+    uint64_t Begin = StressTime();
+    for (unsigned Index = 0; Index < ProducerCount; ++Index) {
+        Producers[Index].Index = Index;
+        pthread_create(&Producers[Index].Thread, NULL, &ProducerThreadProc, &Producers[Index]);
+    }
+
+    if (Mode == Ring_Stress_Ring) {
+        chunk_event Event;
+        while (ReceivedTotal < Expected) {
+            if (PopEventRing(&Ring, &Event)) {
+                ConsumeEvent(&Event);
+            } else {
+                sched_yield();
+            }
+        }
+    }
+
+    for (unsigned Index = 0; Index < ProducerCount; ++Index) {
+        pthread_join(Producers[Index].Thread, NULL);
+    }
+
+    // NOTE(koekeishiya): Give the event-loop a generous amount of time, and report what is missing if it does not finish.
+    uint64_t Deadline = StressTime() + 30ULL * 1000000000ULL;
+    while ((__atomic_load_n(&ReceivedTotal, __ATOMIC_ACQUIRE) < Expected) && (StressTime() < Deadline)) {
+        usleep(1000);
+    }
+    uint64_t Elapsed = StressTime() - Begin;
+
+    bool Success = (OutOfOrder == 0) && (Unknown == 0) && (ReceivedTotal == Expected);
+    for (unsigned Index = 0; Index < ProducerCount; ++Index) {
+        if (Received[Index] != EventCount) {
+            fprintf(stderr, "ringstress: producer %u: received %u of %u events\n",
+                    Index, Received[Index], EventCount);
+            Success = false;
+        }
+    }
+
+    printf("round %u: %s producers:%u events:%llu in %.3fms (%.0f events/s) out_of_order:%llu unknown:%llu",
+           Round + 1, Success ? "ok" : "FAILED", ProducerCount,
+           (unsigned long long) ReceivedTotal, Elapsed / 1000000.0,
+           ReceivedTotal / (Elapsed / 1000000000.0),
+           (unsigned long long) OutOfOrder, (unsigned long long) Unknown);
+
+    if (Mode == Ring_Stress_Loop) {
+        printf(" spilled[critical:%u bulk:%u]",
+               EventLoop.Lanes[Event_Lane_Critical].Ring.OverflowTotal - Spilled[Event_Lane_Critical],
+               EventLoop.Lanes[Event_Lane_Bulk].Ring.OverflowTotal - Spilled[Event_Lane_Bulk]);
+    }
+    printf("\n");
+
+    return Success;
+}
+
+internal bool
+ParseArguments(int Count, char **Args)
+{
+    int Option;
+    while ((Option = getopt(Count, Args, "m:p:n:w:r:")) != -1) {
+        switch (Option) {
+        case 'm': {
+            if (strcmp(optarg, "ring") == 0)      Mode = Ring_Stress_Ring;
+            else if (strcmp(optarg, "loop") == 0) Mode = Ring_Stress_Loop;
+            else if (strcmp(optarg, "order") == 0) Mode = Ring_Stress_Order;
+            else                                  return false;
+        } break;
+        case 'p': { ProducerCount = atoi(optarg); } break;
+        case 'n': { EventCount = atoi(optarg); } break;
+        case 'w': { ConsumerWork = atoi(optarg); } break;
+        case 'r': { Rounds = atoi(optarg); } break;
+        default: { return false; } break;
+        }
+    }
+
+    return (optind == Count) &&
+           (ProducerCount > 0) &&
+           (ProducerCount <= RING_STRESS_MAX_PRODUCERS) &&
+           (EventCount > 0);
+}
+
+int main(int Count, char **Args)
+{
+    if (!ParseArguments(Count, Args)) {
+        fprintf(stderr, "usage: ringstress [-m ring|loop|order] [-p producers] [-n events] [-w work_ns] [-r rounds]\n");
+        return EXIT_FAILURE;
+    }
+
+    if (Mode == Ring_Stress_Order) {
+        if (!ConsumerWork) ConsumerWork = 1000;
+        for (unsigned Pair = 0; Pair < RING_STRESS_PAIR_COUNT; ++Pair) {
+            OrderSeen[Pair] = (bool *) malloc(sizeof(bool) * EventCount);
+        }
+    }
+
+    if (Mode == Ring_Stress_Ring) {
+        BeginEventRing(&Ring);
+    } else {
+        if (!BeginEventLoop()) {
+            fprintf(stderr, "ringstress: could not initialize event-loop!\n");
+            return EXIT_FAILURE;
+        }
+        StartEventLoop();
+    }
+
+    bool Success = true;
+    for (unsigned Round = 0; Round < Rounds; ++Round) {
+        Success &= Mode == Ring_Stress_Order ? RunOrderRound(Round) : RunRound(Round);
+    }
+
+    if (Mode != Ring_Stress_Ring) {
+        StopEventLoop();
+        sem_unlink("eventloop_semaphore");
+    }
+
+    return Success ? EXIT_SUCCESS : EXIT_FAILURE;
+}